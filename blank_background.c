@@ -1,51 +1,221 @@
 #include "blank_background.h"
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "interface/mmal/util/mmal_util_params.h"
 #include "interface/mmal/util/mmal_util.h"
 #include "interface/mmal/util/mmal_default_components.h"
 
+// Smallest frame the renderer takes, in its 32x16 alignment
+#define SCALED_WIDTH  32
+#define SCALED_HEIGHT 16
+// How long the renderer gets to hand the frame back before the pool is kept until stop
+#define RETURN_TIMEOUT_MS 50
+#define IMAGE_SIZE_MAX 4096
+
 static void callback_vr_input(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer)
 {
+    struct blank_background *context = (struct blank_background *)port->userdata;
+
     mmal_buffer_header_release(buffer);
+    vcos_semaphore_post(&context->returned);
+}
+
+// Free relocatable heap in kB as "get_mem reloc" reports it, -1 without the firmware's answer
+static int gpu_free_kb(void)
+{
+    char response[64];
+    char *value;
+    long kb;
+
+    if (vc_gencmd(response, sizeof(response), "get_mem reloc") != 0)
+        return -1;
+    value = strchr(response, '=');
+    if (value == NULL)
+        return -1;
+    kb = strtol(value + 1, &value, 10);
+    if (*value == 'M')
+        kb *= 1024;
+    return (int)kb;
+}
+
+int blank_background_parse(struct blank_background_options *options, const char *arg)
+{
+    memset(options, 0, sizeof(struct blank_background_options));
+
+    if (strncmp(arg, "screen", 6) == 0) {
+        options->mode = BLANK_BACKGROUND_SCREEN;
+        if (arg[6] == '\0')
+            return 0;
+        if (arg[6] != ':')
+            return -1;
+        arg += 7;
+    } else if (*arg == '#') {
+        options->mode = BLANK_BACKGROUND_SOLID;
+    } else {
+        options->mode = BLANK_BACKGROUND_IMAGE;
+        options->image = arg;
+        return 0;
+    }
+
+    if (*arg != '#' || strlen(arg) != 7 || strspn(arg + 1, "0123456789abcdefABCDEF") != 6)
+        return -1;
+    options->colour = strtoul(arg + 1, NULL, 16);
+    return 0;
+}
+
+/* frames */
+
+static void rgb_to_yuv(const uint8_t *rgb, uint8_t *y, uint8_t *u, uint8_t *v)
+{
+    int r = rgb[0], g = rgb[1], b = rgb[2];
+
+    // BT.601, limited range
+    *y = (uint8_t)(16 + ((66 * r + 129 * g + 25 * b + 128) >> 8));
+    *u = (uint8_t)(128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8));
+    *v = (uint8_t)(128 + ((112 * r - 94 * g - 18 * b + 128) >> 8));
 }
 
-int blank_background_start(struct blank_background *context, int layer, int width, int height)
+// `rgb` is width x height, `data` an I420 frame of the aligned size; chroma from the top left pixel of each 2x2 block
+static void fill_i420(uint8_t *data, uint32_t stride, uint32_t slice, const uint8_t *rgb, uint32_t width, uint32_t height)
 {
+    uint8_t *plane_u = data + stride * slice;
+    uint8_t *plane_v = plane_u + (stride / 2) * (slice / 2);
+    uint32_t x, y;
+    uint8_t u, v;
+
+    for (y = 0; y < slice; y++) {
+        for (x = 0; x < stride; x++) {
+            // the alignment padding repeats the last row and column
+            const uint8_t *pixel = rgb + ((y < height ? y : height - 1) * width + (x < width ? x : width - 1)) * 3;
+
+            rgb_to_yuv(pixel, &data[y * stride + x], &u, &v);
+            if (!(x & 1) && !(y & 1)) {
+                plane_u[(y / 2) * (stride / 2) + x / 2] = u;
+                plane_v[(y / 2) * (stride / 2) + x / 2] = v;
+            }
+        }
+    }
+}
+
+// Binary PPM, 8 bits per sample; returns the RGB24 pixels or NULL
+static uint8_t *load_ppm(const char *path, uint32_t *width, uint32_t *height)
+{
+    FILE *file = fopen(path, "rb");
+    unsigned int w = 0, h = 0, max = 0;
+    uint8_t *rgb = NULL;
+    int c;
+
+    if (file == NULL) {
+        perror(path);
+        return NULL;
+    }
+    if (fgetc(file) != 'P' || fgetc(file) != '6')
+        goto out;
+    // whitespace and comments between the header fields
+    for (int field = 0; field < 3; field++) {
+        while ((c = fgetc(file)) == '#' || c == ' ' || c == '\t' || c == '\r' || c == '\n')
+            if (c == '#')
+                while ((c = fgetc(file)) != '\n' && c != EOF)
+                    ;
+        ungetc(c, file);
+        if (fscanf(file, "%u", field == 0 ? &w : field == 1 ? &h : &max) != 1)
+            goto out;
+    }
+    fgetc(file);
+    if (w == 0 || h == 0 || w > IMAGE_SIZE_MAX || h > IMAGE_SIZE_MAX || max != 255)
+        goto out;
+
+    rgb = malloc((size_t)w * h * 3);
+    if (rgb != NULL && fread(rgb, 3, (size_t)w * h, file) != (size_t)w * h) {
+        free(rgb);
+        rgb = NULL;
+    }
+    *width = w;
+    *height = h;
+
+out:
+    if (rgb == NULL)
+        fprintf(stderr, "%s: not an 8 bit binary PPM of at most %dx%d\n", path, IMAGE_SIZE_MAX, IMAGE_SIZE_MAX);
+    fclose(file);
+    return rgb;
+}
+
+int blank_background_start(struct blank_background *context, int display, int layer, int width, int height,
+                           const struct blank_background_options *options)
+{
+    static const struct blank_background_options defaults = {BLANK_BACKGROUND_SCREEN, 0, NULL};
+    uint8_t colour[3];
+    uint8_t *image = NULL;
+    uint32_t image_width = 1, image_height = 1;
+    int scaled;
+
     if (context == NULL)
         return -1;
+    if (options == NULL)
+        options = &defaults;
 
     memset(context, 0, sizeof(struct blank_background));
+    vcos_semaphore_create(&context->returned, "blank_background.returned", 0);
 
     context->layer = layer;
+    context->display = display;
     context->screen_width = width;
     context->screen_height = height;
+    context->start_time = vcos_getmicrosecs64();
+    context->gpu_free_before = gpu_free_kb();
+
+    colour[0] = (options->colour >> 16) & 0xff;
+    colour[1] = (options->colour >> 8) & 0xff;
+    colour[2] = options->colour & 0xff;
+    scaled = options->mode != BLANK_BACKGROUND_SCREEN;
+    if (options->mode == BLANK_BACKGROUND_IMAGE) {
+        image = load_ppm(options->image, &image_width, &image_height);
+        if (image == NULL)
+            return -1;
+    }
 
     mmal_component_create(MMAL_COMPONENT_DEFAULT_VIDEO_RENDERER, &context->video_render);
 
     MMAL_PORT_T* input = context->video_render->input[0];
 
-    input->format->encoding = MMAL_ENCODING_RGB24;
-    input->format->es->video.width  = VCOS_ALIGN_UP(context->screen_width,  32);
-    input->format->es->video.height = VCOS_ALIGN_UP(context->screen_height, 16);
+    if (!scaled) {
+        input->format->encoding = MMAL_ENCODING_RGB24;
+        context->width = width;
+        context->height = height;
+    } else {
+        input->format->encoding = MMAL_ENCODING_I420;
+        context->width = image != NULL ? image_width : SCALED_WIDTH;
+        context->height = image != NULL ? image_height : SCALED_HEIGHT;
+    }
+    input->format->es->video.width  = VCOS_ALIGN_UP(context->width,  32);
+    input->format->es->video.height = VCOS_ALIGN_UP(context->height, 16);
     input->format->es->video.crop.x = 0;
     input->format->es->video.crop.y = 0;
-    input->format->es->video.crop.width  = context->screen_width;
-    input->format->es->video.crop.height = context->screen_height;
+    input->format->es->video.crop.width  = context->width;
+    input->format->es->video.crop.height = context->height;
 
     mmal_port_format_commit(input);
     mmal_component_enable(context->video_render);
-    mmal_port_parameter_set_boolean(input, MMAL_PARAMETER_ZERO_COPY, MMAL_TRUE);
+    // a tiny frame is cheaper copied over than kept in GPU memory, and can be let go of once shown
+    if (!scaled)
+        mmal_port_parameter_set_boolean(input, MMAL_PARAMETER_ZERO_COPY, MMAL_TRUE);
 
     input->buffer_size = input->buffer_size_recommended;
     input->buffer_num = input->buffer_num_recommended;
     if (input->buffer_num < 2)
         input->buffer_num = 2;
+    // a scaled frame is sent once and never replaced
+    if (scaled)
+        input->buffer_num = 1;
+    context->buffer_num = input->buffer_num;
+    context->buffer_size = input->buffer_size;
 
     context->pool = mmal_port_pool_create(input, input->buffer_num, input->buffer_size);
     if (!context->pool) {
         fprintf(stderr, "Oops, ,pool alloc failed\n");
+        free(image);
         return -1;
     }
 
@@ -57,6 +227,9 @@ int blank_background_start(struct blank_background *context, int layer, int widt
         param.set = MMAL_DISPLAY_SET_LAYER;
         param.layer = layer;    //On top of most things
 
+        param.set |= MMAL_DISPLAY_SET_NUM;
+        param.display_num = display;
+
         param.set |= MMAL_DISPLAY_SET_ALPHA;
         param.alpha = 255;    //0 = transparent, 255 = opaque
 
@@ -66,19 +239,42 @@ int blank_background_start(struct blank_background *context, int layer, int widt
         param.dest_rect.y = 0;
         param.dest_rect.width = context->screen_width;
         param.dest_rect.height = context->screen_height;
+
+        // stretched, not letterboxed, when the buffer is not the screen's shape
+        param.set |= MMAL_DISPLAY_SET_MODE;
+        param.mode = MMAL_DISPLAY_MODE_FILL;
         mmal_port_parameter_set(input, &param.hdr);
     }
 
+    input->userdata = (struct MMAL_PORT_USERDATA_T *)context;
     mmal_port_enable(input, callback_vr_input);
 
     MMAL_BUFFER_HEADER_T* buffer = mmal_queue_wait(context->pool->queue);
 
-    // Write something into the buffer.
-    memset(buffer->data, 0, buffer->alloc_size);
+    if (scaled) {
+        fill_i420(buffer->data, input->format->es->video.width, input->format->es->video.height,
+                  image != NULL ? image : colour, image_width, image_height);
+    } else if (options->colour == 0) {
+        memset(buffer->data, 0, buffer->alloc_size);
+    } else {
+        for (uint32_t i = 0; i + 3 <= buffer->alloc_size; i += 3)
+            memcpy(buffer->data + i, colour, 3);
+    }
+    free(image);
 
     buffer->length = buffer->alloc_size;
     mmal_port_send_buffer(input, buffer);
 
+    // the renderer copied the frame over and keeps showing it
+    if (scaled && vcos_semaphore_wait_timeout(&context->returned, RETURN_TIMEOUT_MS) == VCOS_SUCCESS) {
+        mmal_port_pool_destroy(input, context->pool);
+        context->pool = NULL;
+        context->released = 1;
+    }
+
+    context->start_time = vcos_getmicrosecs64() - context->start_time;
+    context->gpu_free_after = gpu_free_kb();
+
     return 0;
 }
 
@@ -94,6 +290,7 @@ int blank_background_stop(struct blank_background *context)
         mmal_component_destroy(context->video_render);
         context->video_render = NULL;
     }
+    vcos_semaphore_delete(&context->returned);
 
     return 0;
 }
@@ -4,16 +4,45 @@
 #include "bcm_host.h"
 #include "interface/mmal/mmal.h"
 
+enum blank_background_mode
+{
+    BLANK_BACKGROUND_SCREEN = 0,    // a screen sized RGB24 buffer, 6 MB of GPU memory at 1080p
+    BLANK_BACKGROUND_SOLID,         // a 32x16 I420 buffer of one colour, stretched by the renderer
+    BLANK_BACKGROUND_IMAGE,         // a small binary PPM (P6) image, stretched as well
+};
+
+struct blank_background_options
+{
+    int mode;               // enum blank_background_mode
+    uint32_t colour;        // 0xRRGGBB, SCREEN and SOLID
+    const char* image;      // IMAGE: path of the PPM file; kept, not copied
+};
+
 struct blank_background
 {
     int layer;
+    int display;
     uint32_t screen_width, screen_height;
 
     MMAL_COMPONENT_T* video_render;
-    MMAL_POOL_T* pool;
+    MMAL_POOL_T* pool;      // NULL once the frame was handed back by the renderer, see `released`
+    VCOS_SEMAPHORE_T returned;
+
+    // what it cost
+    uint32_t buffer_num, buffer_size;
+    uint32_t width, height;
+    uint64_t start_time;    // us
+    int released;           // the pool was freed right after the frame went on screen
+    int gpu_free_before;    // relocatable GPU heap free, kB, -1 when unknown
+    int gpu_free_after;
 };
 
-int blank_background_start(struct blank_background* context, int layer, int screen_width, int screen_height);
+// "screen", "screen:#RRGGBB", "#RRGGBB" or a PPM file for `options`; -1 when it is none of them
+int blank_background_parse(struct blank_background_options* options, const char* arg);
+
+// `options` NULL: black, screen sized
+int blank_background_start(struct blank_background* context, int display, int layer, int screen_width, int screen_height,
+                           const struct blank_background_options* options);
 int blank_background_stop(struct blank_background* context);
 
 #endif //MMAL_CHAIN_PLAYER_BLANK_BACKGROUND_H
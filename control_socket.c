@@ -0,0 +1,218 @@
+#include "control_socket.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define CONTROL_LINE_MAX        1024
+#define CONTROL_REPLY_MAX       16384
+#define CONTROL_POLL_MS         250     // how often a blocked thread looks at `terminate`
+#define CONTROL_IDLE_MS         30000   // a silent client is dropped so the next one gets in
+
+static int write_all(int fd, const char* buffer, size_t length)
+{
+    while(length > 0) {
+        ssize_t n = send(fd, buffer, length, MSG_NOSIGNAL);
+
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return -1;
+        buffer += n;
+        length -= n;
+    }
+    return 0;
+}
+
+// waits for `fd` to become readable; 1: readable, 0: timed out or terminating, -1: error
+static int wait_readable(struct control_socket* context, int fd, int timeout_ms)
+{
+    struct pollfd pfd = {fd, POLLIN, 0};
+
+    while(!__atomic_load_n(&context->terminate, __ATOMIC_ACQUIRE) && timeout_ms > 0) {
+        int n = poll(&pfd, 1, CONTROL_POLL_MS);
+
+        if(n > 0)
+            return 1;
+        if(n < 0 && errno != EINTR)
+            return -1;
+        timeout_ms -= CONTROL_POLL_MS;
+    }
+    return 0;
+}
+
+static void serve_client(struct control_socket* context, int fd, char* line, char* reply)
+{
+    size_t length = 0;
+
+    while(wait_readable(context, fd, CONTROL_IDLE_MS) > 0) {
+        ssize_t n = recv(fd, line + length, CONTROL_LINE_MAX - 1 - length, 0);
+        char* end;
+
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return;
+        length += n;
+        line[length] = '\0';
+
+        while((end = memchr(line, '\n', length)) != NULL) {
+            size_t consumed = end - line + 1;
+
+            *end = '\0';
+            if(end > line && end[-1] == '\r')
+                end[-1] = '\0';
+
+            reply[0] = '\0';
+            context->handler(context->user, line, reply, CONTROL_REPLY_MAX - 1);
+            strcat(reply, "\n");
+            if(write_all(fd, reply, strlen(reply)) != 0)
+                return;
+
+            memmove(line, line + consumed, length - consumed);
+            length -= consumed;
+            line[length] = '\0';
+        }
+
+        if(length == CONTROL_LINE_MAX - 1) {
+            const char* error = "ERR line too long\n";
+
+            write_all(fd, error, strlen(error));
+            return;
+        }
+    }
+}
+
+static void* control_socket_thread(void* user)
+{
+    struct control_socket* context = user;
+    char* line = malloc(CONTROL_LINE_MAX);
+    char* reply = malloc(CONTROL_REPLY_MAX);
+
+    if(line == NULL || reply == NULL)
+        goto out;
+
+    while(1) {
+        int client, ready = wait_readable(context, context->fd, CONTROL_POLL_MS);
+
+        if(__atomic_load_n(&context->terminate, __ATOMIC_ACQUIRE) || ready < 0)
+            break;
+        if(ready == 0)
+            continue;
+
+        client = accept(context->fd, NULL, NULL);
+        if(client < 0)
+            continue;
+
+        serve_client(context, client, line, reply);
+        close(client);
+    }
+
+out:
+    free(line);
+    free(reply);
+    return NULL;
+}
+
+// A stale socket from a previous run would make bind() fail and is removed; a file that is not a
+// socket, or a socket another player still listens on, is left alone and fails the start
+static int control_socket_clear(const struct sockaddr_un* addr)
+{
+    struct stat st;
+    int fd, status, error;
+
+    if(lstat(addr->sun_path, &st) != 0)
+        return 0;
+    if(!S_ISSOCK(st.st_mode)) {
+        fprintf(stderr, "%s exists and is not a socket\n", addr->sun_path);
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0) {
+        perror("control socket");
+        return -1;
+    }
+    status = connect(fd, (const struct sockaddr*)addr, sizeof(*addr));
+    error = errno;
+    close(fd);
+
+    if(status != 0 && error == ECONNREFUSED) {
+        unlink(addr->sun_path);
+        return 0;
+    }
+    if(status == 0)
+        fprintf(stderr, "%s already in use\n", addr->sun_path);
+    else
+        fprintf(stderr, "%s: %s\n", addr->sun_path, strerror(error));
+    return -1;
+}
+
+int control_socket_start(struct control_socket* context, const char* path, control_socket_handler handler, void* user)
+{
+    struct sockaddr_un addr;
+
+    if(context == NULL || path == NULL || handler == NULL || strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+
+    memset(context, 0, sizeof(struct control_socket));
+    context->handler = handler;
+    context->user = user;
+
+    context->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(context->fd < 0) {
+        perror("control socket");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if(control_socket_clear(&addr) != 0) {
+        close(context->fd);
+        return -1;
+    }
+    // owner and group only before listen(), nobody can connect until then
+    if(bind(context->fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+       chmod(path, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP) != 0 || listen(context->fd, 4) != 0) {
+        perror(path);
+        close(context->fd);
+        return -1;
+    }
+    context->path = strdup(path);
+
+    if(vcos_thread_create(&context->thread, "control_socket", NULL, control_socket_thread, context) != VCOS_SUCCESS) {
+        fprintf(stderr, "unable to start control socket thread\n");
+        close(context->fd);
+        unlink(path);
+        free(context->path);
+        return -1;
+    }
+
+    return 0;
+}
+
+int control_socket_stop(struct control_socket* context)
+{
+    void* ret = NULL;
+
+    if(context == NULL || context->path == NULL)
+        return -1;
+
+    __atomic_store_n(&context->terminate, 1, __ATOMIC_RELEASE);
+    vcos_thread_join(&context->thread, &ret);
+
+    close(context->fd);
+    unlink(context->path);
+    free(context->path);
+    context->path = NULL;
+
+    return 0;
+}
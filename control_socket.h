@@ -0,0 +1,28 @@
+#ifndef MMAL_CHAIN_PLAYER_CONTROL_SOCKET_H
+#define MMAL_CHAIN_PLAYER_CONTROL_SOCKET_H
+
+#include <stddef.h>
+
+#include "interface/vcos/vcos.h"
+
+// Handles one command line, writes the reply (without the trailing newline) to `reply`
+typedef void (*control_socket_handler)(void* user, char* line, char* reply, size_t size);
+
+// A UNIX-domain stream socket served by its own thread, one client at a time,
+// one line per command and one reply per line.
+struct control_socket
+{
+    int fd;
+    char* path;
+    int terminate;
+
+    control_socket_handler handler;
+    void* user;
+
+    VCOS_THREAD_T thread;
+};
+
+int control_socket_start(struct control_socket* context, const char* path, control_socket_handler handler, void* user);
+int control_socket_stop(struct control_socket* context);
+
+#endif //MMAL_CHAIN_PLAYER_CONTROL_SOCKET_H
@@ -1,33 +1,134 @@
 #include "bcm_host.h"
 #include "interface/mmal/mmal.h"
 #include <stdio.h>
+#include <stdarg.h>
 #include <pthread.h>
 #include <string.h>
 #include <getopt.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "blank_background.h"
+#include "control_socket.h"
+#include "playlist.h"
+#include "playlist_watch.h"
+#include "mmal-player-executor.h"
+#include "mmal-player-overlay.h"
 #include "mmal-player-pipeline.h"
+#include "mmal-player-pool.h"
+#include "mmal-player-prefetch.h"
+#include "mmal-player-sync.h"
+#include "mmal-player-transition.h"
+#include "mmal-player-analysis.h"
+#include "mmal-player-tap.h"
+#include "mmal-player-watchdog.h"
 
+// One window: a playlist played into its own dest_rect, layer and display
 struct player_context
 {
+    int index;
     int rotation;
     int loop;               // 0: no loop, -1: infinity, 1~: repeat n times
-    int current_iter;
     int loop_overall;
+    int shuffle;
+    int preroll;            // build and decode the next file while the current one plays
+    int metrics_fd;         // per-pipeline JSON lines, -1 when disabled
+    uint32_t monitor_alert; // -V: black or frozen frames in a row that get logged, 0 when not monitored
+    struct mmal_player_options options;
+    struct mmal_player_prefetcher* prefetcher;  // NULL unless -P, shared by all windows
+    struct mmal_player_pool* pool;              // finished pipelines are handed back here, shared as well
 
-    int reason;             // why player thread has exit
+    int reason;             // why player thread has exit, taken by the main thread
+    int finished;           // no control socket and the playlist ran out
 
-    char **av;
-    int ac, ai;
+    struct playlist playlist;
+    struct playlist_cursor at;                  // the playing entry
+    int cut;                // its play time ran out and it was skipped
+    const char* playlist_path;                  // -f: NULL when the playlist came from FILES
+    struct playlist_watch watch;                // reloads playlist_path as it is written
 
-    struct blank_background bb;
-    struct mmal_player_pipeline* player;
+    const char* control_path;   // NULL: no control socket, exit at the end of the playlist
+
+    struct mmal_player_pipeline* player;        // NULL while idle
     struct mmal_player_pipeline* old_player;
+    struct mmal_player_pipeline* next_player;   // prerolled, becomes `player` on EOS
+    struct playlist_cursor next_at;             // playlist position of next_player
+    int next_stale;                             // the playlist changed under next_player
+    int need_preroll;                           // main thread should reap old_player and preroll
+    struct mmal_player_transition* transition;  // NULL: hard cuts
+    int transition_pending;                     // `player` ended, the transition thread takes next_player on
+
+    VCOS_SEMAPHORE_T* sem_event;    // the main thread's, shared by all windows
+    VCOS_MUTEX_T lock;      // guards playlist position and player handover
+};
+
+#define WINDOWS_MAX 8
+#define MONITOR_SLOTS (3 * WINDOWS_MAX)    // the playing, prerolled and outgoing pipeline of each window
+
+// -V: decoded frames of every window through the analysis kernels, one analysis per pipeline as
+// their frames come in interleaved; only the tap's single worker touches it
+struct chain_monitor
+{
+    struct mmal_player_tap* tap;
+    struct {
+        struct mmal_player_pipeline* pipeline;
+        struct mmal_player_analysis* analysis;
+        uint32_t used;
+    } slots[MONITOR_SLOTS];
+    uint32_t clock;
+};
+
+// Time to the first frame, phase by phase; vcos_getmicrosecs64() deltas
+struct chain_startup
+{
+    uint64_t launch;        // main() entered
+    uint64_t host_init;
+    uint64_t backgrounds;   // display sizes and blank backgrounds, on a thread of their own with -F
+    uint64_t pipelines;     // the first pipeline of every window built and started
+    uint64_t started;       // when that was done
+    int fast;
+    int reported;
+};
+
+struct chain_player
+{
+    struct player_context windows[WINDOWS_MAX];
+    int window_count;
+    int quit;               // asked for over the control socket
 
+    struct blank_background bb[WINDOWS_MAX];    // one per display in use
+    int bb_count;
+    struct blank_background_options bb_options;
+    VCOS_THREAD_T bb_thread;                    // starts them with -F
+    struct chain_startup startup;
+    struct control_socket control;
+    const char* control_path;
 
+    struct mmal_player_executor* executor;      // NULL: every pipeline runs its own thread
+    struct mmal_player_sync* sync;              // NULL: every window runs its own clock
+    struct mmal_player_watchdog* watchdog;      // NULL with -D 0
     VCOS_SEMAPHORE_T sem_event;
+
+    struct mmal_player_transition_options transition_options;  // kind CUT unless -X
+    struct mmal_player_overlay_options clock_options;
+    struct mmal_player_overlay* clock;          // NULL unless -C
+    char clock_shown[9];                        // "HH:MM:SS" as on the canvas
+    struct chain_monitor monitor;               // no tap unless -V
 };
 
+#define METRICS_INTERVAL_MS 1000
+#define DEFAULT_POOL_CAPACITY 2      // per window
+#define DEFAULT_WINDOW_LAYER 128
+#define STARTUP_POLL_MS 5
+#define STARTUP_REPORT_TIMEOUT_US 10000000
+#define CLOCK_TICK_MS 250
+#define CLOCK_CELLS 8
+#define DEFAULT_MONITOR_ALERT_S 2
+#define DEFAULT_WATCHDOG_FRAMES 25
+#define SCHEDULE_POLL_MS 1000        // how often a window waiting for a time of day window looks again
+#define PLAY_TIME_SLACK_US 100000    // a clip ending this close to its play time is not looped for the rest
+
 #define CHECK_STATUS(status, msg) if (status != MMAL_SUCCESS) { fprintf(stderr, msg"\n"); goto error; }
 
 static const struct option long_options[] =
@@ -35,117 +136,1178 @@ static const struct option long_options[] =
     {"rotate",   required_argument, NULL, 'r'},
     {"loop",     optional_argument, NULL, 'l'},
     {"loop-all", no_argument,       NULL, 'L'},
+    {"preroll",  no_argument,       NULL, 'p'},
+    {"metrics",  required_argument, NULL, 'm'},
+    {"buffers",  required_argument, NULL, 'b'},
+    {"adaptive-buffers", no_argument, NULL, 'A'},
+    {"prefetch", required_argument, NULL, 'P'},
+    {"control",  required_argument, NULL, 'S'},
+    {"recycle",  required_argument, NULL, 'R'},
+    {"window",   required_argument, NULL, 'W'},
+    {"threads",  required_argument, NULL, 'T'},
+    {"sync",     required_argument, NULL, 'Y'},
+    {"sync-master", no_argument,    NULL, 'M'},
+    {"stream-latency", required_argument, NULL, 'J'},
+    {"fast-start", no_argument,     NULL, 'F'},
+    {"background", required_argument, NULL, 'B'},
+    {"clock",    required_argument, NULL, 'C'},
+    {"transition", required_argument, NULL, 'X'},
+    {"verify",   required_argument, NULL, 'V'},
+    {"watchdog", required_argument, NULL, 'D'},
+    {"playlist", required_argument, NULL, 'f'},
+    {"shuffle",  no_argument,       NULL, 'Z'},
     {NULL, 0,                       NULL, 0}
 };
 
-struct mmal_player_pipeline* make_player(struct player_context* ctx, char* uri);
+struct mmal_player_pipeline* make_player(struct player_context* ctx, const char* uri);
+
+
+// What comes after the playing entry once it is done, its play time run out; `cursor` ends up
+// there and ctx->at stays. NULL at the end of the playlist.
+const char* chain_player_peek(struct player_context* ctx, struct playlist_cursor* cursor)
+{
+    int64_t now = vcos_getmicrosecs64();
+
+    *cursor = ctx->at;
+    return playlist_next(&ctx->playlist, cursor, now > ctx->at.until ? now : ctx->at.until);
+}
+
+// The cursor's entry went on screen: its play time, if it has one, starts running
+static void chain_player_started(struct player_context* ctx)
+{
+    playlist_start(&ctx->playlist, &ctx->at, vcos_getmicrosecs64());
+    ctx->cut = 0;
+}
+
+// Queues the current entry and the one after it, so both are read ahead of the container reader
+void chain_player_prefetch(struct player_context* ctx)
+{
+    struct playlist_cursor cursor;
+    const char* next_uri;
+
+    if(ctx->prefetcher == NULL)
+        return;
+
+    if(playlist_get(&ctx->playlist, ctx->at.entry) != NULL)
+        mmal_player_prefetch(ctx->prefetcher, playlist_get(&ctx->playlist, ctx->at.entry));
+    next_uri = chain_player_peek(ctx, &cursor);
+    if(next_uri != NULL)
+        mmal_player_prefetch(ctx->prefetcher, next_uri);
+}
+
+// Same file again: loop in place, the pipeline rewinds instead of being rebuilt. `uri` must
+// not be pipeline->uri, which this frees. Called with ctx->lock held.
+static MMAL_BOOL_T chain_player_loop(struct player_context* ctx, struct mmal_player_pipeline* pipeline, const char* uri)
+{
+    MMAL_STATUS_T status = mmal_player_set_new_uri(pipeline, uri);
 
+    if(status != MMAL_SUCCESS)
+        return MMAL_FALSE;
+    chain_player_started(ctx);
+    if(ctx->preroll) {
+        ctx->need_preroll = 1;
+        vcos_semaphore_post(ctx->sem_event);
+    }
+    return MMAL_TRUE;
+}
 
 MMAL_BOOL_T chain_player_eos_callback(struct mmal_player_pipeline* pipeline, void* user)
 {
     struct player_context* ctx = user;
-    char* next_uri;
+    struct mmal_player_pipeline* new_player;
+    const char* uri;
+    int64_t now;
+
+    // a clip shorter than the transition into it holds its last frame, the transition skips it once done
+    if(ctx->transition != NULL && mmal_player_transition_ended(ctx->transition, pipeline)) {
+        mmal_player_hold_eos(pipeline);
+        return MMAL_TRUE;
+    }
 
-    if((ctx->loop > 0 && --ctx->current_iter > 0) || ctx->loop == -1) {
-        // continue with current mov
-        next_uri = ctx->av[ctx->ai];
+    // proof of play, as far as the frames checked before the end go
+    if(ctx->monitor_alert > 0)
+        fprintf(stderr, "window %d played %s: %u frames checked, %u black, %u frozen, hash %016llx\n",
+                ctx->index, pipeline->uri, pipeline->analysis.frames, pipeline->analysis.black, pipeline->analysis.frozen,
+                (unsigned long long)pipeline->analysis.hash);
+
+    vcos_mutex_lock(&ctx->lock);
+    if(pipeline != ctx->player) {
+        // a transition took over while this clip played on unseen, its thread joins it
+        mmal_player_set_exit_callback(pipeline, NULL, ctx);
+        mmal_player_set_eos_callback(pipeline, NULL, ctx);
+        vcos_mutex_unlock(&ctx->lock);
+        return MMAL_FALSE;
+    }
+    // transitions into the next entry start this far ahead of the end next time
+    uri = playlist_get(&ctx->playlist, ctx->at.entry);
+    if(pipeline->clip_duration > 0 && uri != NULL && strcmp(uri, pipeline->uri) == 0)
+        playlist_set_duration(&ctx->playlist, ctx->at.entry, pipeline->clip_duration);
+
+    // shorter than its play time: the clip plays again under it, next_player and the transition wait
+    now = vcos_getmicrosecs64() + PLAY_TIME_SLACK_US;
+    if(ctx->at.until > now && uri != NULL && strcmp(uri, pipeline->uri) == 0) {
+        MMAL_BOOL_T looped = chain_player_loop(ctx, pipeline, uri);
+
+        vcos_mutex_unlock(&ctx->lock);
+        return looped;
+    }
+
+    if(ctx->next_player != NULL && !ctx->next_stale && ctx->transition != NULL &&
+       mmal_player_transition_eos(ctx->transition, pipeline)) {
+        // the last frame stays up for the transition, which starts next_player over it
+        mmal_player_set_exit_callback(pipeline, NULL, ctx);
+        mmal_player_set_eos_callback(pipeline, NULL, ctx);
+        ctx->transition_pending = 1;
+        vcos_mutex_unlock(&ctx->lock);
+        return MMAL_FALSE;
+    }
+    if(ctx->transition != NULL)
+        mmal_player_transition_cancel(ctx->transition);
+
+    if(ctx->next_player != NULL && !ctx->next_stale) {
+        new_player = ctx->next_player;
+        ctx->next_player = NULL;
+        ctx->at = ctx->next_at;
     } else {
-        // proceed to next mov
-        if(ctx->av[ctx->ai + 1] == NULL || ctx->ai + 1 > ctx->ac) {
-            if(ctx->loop_overall) {
-                ctx->ai = optind - 1;
-                // fall thru
-            } else {
-                fprintf(stderr, "Exiting\n");
-                return MMAL_FALSE;
-            }
+        const char* next_uri = playlist_next(&ctx->playlist, &ctx->at, now);
+        if(next_uri == NULL) {
+            int waits = ctx->control_path != NULL || playlist_waits(&ctx->playlist);
+
+            vcos_mutex_unlock(&ctx->lock);
+            fprintf(stderr, waits ? "End of playlist\n" : "Exiting\n");
+            return MMAL_FALSE;
         }
 
-        next_uri = ctx->av[++ctx->ai];
-        if(ctx->loop > 0)
-            ctx->current_iter = ctx->loop;
-    }
+        if(strcmp(next_uri, pipeline->uri) == 0) {
+            MMAL_BOOL_T looped = chain_player_loop(ctx, pipeline, next_uri);
 
-    if(ctx->old_player != NULL) {
-        mmal_player_join(ctx->old_player);
-        mmal_player_destroy(ctx->old_player);
-        ctx->old_player = NULL;
+            vcos_mutex_unlock(&ctx->lock);
+            return looped;
+        }
+
+        if(ctx->old_player != NULL) {
+            mmal_player_join(ctx->old_player);
+            mmal_player_pool_put(ctx->pool, ctx->old_player);
+            ctx->old_player = NULL;
+        }
+
+        // let the next pipeline start from what this one has learnt
+        if(ctx->options.reader_buffers.adaptive)
+            ctx->options.reader_buffers.num = pipeline->reader_buffer_num;
+        new_player = make_player(ctx, next_uri);
+        if(new_player == NULL) {
+            vcos_mutex_unlock(&ctx->lock);
+            fprintf(stderr, "unable to recreate player\n");
+            return MMAL_FALSE;
+        }
     }
 
     mmal_player_set_exit_callback(pipeline, NULL, ctx);
     mmal_player_set_eos_callback(pipeline, NULL, ctx);
 
-    struct mmal_player_pipeline* new_player = make_player(ctx, next_uri);
-    if(new_player == NULL) {
-        fprintf(stderr, "unable to recreate player\n");
-        return MMAL_FALSE;
-    }
-
     ctx->player = new_player;
     ctx->old_player = pipeline;
 
+    // new_player reports its switch latency once its first frame is up
+    mmal_player_start_after(new_player, pipeline->eos_time);
     mmal_player_stop(pipeline);
-    mmal_player_start(new_player);
+
+    chain_player_started(ctx);
+    chain_player_prefetch(ctx);
+
+    if(ctx->preroll) {
+        // old_player can only be joined from outside its own thread
+        ctx->need_preroll = 1;
+        vcos_semaphore_post(ctx->sem_event);
+    }
+    vcos_mutex_unlock(&ctx->lock);
 
     return MMAL_TRUE;
 }
 
+// Called with ctx->lock held: takes next_player off ctx for chain_player_drop(), NULL if there is none
+static struct mmal_player_pipeline* chain_player_take_next(struct player_context* ctx)
+{
+    struct mmal_player_pipeline* next_player = ctx->next_player;
+
+    if(next_player == NULL)
+        return NULL;
+    if(ctx->transition != NULL)
+        mmal_player_transition_cancel(ctx->transition);
+    // stopped by us, not an exit the main thread should act on
+    mmal_player_set_exit_callback(next_player, NULL, ctx);
+    mmal_player_set_eos_callback(next_player, NULL, ctx);
+    ctx->next_player = NULL;
+    return next_player;
+}
+
+// Main thread, without ctx->lock: it may only wind down on the executor worker that runs the
+// current player's EOS callback, which takes that lock first
+static void chain_player_drop(struct player_context* ctx, struct mmal_player_pipeline* pipeline)
+{
+    if(pipeline == NULL)
+        return;
+    mmal_player_stop(pipeline);
+    mmal_player_join(pipeline);
+    mmal_player_pool_put(ctx->pool, pipeline);
+}
+
+// Called on the main thread: reaps the finished pipeline and prerolls the following entry
+void chain_player_preroll_next(struct player_context* ctx)
+{
+    struct mmal_player_pipeline* stale = NULL;
+    struct playlist_cursor cursor;
+    const char* next_uri;
+    int64_t end, play_time;
+
+    vcos_mutex_lock(&ctx->lock);
+
+    if(ctx->old_player != NULL) {
+        mmal_player_join(ctx->old_player);
+        mmal_player_pool_put(ctx->pool, ctx->old_player);
+        ctx->old_player = NULL;
+    }
+
+    if(ctx->next_stale) {
+        stale = chain_player_take_next(ctx);
+        ctx->next_stale = 0;
+    }
+    if(stale != NULL) {
+        vcos_mutex_unlock(&ctx->lock);
+        chain_player_drop(ctx, stale);
+        vcos_mutex_lock(&ctx->lock);
+    }
+
+    if(ctx->next_player != NULL || ctx->player == NULL || !ctx->preroll)
+        goto out;
+
+    next_uri = chain_player_peek(ctx, &cursor);
+    if(next_uri == NULL || strcmp(next_uri, ctx->player->uri) == 0)
+        goto out;   // end of playlist, or the current file loops in place
+
+    struct mmal_player_pipeline* next_player = make_player(ctx, next_uri);
+    if(next_player == NULL) {
+        fprintf(stderr, "unable to preroll %s, will retry on EOS\n", next_uri);
+        goto out;
+    }
+    if(mmal_player_preroll(next_player) != MMAL_SUCCESS) {
+        mmal_player_pool_put(ctx->pool, next_player);
+        goto out;
+    }
+
+    ctx->next_at = cursor;
+    ctx->next_player = next_player;
+    // ahead of the current clip's end once its length is known, at its EOS until then; a play
+    // time cuts it short, or has it loop and the transition wait for the cut
+    end = playlist_get_duration(&ctx->playlist, ctx->at.entry);
+    play_time = playlist_get_play_time(&ctx->playlist, ctx->at.entry);
+    if(play_time > 0)
+        end = end == 0 || play_time < end ? play_time : 0;
+    if(ctx->transition != NULL)
+        mmal_player_transition_arm(ctx->transition, ctx->player, next_player, end);
+
+out:
+    vcos_mutex_unlock(&ctx->lock);
+}
+
+// Pipeline thread: a picture that stayed black or frozen for long enough, once per run
+void chain_player_analysis_callback(struct mmal_player_pipeline* pipeline, const struct mmal_player_analysis_result* result, void* user)
+{
+    struct player_context* ctx = user;
+
+    if(result->black_run == ctx->monitor_alert || result->frozen_run == ctx->monitor_alert)
+        fprintf(stderr, "window %d: %s %s for %u checks at %lld ms\n", ctx->index, pipeline->uri,
+                result->black ? "black" : "frozen", ctx->monitor_alert, (long long)(result->pts - pipeline->clip_pts) / 1000);
+}
+
 void chain_player_exit_callback(struct mmal_player_pipeline* pipeline, void* user)
 {
     struct player_context* ctx = user;
 
-    ctx->reason = pipeline->exit_reason;
-    vcos_semaphore_post(&ctx->sem_event);
+    __atomic_store_n(&ctx->reason, pipeline->exit_reason, __ATOMIC_RELEASE);
+    vcos_semaphore_post(ctx->sem_event);
 }
 
-struct mmal_player_pipeline* make_player(struct player_context* ctx, char* uri)
+// Main thread, control socket only: the playlist ran out, drop the pipeline and show the background
+void chain_player_idle(struct player_context* ctx)
+{
+    struct mmal_player_pipeline* next_player;
+
+    vcos_mutex_lock(&ctx->lock);
+    if(ctx->player != NULL) {
+        mmal_player_join(ctx->player);
+        mmal_player_pool_put(ctx->pool, ctx->player);
+        ctx->player = NULL;
+    }
+    next_player = chain_player_take_next(ctx);
+    vcos_mutex_unlock(&ctx->lock);
+
+    chain_player_drop(ctx, next_player);
+}
+
+// Transition thread, as `to` starts: the handover a cut does on EOS
+static MMAL_BOOL_T chain_player_transition_begin(struct mmal_player_pipeline* from, struct mmal_player_pipeline* to, void* user)
+{
+    struct player_context* ctx = user;
+    int pending;
+
+    vcos_mutex_lock(&ctx->lock);
+    pending = ctx->transition_pending;
+    ctx->transition_pending = 0;
+    if(ctx->player != from || ctx->next_player != to || ctx->next_stale) {
+        // the playlist changed; a clip that ended already is reaped and the main thread starts what comes next
+        if(pending && ctx->player == from) {
+            if(ctx->old_player != NULL) {
+                mmal_player_join(ctx->old_player);
+                mmal_player_pool_put(ctx->pool, ctx->old_player);
+            }
+            ctx->old_player = from;
+            ctx->player = NULL;
+            ctx->need_preroll = 1;
+            vcos_semaphore_post(ctx->sem_event);
+        }
+        vcos_mutex_unlock(&ctx->lock);
+        return MMAL_FALSE;
+    }
+
+    ctx->player = to;
+    ctx->next_player = NULL;
+    ctx->at = ctx->next_at;
+    chain_player_started(ctx);
+    chain_player_prefetch(ctx);
+    vcos_mutex_unlock(&ctx->lock);
+
+    return MMAL_TRUE;
+}
+
+// Transition thread, once `to` is alone on screen
+static void chain_player_transition_end(struct mmal_player_pipeline* from, void* user)
+{
+    struct player_context* ctx = user;
+
+    // an unseen rest of the clip is cut; its EOS callback takes ctx->lock, so not joined under it
+    mmal_player_skip(from);
+    mmal_player_join(from);
+
+    vcos_mutex_lock(&ctx->lock);
+    mmal_player_pool_put(ctx->pool, from);
+    if(ctx->preroll) {
+        ctx->need_preroll = 1;
+        vcos_semaphore_post(ctx->sem_event);
+    }
+    vcos_mutex_unlock(&ctx->lock);
+}
+
+// Main thread: starts the entry after the current one if nothing is playing
+void chain_player_wake(struct player_context* ctx)
+{
+    const char* uri;
+
+    vcos_mutex_lock(&ctx->lock);
+    if(ctx->player != NULL || (uri = playlist_next(&ctx->playlist, &ctx->at, vcos_getmicrosecs64())) == NULL) {
+        vcos_mutex_unlock(&ctx->lock);
+        return;
+    }
+
+    ctx->player = make_player(ctx, uri);
+    if(ctx->player == NULL) {
+        fprintf(stderr, "unable to create player for %s\n", uri);
+    } else {
+        mmal_player_start(ctx->player);
+        chain_player_started(ctx);
+        chain_player_prefetch(ctx);
+        if(ctx->preroll) {
+            ctx->need_preroll = 1;
+            vcos_semaphore_post(ctx->sem_event);
+        }
+    }
+    vcos_mutex_unlock(&ctx->lock);
+}
+
+// Called with ctx->lock held after every playlist edit: keeps next_player if it is still
+// what comes next, otherwise has the main thread replace it
+static void chain_player_playlist_changed(struct player_context* ctx)
+{
+    struct playlist_cursor cursor;
+    const char* next_uri;
+
+    playlist_cursor_update(&ctx->playlist, &ctx->at);
+    next_uri = chain_player_peek(ctx, &cursor);
+    if(ctx->next_player != NULL) {
+        if(next_uri != NULL && strcmp(next_uri, ctx->next_player->uri) == 0)
+            ctx->next_at = cursor;
+        else
+            ctx->next_stale = 1;
+    }
+
+    chain_player_prefetch(ctx);
+    ctx->need_preroll = ctx->preroll || ctx->next_stale;
+    vcos_semaphore_post(ctx->sem_event);
+}
+
+// Playlist watch thread: the -f file was written. It is parsed off the lock and swapped in
+// whole, the clip on screen plays on, and what comes next is worked out again.
+static void chain_player_reload(void* user, const char* path)
+{
+    struct player_context* ctx = user;
+    struct playlist playlist, old;
+    const char* uri;
+    int i, same, count;
+
+    playlist_init(&playlist);
+    if(playlist_configure(&playlist, ctx->loop, ctx->loop_overall, ctx->shuffle) != 0 ||
+       playlist_load(&playlist, path) != 0) {
+        fprintf(stderr, "window %d: %s not reloaded, the old playlist plays on\n", ctx->index, path);
+        playlist_deinit(&playlist);
+        return;
+    }
+
+    vcos_mutex_lock(&ctx->lock);
+    // what was learnt about clips that stay
+    for(i = 0; i < playlist.count; i++) {
+        same = playlist_find(&ctx->playlist, playlist_get(&playlist, i));
+        if(same >= 0)
+            playlist_set_duration(&playlist, i, playlist_get_duration(&ctx->playlist, same));
+    }
+    uri = playlist_get(&ctx->playlist, ctx->at.entry);
+    ctx->at.entry = uri != NULL ? playlist_find(&playlist, uri) : -1;
+    uri = playlist_get(&ctx->playlist, ctx->at.cue);
+    ctx->at.cue = uri != NULL ? playlist_find(&playlist, uri) : -1;
+
+    // the old one is freed off the lock
+    old = ctx->playlist;
+    ctx->playlist = playlist;
+    playlist = old;
+    count = ctx->playlist.count;
+    chain_player_playlist_changed(ctx);
+    vcos_mutex_unlock(&ctx->lock);
+
+    playlist_deinit(&playlist);
+    fprintf(stderr, "window %d: reloaded %s, %d entries\n", ctx->index, path, count);
+}
+
+// Main thread: the playlist may come up with something as the day goes on
+static int chain_player_waits(struct player_context* ctx)
+{
+    int waits;
+
+    vcos_mutex_lock(&ctx->lock);
+    waits = playlist_waits(&ctx->playlist);
+    vcos_mutex_unlock(&ctx->lock);
+    return waits;
+}
+
+// Main thread: cuts the clip whose play time is up; returns how long the main thread may sleep
+// before this window needs it again, ms, -1 for as long as it likes
+static int chain_player_schedule(struct player_context* ctx)
+{
+    int64_t now = vcos_getmicrosecs64();
+    int wait_ms = -1;
+
+    vcos_mutex_lock(&ctx->lock);
+    if(ctx->player != NULL && ctx->at.until > 0 && !ctx->cut && !ctx->transition_pending) {
+        if(now >= ctx->at.until) {
+            // its EOS callback moves on
+            mmal_player_skip(ctx->player);
+            ctx->cut = 1;
+        } else {
+            wait_ms = (int)((ctx->at.until - now + 999) / 1000);
+        }
+    } else if(ctx->player == NULL && playlist_waits(&ctx->playlist)) {
+        wait_ms = SCHEDULE_POLL_MS;
+    }
+    vcos_mutex_unlock(&ctx->lock);
+
+    return wait_ms;
+}
+
+static int control_reply(char* reply, size_t size, const char* format, ...) __attribute__((format(printf, 3, 4)));
+static int control_reply(char* reply, size_t size, const char* format, ...)
+{
+    size_t len = strlen(reply);
+    va_list ap;
+    int n;
+
+    if(len >= size)
+        return -1;
+
+    va_start(ap, format);
+    n = vsnprintf(reply + len, size - len, format, ap);
+    va_end(ap);
+
+    return n;
+}
+
+// Control socket thread. Commands only edit the playlist under ctx->lock or flag the
+// pipeline; building and tearing down pipelines stays on the pipeline and main threads.
+// "@N " in front of a command addresses window N, window 0 otherwise.
+void chain_player_control(void* user, char* line, char* reply, size_t size)
+{
+    struct chain_player* app = user;
+    struct player_context* ctx = &app->windows[0];
+    char* arg;
+    int i;
+
+    if(*line == '@') {
+        i = (int)strtol(line + 1, &line, 10);
+        if(i < 0 || i >= app->window_count) {
+            control_reply(reply, size, "ERR no window %d of %d", i, app->window_count);
+            return;
+        }
+        ctx = &app->windows[i];
+        while(*line == ' ')
+            line++;
+    }
+
+    arg = strchr(line, ' ');
+    if(arg != NULL) {
+        *arg++ = '\0';
+        while(*arg == ' ')
+            arg++;
+    }
+
+    vcos_mutex_lock(&ctx->lock);
+    if(strcmp(line, "enqueue") == 0 && arg != NULL && *arg != '\0') {
+        if(playlist_append(&ctx->playlist, arg) < 0) {
+            control_reply(reply, size, "ERR out of memory");
+        } else {
+            chain_player_playlist_changed(ctx);
+            control_reply(reply, size, "OK %d", ctx->playlist.count);
+        }
+    } else if(strcmp(line, "next") == 0 && arg != NULL && *arg != '\0') {
+        if((i = playlist_insert(&ctx->playlist, ctx->at.entry + 1, arg)) < 0) {
+            control_reply(reply, size, "ERR out of memory");
+        } else {
+            // the entry playing now must not repeat before the inserted one, whatever the order
+            ctx->at.cue = i;
+            ctx->at.iter = 1;
+            ctx->at.until = 0;
+            chain_player_playlist_changed(ctx);
+            control_reply(reply, size, "OK %d", ctx->playlist.count);
+        }
+    } else if(strcmp(line, "replace") == 0 && arg != NULL && *arg != '\0') {
+        playlist_clear(&ctx->playlist);
+        if(playlist_append(&ctx->playlist, arg) < 0) {
+            control_reply(reply, size, "ERR out of memory");
+        } else {
+            ctx->at.entry = -1;
+            chain_player_playlist_changed(ctx);
+            control_reply(reply, size, "OK %d", ctx->playlist.count);
+        }
+    } else if(strcmp(line, "clear") == 0) {
+        playlist_clear(&ctx->playlist);
+        ctx->at.entry = -1;
+        chain_player_playlist_changed(ctx);
+        control_reply(reply, size, "OK 0");
+    } else if(strcmp(line, "skip") == 0) {
+        if(ctx->player != NULL) {
+            mmal_player_skip(ctx->player);
+            control_reply(reply, size, "OK");
+        } else {
+            control_reply(reply, size, "ERR idle");
+        }
+    } else if(strcmp(line, "status") == 0) {
+        if(ctx->player != NULL)
+            control_reply(reply, size, "OK playing %d %d %s", ctx->at.entry, ctx->playlist.count, ctx->player->uri);
+        else
+            control_reply(reply, size, "OK idle %d %d", ctx->at.entry, ctx->playlist.count);
+    } else if(strcmp(line, "list") == 0) {
+        control_reply(reply, size, "OK %d", ctx->playlist.count);
+        for(i = 0; i < ctx->playlist.count; i++)
+            control_reply(reply, size, "\n%c%d %s", i == ctx->at.entry ? '*' : ' ', i, playlist_get(&ctx->playlist, i));
+    } else if(strcmp(line, "quit") == 0) {
+        app->quit = 1;
+        vcos_semaphore_post(ctx->sem_event);
+        control_reply(reply, size, "OK");
+    } else {
+        control_reply(reply, size, "ERR unknown command: [@WINDOW] enqueue|next|replace URI, clear, skip, status, list, quit");
+    }
+    vcos_mutex_unlock(&ctx->lock);
+}
+
+struct mmal_player_pipeline* make_player(struct player_context* ctx, const char* uri)
 {
     struct mmal_player_pipeline* player;
     MMAL_STATUS_T status;
 
-    player = mmal_player_create(uri, ctx->rotation, 128);
+    ctx->options.rotation = ctx->rotation;
+    mmal_player_prefetch_opened(ctx->prefetcher, uri);
+    player = mmal_player_pool_get(ctx->pool, uri, &ctx->options);
     if(player == NULL) {
         return NULL;
     }
 
     mmal_player_set_eos_callback(player, chain_player_eos_callback, ctx);
     mmal_player_set_exit_callback(player, chain_player_exit_callback, ctx);
+    if(ctx->monitor_alert > 0)
+        mmal_player_set_analysis_callback(player, chain_player_analysis_callback, ctx);
+    if(ctx->metrics_fd >= 0)
+        mmal_player_set_metrics_output(player, ctx->metrics_fd, METRICS_INTERVAL_MS);
 
     return player;
 }
 
 int usage(int ac, char** av)
 {
-    printf("Usage: %s [-r DEGREE] [-l [TIMES]] [-L] FILES...\n", *av);
+    printf("Usage: %s [-r DEGREE] [-l [TIMES]] [-L] [-Z] [-p] [-m FILE] [-b NUM[:SIZE]] [-A] [-P MB] [-S SOCKET] [-R NUM] [-T NUM] [-Y GROUP [-M]] [-J MS[:FPS]] [-F] [-B BACKGROUND] [-X TRANSITION] [-V FPS[:SECONDS]] [-D FRAMES] [-C GEOMETRY] [[-W GEOMETRY] {-f PLAYLIST | FILES...}]...\n", *av);
     printf("\t-r DEGREE\tRotate DEGREEs clockwise\n");
     printf("\t-l [TIMES]\tRepeat each file by TIMES, -1 indicates infinitely\n");
     printf("\t-L\t\tCycle files\n");
-    printf("\tFILES\t\tAny movie files what mmal_container accepts\n");
+    printf("\t-Z\t\tShuffle files, in a new order every cycle\n");
+    printf("\t-p\t\tPreroll the next file while the current one plays\n");
+    printf("\t-m FILE\t\tAppend pipeline metrics to FILE as JSON lines, once a second\n");
+    printf("\t-b NUM[:SIZE]\tReader buffers and their size in bytes, 0 leaves it to the decoder\n");
+    printf("\t-A\t\tGrow or shrink the reader buffers from clip to clip as the decoder needs\n");
+    printf("\t-P MB\t\tRead the current and the next file ahead into up to MB of page cache\n");
+    printf("\t-S SOCKET\tKeep running and take playlist commands on a UNIX socket, FILES may be empty\n");
+    printf("\t-R NUM\t\tKeep up to NUM finished pipelines for the next files, 0 rebuilds every time (default %d per window)\n", DEFAULT_POOL_CAPACITY);
+    printf("\t-T NUM\t\tRun all pipelines on NUM shared threads, 0 gives each its own (default 0 for one window, 1 for more)\n");
+    printf("\t-Y GROUP\tKeep all windows on one clock and switch clips together, with the windows of\n\t\t\tother players on this host that give the same GROUP; \"-\" for this player only\n");
+    printf("\t-M\t\tMake the first window the one the GROUP follows, implied by -Y -\n");
+    printf("\t-J MS[:FPS]\tHold live streams MS in the jitter buffer; FPS times byte streams (default 100:30)\n");
+    printf("\t-F\t\tFast start: build backgrounds, readers and decoders side by side, backgrounds from a tiny buffer\n");
+    printf("\t-B BACKGROUND\t#RRGGBB from a tiny buffer, FILE.ppm, or screen[:#RRGGBB] from a screen sized one\n\t\t\t(default screen, #000000 with -F)\n");
+    printf("\t-X TRANSITION\tBetween clips: cut, crossfade[:MS] or dip[:MS[:#RRGGBB]] (default 1000 ms, black), implies -p\n");
+    printf("\t-V FPS[:SECONDS]\tCheck FPS decoded frames a second of each window, log black or frozen pictures\n\t\t\tthat last SECONDS (default %d) and a proof-of-play hash per clip\n", DEFAULT_MONITOR_ALERT_S);
+    printf("\t-D FRAMES\tRebuild what stalls for FRAMES frame intervals or fails, then play on; 0 never does (default %d)\n", DEFAULT_WATCHDOG_FRAMES);
+    printf("\t-C WxH+X+Y[,DISPLAY]\n\t\t\tShow a clock above the windows\n");
+    printf("\t-W WxH+X+Y[,LAYER[,DISPLAY]]\n\t\t\tPlay the FILES that follow in a window of their own, up to %d; layers default to %d, %d, ...\n",
+           WINDOWS_MAX, DEFAULT_WINDOW_LAYER, DEFAULT_WINDOW_LAYER + 2);
+    printf("\t-f PLAYLIST\tPlay an M3U or JSON playlist instead of FILES, reloaded as it is written\n"
+           "\t\t\t(loop counts, play times, weights and time of day windows per entry)\n");
+    printf("\tFILES\t\tAny movie files what mmal_container accepts, or live H.264 from\n\t\t\trtp://[ADDRESS]:PORT, udp://[ADDRESS]:PORT, unix:PATH or pipe:PATH\n");
 
     return -1;
 }
 
+// Geometry as in X11, with an optional layer and display number: "640x360+0+360,130,2"
+static int parse_window(struct player_context* window, const char* arg)
+{
+    unsigned int width, height, display = window->options.display_num;
+    int x, y, layer = window->options.layer;
+
+    if(sscanf(arg, "%ux%u+%d+%d,%d,%u", &width, &height, &x, &y, &layer, &display) < 4)
+        return -1;
+
+    window->options.dest_rect.x = x;
+    window->options.dest_rect.y = y;
+    window->options.dest_rect.width = width;
+    window->options.dest_rect.height = height;
+    window->options.layer = layer;
+    window->options.display_num = display;
+
+    return 0;
+}
+
+static struct player_context* open_window(struct chain_player* app)
+{
+    struct player_context* window;
+
+    if(app->window_count == WINDOWS_MAX)
+        return NULL;
+
+    window = &app->windows[app->window_count];
+    window->index = app->window_count++;
+    playlist_init(&window->playlist);
+    playlist_cursor_init(&window->at);
+    playlist_cursor_init(&window->next_at);
+    mmal_player_options_init(&window->options);
+    // preroll renders one layer below, keep that free
+    window->options.layer = DEFAULT_WINDOW_LAYER + 2 * window->index;
+
+    return window;
+}
+
+// Copies what the command line set for all windows, keeping each window's placement
+static void apply_defaults(struct player_context* window, const struct player_context* defaults)
+{
+    MMAL_RECT_T dest_rect = window->options.dest_rect;
+    int layer = window->options.layer;
+    uint32_t display_num = window->options.display_num;
+
+    window->rotation = defaults->rotation;
+    window->loop = defaults->loop;
+    window->loop_overall = defaults->loop_overall;
+    window->shuffle = defaults->shuffle;
+    window->preroll = defaults->preroll;
+    window->metrics_fd = defaults->metrics_fd;
+    window->monitor_alert = defaults->monitor_alert;
+    window->options = defaults->options;
+    window->options.dest_rect = dest_rect;
+    window->options.layer = layer;
+    window->options.display_num = display_num;
+}
+
+// "crossfade:500" or "dip:800:#ffffff"
+static int parse_transition(struct mmal_player_transition_options* options, const char* arg)
+{
+    char* end;
+
+    mmal_player_transition_options_init(options);
+    if(strncmp(arg, "crossfade", 9) == 0) {
+        options->kind = mmal_player_TRANSITION_CROSSFADE;
+        arg += 9;
+    } else if(strncmp(arg, "dip", 3) == 0) {
+        options->kind = mmal_player_TRANSITION_DIP;
+        arg += 3;
+    } else {
+        options->kind = mmal_player_TRANSITION_CUT;
+        return strcmp(arg, "cut") == 0 ? 0 : -1;
+    }
+
+    if(*arg == '\0')
+        return 0;
+    if(*arg != ':')
+        return -1;
+    options->duration_ms = strtoul(arg + 1, &end, 10);
+    if(*end == '\0')
+        return 0;
+    if(options->kind != mmal_player_TRANSITION_DIP || strncmp(end, ":#", 2) != 0 ||
+       strlen(end + 2) != 6 || strspn(end + 2, "0123456789abcdefABCDEF") != 6)
+        return -1;
+    options->colour = strtoul(end + 2, NULL, 16);
+    return 0;
+}
+
+// "640x360+0+360,2" for the clock's place on screen
+static int parse_clock(struct mmal_player_overlay_options* options, const char* arg)
+{
+    unsigned int width, height, display = 0;
+    int x, y;
+
+    if(sscanf(arg, "%ux%u+%d+%d,%u", &width, &height, &x, &y, &display) < 4 || width < CLOCK_CELLS || height < 8)
+        return -1;
+
+    options->dest_rect.x = x;
+    options->dest_rect.y = y;
+    options->dest_rect.width = width;
+    options->dest_rect.height = height;
+    options->display_num = display;
+
+    return 0;
+}
+
+static void fill_rect(uint8_t* canvas, uint32_t stride, uint32_t x, uint32_t y, uint32_t width, uint32_t height, const uint8_t rgba[4])
+{
+    uint32_t i, j;
+
+    for(j = y; j < y + height; j++)
+        for(i = x; i < x + width; i++)
+            memcpy(canvas + j * stride + i * 4, rgba, 4);
+}
+
+// One cell of the clock: a seven segment digit or the colon
+static void draw_clock_cell(uint8_t* canvas, uint32_t stride, uint32_t x, uint32_t width, uint32_t height, char c)
+{
+    // segments a to g as bits 0 to 6: top, top right, bottom right, bottom, bottom left, top left, middle
+    static const uint8_t digits[10] = {0x3f, 0x06, 0x5b, 0x4f, 0x66, 0x6d, 0x7d, 0x07, 0x7f, 0x6f};
+    static const uint8_t back[4] = {0, 0, 0, 160};
+    static const uint8_t fore[4] = {255, 255, 255, 255};
+    uint32_t t = height / 10 > 0 ? height / 10 : 1;
+    uint32_t m = width / 8;
+    uint32_t left = x + m, right = x + width - m, top = m, bottom = height - m, mid = height / 2;
+    uint8_t segments;
+
+    fill_rect(canvas, stride, x, 0, width, height, back);
+    if(c == ':') {
+        fill_rect(canvas, stride, x + (width - t) / 2, height / 3 - t / 2, t, t, fore);
+        fill_rect(canvas, stride, x + (width - t) / 2, 2 * height / 3 - t / 2, t, t, fore);
+        return;
+    }
+    if(c < '0' || c > '9' || right <= left + 2 * t || bottom <= top + 2 * t)
+        return;
+
+    segments = digits[c - '0'];
+    if(segments & 0x01)
+        fill_rect(canvas, stride, left, top, right - left, t, fore);
+    if(segments & 0x02)
+        fill_rect(canvas, stride, right - t, top, t, mid - top, fore);
+    if(segments & 0x04)
+        fill_rect(canvas, stride, right - t, mid, t, bottom - mid, fore);
+    if(segments & 0x08)
+        fill_rect(canvas, stride, left, bottom - t, right - left, t, fore);
+    if(segments & 0x10)
+        fill_rect(canvas, stride, left, mid, t, bottom - mid, fore);
+    if(segments & 0x20)
+        fill_rect(canvas, stride, left, top, t, mid - top, fore);
+    if(segments & 0x40)
+        fill_rect(canvas, stride, left, mid - t / 2, right - left, t, fore);
+}
+
+// Overlay thread: redraws only the cells that changed since the last tick, mostly the seconds
+static void clock_tick(struct mmal_player_overlay* overlay, void* user)
+{
+    struct chain_player* app = user;
+    uint32_t width, height, stride, cell_width;
+    int first = -1, last = -1, i;
+    char now[sizeof(app->clock_shown)];
+    MMAL_RECT_T dirty;
+    struct tm tm;
+    time_t t = time(NULL);
+    uint8_t* canvas;
+
+    localtime_r(&t, &tm);
+    snprintf(now, sizeof(now), "%02d:%02d:%02d", tm.tm_hour, tm.tm_min, tm.tm_sec);
+    for(i = 0; i < CLOCK_CELLS; i++) {
+        if(now[i] == app->clock_shown[i])
+            continue;
+        if(first < 0)
+            first = i;
+        last = i;
+    }
+    if(first < 0)
+        return;
+
+    canvas = mmal_player_overlay_lock(overlay, &width, &height, &stride);
+    cell_width = width / CLOCK_CELLS;
+    for(i = first; i <= last; i++)
+        draw_clock_cell(canvas, stride, i * cell_width, cell_width, height, now[i]);
+    dirty.x = first * cell_width;
+    dirty.y = 0;
+    dirty.width = (last - first + 1) * cell_width;
+    dirty.height = height;
+    mmal_player_overlay_unlock(overlay, &dirty);
+    memcpy(app->clock_shown, now, sizeof(now));
+}
+
+// One black background below the windows of every display in use
+static void start_backgrounds(struct chain_player* app)
+{
+    struct blank_background* bb;
+    uint32_t screen_width, screen_height;
+    int i, j;
+
+    for(i = 0; i < app->window_count; i++) {
+        uint32_t display = app->windows[i].options.display_num;
+
+        for(j = 0; j < app->bb_count && app->bb[j].display != (int)display; j++)
+            ;
+        if(j < app->bb_count)
+            continue;
+
+        graphics_get_display_size(display, &screen_width, &screen_height);
+        bb = &app->bb[app->bb_count++];
+        if(blank_background_start(bb, display, 64, screen_width, screen_height, &app->bb_options) != 0) {
+            fprintf(stderr, "display %u: no background\n", display);
+            continue;
+        }
+        fprintf(stderr, "display %u background: %ux%u %s, %u x %u bytes (%s), up in %llu us",
+                display, bb->width, bb->height, app->bb_options.mode == BLANK_BACKGROUND_SCREEN ? "RGB24" : "I420",
+                bb->buffer_num, bb->buffer_size, bb->released ? "freed once shown" : "kept",
+                (unsigned long long)bb->start_time);
+        if(bb->gpu_free_before >= 0 && bb->gpu_free_after >= 0)
+            fprintf(stderr, ", GPU memory free %d kB before, %d kB after", bb->gpu_free_before, bb->gpu_free_after);
+        fprintf(stderr, "\n");
+    }
+}
+
+static void* start_backgrounds_thread(void* user)
+{
+    struct chain_player* app = user;
+    uint64_t started = vcos_getmicrosecs64();
+
+    start_backgrounds(app);
+    app->startup.backgrounds = vcos_getmicrosecs64() - started;
+
+    return NULL;
+}
+
+// Tap worker: each frame to the analysis of its pipeline, the result back to that pipeline's thread
+static void chain_monitor_callback(const struct mmal_player_tap_frame* frames, uint32_t count, void* user)
+{
+    struct chain_monitor* monitor = user;
+    struct mmal_player_analysis_result result;
+    uint32_t i, j;
+
+    for(i = 0; i < count; i++) {
+        uint32_t slot = 0;
+
+        // the pipeline's own, or the one left longest; a recycled pipeline starts over at its first PTS
+        for(j = 0; j < MONITOR_SLOTS; j++) {
+            if(monitor->slots[j].pipeline == frames[i].pipeline) {
+                slot = j;
+                break;
+            }
+            if(monitor->slots[j].used < monitor->slots[slot].used)
+                slot = j;
+        }
+        monitor->slots[slot].pipeline = frames[i].pipeline;
+        monitor->slots[slot].used = ++monitor->clock;
+
+        if(mmal_player_analysis_frame(monitor->slots[slot].analysis, &frames[i], &result) == MMAL_SUCCESS)
+            mmal_player_post_analysis(frames[i].pipeline, &result);
+    }
+}
+
+static int start_monitor(struct chain_monitor* monitor, uint32_t fps)
+{
+    struct mmal_player_analysis_options analysis_options;
+    struct mmal_player_tap_options tap_options;
+    int i;
+
+    mmal_player_analysis_options_init(&analysis_options);
+    for(i = 0; i < MONITOR_SLOTS; i++) {
+        monitor->slots[i].analysis = mmal_player_analysis_create(&analysis_options);
+        if(monitor->slots[i].analysis == NULL)
+            return -1;
+    }
+
+    mmal_player_tap_options_init(&tap_options);
+    tap_options.max_fps = fps;
+    tap_options.callback = chain_monitor_callback;
+    tap_options.user = monitor;
+    monitor->tap = mmal_player_tap_create(&tap_options);
+    if(monitor->tap == NULL)
+        return -1;
+
+    fprintf(stderr, "monitor: %u frames a second, %s kernels\n", fps, mmal_player_analysis_kernels_name(monitor->slots[0].analysis));
+    return 0;
+}
+
+// After every pipeline that used the tap, parked ones included
+static void stop_monitor(struct chain_monitor* monitor)
+{
+    int i;
+
+    if(monitor->tap != NULL) {
+        struct mmal_player_tap_stats stats;
+
+        mmal_player_tap_get_stats(monitor->tap, &stats);
+        fprintf(stderr, "monitor: %u of %u frames checked (%u over the rate, %u with every buffer out), "
+                "cost avg %llu us, max %llu us per frame\n",
+                stats.tapped, stats.offered, stats.skipped_rate, stats.skipped_busy,
+                (unsigned long long)(stats.cost.count > 0 ? stats.cost.total / stats.cost.count : 0),
+                (unsigned long long)stats.cost.max);
+        mmal_player_tap_destroy(monitor->tap);
+        monitor->tap = NULL;
+    }
+    for(i = 0; i < MONITOR_SLOTS; i++) {
+        mmal_player_analysis_destroy(monitor->slots[i].analysis);
+        monitor->slots[i].analysis = NULL;
+    }
+}
+
+static void stop_transition(struct player_context* window)
+{
+    struct mmal_player_transition_stats stats;
+
+    if(window->transition == NULL)
+        return;
+
+    mmal_player_transition_get_stats(window->transition, &stats);
+    fprintf(stderr, "window %d transitions: %u, %u of them overlapped (%u cut short, %u frames late), "
+            "decoder headroom avg %llu us, least %lld us\n",
+            window->index, stats.transitions, stats.overlapped, stats.cut_short, stats.late_frames,
+            (unsigned long long)(stats.headroom.count > 0 ? stats.headroom.total / stats.headroom.count : 0),
+            (long long)stats.headroom_min);
+    mmal_player_transition_destroy(window->transition);
+    window->transition = NULL;
+}
+
+// Main thread: once window 0 presented its first frame, prints where the time to it went;
+// returns 0 while still waiting
+static int report_startup(struct chain_player* app)
+{
+    struct player_context* ctx = &app->windows[0];
+    struct chain_startup* startup = &app->startup;
+    struct mmal_player_metrics metrics;
+
+    memset(&metrics, 0, sizeof(metrics));
+    vcos_mutex_lock(&ctx->lock);
+    if(ctx->player != NULL)
+        mmal_player_get_metrics(ctx->player, &metrics);
+    vcos_mutex_unlock(&ctx->lock);
+
+    if(metrics.startup.first_frame == 0) {
+        if(vcos_getmicrosecs64() < startup->started + STARTUP_REPORT_TIMEOUT_US)
+            return 0;
+        fprintf(stderr, "startup: no first frame within %d s\n", STARTUP_REPORT_TIMEOUT_US / 1000000);
+        return 1;
+    }
+
+    fprintf(stderr, "startup: first frame %llu us after launch%s: host init %llu, backgrounds %llu%s, "
+            "pipelines %llu (reader %llu, decoder %llu, presentation %llu, connections %llu), "
+            "start to first input %llu, to first frame %llu\n",
+            (unsigned long long)(startup->started - startup->launch + metrics.startup.first_frame),
+            startup->fast ? " (fast start)" : "",
+            (unsigned long long)startup->host_init, (unsigned long long)startup->backgrounds,
+            startup->fast ? " alongside" : "", (unsigned long long)startup->pipelines,
+            (unsigned long long)metrics.startup.reader, (unsigned long long)metrics.startup.decoder,
+            (unsigned long long)metrics.startup.presentation, (unsigned long long)metrics.startup.connections,
+            (unsigned long long)metrics.startup.first_input, (unsigned long long)metrics.startup.first_frame);
+    return 1;
+}
+
 int main(int ac, char **av)
 {
-    struct player_context context;
-    MMAL_STATUS_T status;
+    struct chain_player app;
+    struct player_context defaults;
+    struct player_context* window;
+    size_t prefetch_mb = 0;
+    int pool_capacity = -1;
+    int workers = -1;
+    int window_placed = 0;
+    const char* sync_name = NULL;
+    int sync_master = 0;
+    int files = 0;
+    int running;
+    int bb_threaded = 0;
+    int bb_given = 0;
+    uint32_t monitor_fps = 0;
+    uint32_t monitor_seconds = DEFAULT_MONITOR_ALERT_S;
+    int watchdog_frames = DEFAULT_WATCHDOG_FRAMES;
+    int wait_ms;
+    uint64_t phase;
+    int i;
 
-    memset(&context, 0, sizeof(struct player_context));
+    memset(&app, 0, sizeof(struct chain_player));
+    app.startup.launch = vcos_getmicrosecs64();
+    memset(&defaults, 0, sizeof(struct player_context));
+    defaults.metrics_fd = -1;
+    mmal_player_options_init(&defaults.options);
+    window = open_window(&app);
 
     int opt = -1;
-    while ((opt = getopt_long(ac, av, "r:l::L", long_options, NULL)) != -1) {
+    // a leading '-' hands FILES over in order, so they land in the window opened before them
+    while ((opt = getopt_long(ac, av, "-r:l::LZpm:b:AP:S:R:W:T:Y:MJ:FB:C:X:V:D:f:", long_options, NULL)) != -1) {
         switch (opt) {
+            case 1:
+                if(window->playlist_path != NULL) {
+                    fprintf(stderr, "window %d plays %s, not FILES as well\n", window->index, window->playlist_path);
+                    return usage(ac, av);
+                }
+                playlist_append(&window->playlist, optarg);
+                files++;
+                break;
+            case 'f':
+                if(window->playlist_path != NULL || window->playlist.count > 0) {
+                    fprintf(stderr, "window %d has FILES or a playlist already\n", window->index);
+                    return usage(ac, av);
+                }
+                window->playlist_path = optarg;
+                files++;
+                break;
             case 'r':
-                context.rotation = atoi(optarg);
+                defaults.rotation = atoi(optarg);
                 break;
             case 'l':
                 if (optarg == NULL)
-                    context.loop = -1;
+                    defaults.loop = -1;
                 else
-                    context.loop = atoi(optarg);
+                    defaults.loop = atoi(optarg);
                 break;
             case 'L':
-                context.loop_overall = 1;
+                defaults.loop_overall = 1;
+                break;
+            case 'Z':
+                defaults.shuffle = 1;
+                break;
+            case 'p':
+                defaults.preroll = 1;
+                break;
+            case 'm':
+                defaults.metrics_fd = open(optarg, O_WRONLY | O_CREAT | O_APPEND, 0644);
+                if(defaults.metrics_fd < 0) {
+                    perror(optarg);
+                    return -1;
+                }
+                break;
+            case 'b': {
+                char* size = strchr(optarg, ':');
+
+                defaults.options.reader_buffers.num = strtoul(optarg, NULL, 0);
+                if(size != NULL)
+                    defaults.options.reader_buffers.size = strtoul(size + 1, NULL, 0);
+                break;
+            }
+            case 'A':
+                defaults.options.reader_buffers.adaptive = MMAL_TRUE;
+                break;
+            case 'P':
+                prefetch_mb = strtoul(optarg, NULL, 0);
+                break;
+            case 'S':
+                app.control_path = optarg;
+                break;
+            case 'R':
+                pool_capacity = atoi(optarg);
+                break;
+            case 'W':
+                // the first -W places the full screen window unless it already has files
+                if(window_placed || window->playlist.count > 0 || window->playlist_path != NULL) {
+                    window = open_window(&app);
+                    if(window == NULL) {
+                        fprintf(stderr, "too many windows, at most %d\n", WINDOWS_MAX);
+                        return -1;
+                    }
+                }
+                if(parse_window(window, optarg) != 0) {
+                    fprintf(stderr, "bad window geometry: %s\n", optarg);
+                    return usage(ac, av);
+                }
+                window_placed = 1;
+                break;
+            case 'T':
+                workers = atoi(optarg);
+                break;
+            case 'D':
+                watchdog_frames = atoi(optarg);
+                if(watchdog_frames < 0)
+                    return usage(ac, av);
+                break;
+            case 'Y':
+                sync_name = optarg;
+                break;
+            case 'M':
+                sync_master = 1;
+                break;
+            case 'J': {
+                char* fps = strchr(optarg, ':');
+
+                defaults.options.stream.latency_ms = strtoul(optarg, NULL, 0);
+                if(fps != NULL)
+                    defaults.options.stream.fps = strtoul(fps + 1, NULL, 0);
+                break;
+            }
+            case 'F':
+                app.startup.fast = 1;
+                defaults.options.fast_start = MMAL_TRUE;
+                break;
+            case 'B':
+                if(blank_background_parse(&app.bb_options, optarg) != 0) {
+                    fprintf(stderr, "bad background: %s\n", optarg);
+                    return usage(ac, av);
+                }
+                bb_given = 1;
+                break;
+            case 'X':
+                if(parse_transition(&app.transition_options, optarg) != 0) {
+                    fprintf(stderr, "bad transition: %s\n", optarg);
+                    return usage(ac, av);
+                }
+                // the next clip has to be there ahead of the switch
+                if(app.transition_options.kind != mmal_player_TRANSITION_CUT)
+                    defaults.preroll = 1;
+                break;
+            case 'V': {
+                char* seconds = strchr(optarg, ':');
+
+                monitor_fps = strtoul(optarg, NULL, 0);
+                if(seconds != NULL)
+                    monitor_seconds = strtoul(seconds + 1, NULL, 0);
+                if(monitor_fps == 0 || monitor_seconds == 0)
+                    return usage(ac, av);
+                break;
+            }
+            case 'C':
+                mmal_player_overlay_options_init(&app.clock_options);
+                if(parse_clock(&app.clock_options, optarg) != 0) {
+                    fprintf(stderr, "bad clock geometry: %s\n", optarg);
+                    return usage(ac, av);
+                }
+                app.clock_options.tick = clock_tick;
+                app.clock_options.tick_ms = CLOCK_TICK_MS;
+                app.clock_options.user = &app;
                 break;
             case '?':
             default:
@@ -153,57 +1315,332 @@ int main(int ac, char **av)
         }
     }
 
-    if (optind == ac) {
+    if (files == 0 && app.control_path == NULL) {
         return usage(ac, av);
     }
+    if(app.startup.fast && !bb_given)
+        app.bb_options.mode = BLANK_BACKGROUND_SOLID;
+
+    // a file's own settings win over the command line's
+    for(i = 0; i < app.window_count; i++) {
+        window = &app.windows[i];
+        if(playlist_configure(&window->playlist, defaults.loop, defaults.loop_overall, defaults.shuffle) != 0 ||
+           (window->playlist_path != NULL && playlist_load(&window->playlist, window->playlist_path) != 0)) {
+            fprintf(stderr, "window %d: unable to load its playlist\n", i);
+            return -1;
+        }
+    }
+
+    if(monitor_fps > 0) {
+        // one tap for all windows, as their pipelines come from one pool
+        if(start_monitor(&app.monitor, monitor_fps) != 0) {
+            fprintf(stderr, "unable to start the monitor\n");
+            stop_monitor(&app.monitor);
+            return -1;
+        }
+        defaults.options.tap = app.monitor.tap;
+        defaults.monitor_alert = monitor_fps * monitor_seconds;
+    }
+
+    if(pool_capacity < 0)
+        pool_capacity = DEFAULT_POOL_CAPACITY * app.window_count;
+    defaults.pool = mmal_player_pool_create(pool_capacity);
+    if(defaults.pool == NULL) {
+        fprintf(stderr, "unable to create pipeline pool\n");
+        return -1;
+    }
+
+    if(workers < 0)
+        workers = app.window_count > 1 ? 1 : 0;
+    if(workers > 0) {
+        app.executor = mmal_player_executor_create(workers);
+        if(app.executor == NULL) {
+            fprintf(stderr, "unable to start %d pipeline threads\n", workers);
+            mmal_player_pool_destroy(defaults.pool);
+            return -1;
+        }
+        defaults.options.executor = app.executor;
+    }
 
-    context.ac = ac;
-    context.av = av;
-    context.ai = optind;
+    if(watchdog_frames > 0) {
+        struct mmal_player_watchdog_options options;
+
+        mmal_player_watchdog_options_init(&options);
+        options.stall_frames = watchdog_frames;
+        app.watchdog = mmal_player_watchdog_create(&options);
+        if(app.watchdog == NULL)
+            fprintf(stderr, "unable to start the watchdog, a stalled window stays stalled\n");
+        defaults.options.watchdog = app.watchdog;
+    }
+
+    if(sync_name != NULL) {
+        int local = strcmp(sync_name, "-") == 0;
+
+        app.sync = mmal_player_sync_open(local ? NULL : sync_name);
+        if(app.sync == NULL) {
+            fprintf(stderr, "unable to open sync group %s\n", sync_name);
+            return -1;
+        }
+        sync_master |= local;
+    }
 
+    phase = vcos_getmicrosecs64();
     bcm_host_init();
-    vcos_semaphore_create(&context.sem_event, "chain_player.events", 0);
+    app.startup.host_init = vcos_getmicrosecs64() - phase;
+    vcos_semaphore_create(&app.sem_event, "chain_player.events", 0);
 
-    context.current_iter = context.loop;
+    if(prefetch_mb > 0)
+        defaults.prefetcher = mmal_player_prefetcher_create(prefetch_mb << 20);
 
-    uint32_t screen_width, screen_height;
-    graphics_get_display_size(0 /* LCD */, &screen_width, &screen_height);
+    for(i = 0; i < app.window_count; i++) {
+        window = &app.windows[i];
+        apply_defaults(window, &defaults);
+        window->pool = defaults.pool;
+        window->prefetcher = defaults.prefetcher;
+        window->control_path = app.control_path;
+        window->sem_event = &app.sem_event;
+        vcos_mutex_create(&window->lock, "chain_player.lock");
+        if(app.sync != NULL) {
+            window->options.sync = mmal_player_sync_join(app.sync, i == 0 && sync_master);
+            if(window->options.sync == NULL)
+                fprintf(stderr, "window %d plays unsynced\n", i);
+        }
+
+        if(app.transition_options.kind != mmal_player_TRANSITION_CUT) {
+            struct mmal_player_transition_options options = app.transition_options;
+
+            options.backend = window->options.backend;
+            options.display_num = window->options.display_num;
+            options.layer = window->options.layer;
+            options.dest_rect = window->options.dest_rect;
+            window->transition = mmal_player_transition_create(&options, chain_player_transition_begin,
+                                                               chain_player_transition_end, window);
+            if(window->transition == NULL)
+                fprintf(stderr, "window %d: no transitions, hard cuts\n", i);
+        }
+    }
 
-    blank_background_start(&context.bb, 64, screen_width, screen_height);
+    // the backgrounds sit below every window, nothing waits for them
+    if(app.startup.fast)
+        bb_threaded = vcos_thread_create(&app.bb_thread, "chain_player.backgrounds", NULL, start_backgrounds_thread, &app) == VCOS_SUCCESS;
+    if(!bb_threaded)
+        start_backgrounds_thread(&app);
 
-    context.player = make_player(&context, context.av[context.ai]);
-    if(context.player == NULL) {
+    phase = vcos_getmicrosecs64();
+    running = 0;
+    for(i = 0; i < app.window_count; i++) {
+        chain_player_wake(&app.windows[i]);
+        if(app.windows[i].player != NULL || chain_player_waits(&app.windows[i]))
+            running++;
+        else if(app.control_path == NULL)
+            app.windows[i].finished = 1;
+    }
+    app.startup.started = vcos_getmicrosecs64();
+    app.startup.pipelines = app.startup.started - phase;
+    app.startup.reported = app.windows[0].player == NULL;
+
+    if(bb_threaded) {
+        void* ret = NULL;
+
+        vcos_thread_join(&app.bb_thread, &ret);
+    }
+    // above everything, drawn on a thread of its own
+    if(app.clock_options.tick != NULL) {
+        app.clock_options.backend = defaults.options.backend;
+        app.clock = mmal_player_overlay_create(&app.clock_options);
+        if(app.clock == NULL)
+            fprintf(stderr, "no clock\n");
+    }
+    if(running == 0 && app.control_path == NULL) {
         goto error;
     }
-    mmal_player_start(context.player);
 
-    while(1) {
-        vcos_semaphore_wait(&context.sem_event);
+    if(app.control_path != NULL &&
+       control_socket_start(&app.control, app.control_path, chain_player_control, &app) != 0) {
+        app.control_path = NULL;
+        goto stop;
+    }
 
-        int exit_reason = context.reason;
-        if(exit_reason == mmal_player_TERMINATED)
-            break;
-        if(exit_reason == mmal_player_ERROR) {
-            fprintf(stderr, "exit reason: error\n");
-            break;
+    for(i = 0; i < app.window_count; i++) {
+        window = &app.windows[i];
+        if(window->playlist_path != NULL &&
+           playlist_watch_start(&window->watch, window->playlist_path, chain_player_reload, window) != 0)
+            fprintf(stderr, "window %d: %s is not reloaded when it changes\n", i, window->playlist_path);
+    }
+
+    // the first pass works out how long the next may sleep
+    wait_ms = 0;
+    while(!app.quit) {
+        if(!app.startup.reported) {
+            if(vcos_semaphore_wait_timeout(&app.sem_event, STARTUP_POLL_MS) != VCOS_SUCCESS) {
+                app.startup.reported = report_startup(&app);
+                continue;
+            }
+            app.startup.reported = report_startup(&app);
+        } else if(wait_ms >= 0) {
+            // a play time running out, or a time of day window to look at
+            vcos_semaphore_wait_timeout(&app.sem_event, wait_ms);
+        } else {
+            vcos_semaphore_wait(&app.sem_event);
+        }
+
+        running = 0;
+        wait_ms = -1;
+        for(i = 0; i < app.window_count && !app.quit; i++) {
+            window = &app.windows[i];
+
+            if(window->need_preroll) {
+                window->need_preroll = 0;
+                chain_player_preroll_next(window);
+            }
+
+            int exit_reason = __atomic_exchange_n(&window->reason, mmal_player_UNDEFINED, __ATOMIC_ACQ_REL);
+            if(exit_reason == mmal_player_TERMINATED)
+                app.quit = 1;
+            if(exit_reason == mmal_player_ERROR) {
+                fprintf(stderr, "window %d exit reason: error\n", window->index);
+                app.quit = 1;
+            }
+
+            if(exit_reason == mmal_player_EOS) {
+                fprintf(stderr, "window %d exit reason: EOS received\n", window->index);
+                if(app.control_path == NULL && !chain_player_waits(window))
+                    window->finished = 1;
+                else
+                    chain_player_idle(window);
+            }
+
+            // something may have been enqueued, or a time of day window opened, while idle
+            if(!window->finished && (app.control_path != NULL || chain_player_waits(window)))
+                chain_player_wake(window);
+
+            if(!window->finished) {
+                int window_ms = chain_player_schedule(window);
+
+                if(window_ms >= 0 && (wait_ms < 0 || window_ms < wait_ms))
+                    wait_ms = window_ms;
+                running++;
+            }
         }
 
-        if(exit_reason == mmal_player_EOS) {
-            fprintf(stderr, "exit reason: EOS received\n");
+        if(running == 0)
             break;
+    }
+
+stop:
+    if(app.control_path != NULL)
+        control_socket_stop(&app.control);
+    // a reload touches the players
+    for(i = 0; i < app.window_count; i++)
+        playlist_watch_stop(&app.windows[i].watch);
+
+    // one under way ends at once and hands its outgoing clip back
+    for(i = 0; i < app.window_count; i++)
+        stop_transition(&app.windows[i]);
+
+    for(i = 0; i < app.window_count; i++) {
+        window = &app.windows[i];
+
+        if(window->player != NULL) {
+            mmal_player_stop(window->player);
+            mmal_player_join(window->player);
+        }
+
+        if(window->next_player != NULL) {
+            mmal_player_stop(window->next_player);
+            mmal_player_join(window->next_player);
+            mmal_player_destroy(window->next_player);
+        }
+        if(window->old_player != NULL) {
+            mmal_player_join(window->old_player);
+            mmal_player_destroy(window->old_player);
         }
     }
-    mmal_player_stop(context.player);
-    mmal_player_join(context.player);
 
 error:
-    blank_background_stop(&context.bb);
+    for(i = 0; i < app.window_count; i++)
+        stop_transition(&app.windows[i]);
+
+    if(app.clock != NULL) {
+        struct mmal_player_overlay_stats stats;
+
+        mmal_player_overlay_get_stats(app.clock, &stats);
+        fprintf(stderr, "clock: %u updates, %llu bytes copied, CPU avg %llu us, max %llu us per update\n",
+                stats.updates, (unsigned long long)stats.bytes,
+                (unsigned long long)(stats.copy.count > 0 ? stats.copy.total / stats.copy.count : 0),
+                (unsigned long long)stats.copy.max);
+        mmal_player_overlay_destroy(app.clock);
+    }
+
+    for(i = 0; i < app.bb_count; i++)
+        blank_background_stop(&app.bb[i]);
 
-    vcos_semaphore_delete(&context.sem_event);
+    vcos_semaphore_delete(&app.sem_event);
+
+    for(i = 0; i < app.window_count; i++) {
+        window = &app.windows[i];
+
+        vcos_mutex_delete(&window->lock);
+        mmal_player_destroy(window->player);
+        playlist_deinit(&window->playlist);
+    }
+
+    {
+        struct mmal_player_pool_stats stats;
+
+        mmal_player_pool_get_stats(defaults.pool, &stats);
+        fprintf(stderr, "pipelines: %u created, %u recycled (%u kept their decoder), %u destroyed\n",
+                stats.created, stats.recycled, stats.reused, stats.destroyed);
+        mmal_player_pool_destroy(defaults.pool);
+    }
+    stop_monitor(&app.monitor);
 
-    mmal_player_destroy(context.player);
+    if(app.sync != NULL) {
+        struct mmal_player_sync_stats stats;
+
+        mmal_player_sync_get_stats(app.sync, &stats);
+        fprintf(stderr, "sync: %u clips started by the group\n", stats.generation);
+        for(i = 0; i < app.window_count; i++)
+            mmal_player_sync_leave(app.windows[i].options.sync);
+        mmal_player_sync_close(app.sync);
+    }
+
+    // after every pipeline attached to them, parked ones included
+    if(app.watchdog != NULL) {
+        struct mmal_player_watchdog_stats stats;
+
+        mmal_player_watchdog_get_stats(app.watchdog, &stats);
+        fprintf(stderr, "watchdog: %u stalls, %u errors, %u recovered in avg %llu ms, max %llu ms, %u given up\n",
+                stats.stalls, stats.errors, stats.recovered,
+                (unsigned long long)(stats.recovery.count > 0 ? stats.recovery.total / stats.recovery.count : 0) / 1000,
+                (unsigned long long)stats.recovery.max / 1000, stats.gave_up);
+        mmal_player_watchdog_destroy(app.watchdog);
+    }
+    if(app.executor != NULL) {
+        struct mmal_player_executor_stats stats;
+
+        mmal_player_executor_get_stats(app.executor, &stats);
+        fprintf(stderr, "executor: %d threads for %d windows, %u wakeups, at most %u pipelines waiting\n",
+                stats.workers, app.window_count, stats.steps, stats.queue_max);
+        mmal_player_executor_destroy(app.executor);
+    }
 
     bcm_host_deinit();
 
+    if(defaults.metrics_fd >= 0)
+        close(defaults.metrics_fd);
+
+    if(defaults.prefetcher != NULL) {
+        struct mmal_player_prefetch_stats stats;
+
+        mmal_player_prefetcher_get_stats(defaults.prefetcher, &stats);
+        fprintf(stderr, "prefetch: %u hits, %u misses of %u files, %llu MB read ahead, %llu%% resident at open, lag avg %llu max %llu ms\n",
+                stats.hits, stats.misses, stats.requests, (unsigned long long)(stats.bytes >> 20),
+                (unsigned long long)(stats.opened_bytes > 0 ? stats.resident_bytes * 100 / stats.opened_bytes : 0),
+                (unsigned long long)(stats.lag.count > 0 ? stats.lag.total / stats.lag.count / 1000 : 0),
+                (unsigned long long)(stats.lag.max / 1000));
+        mmal_player_prefetcher_destroy(defaults.prefetcher);
+    }
+
     return 0;
 }
@@ -0,0 +1,113 @@
+#include "mmal-player-analysis.h"
+
+// NEON kernels: always there on aarch64; on 32 bit ARM the file is built with -mfpu=neon (see
+// CMakeLists.txt) for CPUs that may lack it, so nothing here runs before mmal-player-analysis.c
+// asked the kernel
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+#include <arm_neon.h>
+
+// 16 bit lanes take two pixels per 16, 128 times before they could wrap
+#define NEON_BLOCK  (16 * 128)
+
+static uint32_t sum_u32x4(uint32x4_t sums)
+{
+#if defined(__aarch64__)
+    return vaddvq_u32(sums);
+#else
+    uint32x2_t half = vadd_u32(vget_low_u32(sums), vget_high_u32(sums));
+
+    return vget_lane_u32(vpadd_u32(half, half), 0);
+#endif
+}
+
+static uint32_t luma_row_neon(const uint8_t* row, uint32_t width, uint8_t dark, uint32_t* dark_count)
+{
+    const uint8x16_t limit = vdupq_n_u8(dark);
+    uint32x4_t sums = vdupq_n_u32(0), counts = vdupq_n_u32(0);
+    uint32_t sum, count, x = 0;
+
+    while(x + 16 <= width) {
+        uint32_t end = x + NEON_BLOCK < width ? x + NEON_BLOCK : width;
+        uint16x8_t block_sums = vdupq_n_u16(0), block_counts = vdupq_n_u16(0);
+
+        for(; x + 16 <= end; x += 16) {
+            uint8x16_t pixels = vld1q_u8(row + x);
+
+            block_sums = vpadalq_u8(block_sums, pixels);
+            // 0xff where p <= dark, 1 after the shift
+            block_counts = vpadalq_u8(block_counts, vshrq_n_u8(vcleq_u8(pixels, limit), 7));
+        }
+        sums = vpadalq_u16(sums, block_sums);
+        counts = vpadalq_u16(counts, block_counts);
+    }
+    sum = sum_u32x4(sums);
+    count = sum_u32x4(counts);
+    for(; x < width; x++) {
+        sum += row[x];
+        count += row[x] <= dark;
+    }
+    *dark_count += count;
+    return sum;
+}
+
+static uint32_t sad_copy_row_neon(uint8_t* prev, const uint8_t* row, uint32_t width)
+{
+    uint32x4_t sums = vdupq_n_u32(0);
+    uint32_t sum, x = 0;
+
+    while(x + 16 <= width) {
+        uint32_t end = x + NEON_BLOCK < width ? x + NEON_BLOCK : width;
+        uint16x8_t block = vdupq_n_u16(0);
+
+        for(; x + 16 <= end; x += 16) {
+            uint8x16_t pixels = vld1q_u8(row + x);
+
+            block = vpadalq_u8(block, vabdq_u8(pixels, vld1q_u8(prev + x)));
+            vst1q_u8(prev + x, pixels);
+        }
+        sums = vpadalq_u16(sums, block);
+    }
+    sum = sum_u32x4(sums);
+    for(; x < width; x++) {
+        sum += row[x] > prev[x] ? row[x] - prev[x] : prev[x] - row[x];
+        prev[x] = row[x];
+    }
+    return sum;
+}
+
+static void accumulate_row_neon(uint16_t* sums, const uint8_t* row, uint32_t width)
+{
+    uint32_t x = 0;
+
+    for(; x + 16 <= width; x += 16) {
+        uint8x16_t pixels = vld1q_u8(row + x);
+
+        vst1q_u16(sums + x, vaddw_u8(vld1q_u16(sums + x), vget_low_u8(pixels)));
+        vst1q_u16(sums + x + 8, vaddw_u8(vld1q_u16(sums + x + 8), vget_high_u8(pixels)));
+    }
+    for(; x < width; x++)
+        sums[x] += row[x];
+}
+
+static const struct mmal_player_analysis_kernels kernels_neon = {
+    .name = "neon",
+    .luma_row = luma_row_neon,
+    .sad_copy_row = sad_copy_row_neon,
+    .accumulate_row = accumulate_row_neon,
+};
+
+const struct mmal_player_analysis_kernels* mmal_player_analysis_kernels_neon(void)
+{
+    return &kernels_neon;
+}
+
+#else
+
+const struct mmal_player_analysis_kernels* mmal_player_analysis_kernels_neon(void)
+{
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,173 @@
+#include "mmal-player-analysis.h"
+
+#include <string.h>
+
+// SSE2 and AVX2 kernels, built for whatever the compiler targets and picked by what the CPU has
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2")))
+
+SSE2 static uint32_t sum_epi64_sse2(__m128i sums)
+{
+    return (uint32_t)(_mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(sums, sums)));
+}
+
+SSE2 static uint32_t luma_row_sse2(const uint8_t* row, uint32_t width, uint8_t dark, uint32_t* dark_count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i limit = _mm_set1_epi8((char)dark);
+    __m128i sums = zero, counts = zero;
+    uint32_t sum, count = 0, x = 0;
+
+    for(; x + 16 <= width; x += 16) {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(row + x));
+
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(pixels, zero));
+        // min(p, dark) == p where p <= dark: 0xff, summed as 255 per pixel
+        counts = _mm_add_epi64(counts, _mm_sad_epu8(_mm_cmpeq_epi8(_mm_min_epu8(pixels, limit), pixels), zero));
+    }
+    sum = sum_epi64_sse2(sums);
+    count = sum_epi64_sse2(counts) / 255;
+    for(; x < width; x++) {
+        sum += row[x];
+        count += row[x] <= dark;
+    }
+    *dark_count += count;
+    return sum;
+}
+
+SSE2 static uint32_t sad_copy_row_sse2(uint8_t* prev, const uint8_t* row, uint32_t width)
+{
+    __m128i sums = _mm_setzero_si128();
+    uint32_t sum, x = 0;
+
+    for(; x + 16 <= width; x += 16) {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(row + x));
+
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(pixels, _mm_loadu_si128((const __m128i*)(prev + x))));
+        _mm_storeu_si128((__m128i*)(prev + x), pixels);
+    }
+    sum = sum_epi64_sse2(sums);
+    for(; x < width; x++) {
+        sum += row[x] > prev[x] ? row[x] - prev[x] : prev[x] - row[x];
+        prev[x] = row[x];
+    }
+    return sum;
+}
+
+SSE2 static void accumulate_row_sse2(uint16_t* sums, const uint8_t* row, uint32_t width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t x = 0;
+
+    for(; x + 16 <= width; x += 16) {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(row + x));
+        __m128i* low = (__m128i*)(sums + x);
+        __m128i* high = (__m128i*)(sums + x + 8);
+
+        _mm_storeu_si128(low, _mm_add_epi16(_mm_loadu_si128(low), _mm_unpacklo_epi8(pixels, zero)));
+        _mm_storeu_si128(high, _mm_add_epi16(_mm_loadu_si128(high), _mm_unpackhi_epi8(pixels, zero)));
+    }
+    for(; x < width; x++)
+        sums[x] += row[x];
+}
+
+AVX2 static uint32_t sum_epi64_avx2(__m256i sums)
+{
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+
+    return (uint32_t)(_mm_cvtsi128_si32(half) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(half, half)));
+}
+
+AVX2 static uint32_t luma_row_avx2(const uint8_t* row, uint32_t width, uint8_t dark, uint32_t* dark_count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i limit = _mm256_set1_epi8((char)dark);
+    __m256i sums = zero, counts = zero;
+    uint32_t sum, count, x = 0;
+
+    for(; x + 32 <= width; x += 32) {
+        __m256i pixels = _mm256_loadu_si256((const __m256i*)(row + x));
+
+        sums = _mm256_add_epi64(sums, _mm256_sad_epu8(pixels, zero));
+        counts = _mm256_add_epi64(counts, _mm256_sad_epu8(_mm256_cmpeq_epi8(_mm256_min_epu8(pixels, limit), pixels), zero));
+    }
+    sum = sum_epi64_avx2(sums);
+    count = sum_epi64_avx2(counts) / 255;
+    for(; x < width; x++) {
+        sum += row[x];
+        count += row[x] <= dark;
+    }
+    *dark_count += count;
+    return sum;
+}
+
+AVX2 static uint32_t sad_copy_row_avx2(uint8_t* prev, const uint8_t* row, uint32_t width)
+{
+    __m256i sums = _mm256_setzero_si256();
+    uint32_t sum, x = 0;
+
+    for(; x + 32 <= width; x += 32) {
+        __m256i pixels = _mm256_loadu_si256((const __m256i*)(row + x));
+
+        sums = _mm256_add_epi64(sums, _mm256_sad_epu8(pixels, _mm256_loadu_si256((const __m256i*)(prev + x))));
+        _mm256_storeu_si256((__m256i*)(prev + x), pixels);
+    }
+    sum = sum_epi64_avx2(sums);
+    for(; x < width; x++) {
+        sum += row[x] > prev[x] ? row[x] - prev[x] : prev[x] - row[x];
+        prev[x] = row[x];
+    }
+    return sum;
+}
+
+AVX2 static void accumulate_row_avx2(uint16_t* sums, const uint8_t* row, uint32_t width)
+{
+    uint32_t x = 0;
+
+    for(; x + 16 <= width; x += 16) {
+        __m256i* at = (__m256i*)(sums + x);
+
+        _mm256_storeu_si256(at, _mm256_add_epi16(_mm256_loadu_si256(at),
+                                                 _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(row + x)))));
+    }
+    for(; x < width; x++)
+        sums[x] += row[x];
+}
+
+static const struct mmal_player_analysis_kernels kernels_sse2 = {
+    .name = "sse2",
+    .luma_row = luma_row_sse2,
+    .sad_copy_row = sad_copy_row_sse2,
+    .accumulate_row = accumulate_row_sse2,
+};
+
+static const struct mmal_player_analysis_kernels kernels_avx2 = {
+    .name = "avx2",
+    .luma_row = luma_row_avx2,
+    .sad_copy_row = sad_copy_row_avx2,
+    .accumulate_row = accumulate_row_avx2,
+};
+
+const struct mmal_player_analysis_kernels* mmal_player_analysis_kernels_x86(const char* name)
+{
+    __builtin_cpu_init();
+    if((name == NULL || strcmp(name, kernels_avx2.name) == 0) && __builtin_cpu_supports("avx2"))
+        return &kernels_avx2;
+    if((name == NULL || strcmp(name, kernels_sse2.name) == 0) && __builtin_cpu_supports("sse2"))
+        return &kernels_sse2;
+    return NULL;
+}
+
+#else
+
+const struct mmal_player_analysis_kernels* mmal_player_analysis_kernels_x86(const char* name)
+{
+    return NULL;
+}
+
+#endif
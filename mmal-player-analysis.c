@@ -0,0 +1,362 @@
+#include "mmal-player-analysis.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "interface/vcos/vcos.h"
+
+#if defined(__arm__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#define ANALYSIS_DEFAULT_DARK           32
+#define ANALYSIS_DEFAULT_BLACK_PERMILLE 980
+#define ANALYSIS_DEFAULT_FROZEN_MAD     64
+#define ANALYSIS_DEFAULT_HASH_EVERY     25
+
+#define HASH_GRID           32      // thumbnail the DCT runs on
+#define HASH_BITS_SIDE      8       // lowest frequencies kept, 8x8 bits
+#define HASH_ROWS_MAX       256     // rows summed into 16 bit columns before they are folded
+#define HASH_TOLERANCE      1e-9    // of the DC coefficient
+#define COS_PI_64           0.99879545620517239271
+
+/* plain C */
+
+static uint32_t luma_row_scalar(const uint8_t* row, uint32_t width, uint8_t dark, uint32_t* dark_count)
+{
+    uint32_t sum = 0, count = 0, x;
+
+    for(x = 0; x < width; x++) {
+        sum += row[x];
+        count += row[x] <= dark;
+    }
+    *dark_count += count;
+    return sum;
+}
+
+static uint32_t sad_copy_row_scalar(uint8_t* prev, const uint8_t* row, uint32_t width)
+{
+    uint32_t sum = 0, x;
+
+    for(x = 0; x < width; x++) {
+        sum += row[x] > prev[x] ? row[x] - prev[x] : prev[x] - row[x];
+        prev[x] = row[x];
+    }
+    return sum;
+}
+
+static void accumulate_row_scalar(uint16_t* sums, const uint8_t* row, uint32_t width)
+{
+    uint32_t x;
+
+    for(x = 0; x < width; x++)
+        sums[x] += row[x];
+}
+
+static const struct mmal_player_analysis_kernels kernels_scalar = {
+    .name = "scalar",
+    .luma_row = luma_row_scalar,
+    .sad_copy_row = sad_copy_row_scalar,
+    .accumulate_row = accumulate_row_scalar,
+};
+
+// Built for the baseline, unlike mmal-player-analysis-neon.c on 32 bit ARM
+static MMAL_BOOL_T have_neon(void)
+{
+#if defined(__arm__) && defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#else
+    return MMAL_TRUE;
+#endif
+}
+
+const struct mmal_player_analysis_kernels* mmal_player_analysis_kernels(const char* name)
+{
+    const struct mmal_player_analysis_kernels* kernels;
+
+    if(name != NULL && strcmp(name, kernels_scalar.name) == 0)
+        return &kernels_scalar;
+    if(name == NULL || strcmp(name, "neon") == 0) {
+        if((kernels = have_neon() ? mmal_player_analysis_kernels_neon() : NULL) != NULL || name != NULL)
+            return kernels;
+    }
+    if((kernels = mmal_player_analysis_kernels_x86(name)) != NULL || name != NULL)
+        return kernels;
+
+    return &kernels_scalar;
+}
+
+/* planes */
+
+void mmal_player_analysis_luma(const struct mmal_player_analysis_kernels* kernels, const uint8_t* plane, uint32_t stride,
+                               uint32_t width, uint32_t height, uint8_t dark, uint64_t* sum, uint64_t* dark_count)
+{
+    uint32_t y, count;
+
+    *sum = *dark_count = 0;
+    for(y = 0; y < height; y++) {
+        count = 0;
+        *sum += kernels->luma_row(plane + (size_t)y * stride, width, dark, &count);
+        *dark_count += count;
+    }
+}
+
+uint64_t mmal_player_analysis_sad_copy(const struct mmal_player_analysis_kernels* kernels, uint8_t* prev,
+                                       const uint8_t* plane, uint32_t stride, uint32_t width, uint32_t height)
+{
+    uint64_t sad = 0;
+    uint32_t y;
+
+    for(y = 0; y < height; y++)
+        sad += kernels->sad_copy_row(prev + (size_t)y * width, plane + (size_t)y * stride, width);
+    return sad;
+}
+
+// cos(k * pi / 64) for k in [0, 128), without libm
+static void cos_table(double* table)
+{
+    int k;
+
+    table[0] = 1.0;
+    table[1] = COS_PI_64;
+    for(k = 2; k < 4 * HASH_GRID; k++)
+        table[k] = 2.0 * COS_PI_64 * table[k - 1] - table[k - 2];
+}
+
+// The sums of `columns` into the thumbnail row `cells`, one band of columns per cell
+static void fold_columns(const uint16_t* columns, uint32_t width, double* cells)
+{
+    uint32_t i, x;
+
+    for(i = 0; i < HASH_GRID; i++) {
+        uint32_t sum = 0;
+
+        for(x = i * width / HASH_GRID; x < (i + 1) * width / HASH_GRID; x++)
+            sum += columns[x];
+        cells[i] += sum;
+    }
+}
+
+static int compare_double(const void* a, const void* b)
+{
+    double da = *(const double*)a, db = *(const double*)b;
+
+    return da < db ? -1 : da > db;
+}
+
+// pHash: the 32x32 thumbnail's lowest 8x8 DCT frequencies, one bit each for being above their median
+uint64_t mmal_player_analysis_phash(const struct mmal_player_analysis_kernels* kernels, const uint8_t* plane, uint32_t stride,
+                                    uint32_t width, uint32_t height)
+{
+    double grid[HASH_GRID][HASH_GRID], rows[HASH_GRID][HASH_BITS_SIDE];
+    double coeffs[HASH_BITS_SIDE * HASH_BITS_SIDE], sorted[HASH_BITS_SIDE * HASH_BITS_SIDE];
+    double cosines[4 * HASH_GRID], median;
+    uint16_t* columns;
+    uint64_t hash = 0;
+    uint32_t band, y, rows_summed, x, u, v;
+
+    if(width < HASH_GRID || height < HASH_GRID)
+        return 0;
+    columns = malloc(width * sizeof(uint16_t));
+    if(columns == NULL)
+        return 0;
+
+    memset(grid, 0, sizeof(grid));
+    for(band = 0; band < HASH_GRID; band++) {
+        uint32_t y0 = band * height / HASH_GRID, y1 = (band + 1) * height / HASH_GRID;
+
+        memset(columns, 0, width * sizeof(uint16_t));
+        for(y = y0, rows_summed = 0; y < y1; y++) {
+            kernels->accumulate_row(columns, plane + (size_t)y * stride, width);
+            if(++rows_summed == HASH_ROWS_MAX) {
+                fold_columns(columns, width, grid[band]);
+                memset(columns, 0, width * sizeof(uint16_t));
+                rows_summed = 0;
+            }
+        }
+        fold_columns(columns, width, grid[band]);
+        // bands differ by a sample at most, the DCT does not mind
+        for(x = 0; x < HASH_GRID; x++)
+            grid[band][x] /= (double)(y1 - y0) * (((x + 1) * width / HASH_GRID) - (x * width / HASH_GRID));
+    }
+    free(columns);
+
+    // separable DCT-II, only the frequencies kept: C(u, x) = cos((2x + 1) u pi / 64)
+    cos_table(cosines);
+    for(y = 0; y < HASH_GRID; y++) {
+        for(u = 0; u < HASH_BITS_SIDE; u++) {
+            rows[y][u] = 0;
+            for(x = 0; x < HASH_GRID; x++)
+                rows[y][u] += grid[y][x] * cosines[((2 * x + 1) * u) % (4 * HASH_GRID)];
+        }
+    }
+    for(v = 0; v < HASH_BITS_SIDE; v++) {
+        for(u = 0; u < HASH_BITS_SIDE; u++) {
+            double sum = 0;
+
+            for(y = 0; y < HASH_GRID; y++)
+                sum += rows[y][u] * cosines[((2 * y + 1) * v) % (4 * HASH_GRID)];
+            coeffs[v * HASH_BITS_SIDE + u] = sum;
+        }
+    }
+
+    memcpy(sorted, coeffs, sizeof(sorted));
+    qsort(sorted, HASH_BITS_SIDE * HASH_BITS_SIDE, sizeof(double), compare_double);
+    median = (sorted[HASH_BITS_SIDE * HASH_BITS_SIDE / 2 - 1] + sorted[HASH_BITS_SIDE * HASH_BITS_SIDE / 2]) / 2;
+    // rounding noise, as all there is on a flat picture, sets no bits: the same hash on any FPU
+    median += coeffs[0] * HASH_TOLERANCE + HASH_TOLERANCE;
+    for(u = 0; u < HASH_BITS_SIDE * HASH_BITS_SIDE; u++)
+        if(coeffs[u] > median)
+            hash |= 1ull << u;
+
+    return hash;
+}
+
+/* frames */
+
+struct mmal_player_analysis
+{
+    struct mmal_player_analysis_options options;
+    const struct mmal_player_analysis_kernels* kernels;
+
+    uint8_t* prev;              // luma of the frame analysed last, packed
+    uint32_t prev_width, prev_height;
+    MMAL_BOOL_T have_prev;
+    struct mmal_player_pipeline* pipeline;  // ... and where it came from
+    int64_t last_pts;
+
+    uint32_t black_run;
+    uint32_t frozen_run;
+    uint32_t since_hash;
+};
+
+void mmal_player_analysis_options_init(struct mmal_player_analysis_options* options)
+{
+    memset(options, 0, sizeof(struct mmal_player_analysis_options));
+}
+
+struct mmal_player_analysis* mmal_player_analysis_create(const struct mmal_player_analysis_options* options)
+{
+    struct mmal_player_analysis* analysis;
+
+    analysis = calloc(1, sizeof(struct mmal_player_analysis));
+    if(analysis == NULL)
+        return NULL;
+
+    analysis->options = *options;
+    analysis->last_pts = MMAL_TIME_UNKNOWN;
+    analysis->kernels = mmal_player_analysis_kernels(options->kernels);
+    if(analysis->kernels == NULL) {
+        fprintf(stderr, "analysis: no %s kernels on this CPU\n", options->kernels);
+        free(analysis);
+        return NULL;
+    }
+    if(analysis->options.dark == 0)
+        analysis->options.dark = ANALYSIS_DEFAULT_DARK;
+    if(analysis->options.black_permille == 0)
+        analysis->options.black_permille = ANALYSIS_DEFAULT_BLACK_PERMILLE;
+    if(analysis->options.frozen_mad == 0)
+        analysis->options.frozen_mad = ANALYSIS_DEFAULT_FROZEN_MAD;
+    if(analysis->options.hash_every == 0)
+        analysis->options.hash_every = ANALYSIS_DEFAULT_HASH_EVERY;
+
+    return analysis;
+}
+
+void mmal_player_analysis_destroy(struct mmal_player_analysis* analysis)
+{
+    if(analysis == NULL)
+        return;
+
+    free(analysis->prev);
+    free(analysis);
+}
+
+const char* mmal_player_analysis_kernels_name(struct mmal_player_analysis* analysis)
+{
+    return analysis->kernels->name;
+}
+
+MMAL_STATUS_T mmal_player_analysis_frame(struct mmal_player_analysis* analysis, const struct mmal_player_tap_frame* frame,
+                                         struct mmal_player_analysis_result* result)
+{
+    const uint8_t* plane;
+    uint32_t width = frame->crop.width > 0 ? frame->crop.width : frame->width;
+    uint32_t height = frame->crop.height > 0 ? frame->crop.height : frame->height;
+    uint64_t sum, dark, sad, pixels;
+    uint64_t started = vcos_getmicrosecs64();
+
+    // the luma plane comes first in all of them
+    if(frame->encoding != MMAL_ENCODING_I420 && frame->encoding != MMAL_ENCODING_YV12 && frame->encoding != MMAL_ENCODING_NV12)
+        return MMAL_ENOSYS;
+    if(width == 0 || height == 0 || frame->crop.x + width > frame->width ||
+       (uint64_t)frame->width * (frame->crop.y + height) > frame->length)
+        return MMAL_EINVAL;
+    plane = frame->data + (size_t)frame->crop.y * frame->width + frame->crop.x;
+    pixels = (uint64_t)width * height;
+
+    // a clip that started over, or another one: nothing to compare with
+    if(frame->pipeline != analysis->pipeline ||
+       (frame->pts != MMAL_TIME_UNKNOWN && analysis->last_pts != MMAL_TIME_UNKNOWN && frame->pts < analysis->last_pts)) {
+        analysis->have_prev = MMAL_FALSE;
+        analysis->black_run = analysis->frozen_run = 0;
+        analysis->since_hash = analysis->options.hash_every - 1;
+    }
+    analysis->pipeline = frame->pipeline;
+    analysis->last_pts = frame->pts;
+    if(width != analysis->prev_width || height != analysis->prev_height) {
+        free(analysis->prev);
+        analysis->prev = malloc(pixels);
+        if(analysis->prev == NULL) {
+            analysis->prev_width = analysis->prev_height = 0;
+            return MMAL_ENOMEM;
+        }
+        analysis->prev_width = width;
+        analysis->prev_height = height;
+        analysis->have_prev = MMAL_FALSE;
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->pipeline = frame->pipeline;
+    result->pts = frame->pts;
+
+    mmal_player_analysis_luma(analysis->kernels, plane, frame->width, width, height, analysis->options.dark, &sum, &dark);
+    result->mean = (uint32_t)(sum / pixels);
+    result->dark_permille = (uint32_t)(dark * 1000 / pixels);
+    result->black = result->dark_permille >= analysis->options.black_permille;
+
+    sad = mmal_player_analysis_sad_copy(analysis->kernels, analysis->prev, plane, frame->width, width, height);
+    result->mad = analysis->have_prev ? (uint32_t)(sad * 256 / pixels) : UINT32_MAX;
+    // black stays black, which is not what frozen is about
+    result->frozen = analysis->have_prev && !result->black && result->mad < analysis->options.frozen_mad;
+    analysis->have_prev = MMAL_TRUE;
+
+    analysis->black_run = result->black ? analysis->black_run + 1 : 0;
+    analysis->frozen_run = result->frozen ? analysis->frozen_run + 1 : 0;
+    result->black_run = analysis->black_run;
+    result->frozen_run = analysis->frozen_run;
+
+    if(++analysis->since_hash >= analysis->options.hash_every) {
+        result->hash = mmal_player_analysis_phash(analysis->kernels, plane, frame->width, width, height);
+        result->hashed = MMAL_TRUE;
+        analysis->since_hash = 0;
+    }
+
+    result->cost_us = (uint32_t)(vcos_getmicrosecs64() - started);
+    return MMAL_SUCCESS;
+}
+
+void mmal_player_analysis_summary_add(struct mmal_player_analysis_summary* summary, const struct mmal_player_analysis_result* result)
+{
+    summary->frames++;
+    summary->black += result->black;
+    summary->frozen += result->frozen;
+    if(result->hashed) {
+        summary->hashes++;
+        summary->hash = result->hash;
+    }
+    summary->black_run_max = vcos_max(summary->black_run_max, result->black_run);
+    summary->frozen_run_max = vcos_max(summary->frozen_run_max, result->frozen_run);
+}
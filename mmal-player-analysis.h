@@ -0,0 +1,96 @@
+#ifndef MMAL_CHAIN_PLAYER_MMAL_PLAYER_ANALYSIS_H
+#define MMAL_CHAIN_PLAYER_MMAL_PLAYER_ANALYSIS_H
+
+#include <stdint.h>
+
+#include "interface/mmal/mmal.h"
+
+#include "mmal-player-tap.h"
+
+// Monitoring of tapped frames (see mmal-player-tap.h) on their luma plane: black frames, frozen
+// frames by the difference to the frame analysed before, and a 64 bit perceptual hash (DCT of a
+// 32x32 thumbnail) every so many frames as proof of play. The work is done a row at a time by
+// kernels for NEON, SSE2 or AVX2, whichever the CPU has, with plain C behind them.
+
+// One row of `width` 8 bit samples per call
+struct mmal_player_analysis_kernels
+{
+    const char* name;
+    // returns the sum of the samples, adds those at or below `dark` to dark_count
+    uint32_t (*luma_row)(const uint8_t* row, uint32_t width, uint8_t dark, uint32_t* dark_count);
+    // returns the sum of absolute differences, and leaves `row` in `prev`
+    uint32_t (*sad_copy_row)(uint8_t* prev, const uint8_t* row, uint32_t width);
+    // adds every sample to its column's sum
+    void (*accumulate_row)(uint16_t* sums, const uint8_t* row, uint32_t width);
+};
+
+// "scalar", "sse2", "avx2" or "neon"; NULL for the best this CPU runs. NULL when not available.
+const struct mmal_player_analysis_kernels* mmal_player_analysis_kernels(const char* name);
+
+// Whole planes, `stride` bytes apart
+void mmal_player_analysis_luma(const struct mmal_player_analysis_kernels* kernels, const uint8_t* plane, uint32_t stride,
+                               uint32_t width, uint32_t height, uint8_t dark, uint64_t* sum, uint64_t* dark_count);
+// `prev` is width x height, packed
+uint64_t mmal_player_analysis_sad_copy(const struct mmal_player_analysis_kernels* kernels, uint8_t* prev,
+                                       const uint8_t* plane, uint32_t stride, uint32_t width, uint32_t height);
+uint64_t mmal_player_analysis_phash(const struct mmal_player_analysis_kernels* kernels, const uint8_t* plane, uint32_t stride,
+                                    uint32_t width, uint32_t height);
+
+// Used by mmal-player-analysis.c, NULL where they are not built or the CPU lacks them; the NEON
+// one does not ask the CPU, that is left to the caller
+const struct mmal_player_analysis_kernels* mmal_player_analysis_kernels_x86(const char* name);
+const struct mmal_player_analysis_kernels* mmal_player_analysis_kernels_neon(void);
+
+// 0 takes the default
+struct mmal_player_analysis_options
+{
+    const char* kernels;        // NULL: the best there is
+    uint8_t dark;               // luma of a black pixel at most, default 32 (video black is 16)
+    uint32_t black_permille;    // ... of the picture for a black frame, default 980
+    uint32_t frozen_mad;        // mean absolute difference below which a frame is frozen, 1/256 steps, default 64
+    uint32_t hash_every;        // frames between hashes, default 25; first frame of a clip always
+};
+
+struct mmal_player_analysis_result
+{
+    struct mmal_player_pipeline* pipeline;
+    int64_t pts;
+    uint32_t mean;              // luma
+    uint32_t dark_permille;
+    uint32_t mad;               // mean absolute difference to the frame before, 1/256 steps; UINT32_MAX for none
+    MMAL_BOOL_T black;
+    MMAL_BOOL_T frozen;
+    uint32_t black_run;         // frames analysed in a row that were black, this one included, 0 when not
+    uint32_t frozen_run;
+    MMAL_BOOL_T hashed;
+    uint64_t hash;
+    uint32_t cost_us;           // time the kernels took on this frame
+};
+
+// Per clip, kept by the pipeline from mmal_player_post_analysis() for its EOS callback
+struct mmal_player_analysis_summary
+{
+    uint32_t frames;
+    uint32_t black;
+    uint32_t frozen;
+    uint32_t hashes;
+    uint64_t hash;              // the last one
+    uint32_t black_run_max;
+    uint32_t frozen_run_max;
+};
+
+struct mmal_player_analysis;
+
+void mmal_player_analysis_options_init(struct mmal_player_analysis_options* options);
+struct mmal_player_analysis* mmal_player_analysis_create(const struct mmal_player_analysis_options* options);
+void mmal_player_analysis_destroy(struct mmal_player_analysis* analysis);
+
+// One I420 frame at a time, e.g. from a tap callback with a single worker; comparisons start over
+// when the frame comes from another pipeline or from before the last one
+MMAL_STATUS_T mmal_player_analysis_frame(struct mmal_player_analysis* analysis, const struct mmal_player_tap_frame* frame,
+                                         struct mmal_player_analysis_result* result);
+const char* mmal_player_analysis_kernels_name(struct mmal_player_analysis* analysis);
+
+void mmal_player_analysis_summary_add(struct mmal_player_analysis_summary* summary, const struct mmal_player_analysis_result* result);
+
+#endif //MMAL_CHAIN_PLAYER_MMAL_PLAYER_ANALYSIS_H
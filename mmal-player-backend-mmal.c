@@ -0,0 +1,76 @@
+#include "mmal-player-backend.h"
+
+#include <string.h>
+
+#include "interface/mmal/util/mmal_util_params.h"
+#include "interface/mmal/util/mmal_default_components.h"
+
+static const char* component_names[mmal_player_ROLE_MAX] = {
+    MMAL_COMPONENT_DEFAULT_CONTAINER_READER,
+    MMAL_COMPONENT_DEFAULT_VIDEO_DECODER,
+    MMAL_COMPONENT_DEFAULT_SCHEDULER,
+    MMAL_COMPONENT_DEFAULT_VIDEO_RENDERER,
+};
+
+static MMAL_STATUS_T backend_component_create(enum mmal_player_role role, MMAL_COMPONENT_T** component)
+{
+    if(role < 0 || role >= mmal_player_ROLE_MAX)
+        return MMAL_EINVAL;
+
+    return mmal_component_create(component_names[role], component);
+}
+
+static MMAL_STATUS_T backend_set_uri(MMAL_COMPONENT_T* reader, const char* uri)
+{
+    return mmal_util_port_set_uri(reader->control, uri);
+}
+
+// mmal_connection_create() starts out with an empty pool and mmal_connection_enable() only resizes
+// whatever pool is there, so a pipeline-owned one can take its place until the connection goes away.
+static MMAL_STATUS_T backend_connection_set_pool(MMAL_CONNECTION_T* connection, MMAL_POOL_T* pool)
+{
+    if(connection->is_enabled || (connection->flags & MMAL_CONNECTION_FLAG_TUNNELLING))
+        return MMAL_EINVAL;
+
+    if(pool != NULL && connection->pool != NULL)
+        mmal_pool_destroy(connection->pool);
+    connection->pool = pool;
+
+    return MMAL_SUCCESS;
+}
+
+const struct mmal_player_backend mmal_player_backend_mmal = {
+    .name = "mmal",
+    .tunnelling = MMAL_CONNECTION_FLAG_TUNNELLING,
+
+    .component_create = backend_component_create,
+    .component_enable = mmal_component_enable,
+    .component_disable = mmal_component_disable,
+    .component_destroy = mmal_component_destroy,
+
+    .port_enable = mmal_port_enable,
+    .port_disable = mmal_port_disable,
+    .port_flush = mmal_port_flush,
+    .format_commit = mmal_port_format_commit,
+    .parameter_set = mmal_port_parameter_set,
+    .parameter_get = mmal_port_parameter_get,
+    .set_uri = backend_set_uri,
+    .send_buffer = mmal_port_send_buffer,
+    .port_pool_create = mmal_port_pool_create,
+    .port_pool_destroy = mmal_port_pool_destroy,
+
+    .connection_create = mmal_connection_create,
+    .connection_enable = mmal_connection_enable,
+    .connection_disable = mmal_connection_disable,
+    .connection_destroy = mmal_connection_destroy,
+    .connection_set_pool = backend_connection_set_pool,
+};
+
+const struct mmal_player_backend* mmal_player_backend_by_name(const char* name)
+{
+    if(name == NULL || strcmp(name, mmal_player_backend_mmal.name) == 0)
+        return &mmal_player_backend_mmal;
+    if(strcmp(name, mmal_player_backend_soft.name) == 0)
+        return &mmal_player_backend_soft;
+    return NULL;
+}
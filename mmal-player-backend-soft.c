@@ -0,0 +1,1009 @@
+#include "mmal-player-backend.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "interface/mmal/util/mmal_util_params.h"
+
+// Software stand-ins for the four pipeline components. Ports and connections are plain structs
+// owned by this file; buffers, pools and queues are the real libmmal_core ones, so the pipeline
+// sees the same callback and release semantics as on VideoCore, just without tunnelling.
+
+#define SOFT_PORT_CONTROL   0
+#define SOFT_PORT_INPUT     1
+#define SOFT_PORT_OUTPUT    2
+#define SOFT_PORT_CLOCK     3
+#define SOFT_PORT_MAX       4
+
+#define SOFT_ENCODED_BUFFER_NUM     8
+#define SOFT_ENCODED_BUFFER_SIZE    (64 * 1024)
+#define SOFT_ENCODED_BUFFER_MIN     4096    // a synthetic access unit
+#define SOFT_FRAME_BUFFER_NUM       3
+
+#define SOFT_DEFAULT_WIDTH      1920
+#define SOFT_DEFAULT_HEIGHT     1080
+#define SOFT_DEFAULT_FPS        30
+#define SOFT_DEFAULT_FRAMES     300
+#define SOFT_KEYFRAME_INTERVAL  30
+
+struct soft_component;
+
+struct soft_port
+{
+    MMAL_PORT_T port;               // first, MMAL_PORT_T* converts back to soft_port*
+    struct soft_component* owner;
+    MMAL_PORT_BH_CB_T callback;
+    MMAL_QUEUE_T* queue;            // buffers sent to the port, not yet returned
+};
+
+struct soft_component
+{
+    MMAL_COMPONENT_T component;     // first, see above
+    enum mmal_player_role role;
+
+    struct soft_port ports[SOFT_PORT_MAX];
+    MMAL_PORT_T* input_list[1];
+    MMAL_PORT_T* output_list[1];
+    MMAL_PORT_T* clock_list[1];
+
+    VCOS_MUTEX_T lock;              // held while the worker moves buffers
+    VCOS_SEMAPHORE_T wake;
+    VCOS_THREAD_T thread;
+    MMAL_BOOL_T running;
+
+    MMAL_POOL_T* events;            // control port events
+
+    // mmal_player_soft_fault()
+    enum mmal_player_soft_fault fault;
+    uint32_t moved;                 // buffers its ports handed back
+    uint32_t fault_at;              // ... when the fault goes off
+    MMAL_BOOL_T failed;             // nothing moves any more
+
+    // container reader
+    uint32_t frames;
+    uint32_t next_frame;
+    MMAL_RATIONAL_T frame_rate;
+
+    // decoder
+    int64_t frame_pts;              // first piece of a frame split over buffers
+    uint32_t frame_flags;
+    MMAL_BOOL_T pictures;           // zero copy output: someone looks at the frames, paint them
+
+    // scheduler
+    MMAL_BOOL_T clock_active;
+    MMAL_BOOL_T clock_valid;
+    MMAL_RATIONAL_T clock_scale;
+    int32_t clock_skew;             // ppm the modelled crystal is off by
+    int64_t media_base;             // media time at wall_base
+    uint64_t wall_base;
+
+    // renderer
+    struct mmal_player_soft_stats stats;
+    MMAL_BOOL_T after_eos;
+};
+
+struct soft_connection
+{
+    MMAL_CONNECTION_T connection;   // first, see above
+    MMAL_BOOL_T external_pool;      // connection->pool belongs to the caller
+};
+
+static const char* role_names[mmal_player_ROLE_MAX] = {
+    "soft.container_reader",
+    "soft.video_decode",
+    "soft.scheduler",
+    "soft.null_render",
+};
+
+// Armed by mmal_player_soft_fault(), taken by the next component of the role that runs
+static uint32_t armed_fault[mmal_player_ROLE_MAX];
+static uint32_t armed_after[mmal_player_ROLE_MAX];
+
+static inline struct soft_port* soft_port(MMAL_PORT_T* port)
+{
+    return (struct soft_port*)port;
+}
+
+static inline struct soft_component* soft_component(MMAL_COMPONENT_T* component)
+{
+    return (struct soft_component*)component;
+}
+
+static int64_t frame_pts(struct soft_component* c, uint32_t frame)
+{
+    return (int64_t)frame * 1000000 * c->frame_rate.den / c->frame_rate.num;
+}
+
+/* scheduler clock */
+
+static int64_t clock_now(struct soft_component* c)
+{
+    int64_t elapsed;
+
+    if(!c->clock_active)
+        return c->media_base;
+
+    elapsed = (int64_t)(vcos_getmicrosecs64() - c->wall_base);
+    elapsed += elapsed * c->clock_skew / 1000000;
+    return c->media_base + elapsed * c->clock_scale.num / c->clock_scale.den;
+}
+
+static void clock_rebase(struct soft_component* c, int64_t media_time)
+{
+    c->media_base = media_time;
+    c->wall_base = vcos_getmicrosecs64();
+    c->clock_valid = MMAL_TRUE;
+}
+
+/* buffer movement, called by the worker with c->lock held */
+
+static void send_event(struct soft_component* c, uint32_t cmd, MMAL_STATUS_T status)
+{
+    struct soft_port* control = &c->ports[SOFT_PORT_CONTROL];
+    MMAL_BUFFER_HEADER_T* event;
+
+    if(!control->port.is_enabled || control->callback == NULL)
+        return;
+    if((event = mmal_queue_get(c->events->queue)) == NULL)
+        return;
+
+    event->cmd = cmd;
+    event->length = 0;
+    if(cmd == MMAL_EVENT_ERROR) {
+        *(MMAL_STATUS_T*)event->data = status;
+        event->length = sizeof(status);
+    }
+    control->callback(&control->port, event);
+}
+
+static void return_buffer(struct soft_port* port, MMAL_BUFFER_HEADER_T* buffer)
+{
+    port->owner->moved++;
+    if(port->callback != NULL)
+        port->callback(&port->port, buffer);
+    else
+        mmal_buffer_header_release(buffer);
+}
+
+// move one payload from an input buffer into an output buffer
+static void pass_through(MMAL_BUFFER_HEADER_T* in, MMAL_BUFFER_HEADER_T* out)
+{
+    uint32_t length = vcos_min(in->length, out->alloc_size);
+
+    if(length > 0)
+        memcpy(out->data, in->data + in->offset, length);
+    out->offset = 0;
+    out->length = length;
+    out->pts = in->pts;
+    out->dts = in->dts;
+    out->flags = in->flags;
+
+    in->length = 0;
+}
+
+static uint32_t process_reader(struct soft_component* c)
+{
+    struct soft_port* output = &c->ports[SOFT_PORT_OUTPUT];
+    MMAL_BUFFER_HEADER_T* buffer;
+
+    if(c->next_frame >= c->frames)
+        return 0;
+
+    while(c->next_frame < c->frames && (buffer = mmal_queue_get(output->queue)) != NULL) {
+        // a frame-sized stand-in: only the frame number is meaningful
+        buffer->offset = 0;
+        buffer->length = vcos_min(buffer->alloc_size, 4096);
+        memset(buffer->data, 0, buffer->length);
+        memcpy(buffer->data, &c->next_frame, sizeof(c->next_frame));
+
+        buffer->pts = buffer->dts = frame_pts(c, c->next_frame);
+        buffer->flags = MMAL_BUFFER_HEADER_FLAG_FRAME_END;
+        if(c->next_frame % SOFT_KEYFRAME_INTERVAL == 0)
+            buffer->flags |= MMAL_BUFFER_HEADER_FLAG_KEYFRAME;
+        if(++c->next_frame == c->frames)
+            buffer->flags |= MMAL_BUFFER_HEADER_FLAG_EOS;
+
+        return_buffer(output, buffer);
+    }
+    return 0;
+}
+
+// An I420 picture of the coded size that moves from frame to frame: luma bands scrolling down
+// with the frame number the reader wrote into the payload, grey chroma
+static void paint_picture(struct soft_component* c, MMAL_BUFFER_HEADER_T* out)
+{
+    MMAL_VIDEO_FORMAT_T* video = &c->ports[SOFT_PORT_OUTPUT].port.format->es->video;
+    uint32_t luma = video->width * video->height;
+    uint32_t frame = 0, y;
+
+    if(out->length == 0 || luma == 0 || luma * 3 / 2 > out->alloc_size)
+        return;
+    if(out->length >= sizeof(frame))
+        memcpy(&frame, out->data, sizeof(frame));
+
+    for(y = 0; y < video->height; y++)
+        memset(out->data + y * video->width, (y + frame * 4) & 0xff, video->width);
+    memset(out->data + luma, 0x80, luma / 2);
+    out->length = luma * 3 / 2;
+}
+
+static uint32_t process_decoder(struct soft_component* c)
+{
+    struct soft_port* input = &c->ports[SOFT_PORT_INPUT];
+    struct soft_port* output = &c->ports[SOFT_PORT_OUTPUT];
+    MMAL_BUFFER_HEADER_T *in, *out;
+
+    while(mmal_queue_length(input->queue) > 0 && mmal_queue_length(output->queue) > 0) {
+        in = mmal_queue_get(input->queue);
+
+        // a frame split over several buffers is decoded once its last one is in
+        if(!(in->flags & (MMAL_BUFFER_HEADER_FLAG_FRAME_END | MMAL_BUFFER_HEADER_FLAG_EOS))) {
+            if(c->frame_pts == MMAL_TIME_UNKNOWN)
+                c->frame_pts = in->pts;
+            c->frame_flags |= in->flags;
+            return_buffer(input, in);
+            continue;
+        }
+        out = mmal_queue_get(output->queue);
+
+        pass_through(in, out);
+        if(c->frame_pts != MMAL_TIME_UNKNOWN)
+            out->pts = out->dts = c->frame_pts;
+        out->flags |= c->frame_flags;
+        out->flags &= ~MMAL_BUFFER_HEADER_FLAG_CONFIG;
+        if(c->pictures)
+            paint_picture(c, out);
+        c->frame_pts = MMAL_TIME_UNKNOWN;
+        c->frame_flags = 0;
+
+        return_buffer(input, in);
+        return_buffer(output, out);
+    }
+    return 0;
+}
+
+// returns how long the worker may sleep before the head frame becomes due, 0 to wait for input
+static uint32_t process_scheduler(struct soft_component* c)
+{
+    struct soft_port* input = &c->ports[SOFT_PORT_INPUT];
+    struct soft_port* output = &c->ports[SOFT_PORT_OUTPUT];
+    MMAL_BUFFER_HEADER_T *in, *out;
+
+    while(mmal_queue_length(output->queue) > 0 && (in = mmal_queue_get(input->queue)) != NULL) {
+        if(in->pts != MMAL_TIME_UNKNOWN) {
+            if(!c->clock_valid || (in->flags & MMAL_BUFFER_HEADER_FLAG_DISCONTINUITY))
+                clock_rebase(c, in->pts);
+
+            if(!c->clock_active) {
+                mmal_queue_put_back(input->queue, in);
+                return 0;
+            }
+
+            int64_t wait = in->pts - clock_now(c);
+            if(wait > 0) {
+                mmal_queue_put_back(input->queue, in);
+                // media time, the worker sleeps in wall clock time
+                wait = wait * c->clock_scale.den / c->clock_scale.num;
+                return (uint32_t)vcos_max(wait / 1000, 1);
+            }
+        }
+
+        out = mmal_queue_get(output->queue);
+        pass_through(in, out);
+
+        return_buffer(input, in);
+        return_buffer(output, out);
+    }
+    return 0;
+}
+
+static uint32_t process_renderer(struct soft_component* c)
+{
+    struct soft_port* input = &c->ports[SOFT_PORT_INPUT];
+    MMAL_BUFFER_HEADER_T* buffer;
+
+    while((buffer = mmal_queue_get(input->queue)) != NULL) {
+        uint32_t flags = buffer->flags;
+        uint64_t now = vcos_getmicrosecs64();
+
+        if(buffer->length > 0) {
+            if(c->stats.frames == 0)
+                c->stats.first_frame_time = now;
+            else if(now - c->stats.last_frame_time > c->stats.max_frame_gap)
+                c->stats.max_frame_gap = now - c->stats.last_frame_time;
+
+            if(c->after_eos) {
+                uint64_t gap = now - c->stats.last_frame_time;
+                c->stats.resumes++;
+                c->stats.resume_gap_total += gap;
+                c->stats.resume_gap_max = vcos_max(c->stats.resume_gap_max, gap);
+                c->after_eos = MMAL_FALSE;
+            }
+
+            if(buffer->pts != MMAL_TIME_UNKNOWN) {
+                int64_t lag = (int64_t)now - buffer->pts;
+
+                if(c->stats.lag_count == 0 || lag < c->stats.lag_min)
+                    c->stats.lag_min = lag;
+                if(c->stats.lag_count == 0 || lag > c->stats.lag_max)
+                    c->stats.lag_max = lag;
+                c->stats.lag_total += lag;
+                c->stats.lag_count++;
+            }
+
+            c->stats.last_frame_time = now;
+            c->stats.frames++;
+        }
+        if(flags & MMAL_BUFFER_HEADER_FLAG_EOS)
+            c->after_eos = MMAL_TRUE;
+
+        buffer->length = 0;
+        return_buffer(input, buffer);
+
+        if(flags & MMAL_BUFFER_HEADER_FLAG_EOS)
+            send_event(c, MMAL_EVENT_EOS, MMAL_SUCCESS);
+    }
+    return 0;
+}
+
+static void take_fault(struct soft_component* c)
+{
+    if(__atomic_load_n(&armed_fault[c->role], __ATOMIC_RELAXED) == mmal_player_SOFT_FAULT_NONE)
+        return;
+    c->fault = __atomic_exchange_n(&armed_fault[c->role], mmal_player_SOFT_FAULT_NONE, __ATOMIC_ACQUIRE);
+    c->fault_at = c->moved + __atomic_load_n(&armed_after[c->role], __ATOMIC_RELAXED);
+}
+
+// Like a component that hung or crashed: it keeps whatever it holds until it is disabled
+static void fail(struct soft_component* c)
+{
+    c->failed = MMAL_TRUE;
+    if(c->fault == mmal_player_SOFT_FAULT_ERROR)
+        send_event(c, MMAL_EVENT_ERROR, MMAL_EIO);
+    fprintf(stderr, "%s: injected %s\n", role_names[c->role], c->fault == mmal_player_SOFT_FAULT_ERROR ? "error" : "stall");
+}
+
+static void* soft_component_worker(void* user)
+{
+    struct soft_component* c = user;
+    uint32_t sleep_ms = 0;
+
+    while(1) {
+        if(sleep_ms > 0)
+            vcos_semaphore_wait_timeout(&c->wake, sleep_ms);
+        else
+            vcos_semaphore_wait(&c->wake);
+
+        vcos_mutex_lock(&c->lock);
+        if(!c->running) {
+            vcos_mutex_unlock(&c->lock);
+            break;
+        }
+        if(c->fault == mmal_player_SOFT_FAULT_NONE)
+            take_fault(c);
+        if(c->failed) {
+            vcos_mutex_unlock(&c->lock);
+            sleep_ms = 0;
+            continue;
+        }
+
+        switch(c->role) {
+            case mmal_player_ROLE_READER:
+                sleep_ms = process_reader(c);
+                break;
+            case mmal_player_ROLE_DECODER:
+                sleep_ms = process_decoder(c);
+                break;
+            case mmal_player_ROLE_SCHEDULER:
+                sleep_ms = process_scheduler(c);
+                break;
+            case mmal_player_ROLE_RENDERER:
+                sleep_ms = process_renderer(c);
+                break;
+            default:
+                break;
+        }
+        if(c->fault != mmal_player_SOFT_FAULT_NONE && c->moved >= c->fault_at)
+            fail(c);
+        vcos_mutex_unlock(&c->lock);
+    }
+
+    return NULL;
+}
+
+/* components */
+
+static void port_init(struct soft_component* c, int index, MMAL_PORT_TYPE_T type, const char* name)
+{
+    struct soft_port* p = &c->ports[index];
+
+    p->owner = c;
+    p->port.name = name;
+    p->port.type = type;
+    p->port.component = &c->component;
+    p->port.format = mmal_format_alloc();
+    p->port.format->type = type == MMAL_PORT_TYPE_CONTROL ? MMAL_ES_TYPE_CONTROL : MMAL_ES_TYPE_VIDEO;
+    p->queue = mmal_queue_create();
+
+    if(c->role == mmal_player_ROLE_READER || (c->role == mmal_player_ROLE_DECODER && type == MMAL_PORT_TYPE_INPUT)) {
+        p->port.format->encoding = MMAL_ENCODING_H264;
+        p->port.buffer_num_recommended = SOFT_ENCODED_BUFFER_NUM;
+        p->port.buffer_num_min = 1;
+        p->port.buffer_size_min = SOFT_ENCODED_BUFFER_MIN;
+    } else {
+        p->port.format->encoding = MMAL_ENCODING_I420;
+        p->port.buffer_num_recommended = p->port.buffer_num_min = SOFT_FRAME_BUFFER_NUM;
+        p->port.buffer_size_min = SOFT_ENCODED_BUFFER_SIZE;
+    }
+    p->port.buffer_size_recommended = SOFT_ENCODED_BUFFER_SIZE;
+    p->port.buffer_num = p->port.buffer_num_recommended;
+    p->port.buffer_size = p->port.buffer_size_recommended;
+}
+
+static MMAL_STATUS_T soft_component_create(enum mmal_player_role role, MMAL_COMPONENT_T** component)
+{
+    struct soft_component* c;
+
+    if(role < 0 || role >= mmal_player_ROLE_MAX)
+        return MMAL_EINVAL;
+
+    c = calloc(1, sizeof(struct soft_component));
+    if(c == NULL)
+        return MMAL_ENOMEM;
+
+    c->role = role;
+    c->component.name = role_names[role];
+    c->component.priv = c;
+
+    port_init(c, SOFT_PORT_CONTROL, MMAL_PORT_TYPE_CONTROL, "soft:ctr");
+    c->component.control = &c->ports[SOFT_PORT_CONTROL].port;
+
+    if(role != mmal_player_ROLE_READER) {
+        port_init(c, SOFT_PORT_INPUT, MMAL_PORT_TYPE_INPUT, "soft:in");
+        c->input_list[0] = &c->ports[SOFT_PORT_INPUT].port;
+        c->component.input = c->input_list;
+        c->component.input_num = 1;
+    }
+    if(role != mmal_player_ROLE_RENDERER) {
+        port_init(c, SOFT_PORT_OUTPUT, MMAL_PORT_TYPE_OUTPUT, "soft:out");
+        c->output_list[0] = &c->ports[SOFT_PORT_OUTPUT].port;
+        c->component.output = c->output_list;
+        c->component.output_num = 1;
+    }
+    if(role == mmal_player_ROLE_SCHEDULER) {
+        port_init(c, SOFT_PORT_CLOCK, MMAL_PORT_TYPE_CLOCK, "soft:clk");
+        c->clock_list[0] = &c->ports[SOFT_PORT_CLOCK].port;
+        c->component.clock = c->clock_list;
+        c->component.clock_num = 1;
+    }
+
+    c->frame_rate.num = SOFT_DEFAULT_FPS;
+    c->frame_rate.den = 1;
+    c->clock_scale.num = c->clock_scale.den = 1;
+    c->frame_pts = MMAL_TIME_UNKNOWN;
+
+    c->events = mmal_pool_create(4, sizeof(MMAL_STATUS_T));
+    vcos_mutex_create(&c->lock, "soft:component");
+    vcos_semaphore_create(&c->wake, "soft:wake", 0);
+
+    *component = &c->component;
+    return MMAL_SUCCESS;
+}
+
+static MMAL_STATUS_T soft_component_enable(MMAL_COMPONENT_T* component)
+{
+    struct soft_component* c = soft_component(component);
+    VCOS_STATUS_T status;
+
+    if(c->running)
+        return MMAL_SUCCESS;
+
+    c->running = MMAL_TRUE;
+    status = vcos_thread_create(&c->thread, component->name, NULL, soft_component_worker, c);
+    if(status != VCOS_SUCCESS) {
+        c->running = MMAL_FALSE;
+        return MMAL_ENOSPC;
+    }
+    component->is_enabled = 1;
+    return MMAL_SUCCESS;
+}
+
+static MMAL_STATUS_T soft_component_disable(MMAL_COMPONENT_T* component)
+{
+    struct soft_component* c = soft_component(component);
+    void* ret = NULL;
+
+    if(!c->running)
+        return MMAL_SUCCESS;
+
+    vcos_mutex_lock(&c->lock);
+    c->running = MMAL_FALSE;
+    vcos_mutex_unlock(&c->lock);
+    vcos_semaphore_post(&c->wake);
+    vcos_thread_join(&c->thread, &ret);
+
+    component->is_enabled = 0;
+    return MMAL_SUCCESS;
+}
+
+static MMAL_STATUS_T soft_port_disable(MMAL_PORT_T* port);
+
+static MMAL_STATUS_T soft_component_destroy(MMAL_COMPONENT_T* component)
+{
+    struct soft_component* c = soft_component(component);
+    int i;
+
+    soft_component_disable(component);
+
+    for(i = 0; i < SOFT_PORT_MAX; i++) {
+        struct soft_port* p = &c->ports[i];
+        if(p->owner == NULL)
+            continue;
+        soft_port_disable(&p->port);
+        mmal_queue_destroy(p->queue);
+        mmal_format_free(p->port.format);
+    }
+
+    mmal_pool_destroy(c->events);
+    vcos_semaphore_delete(&c->wake);
+    vcos_mutex_delete(&c->lock);
+    free(c);
+
+    return MMAL_SUCCESS;
+}
+
+/* ports */
+
+static MMAL_STATUS_T soft_port_enable(MMAL_PORT_T* port, MMAL_PORT_BH_CB_T cb)
+{
+    struct soft_port* p = soft_port(port);
+
+    vcos_mutex_lock(&p->owner->lock);
+    p->callback = cb;
+    port->is_enabled = 1;
+    vcos_mutex_unlock(&p->owner->lock);
+
+    return MMAL_SUCCESS;
+}
+
+// hands every buffer still held by the port back to its owner, like mmal_port_disable() does
+static MMAL_STATUS_T soft_port_disable(MMAL_PORT_T* port)
+{
+    struct soft_port* p = soft_port(port);
+    MMAL_BUFFER_HEADER_T* buffer;
+
+    vcos_mutex_lock(&p->owner->lock);
+    port->is_enabled = 0;
+    while((buffer = mmal_queue_get(p->queue)) != NULL) {
+        buffer->length = 0;
+        return_buffer(p, buffer);
+    }
+    p->callback = NULL;
+    vcos_mutex_unlock(&p->owner->lock);
+
+    return MMAL_SUCCESS;
+}
+
+// like soft_port_disable() with the port left enabled; a decoder also drops the frame it was assembling
+static MMAL_STATUS_T soft_port_flush(MMAL_PORT_T* port)
+{
+    struct soft_port* p = soft_port(port);
+    MMAL_BUFFER_HEADER_T* buffer;
+
+    if(!port->is_enabled)
+        return MMAL_EINVAL;
+
+    vcos_mutex_lock(&p->owner->lock);
+    while((buffer = mmal_queue_get(p->queue)) != NULL) {
+        buffer->length = 0;
+        buffer->flags = 0;
+        buffer->pts = buffer->dts = MMAL_TIME_UNKNOWN;
+        return_buffer(p, buffer);
+    }
+    if(p->owner->role == mmal_player_ROLE_DECODER) {
+        p->owner->frame_pts = MMAL_TIME_UNKNOWN;
+        p->owner->frame_flags = 0;
+    }
+    vcos_mutex_unlock(&p->owner->lock);
+
+    return MMAL_SUCCESS;
+}
+
+// video_decode sizes its output from the stream format committed to its input
+static void derive_output_format(struct soft_component* c)
+{
+    MMAL_PORT_T* output = &c->ports[SOFT_PORT_OUTPUT].port;
+    MMAL_VIDEO_FORMAT_T* video;
+
+    if(c->role != mmal_player_ROLE_DECODER)
+        return;
+    video = &output->format->es->video;
+    *video = c->ports[SOFT_PORT_INPUT].port.format->es->video;
+    output->buffer_size_recommended = c->pictures ? vcos_max(video->width * video->height * 3 / 2, SOFT_ENCODED_BUFFER_SIZE)
+                                                  : SOFT_ENCODED_BUFFER_SIZE;
+}
+
+static MMAL_STATUS_T soft_format_commit(MMAL_PORT_T* port)
+{
+    struct soft_port* p = soft_port(port);
+
+    if(port->is_enabled)
+        return MMAL_EINVAL;
+
+    vcos_mutex_lock(&p->owner->lock);
+    if(port->type == MMAL_PORT_TYPE_INPUT)
+        derive_output_format(p->owner);
+    vcos_mutex_unlock(&p->owner->lock);
+
+    return MMAL_SUCCESS;
+}
+
+static MMAL_STATUS_T soft_send_buffer(MMAL_PORT_T* port, MMAL_BUFFER_HEADER_T* buffer)
+{
+    struct soft_port* p = soft_port(port);
+
+    if(!port->is_enabled)
+        return MMAL_EINVAL;
+
+    mmal_queue_put(p->queue, buffer);
+    vcos_semaphore_post(&p->owner->wake);
+
+    return MMAL_SUCCESS;
+}
+
+// host memory is all there is
+static MMAL_POOL_T* soft_port_pool_create(MMAL_PORT_T* port, unsigned int num, uint32_t size)
+{
+    return mmal_pool_create(num, size);
+}
+
+static void soft_port_pool_destroy(MMAL_PORT_T* port, MMAL_POOL_T* pool)
+{
+    mmal_pool_destroy(pool);
+}
+
+static MMAL_STATUS_T soft_parameter_set(MMAL_PORT_T* port, const MMAL_PARAMETER_HEADER_T* param)
+{
+    struct soft_component* c = soft_port(port)->owner;
+    MMAL_STATUS_T status = MMAL_SUCCESS;
+
+    vcos_mutex_lock(&c->lock);
+    switch(param->id) {
+        case MMAL_PARAMETER_SEEK: {
+            const MMAL_PARAMETER_SEEK_T* seek = (const MMAL_PARAMETER_SEEK_T*)param;
+            int64_t frame = seek->offset * c->frame_rate.num / ((int64_t)c->frame_rate.den * 1000000);
+
+            // land on a keyframe, like the container reader does, the last one past the end
+            frame = vcos_min(frame, (int64_t)c->frames - 1);
+            frame -= frame % SOFT_KEYFRAME_INTERVAL;
+            if((seek->flags & MMAL_PARAM_SEEK_FLAG_FORWARD) && frame_pts(c, (uint32_t)frame) < seek->offset)
+                frame += SOFT_KEYFRAME_INTERVAL;
+            c->next_frame = (uint32_t)vcos_min(vcos_max(frame, 0), (int64_t)c->frames);
+            break;
+        }
+        case MMAL_PARAMETER_CLOCK_ACTIVE: {
+            MMAL_BOOL_T active = ((const MMAL_PARAMETER_BOOLEAN_T*)param)->enable;
+            if(active && !c->clock_active)
+                c->wall_base = vcos_getmicrosecs64();
+            else if(!active && c->clock_active)
+                c->media_base = clock_now(c);
+            c->clock_active = active;
+            break;
+        }
+        case MMAL_PARAMETER_CLOCK_TIME:
+            clock_rebase(c, ((const MMAL_PARAMETER_INT64_T*)param)->value);
+            break;
+        case MMAL_PARAMETER_CLOCK_SCALE: {
+            MMAL_RATIONAL_T scale = ((const MMAL_PARAMETER_RATIONAL_T*)param)->value;
+            if(scale.den == 0) {
+                status = MMAL_EINVAL;
+                break;
+            }
+            clock_rebase(c, clock_now(c));
+            c->clock_scale = scale;
+            break;
+        }
+        case MMAL_PARAMETER_ZERO_COPY:
+            if(c->role == mmal_player_ROLE_DECODER && port->type == MMAL_PORT_TYPE_OUTPUT) {
+                c->pictures = ((const MMAL_PARAMETER_BOOLEAN_T*)param)->enable;
+                derive_output_format(c);
+            }
+            break;
+        default:
+            // display regions, clock reference...: nothing to model
+            break;
+    }
+    vcos_mutex_unlock(&c->lock);
+
+    // the new state may release buffers the worker is holding
+    vcos_semaphore_post(&c->wake);
+    return status;
+}
+
+static MMAL_STATUS_T soft_parameter_get(MMAL_PORT_T* port, MMAL_PARAMETER_HEADER_T* param)
+{
+    struct soft_component* c = soft_port(port)->owner;
+    MMAL_STATUS_T status = MMAL_SUCCESS;
+
+    vcos_mutex_lock(&c->lock);
+    switch(param->id) {
+        case MMAL_PARAMETER_CLOCK_TIME:
+            ((MMAL_PARAMETER_INT64_T*)param)->value = clock_now(c);
+            break;
+        case MMAL_PARAMETER_CLOCK_ACTIVE:
+            ((MMAL_PARAMETER_BOOLEAN_T*)param)->enable = c->clock_active;
+            break;
+        case MMAL_PARAMETER_CLOCK_SCALE:
+            ((MMAL_PARAMETER_RATIONAL_T*)param)->value = c->clock_scale;
+            break;
+        case MMAL_PARAMETER_STATISTICS:
+            if(c->role != mmal_player_ROLE_RENDERER || param->size < sizeof(MMAL_PARAMETER_STATISTICS_T)) {
+                status = MMAL_EINVAL;
+                break;
+            }
+            // the null renderer presents everything it is given
+            ((MMAL_PARAMETER_STATISTICS_T*)param)->frame_count = c->stats.frames;
+            ((MMAL_PARAMETER_STATISTICS_T*)param)->frames_skipped = 0;
+            ((MMAL_PARAMETER_STATISTICS_T*)param)->frames_discarded = 0;
+            break;
+        default:
+            status = MMAL_ENOSYS;
+            break;
+    }
+    vcos_mutex_unlock(&c->lock);
+
+    return status;
+}
+
+// "synthetic:WIDTHxHEIGHT@FPS:FRAMES"; anything else plays the default synthetic clip
+static MMAL_STATUS_T soft_set_uri(MMAL_COMPONENT_T* reader, const char* uri)
+{
+    struct soft_component* c = soft_component(reader);
+    MMAL_ES_FORMAT_T* format = c->ports[SOFT_PORT_OUTPUT].port.format;
+    unsigned int width = SOFT_DEFAULT_WIDTH, height = SOFT_DEFAULT_HEIGHT;
+    unsigned int fps = SOFT_DEFAULT_FPS, frames = SOFT_DEFAULT_FRAMES;
+    const char* spec;
+
+    if(c->role != mmal_player_ROLE_READER)
+        return MMAL_EINVAL;
+
+    if(strncmp(uri, "synthetic:", 10) == 0) {
+        spec = uri + 10;
+        if(sscanf(spec, "%ux%u", &width, &height) != 2) {
+            width = SOFT_DEFAULT_WIDTH;
+            height = SOFT_DEFAULT_HEIGHT;
+        }
+        if((spec = strchr(uri + 10, '@')) != NULL)
+            sscanf(spec + 1, "%u", &fps);
+        if((spec = strrchr(uri + 10, ':')) != NULL)
+            sscanf(spec + 1, "%u", &frames);
+    }
+    if(fps == 0 || frames == 0)
+        return MMAL_EINVAL;
+
+    vcos_mutex_lock(&c->lock);
+    c->frame_rate.num = fps;
+    c->frame_rate.den = 1;
+    c->frames = frames;
+    c->next_frame = 0;
+
+    format->es->video.width = VCOS_ALIGN_UP(width, 32);
+    format->es->video.height = VCOS_ALIGN_UP(height, 16);
+    format->es->video.crop.width = width;
+    format->es->video.crop.height = height;
+    format->es->video.frame_rate = c->frame_rate;
+    vcos_mutex_unlock(&c->lock);
+
+    return MMAL_SUCCESS;
+}
+
+/* connections, non-tunnelled only */
+
+static void soft_connection_out_cb(MMAL_PORT_T* port, MMAL_BUFFER_HEADER_T* buffer)
+{
+    MMAL_CONNECTION_T* connection = (MMAL_CONNECTION_T*)port->userdata;
+
+    mmal_queue_put(connection->queue, buffer);
+    if(connection->callback)
+        connection->callback(connection);
+}
+
+static void soft_connection_in_cb(MMAL_PORT_T* port, MMAL_BUFFER_HEADER_T* buffer)
+{
+    mmal_buffer_header_release(buffer);
+}
+
+static MMAL_BOOL_T soft_connection_pool_cb(MMAL_POOL_T* pool, MMAL_BUFFER_HEADER_T* buffer, void* userdata)
+{
+    MMAL_CONNECTION_T* connection = (MMAL_CONNECTION_T*)userdata;
+
+    mmal_queue_put(pool->queue, buffer);
+    if(connection->callback)
+        connection->callback(connection);
+
+    return MMAL_FALSE;
+}
+
+static MMAL_STATUS_T soft_connection_create(MMAL_CONNECTION_T** connection, MMAL_PORT_T* out, MMAL_PORT_T* in, uint32_t flags)
+{
+    struct soft_connection* sc;
+
+    if(flags & MMAL_CONNECTION_FLAG_TUNNELLING)
+        return MMAL_ENOSYS;
+
+    sc = calloc(1, sizeof(struct soft_connection));
+    if(sc == NULL)
+        return MMAL_ENOMEM;
+
+    sc->connection.out = out;
+    sc->connection.in = in;
+    sc->connection.flags = flags;
+    sc->connection.name = "soft:connection";
+    sc->connection.queue = mmal_queue_create();
+
+    mmal_format_copy(in->format, out->format);
+    derive_output_format(soft_component(in->component));
+
+    out->userdata = (struct MMAL_PORT_USERDATA_T*)&sc->connection;
+    in->userdata = (struct MMAL_PORT_USERDATA_T*)&sc->connection;
+
+    *connection = &sc->connection;
+    return MMAL_SUCCESS;
+}
+
+static MMAL_STATUS_T soft_connection_enable(MMAL_CONNECTION_T* connection)
+{
+    MMAL_PORT_T* out = connection->out;
+    MMAL_PORT_T* in = connection->in;
+    uint32_t buffer_num, buffer_size;
+
+    if(connection->is_enabled)
+        return MMAL_SUCCESS;
+
+    if(connection->flags & MMAL_CONNECTION_FLAG_KEEP_BUFFER_REQUIREMENTS) {
+        buffer_num = out->buffer_num;
+        buffer_size = out->buffer_size;
+    } else {
+        buffer_num = vcos_max(out->buffer_num_recommended, in->buffer_num_recommended);
+        buffer_size = vcos_max(out->buffer_size_recommended, in->buffer_size_recommended);
+    }
+    out->buffer_num = in->buffer_num = buffer_num;
+    out->buffer_size = in->buffer_size = buffer_size;
+
+    if(((struct soft_connection*)connection)->external_pool) {
+        if(connection->pool->headers_num < buffer_num)
+            return MMAL_EINVAL;
+    } else {
+        connection->pool = mmal_pool_create(buffer_num, buffer_size);
+        if(connection->pool == NULL)
+            return MMAL_ENOMEM;
+        mmal_pool_callback_set(connection->pool, soft_connection_pool_cb, connection);
+    }
+
+    soft_port_enable(out, soft_connection_out_cb);
+    soft_port_enable(in, soft_connection_in_cb);
+    connection->is_enabled = 1;
+
+    return MMAL_SUCCESS;
+}
+
+static MMAL_STATUS_T soft_connection_disable(MMAL_CONNECTION_T* connection)
+{
+    MMAL_BUFFER_HEADER_T* buffer;
+
+    if(!connection->is_enabled)
+        return MMAL_SUCCESS;
+
+    soft_port_disable(connection->in);
+    soft_port_disable(connection->out);
+
+    while((buffer = mmal_queue_get(connection->queue)) != NULL)
+        mmal_buffer_header_release(buffer);
+
+    connection->is_enabled = 0;
+
+    if(mmal_queue_length(connection->pool->queue) != connection->pool->headers_num)
+        fprintf(stderr, "%s: %u buffers still in flight\n", connection->name,
+                connection->pool->headers_num - mmal_queue_length(connection->pool->queue));
+    if(!((struct soft_connection*)connection)->external_pool) {
+        mmal_pool_callback_set(connection->pool, NULL, NULL);
+        mmal_pool_destroy(connection->pool);
+        connection->pool = NULL;
+    }
+
+    return MMAL_SUCCESS;
+}
+
+static MMAL_STATUS_T soft_connection_set_pool(MMAL_CONNECTION_T* connection, MMAL_POOL_T* pool)
+{
+    if(connection->is_enabled)
+        return MMAL_EINVAL;
+
+    connection->pool = pool;
+    ((struct soft_connection*)connection)->external_pool = pool != NULL;
+
+    return MMAL_SUCCESS;
+}
+
+static MMAL_STATUS_T soft_connection_destroy(MMAL_CONNECTION_T* connection)
+{
+    soft_connection_disable(connection);
+
+    mmal_queue_destroy(connection->queue);
+    free((struct soft_connection*)connection);
+
+    return MMAL_SUCCESS;
+}
+
+MMAL_STATUS_T mmal_player_soft_renderer_stats(MMAL_COMPONENT_T* renderer, struct mmal_player_soft_stats* stats)
+{
+    struct soft_component* c;
+
+    if(renderer == NULL || renderer->priv != renderer)
+        return MMAL_EINVAL;
+
+    c = soft_component(renderer);
+    if(c->role != mmal_player_ROLE_RENDERER)
+        return MMAL_EINVAL;
+
+    vcos_mutex_lock(&c->lock);
+    *stats = c->stats;
+    vcos_mutex_unlock(&c->lock);
+
+    return MMAL_SUCCESS;
+}
+
+MMAL_STATUS_T mmal_player_soft_clock_skew(MMAL_COMPONENT_T* scheduler, int32_t ppm)
+{
+    struct soft_component* c;
+
+    if(scheduler == NULL || scheduler->priv != scheduler)
+        return MMAL_EINVAL;
+
+    c = soft_component(scheduler);
+    if(c->role != mmal_player_ROLE_SCHEDULER)
+        return MMAL_EINVAL;
+
+    vcos_mutex_lock(&c->lock);
+    clock_rebase(c, clock_now(c));
+    c->clock_skew = ppm;
+    vcos_mutex_unlock(&c->lock);
+
+    return MMAL_SUCCESS;
+}
+
+void mmal_player_soft_fault(enum mmal_player_role role, enum mmal_player_soft_fault fault, uint32_t after)
+{
+    if(role >= mmal_player_ROLE_MAX)
+        return;
+
+    __atomic_store_n(&armed_after[role], after, __ATOMIC_RELAXED);
+    __atomic_store_n(&armed_fault[role], fault, __ATOMIC_RELEASE);
+}
+
+const struct mmal_player_backend mmal_player_backend_soft = {
+    .name = "soft",
+    .tunnelling = 0,
+
+    .component_create = soft_component_create,
+    .component_enable = soft_component_enable,
+    .component_disable = soft_component_disable,
+    .component_destroy = soft_component_destroy,
+
+    .port_enable = soft_port_enable,
+    .port_disable = soft_port_disable,
+    .port_flush = soft_port_flush,
+    .format_commit = soft_format_commit,
+    .parameter_set = soft_parameter_set,
+    .parameter_get = soft_parameter_get,
+    .set_uri = soft_set_uri,
+    .send_buffer = soft_send_buffer,
+    .port_pool_create = soft_port_pool_create,
+    .port_pool_destroy = soft_port_pool_destroy,
+
+    .connection_create = soft_connection_create,
+    .connection_enable = soft_connection_enable,
+    .connection_disable = soft_connection_disable,
+    .connection_destroy = soft_connection_destroy,
+    .connection_set_pool = soft_connection_set_pool,
+};
@@ -0,0 +1,95 @@
+#ifndef MMAL_CHAIN_PLAYER_MMAL_PLAYER_BACKEND_H
+#define MMAL_CHAIN_PLAYER_MMAL_PLAYER_BACKEND_H
+
+#include "interface/vcos/vcos.h"
+
+#include "interface/mmal/mmal.h"
+#include "interface/mmal/util/mmal_connection.h"
+
+// Components a pipeline is made of, in stream order
+enum mmal_player_role {
+    mmal_player_ROLE_READER = 0,
+    mmal_player_ROLE_DECODER,
+    mmal_player_ROLE_SCHEDULER,
+    mmal_player_ROLE_RENDERER,
+    mmal_player_ROLE_MAX
+};
+
+// Every component, port and connection call the pipeline makes goes through one of these,
+// so the same pipeline logic runs on VideoCore (mmal) or on any Linux box (soft).
+struct mmal_player_backend
+{
+    const char* name;
+    uint32_t tunnelling;    // connection flags between decoder, scheduler and renderer
+
+    MMAL_STATUS_T (*component_create)(enum mmal_player_role role, MMAL_COMPONENT_T** component);
+    MMAL_STATUS_T (*component_enable)(MMAL_COMPONENT_T* component);
+    MMAL_STATUS_T (*component_disable)(MMAL_COMPONENT_T* component);
+    MMAL_STATUS_T (*component_destroy)(MMAL_COMPONENT_T* component);
+
+    MMAL_STATUS_T (*port_enable)(MMAL_PORT_T* port, MMAL_PORT_BH_CB_T cb);
+    MMAL_STATUS_T (*port_disable)(MMAL_PORT_T* port);
+    // Returns every buffer the port holds, unprocessed, and leaves it enabled
+    MMAL_STATUS_T (*port_flush)(MMAL_PORT_T* port);
+    MMAL_STATUS_T (*format_commit)(MMAL_PORT_T* port);
+    MMAL_STATUS_T (*parameter_set)(MMAL_PORT_T* port, const MMAL_PARAMETER_HEADER_T* param);
+    MMAL_STATUS_T (*parameter_get)(MMAL_PORT_T* port, MMAL_PARAMETER_HEADER_T* param);
+    MMAL_STATUS_T (*set_uri)(MMAL_COMPONENT_T* reader, const char* uri);
+    MMAL_STATUS_T (*send_buffer)(MMAL_PORT_T* port, MMAL_BUFFER_HEADER_T* buffer);
+    // Buffers the port can take without copies, shared with VideoCore under zero copy
+    MMAL_POOL_T* (*port_pool_create)(MMAL_PORT_T* port, unsigned int num, uint32_t size);
+    void (*port_pool_destroy)(MMAL_PORT_T* port, MMAL_POOL_T* pool);
+
+    MMAL_STATUS_T (*connection_create)(MMAL_CONNECTION_T** connection, MMAL_PORT_T* out, MMAL_PORT_T* in, uint32_t flags);
+    MMAL_STATUS_T (*connection_enable)(MMAL_CONNECTION_T* connection);
+    MMAL_STATUS_T (*connection_disable)(MMAL_CONNECTION_T* connection);
+    MMAL_STATUS_T (*connection_destroy)(MMAL_CONNECTION_T* connection);
+    // Replaces the pool of a disabled, non-tunnelled connection with one the caller owns;
+    // NULL hands it back so connection_destroy leaves it alone.
+    MMAL_STATUS_T (*connection_set_pool)(MMAL_CONNECTION_T* connection, MMAL_POOL_T* pool);
+};
+
+// VideoCore components through libmmal
+extern const struct mmal_player_backend mmal_player_backend_mmal;
+
+// Host-side stand-ins: a synthetic container reader, a pass-through decoder,
+// a clock driven scheduler and a null renderer that timestamps what it is given.
+// With zero copy set on its output, the decoder paints an I420 picture into every frame.
+// URIs take the form "synthetic:WIDTHxHEIGHT@FPS:FRAMES", any part may be left out.
+extern const struct mmal_player_backend mmal_player_backend_soft;
+
+struct mmal_player_soft_stats
+{
+    uint32_t frames;            // buffers presented by the null renderer
+    uint64_t first_frame_time;  // vcos_getmicrosecs64() of the first one
+    uint64_t last_frame_time;
+    uint64_t max_frame_gap;     // longest interval between two presented frames, us
+
+    uint32_t resumes;           // frames presented right after an EOS on the same renderer
+    uint64_t resume_gap_total;  // EOS buffer to the next frame, us
+    uint64_t resume_gap_max;
+
+    uint32_t lag_count;         // frames with a PTS
+    int64_t lag_total;          // wall clock at presentation minus PTS, us: glass-to-glass latency
+    int64_t lag_min;            // plus a constant for a live source whose PTS follow the sender's
+    int64_t lag_max;            // vcos_getmicrosecs64()
+};
+
+MMAL_STATUS_T mmal_player_soft_renderer_stats(MMAL_COMPONENT_T* renderer, struct mmal_player_soft_stats* stats);
+// Has the scheduler's clock run `ppm` fast (or slow, when negative) against the wall clock,
+// like a real crystal; CLOCK_SCALE still applies on top
+MMAL_STATUS_T mmal_player_soft_clock_skew(MMAL_COMPONENT_T* scheduler, int32_t ppm);
+
+enum mmal_player_soft_fault {
+    mmal_player_SOFT_FAULT_NONE = 0,
+    mmal_player_SOFT_FAULT_STALL,       // stops moving buffers, like a hung component
+    mmal_player_SOFT_FAULT_ERROR,       // ... after sending MMAL_EVENT_ERROR with MMAL_EIO
+};
+// For exercising recovery (see mmal-player-watchdog.h), from any thread: the next component of
+// `role` to run takes `fault`, which goes off after `after` more buffers and lasts until the
+// component is destroyed. One armed fault per role, a newer one replaces it.
+void mmal_player_soft_fault(enum mmal_player_role role, enum mmal_player_soft_fault fault, uint32_t after);
+
+const struct mmal_player_backend* mmal_player_backend_by_name(const char* name);
+
+#endif //MMAL_CHAIN_PLAYER_MMAL_PLAYER_BACKEND_H
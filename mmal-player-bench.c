@@ -0,0 +1,1202 @@
+#include "interface/vcos/vcos.h"
+#include "interface/mmal/mmal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "mmal-player-analysis.h"
+#include "mmal-player-executor.h"
+#include "mmal-player-overlay.h"
+#include "mmal-player-pipeline.h"
+#include "mmal-player-pool.h"
+#include "mmal-player-sync.h"
+#include "mmal-player-tap.h"
+#include "mmal-player-watchdog.h"
+
+// Drives mmal_player_pipeline over the software backend, so the main loop, connection pumping
+// and EOS chaining can be exercised and timed on any Linux machine.
+
+struct bench_context
+{
+    const char* uris[2];
+    int clips;              // transitions left
+    int alternate;          // switch between uris[0] and uris[1] instead of looping uris[0]
+    int recycle;            // each clip on a pipeline from a pool instead of mmal_player_set_new_uri()
+    int current;
+
+    uint32_t frames;        // presented over all finished clips, less any by renderers the watchdog replaced
+    uint32_t renderer_frames;   // presented by the last pipeline's renderer, recycle only
+    MMAL_COMPONENT_T* renderer;
+    uint64_t eos_time;
+    uint32_t rebuilds;      // watchdog rebuilds up to then
+
+    int switches;
+    uint64_t switch_total, switch_max;
+
+    int reason;
+    VCOS_SEMAPHORE_T sem_done;
+
+    int windows;            // pipelines playing at once, the timed one included
+    int done;               // the timed pipeline finished, companions stop looping
+
+    struct mmal_player_memory* memory;  // -M: looped instead of uris[0]
+
+    struct mmal_player_overlay* overlay;    // -O: a ticker drawn over the timed pipeline
+    VCOS_THREAD_T overlay_thread;
+
+    uint32_t tap_checksum;  // -F: over every frame tapped from the timed pipeline
+    uint32_t tap_frozen;    // ... that had the checksum of the one before
+    uint32_t tap_last;
+    struct mmal_player_analysis* analysis;          // ... and run through the analysis kernels
+    struct mmal_player_analysis_summary analysed;   // over the clips the timed pipeline finished
+
+    struct mmal_player_watchdog* watchdog;  // -E: recovers from the faults injected every fault_ms
+    enum mmal_player_soft_fault fault;
+    uint32_t fault_ms;
+    uint32_t faults;                        // armed so far
+    VCOS_THREAD_T fault_thread;
+};
+
+#define OVERLAY_WIDTH           1280
+#define OVERLAY_HEIGHT          64
+#define OVERLAY_DRAW_INTERVAL_MS 2      // far more often than the overlay goes to the screen
+
+#define FAULT_INTERVAL_MS       1000
+#define FAULT_AFTER_BUFFERS     8       // a fault goes off this far into the component's work
+#define FAULT_SLEEP_MS          10
+
+#define KERNEL_WIDTH            1920
+#define KERNEL_HEIGHT           1080
+
+#define SENDER_PACKET_SIZE      1400
+#define SENDER_PACKETS_MAX      1024
+#define SENDER_FRAME_SIZE       6000    // bytes of a synthetic slice, keyframes are four times that
+#define SENDER_KEYFRAME_INTERVAL 30
+
+// Live source for -s: synthetic H.264 slices over UDP to the pipeline on loopback, either as RTP
+// (FU-A fragments, 90 kHz timestamps counted from the first frame) or as a raw byte stream.
+// Every packet leaves up to `jitter` us after its frame was "captured", so they can overtake
+// each other.
+struct bench_sender
+{
+    int rtp;
+    int fd;
+    struct sockaddr_in to;
+    uint32_t fps;
+    uint32_t frames;
+    uint32_t jitter;
+
+    uint64_t epoch;         // capture time of frame 0, PTS 0
+    uint32_t sent;          // packets
+    VCOS_THREAD_T thread;
+
+    struct {
+        uint64_t time;
+        uint32_t length;
+        uint8_t data[SENDER_PACKET_SIZE + 16];
+    } packets[SENDER_PACKETS_MAX];
+    uint32_t count;
+    uint16_t seq;
+};
+
+static void sender_queue(struct bench_sender* tx, uint64_t time, const uint8_t* header, uint32_t header_length, const uint8_t* data, uint32_t length)
+{
+    if(tx->count == SENDER_PACKETS_MAX)
+        return;
+    tx->packets[tx->count].time = time;
+    memcpy(tx->packets[tx->count].data, header, header_length);
+    memcpy(tx->packets[tx->count].data + header_length, data, length);
+    tx->packets[tx->count].length = header_length + length;
+    tx->count++;
+}
+
+// One frame, packetized; each packet gets its own send time within the jitter
+static void sender_frame(struct bench_sender* tx, uint32_t frame, uint64_t capture)
+{
+    static uint8_t slice[4 * SENDER_FRAME_SIZE];
+    uint32_t size = frame % SENDER_KEYFRAME_INTERVAL == 0 ? 4 * SENDER_FRAME_SIZE : SENDER_FRAME_SIZE;
+    uint32_t ts = (uint32_t)((capture - tx->epoch) * 9 / 100);
+    uint32_t offset;
+
+    // NAL header, then first_mb_in_slice 0
+    memset(slice, 0xa5, size);
+    slice[0] = frame % SENDER_KEYFRAME_INTERVAL == 0 ? 0x65 : 0x41;
+    slice[1] = 0x88;
+
+    if(!tx->rtp) {
+        static const uint8_t start_code[4] = {0, 0, 0, 1};
+
+        for(offset = 0; offset < size; offset += SENDER_PACKET_SIZE) {
+            uint32_t length = vcos_min(SENDER_PACKET_SIZE, size - offset);
+            uint64_t time = capture + (tx->jitter > 0 ? (uint64_t)(rand() % tx->jitter) : 0);
+
+            sender_queue(tx, time, start_code, offset == 0 ? 4 : 0, slice + offset, length);
+        }
+        return;
+    }
+
+    // FU-A from the byte after the NAL header
+    for(offset = 1; offset < size; offset += SENDER_PACKET_SIZE) {
+        uint32_t length = vcos_min(SENDER_PACKET_SIZE, size - offset);
+        uint64_t time = capture + (tx->jitter > 0 ? (uint64_t)(rand() % tx->jitter) : 0);
+        uint8_t header[14];
+
+        header[0] = 0x80;
+        header[1] = 96 | (offset + length == size ? 0x80 : 0);
+        header[2] = tx->seq >> 8;
+        header[3] = tx->seq & 0xff;
+        header[4] = ts >> 24;
+        header[5] = ts >> 16;
+        header[6] = ts >> 8;
+        header[7] = ts;
+        memset(header + 8, 0, 4);
+        header[12] = (slice[0] & 0xe0) | 28;
+        header[13] = (slice[0] & 0x1f) | (offset == 1 ? 0x80 : 0) | (offset + length == size ? 0x40 : 0);
+        tx->seq++;
+
+        sender_queue(tx, time, header, sizeof(header), slice + offset, length);
+    }
+}
+
+static void* sender_thread(void* user)
+{
+    struct bench_sender* tx = user;
+    uint64_t interval = 1000000 / tx->fps;
+    uint32_t frame = 0;
+
+    while(frame < tx->frames || tx->count > 0) {
+        uint64_t now = vcos_getmicrosecs64();
+        uint64_t next;
+        uint32_t i;
+
+        while(frame < tx->frames && tx->epoch + frame * interval <= now) {
+            sender_frame(tx, frame, tx->epoch + frame * interval);
+            frame++;
+        }
+
+        // earliest first, a packet jittered behind the next one goes out after it
+        next = frame < tx->frames ? tx->epoch + frame * interval : UINT64_MAX;
+        for(i = 0; i < tx->count; ) {
+            if(tx->packets[i].time <= now) {
+                if(sendto(tx->fd, tx->packets[i].data, tx->packets[i].length, 0, (struct sockaddr*)&tx->to, sizeof(tx->to)) > 0)
+                    tx->sent++;
+                tx->packets[i] = tx->packets[--tx->count];
+                continue;
+            }
+            next = vcos_min(next, tx->packets[i].time);
+            i++;
+        }
+
+        if(next != UINT64_MAX && next > now)
+            usleep((useconds_t)(next - now));
+    }
+
+    return NULL;
+}
+
+// Picks a free loopback port for the pipeline to bind and opens the socket the sender sends from
+static int sender_open(struct bench_sender* tx)
+{
+    socklen_t length = sizeof(tx->to);
+    int probe = socket(AF_INET, SOCK_DGRAM, 0);
+
+    memset(&tx->to, 0, sizeof(tx->to));
+    tx->to.sin_family = AF_INET;
+    tx->to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(probe < 0)
+        return -1;
+    if(bind(probe, (struct sockaddr*)&tx->to, sizeof(tx->to)) != 0 ||
+       getsockname(probe, (struct sockaddr*)&tx->to, &length) != 0) {
+        close(probe);
+        return -1;
+    }
+    close(probe);
+
+    tx->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    return tx->fd < 0 ? -1 : 0;
+}
+
+#define BENCH_WINDOWS_MAX 64
+
+static const struct option long_options[] =
+{
+    {"clips",     required_argument, NULL, 'c'},
+    {"alternate", no_argument,       NULL, 'a'},
+    {"buffers",   required_argument, NULL, 'b'},
+    {"adaptive-buffers", no_argument, NULL, 'A'},
+    {"recycle",   no_argument,       NULL, 'R'},
+    {"windows",   required_argument, NULL, 'w'},
+    {"threads",   required_argument, NULL, 'T'},
+    {"sync",      no_argument,       NULL, 'y'},
+    {"skew",      required_argument, NULL, 'k'},
+    {"stream",    required_argument, NULL, 's'},
+    {"jitter",    required_argument, NULL, 'j'},
+    {"latency",   required_argument, NULL, 'J'},
+    {"memory",    required_argument, NULL, 'M'},
+    {"seek",      required_argument, NULL, 'S'},
+    {"index",     required_argument, NULL, 'I'},
+    {"overlay",   required_argument, NULL, 'O'},
+    {"tap",       required_argument, NULL, 'F'},
+    {"kernels",   required_argument, NULL, 'K'},
+    {"faults",    required_argument, NULL, 'E'},
+    {NULL, 0,                        NULL, 0}
+};
+
+// times the switch into the pipeline's current renderer, if it was rebuilt since the last EOS
+// for the new clip rather than by the watchdog
+static void bench_collect(struct bench_context* ctx, struct mmal_player_pipeline* pipeline)
+{
+    struct mmal_player_soft_stats stats;
+    uint32_t rebuilds = ctx->rebuilds;
+
+    ctx->rebuilds = pipeline->metrics.rebuilds;
+    if(mmal_player_soft_renderer_stats(pipeline->video_renderer, &stats) != MMAL_SUCCESS)
+        return;
+
+    if(pipeline->video_renderer != ctx->renderer && ctx->eos_time != 0 && stats.frames > 0 &&
+       pipeline->metrics.rebuilds == rebuilds) {
+        uint64_t latency = stats.first_frame_time - ctx->eos_time;
+
+        ctx->switches++;
+        ctx->switch_total += latency;
+        ctx->switch_max = vcos_max(ctx->switch_max, latency);
+    }
+}
+
+MMAL_BOOL_T bench_eos_callback(struct mmal_player_pipeline* pipeline, void* user)
+{
+    struct bench_context* ctx = user;
+    struct mmal_player_soft_stats stats;
+
+    // what the tap analysed of the clip, reset once this returns
+    ctx->analysed.frames += pipeline->analysis.frames;
+    ctx->analysed.black += pipeline->analysis.black;
+    ctx->analysed.frozen += pipeline->analysis.frozen;
+    ctx->analysed.hashes += pipeline->analysis.hashes;
+    if(pipeline->analysis.hashes > 0)
+        ctx->analysed.hash = pipeline->analysis.hash;
+    ctx->analysed.black_run_max = vcos_max(ctx->analysed.black_run_max, pipeline->analysis.black_run_max);
+    ctx->analysed.frozen_run_max = vcos_max(ctx->analysed.frozen_run_max, pipeline->analysis.frozen_run_max);
+
+    if(ctx->recycle) {
+        // main() moves on to the next pipeline; a kept renderer carries on counting
+        if(mmal_player_soft_renderer_stats(pipeline->video_renderer, &stats) == MMAL_SUCCESS) {
+            ctx->frames += stats.frames - (pipeline->last_switch != mmal_player_SWITCH_REBUILD ? ctx->renderer_frames : 0);
+            ctx->renderer_frames = stats.frames;
+        }
+        ctx->eos_time = pipeline->eos_time;
+        return MMAL_FALSE;
+    }
+
+    bench_collect(ctx, pipeline);
+
+    if(mmal_player_soft_renderer_stats(pipeline->video_renderer, &stats) == MMAL_SUCCESS)
+        ctx->frames += stats.frames;
+    ctx->renderer = pipeline->video_renderer;
+    ctx->eos_time = pipeline->eos_time;
+
+    if(ctx->clips-- <= 0)
+        return MMAL_FALSE;
+
+    if(ctx->memory != NULL) {
+        if(mmal_player_set_new_memory(pipeline, ctx->memory) != MMAL_SUCCESS)
+            return MMAL_FALSE;
+    } else {
+        if(ctx->alternate)
+            ctx->current ^= 1;
+        if(mmal_player_set_new_uri(pipeline, ctx->uris[ctx->current]) != MMAL_SUCCESS)
+            return MMAL_FALSE;
+    }
+
+    // the renderer survived a rewind, its counters carry on
+    if(pipeline->video_renderer == ctx->renderer)
+        ctx->frames -= stats.frames;
+    return MMAL_TRUE;
+}
+
+// the untimed pipelines of -w loop uris[0] until the timed one is done
+MMAL_BOOL_T companion_eos_callback(struct mmal_player_pipeline* pipeline, void* user)
+{
+    struct bench_context* ctx = user;
+
+    if(__atomic_load_n(&ctx->done, __ATOMIC_ACQUIRE))
+        return MMAL_FALSE;
+    return mmal_player_set_new_uri(pipeline, ctx->uris[0]) == MMAL_SUCCESS;
+}
+
+void bench_exit_callback(struct mmal_player_pipeline* pipeline, void* user)
+{
+    struct bench_context* ctx = user;
+
+    ctx->reason = pipeline->exit_reason;
+    vcos_semaphore_post(&ctx->sem_done);
+}
+
+// -s: plays what the sender sends until it is done and the jitter buffer has drained
+static int bench_stream(struct bench_sender* tx, struct mmal_player_options* options)
+{
+    struct mmal_player_pipeline* player;
+    struct mmal_player_stream_stats stream;
+    struct mmal_player_soft_stats stats;
+    uint64_t depth_total = 0;
+    uint32_t depth_max = 0, samples = 0;
+    uint64_t end;
+    char uri[64];
+
+    if(sender_open(tx) != 0) {
+        fprintf(stderr, "unable to open the sender socket\n");
+        return 1;
+    }
+    snprintf(uri, sizeof(uri), "%s://127.0.0.1:%u", tx->rtp ? "rtp" : "udp", ntohs(tx->to.sin_port));
+    options->stream.fps = tx->fps;
+
+    player = mmal_player_create_with_options(uri, options);
+    if(player == NULL) {
+        fprintf(stderr, "unable to create pipeline for %s\n", uri);
+        return 1;
+    }
+    mmal_player_start(player);
+
+    tx->epoch = vcos_getmicrosecs64();
+    if(vcos_thread_create(&tx->thread, "bench.sender", NULL, sender_thread, tx) != VCOS_SUCCESS) {
+        fprintf(stderr, "unable to start the sender\n");
+        return 1;
+    }
+
+    // the receive side's buffer depth while frames come in, then the latency to drain it
+    end = tx->epoch + (uint64_t)tx->frames * 1000000 / tx->fps + tx->jitter;
+    while(vcos_getmicrosecs64() < end) {
+        vcos_sleep(10);
+        mmal_player_stream_get_stats(player->stream, &stream);
+        depth_total += stream.depth;
+        depth_max = vcos_max(depth_max, stream.depth);
+        samples++;
+    }
+    vcos_thread_join(&tx->thread, NULL);
+    vcos_sleep((options->stream.latency_ms > 0 ? options->stream.latency_ms : 100) + 100);
+
+    mmal_player_stream_get_stats(player->stream, &stream);
+    mmal_player_stop(player);
+    mmal_player_join(player);
+
+    memset(&stats, 0, sizeof(stats));
+    mmal_player_soft_renderer_stats(player->video_renderer, &stats);
+
+    printf("stream: %s, %u frames in %u packets, %u us sender jitter\n", uri, tx->frames, tx->sent, tx->jitter);
+    printf("frames presented: %u, longest frame gap: %llu us\n", stats.frames, (unsigned long long)stats.max_frame_gap);
+    // PTS count from the first frame's capture, for RTP they follow the sender's clock
+    if(tx->rtp && stats.lag_count > 0)
+        printf("capture to presentation avg %lld us, min %lld us, max %lld us\n",
+               (long long)(stats.lag_total / stats.lag_count - (int64_t)tx->epoch),
+               (long long)(stats.lag_min - (int64_t)tx->epoch), (long long)(stats.lag_max - (int64_t)tx->epoch));
+    printf("jitter buffer: depth avg %.1f, max %u, %u late, %u overflow, %u lost, %u rebases\n",
+           samples > 0 ? (double)depth_total / samples : 0.0, depth_max,
+           stream.late, stream.overflow, stream.lost, stream.rebases);
+    if(stream.hold.count > 0)
+        printf("held avg %llu us, max %llu us\n",
+               (unsigned long long)(stream.hold.total / stream.hold.count), (unsigned long long)stream.hold.max);
+
+    mmal_player_destroy(player);
+    close(tx->fd);
+
+    return stats.frames > 0 ? 0 : 1;
+}
+
+// loops the clip for -S, a seek near the end must not run into the end of the session
+static MMAL_BOOL_T seek_eos_callback(struct mmal_player_pipeline* pipeline, void* user)
+{
+    struct bench_context* ctx = user;
+
+    if(ctx->memory != NULL)
+        return mmal_player_set_new_memory(pipeline, ctx->memory) == MMAL_SUCCESS;
+    return mmal_player_set_new_uri(pipeline, ctx->uris[0]) == MMAL_SUCCESS;
+}
+
+static uint32_t bench_frames(struct mmal_player_pipeline* player)
+{
+    struct mmal_player_soft_stats stats;
+
+    memset(&stats, 0, sizeof(stats));
+    mmal_player_soft_renderer_stats(player->video_renderer, &stats);
+    return stats.frames;
+}
+
+// frames presented over `ms` at `rate`
+static uint32_t bench_rate(struct mmal_player_pipeline* player, int32_t num, int32_t den, uint32_t ms)
+{
+    MMAL_RATIONAL_T rate = {num, den};
+    uint32_t frames;
+
+    mmal_player_set_rate(player, rate);
+    vcos_sleep(100);
+    frames = bench_frames(player);
+    vcos_sleep(ms);
+    return bench_frames(player) - frames;
+}
+
+// -S: seeks all over the clip, each once its predecessor showed its first frame, then pauses
+// and plays at a few rates
+// A block running along the overlay's ticker strip, redrawn until the timed pipeline is done
+static void* overlay_draw_thread(void* user)
+{
+    struct bench_context* ctx = user;
+    uint32_t x = 0, width, height, stride, y;
+
+    while(!__atomic_load_n(&ctx->done, __ATOMIC_ACQUIRE)) {
+        uint8_t* canvas = mmal_player_overlay_lock(ctx->overlay, &width, &height, &stride);
+        MMAL_RECT_T dirty = {x, 0, 2 * height, height};
+
+        // the block moves by one pixel: clear its old column, draw the new one
+        for(y = 0; y < height; y++) {
+            memset(canvas + y * stride + x * 4, 0, 4);
+            memset(canvas + y * stride + ((x + height) % width) * 4, 0xff, 4);
+        }
+        if(x + 2 * height > width)
+            dirty.width = width - x;
+        mmal_player_overlay_unlock(ctx->overlay, &dirty);
+        x = (x + 1) % width;
+        vcos_sleep(OVERLAY_DRAW_INTERVAL_MS);
+    }
+
+    return NULL;
+}
+
+// -E: arms a fault in decoder, scheduler, renderer and reader in turn until the timed pipeline is done
+static void* fault_thread(void* user)
+{
+    static const enum mmal_player_role roles[] = {
+        mmal_player_ROLE_DECODER, mmal_player_ROLE_SCHEDULER, mmal_player_ROLE_RENDERER, mmal_player_ROLE_READER
+    };
+    struct bench_context* ctx = user;
+    uint32_t waited = 0;
+
+    while(!__atomic_load_n(&ctx->done, __ATOMIC_ACQUIRE)) {
+        vcos_sleep(FAULT_SLEEP_MS);
+        if((waited += FAULT_SLEEP_MS) < ctx->fault_ms)
+            continue;
+        waited = 0;
+        mmal_player_soft_fault(roles[ctx->faults++ % (sizeof(roles) / sizeof(roles[0]))], ctx->fault, FAULT_AFTER_BUFFERS);
+    }
+
+    return NULL;
+}
+
+// Proof-of-play checksum over the visible luma of each tapped frame, a word at a time
+static void bench_tap_callback(const struct mmal_player_tap_frame* frames, uint32_t count, void* user)
+{
+    struct bench_context* ctx = user;
+    uint32_t i, x, y;
+
+    for(i = 0; i < count; i++) {
+        const struct mmal_player_tap_frame* frame = &frames[i];
+        uint32_t sum = 2166136261u;
+
+        if((uint64_t)frame->width * (frame->crop.y + frame->crop.height) > frame->length)
+            continue;
+        for(y = frame->crop.y; y < frame->crop.y + frame->crop.height; y++) {
+            const uint8_t* row = frame->data + (size_t)y * frame->width + frame->crop.x;
+
+            for(x = 0; x + 4 <= (uint32_t)frame->crop.width; x += 4) {
+                uint32_t word;
+
+                memcpy(&word, row + x, sizeof(word));
+                sum = (sum ^ word) * 16777619u;
+            }
+        }
+        // a single worker calls back, in order
+        if(sum == ctx->tap_last)
+            ctx->tap_frozen++;
+        ctx->tap_last = sum;
+        ctx->tap_checksum ^= sum;
+
+        if(ctx->analysis != NULL) {
+            struct mmal_player_analysis_result result;
+
+            if(mmal_player_analysis_frame(ctx->analysis, frame, &result) == MMAL_SUCCESS)
+                mmal_player_post_analysis(frame->pipeline, &result);
+        }
+    }
+}
+
+// -K: each kernel set on a 1080p luma plane, checked against plain C
+static int bench_kernels(int iterations)
+{
+    static const char* names[] = {"scalar", "sse2", "avx2", "neon"};
+    const uint32_t pixels = KERNEL_WIDTH * KERNEL_HEIGHT;
+    uint64_t expect_sum = 0, expect_dark = 0, expect_sad = 0, expect_hash = 0;
+    uint8_t* plane = malloc(pixels);
+    uint8_t* prev = malloc(pixels);
+    uint32_t i, n;
+    int failed = 0;
+
+    if(plane == NULL || prev == NULL) {
+        free(plane);
+        free(prev);
+        return 1;
+    }
+    // a dark half, then a gradient with some noise on it
+    for(i = 0; i < pixels; i++)
+        plane[i] = i % KERNEL_WIDTH < KERNEL_WIDTH / 2 ? 16 + (i * 7 % 13) : (i % KERNEL_WIDTH + i / KERNEL_WIDTH + i * 31 % 17) & 0xff;
+
+    for(n = 0; n < sizeof(names) / sizeof(names[0]); n++) {
+        const struct mmal_player_analysis_kernels* kernels = mmal_player_analysis_kernels(names[n]);
+        uint64_t sum, dark, sad = 0, hash = 0, luma_us, sad_us, hash_us, start;
+        int mismatch;
+
+        if(kernels == NULL) {
+            printf("kernels %-6s: not on this CPU\n", names[n]);
+            continue;
+        }
+
+        start = vcos_getmicrosecs64();
+        for(i = 0; i < (uint32_t)iterations; i++)
+            mmal_player_analysis_luma(kernels, plane, KERNEL_WIDTH, KERNEL_WIDTH, KERNEL_HEIGHT, 32, &sum, &dark);
+        luma_us = vcos_getmicrosecs64() - start;
+
+        // against the plane shifted by a row, so there is a difference to find
+        start = vcos_getmicrosecs64();
+        for(i = 0; i < (uint32_t)iterations; i++) {
+            memcpy(prev, plane + KERNEL_WIDTH, pixels - KERNEL_WIDTH);
+            sad = mmal_player_analysis_sad_copy(kernels, prev, plane, KERNEL_WIDTH, KERNEL_WIDTH, KERNEL_HEIGHT);
+        }
+        sad_us = vcos_getmicrosecs64() - start;
+
+        start = vcos_getmicrosecs64();
+        for(i = 0; i < (uint32_t)iterations; i++)
+            hash = mmal_player_analysis_phash(kernels, plane, KERNEL_WIDTH, KERNEL_WIDTH, KERNEL_HEIGHT);
+        hash_us = vcos_getmicrosecs64() - start;
+
+        if(n == 0) {
+            expect_sum = sum;
+            expect_dark = dark;
+            expect_sad = sad;
+            expect_hash = hash;
+        }
+        mismatch = sum != expect_sum || dark != expect_dark || sad != expect_sad || hash != expect_hash;
+        failed += mismatch;
+
+        printf("kernels %-6s: luma %llu us/MP, %llu MP/s; sad+copy %llu us/MP, %llu MP/s; phash %llu us/MP, %llu MP/s; "
+               "hash %016llx%s\n", kernels->name,
+               (unsigned long long)(luma_us * 1000000 / ((uint64_t)pixels * iterations)),
+               (unsigned long long)((uint64_t)pixels * iterations / vcos_max(luma_us, 1)),
+               (unsigned long long)(sad_us * 1000000 / ((uint64_t)pixels * iterations)),
+               (unsigned long long)((uint64_t)pixels * iterations / vcos_max(sad_us, 1)),
+               (unsigned long long)(hash_us * 1000000 / ((uint64_t)pixels * iterations)),
+               (unsigned long long)((uint64_t)pixels * iterations / vcos_max(hash_us, 1)),
+               (unsigned long long)hash, mismatch ? ", MISMATCH" : "");
+    }
+    printf("kernels: %s picked\n", mmal_player_analysis_kernels(NULL)->name);
+
+    free(plane);
+    free(prev);
+    return failed ? 1 : 0;
+}
+
+// seeks spread over the clip, returns how many never showed a frame
+static uint32_t bench_seek_loop(struct mmal_player_pipeline* player, int seeks, unsigned frames, int64_t interval)
+{
+    struct mmal_player_metrics metrics;
+    uint32_t timeouts = 0;
+    int i;
+
+    for(i = 0; i < seeks; i++) {
+        uint64_t count, deadline;
+
+        mmal_player_get_metrics(player, &metrics);
+        count = metrics.seeks.count;
+        // spread over the clip in an order that jumps back and forth
+        mmal_player_seek(player, (int64_t)((i * 7919u + 13) % frames) * interval, 0);
+
+        deadline = vcos_getmicrosecs64() + 1000000;
+        do {
+            vcos_sleep(1);
+            mmal_player_get_metrics(player, &metrics);
+        } while(metrics.seeks.count == count && vcos_getmicrosecs64() < deadline);
+        if(metrics.seeks.count == count)
+            timeouts++;
+        vcos_sleep(20);
+    }
+
+    mmal_player_get_metrics(player, &metrics);
+    printf("seeks: %llu of %d showed a frame, seek to first frame avg %llu us, max %llu us\n",
+           (unsigned long long)metrics.seeks.count, seeks,
+           (unsigned long long)(metrics.seeks.count > 0 ? metrics.seeks.total / metrics.seeks.count : 0),
+           (unsigned long long)metrics.seeks.max);
+
+    return timeouts;
+}
+
+// builds and stores the keyframe index of the file at `uri`, then times loading it back
+static int bench_index(const char* uri, const char* cache_dir, unsigned* frames, int64_t* interval)
+{
+    struct mmal_player_index* index;
+    const struct mmal_player_keyframe* last;
+    uint32_t count;
+
+    index = mmal_player_index_build(uri, &mmal_player_backend_soft, 0);
+    if(index == NULL) {
+        fprintf(stderr, "unable to index %s\n", uri);
+        return 1;
+    }
+    printf("index: built in %llu us, ", (unsigned long long)mmal_player_index_build_time(index));
+    mmal_player_index_save(index, cache_dir);
+    mmal_player_index_destroy(index);
+
+    index = mmal_player_index_load(uri, cache_dir);
+    if(index == NULL) {
+        fprintf(stderr, "unable to load the index of %s back\n", uri);
+        return 1;
+    }
+    count = mmal_player_index_count(index);
+    last = mmal_player_index_entry(index, count - 1);
+    printf("loaded in %llu us, %u keyframes\n", (unsigned long long)mmal_player_index_build_time(index), count);
+    // the index is all there is to know of a file's length
+    *interval = 1000000 / 30;
+    *frames = last != NULL ? last->pts / *interval + 1 : 1;
+    mmal_player_index_destroy(index);
+
+    return 0;
+}
+
+static int bench_seek(struct bench_context* ctx, struct mmal_player_options* options, int seeks)
+{
+    struct mmal_player_pipeline* player;
+    struct mmal_player_options indexed = *options;
+    unsigned width, height, fps = 0, frames = 0;
+    uint32_t paused, timeouts = 0, rates[4];
+    int64_t interval;
+    int i;
+
+    // with an index the clip is first timed without it, for comparison
+    options->keyframe_index.enabled = MMAL_FALSE;
+    if(ctx->memory != NULL) {
+        frames = mmal_player_memory_units(ctx->memory);
+        interval = mmal_player_memory_frame_interval(ctx->memory);
+        player = mmal_player_create_with_memory(ctx->memory, options);
+    } else if(sscanf(ctx->uris[0], "synthetic:%ux%u@%u:%u", &width, &height, &fps, &frames) == 4 && fps > 0) {
+        interval = 1000000 / fps;
+        player = mmal_player_create_with_options(ctx->uris[0], options);
+    } else if(indexed.keyframe_index.enabled) {
+        if(bench_index(ctx->uris[0], indexed.keyframe_index.cache_dir, &frames, &interval) != 0)
+            return 1;
+        player = mmal_player_create_with_options(ctx->uris[0], options);
+    } else {
+        fprintf(stderr, "-S needs a synthetic:WIDTHxHEIGHT@FPS:FRAMES URI, -M, or a FILE with -I\n");
+        return 1;
+    }
+    if(player == NULL) {
+        fprintf(stderr, "unable to create pipeline\n");
+        return 1;
+    }
+    mmal_player_set_eos_callback(player, seek_eos_callback, ctx);
+    mmal_player_start(player);
+    vcos_sleep(200);
+
+    printf("clip: %s, %u frames\n", player->uri, frames);
+    timeouts = bench_seek_loop(player, seeks, frames, interval);
+
+    mmal_player_pause(player);
+    vcos_sleep(100);
+    paused = bench_frames(player);
+    vcos_sleep(300);
+    paused = bench_frames(player) - paused;
+    mmal_player_resume(player);
+
+    printf("paused: %u frames presented in 300 ms\n", paused);
+    for(i = 0; i < 4; i++)
+        rates[i] = bench_rate(player, i < 1 ? 1 : i, i < 1 ? 2 : 1, 500) * 2;
+    printf("frames presented per second: %u at 1/2x, %u at 1x, %u at 2x, %u at 3x\n", rates[0], rates[1], rates[2], rates[3]);
+    rates[0] = bench_rate(player, 8, 1, 1000);
+    printf("... and %u at 8x, which decodes keyframes only\n", rates[0]);
+
+    mmal_player_stop(player);
+    mmal_player_join(player);
+    mmal_player_destroy(player);
+
+    if(indexed.keyframe_index.enabled && ctx->memory == NULL && fps == 0) {
+        player = mmal_player_create_with_options(ctx->uris[0], &indexed);
+        if(player == NULL) {
+            fprintf(stderr, "unable to create pipeline\n");
+            return 1;
+        }
+        mmal_player_set_eos_callback(player, seek_eos_callback, ctx);
+        mmal_player_start(player);
+        vcos_sleep(200);
+        printf("with the keyframe index, ");
+        timeouts += bench_seek_loop(player, seeks, frames, interval);
+        mmal_player_stop(player);
+        mmal_player_join(player);
+        mmal_player_destroy(player);
+    }
+    mmal_player_memory_release(ctx->memory);
+
+    return timeouts == 0 && paused == 0 ? 0 : 1;
+}
+
+int usage(int ac, char** av)
+{
+    printf("Usage: %s [-c CLIPS] [-a] [-b NUM[:SIZE]] [-A] [-R] [-w WINDOWS [-T THREADS] [-y] [-k PPM]] [-s rtp|udp [-j US] [-J MS]] [-M FILE] [-S SEEKS [-I DIR]] [-O FPS] [-F FPS[:BATCH]] [-K ITERATIONS] [-E stall|error[:MS]] [URI [URI2]]\n", *av);
+    printf("\t-c CLIPS\tNumber of clip transitions to run\n");
+    printf("\t-a\t\tAlternate between URI and URI2, forcing a pipeline rebuild per clip\n");
+    printf("\t-b NUM[:SIZE]\tReader buffers and their size in bytes\n");
+    printf("\t-A\t\tAdapt the reader buffers from clip to clip\n");
+    printf("\t-R\t\tPlay each clip on a recycled pipeline, as the chain player does\n");
+    printf("\t-w WINDOWS\tPlay URI on WINDOWS - 1 more pipelines alongside the timed one\n");
+    printf("\t-T THREADS\tRun the pipelines on THREADS shared threads, 0 gives each its own\n");
+    printf("\t-y\t\tSync the other pipelines to the timed one's clock and clip starts\n");
+    printf("\t-k PPM\t\tRun the other pipelines' scheduler clocks PPM fast, negative for slow\n");
+    printf("\t-s rtp|udp\tPlay URI's frames as a live stream from a sender on loopback\n");
+    printf("\t-j US\t\tDelay each packet the sender sends by up to US, reordering them\n");
+    printf("\t-J MS\t\tJitter buffer latency\n");
+    printf("\t-M FILE\t\tLoop the H.264 byte stream FILE from memory instead of URI\n");
+    printf("\t-S SEEKS\tTime SEEKS seeks in URI or FILE, then pause and change the rate\n");
+    printf("\t-O FPS\t\tDraw a ticker on an overlay above the timed pipeline, shown at most FPS times a second\n");
+    printf("\t-F FPS[:BATCH]\tChecksum and analyse FPS decoded frames a second of the timed pipeline, BATCH per callback\n");
+    printf("\t-K ITERATIONS\tTime each set of analysis kernels over ITERATIONS 1080p frames\n");
+    printf("\t-E stall|error[:MS]\tHave a component stall or fail every MS, 1000 by default, and a watchdog recover\n");
+    printf("\t-I DIR\t\tIndex the keyframes of FILE into DIR first, then time the seeks again with it\n");
+    printf("\tURI\t\tsynthetic:WIDTHxHEIGHT@FPS:FRAMES, or a FILE with -S and -I\n");
+
+    return -1;
+}
+
+int main(int ac, char** av)
+{
+    struct bench_context context;
+    struct mmal_player_options options;
+    struct mmal_player_pool* pool;
+    struct mmal_player_pipeline* player;
+    struct mmal_player_soft_stats stats;
+    struct mmal_player_loop_stats loop;
+    struct mmal_player_pipeline* companions[BENCH_WINDOWS_MAX];
+    struct mmal_player_executor* executor = NULL;
+    struct rusage usage_start, usage_end;
+    struct mmal_player_sync* sync = NULL;
+    struct mmal_player_sync_member* members[BENCH_WINDOWS_MAX];
+    static struct bench_sender sender;
+    int stream = 0;
+    const char* memory_path = NULL;
+    int seeks = 0;
+    int overlay_fps = 0;
+    struct mmal_player_tap_options tap_options;
+    struct mmal_player_tap* tap = NULL;
+    const char* tap_spec = NULL;
+    struct mmal_player_analysis_options analysis_options;
+    int kernel_iterations = 0;
+    uint64_t start, elapsed;
+    int threads = 0;
+    int skew = 0;
+    int i;
+
+    memset(&context, 0, sizeof(struct bench_context));
+    mmal_player_options_init(&options);
+    options.backend = &mmal_player_backend_soft;
+
+    context.clips = 10;
+    context.windows = 1;
+    context.uris[0] = "synthetic:1280x720@120:240";
+    context.uris[1] = "synthetic:1280x720@120:120";
+
+    int opt = -1;
+    while((opt = getopt_long(ac, av, "c:ab:ARw:T:yk:s:j:J:M:S:I:O:F:K:E:", long_options, NULL)) != -1) {
+        switch(opt) {
+            case 'c':
+                context.clips = atoi(optarg);
+                break;
+            case 'a':
+                context.alternate = 1;
+                break;
+            case 'b': {
+                char* size = strchr(optarg, ':');
+
+                options.reader_buffers.num = strtoul(optarg, NULL, 0);
+                if(size != NULL)
+                    options.reader_buffers.size = strtoul(size + 1, NULL, 0);
+                break;
+            }
+            case 'A':
+                options.reader_buffers.adaptive = MMAL_TRUE;
+                break;
+            case 'R':
+                context.recycle = 1;
+                break;
+            case 'w':
+                context.windows = atoi(optarg);
+                if(context.windows < 1 || context.windows > BENCH_WINDOWS_MAX)
+                    return usage(ac, av);
+                break;
+            case 'T':
+                threads = atoi(optarg);
+                break;
+            case 'y':
+                sync = mmal_player_sync_open(NULL);
+                if(sync == NULL) {
+                    fprintf(stderr, "unable to open a sync group\n");
+                    return 1;
+                }
+                break;
+            case 'k':
+                skew = atoi(optarg);
+                break;
+            case 's':
+                if(strcmp(optarg, "rtp") != 0 && strcmp(optarg, "udp") != 0)
+                    return usage(ac, av);
+                stream = 1;
+                sender.rtp = strcmp(optarg, "rtp") == 0;
+                break;
+            case 'j':
+                sender.jitter = strtoul(optarg, NULL, 0);
+                break;
+            case 'J':
+                options.stream.latency_ms = strtoul(optarg, NULL, 0);
+                break;
+            case 'M':
+                memory_path = optarg;
+                break;
+            case 'S':
+                seeks = atoi(optarg);
+                break;
+            case 'I':
+                options.keyframe_index.enabled = MMAL_TRUE;
+                options.keyframe_index.cache_dir = optarg;
+                break;
+            case 'O':
+                overlay_fps = atoi(optarg);
+                break;
+            case 'F':
+                tap_spec = optarg;
+                break;
+            case 'K':
+                kernel_iterations = atoi(optarg);
+                if(kernel_iterations <= 0)
+                    return usage(ac, av);
+                break;
+            case 'E': {
+                struct mmal_player_watchdog_options watchdog_options;
+                const char* ms = strchr(optarg, ':');
+
+                if(strncmp(optarg, "stall", 5) == 0)
+                    context.fault = mmal_player_SOFT_FAULT_STALL;
+                else if(strncmp(optarg, "error", 5) == 0)
+                    context.fault = mmal_player_SOFT_FAULT_ERROR;
+                else
+                    return usage(ac, av);
+                context.fault_ms = ms != NULL ? strtoul(ms + 1, NULL, 0) : FAULT_INTERVAL_MS;
+                mmal_player_watchdog_options_init(&watchdog_options);
+                options.watchdog = context.watchdog = mmal_player_watchdog_create(&watchdog_options);
+                if(context.watchdog == NULL) {
+                    fprintf(stderr, "unable to start the watchdog\n");
+                    return 1;
+                }
+                break;
+            }
+            case '?':
+            default:
+                return usage(ac, av);
+        }
+    }
+    if(optind < ac)
+        context.uris[0] = av[optind++];
+    if(optind < ac)
+        context.uris[1] = av[optind++];
+
+    vcos_init();
+    if(kernel_iterations > 0)
+        return bench_kernels(kernel_iterations);
+    vcos_semaphore_create(&context.sem_done, "bench.done", 0);
+
+    if(stream) {
+        unsigned width, height;
+
+        if(context.watchdog != NULL) {
+            fprintf(stderr, "-E injects faults into clips, not with -s\n");
+            return 1;
+        }
+        if(sscanf(context.uris[0], "synthetic:%ux%u@%u:%u", &width, &height, &sender.fps, &sender.frames) != 4 ||
+           sender.fps == 0) {
+            fprintf(stderr, "-s needs a synthetic:WIDTHxHEIGHT@FPS:FRAMES URI\n");
+            return 1;
+        }
+        options.stream.width = width;
+        options.stream.height = height;
+        return bench_stream(&sender, &options);
+    }
+
+    if(memory_path != NULL) {
+        if(context.recycle || context.windows > 1) {
+            fprintf(stderr, "-M plays on a single pipeline, without -R or -w\n");
+            return 1;
+        }
+        context.memory = mmal_player_memory_map(memory_path, NULL);
+        if(context.memory == NULL)
+            return 1;
+    }
+
+    if(seeks > 0) {
+        if(context.recycle || context.windows > 1 || sync != NULL || context.watchdog != NULL) {
+            fprintf(stderr, "-S plays on a single pipeline, without -R, -w, -y or -E\n");
+            return 1;
+        }
+        return bench_seek(&context, &options, seeks);
+    }
+
+    if(threads > 0) {
+        executor = mmal_player_executor_create(threads);
+        if(executor == NULL) {
+            fprintf(stderr, "unable to start %d threads\n", threads);
+            return 1;
+        }
+        options.executor = executor;
+    }
+
+    for(i = 1; i < context.windows; i++) {
+        struct mmal_player_options companion = options;
+
+        if(sync != NULL)
+            companion.sync = members[i] = mmal_player_sync_join(sync, MMAL_FALSE);
+        companions[i] = mmal_player_create_with_options(context.uris[0], &companion);
+        if(companions[i] == NULL) {
+            fprintf(stderr, "unable to create pipeline %d\n", i);
+            return 1;
+        }
+        if(skew != 0)
+            mmal_player_soft_clock_skew(companions[i]->scheduler, skew);
+        mmal_player_set_eos_callback(companions[i], companion_eos_callback, &context);
+        mmal_player_start(companions[i]);
+    }
+    if(sync != NULL)
+        options.sync = members[0] = mmal_player_sync_join(sync, MMAL_TRUE);
+
+    if(tap_spec != NULL) {
+        const char* batch = strchr(tap_spec, ':');
+
+        mmal_player_tap_options_init(&tap_options);
+        tap_options.max_fps = strtoul(tap_spec, NULL, 0);
+        if(batch != NULL)
+            tap_options.batch = tap_options.max_held = strtoul(batch + 1, NULL, 0);
+        tap_options.callback = bench_tap_callback;
+        tap_options.user = &context;
+        mmal_player_analysis_options_init(&analysis_options);
+        context.analysis = mmal_player_analysis_create(&analysis_options);
+        options.tap = tap = mmal_player_tap_create(&tap_options);
+        if(tap == NULL || context.analysis == NULL) {
+            fprintf(stderr, "unable to start the tap\n");
+            return 1;
+        }
+    }
+
+    pool = mmal_player_pool_create(1);
+    if(context.memory != NULL)
+        player = mmal_player_create_with_memory(context.memory, &options);
+    else
+        player = pool != NULL ? mmal_player_pool_get(pool, context.uris[0], &options) : NULL;
+    if(player == NULL) {
+        fprintf(stderr, "unable to create pipeline\n");
+        return 1;
+    }
+    mmal_player_set_eos_callback(player, bench_eos_callback, &context);
+    mmal_player_set_exit_callback(player, bench_exit_callback, &context);
+
+    if(overlay_fps > 0) {
+        struct mmal_player_overlay_options overlay_options;
+
+        mmal_player_overlay_options_init(&overlay_options);
+        overlay_options.backend = options.backend;
+        overlay_options.dest_rect.width = OVERLAY_WIDTH;
+        overlay_options.dest_rect.height = OVERLAY_HEIGHT;
+        overlay_options.max_fps = overlay_fps;
+        context.overlay = mmal_player_overlay_create(&overlay_options);
+        if(context.overlay == NULL ||
+           vcos_thread_create(&context.overlay_thread, "bench.overlay", NULL, overlay_draw_thread, &context) != VCOS_SUCCESS) {
+            fprintf(stderr, "unable to start the overlay\n");
+            return 1;
+        }
+    }
+
+    if(context.watchdog != NULL &&
+       vcos_thread_create(&context.fault_thread, "bench.faults", NULL, fault_thread, &context) != VCOS_SUCCESS) {
+        fprintf(stderr, "unable to start injecting faults\n");
+        return 1;
+    }
+
+    getrusage(RUSAGE_SELF, &usage_start);
+    start = vcos_getmicrosecs64();
+    mmal_player_start(player);
+    while(1) {
+        vcos_semaphore_wait(&context.sem_done);
+        if(!context.recycle || context.reason != mmal_player_EOS || context.clips-- <= 0)
+            break;
+
+        mmal_player_join(player);
+        mmal_player_pool_put(pool, player);
+
+        if(context.alternate)
+            context.current ^= 1;
+        player = mmal_player_pool_get(pool, context.uris[context.current], &options);
+        if(player == NULL) {
+            fprintf(stderr, "unable to recycle pipeline\n");
+            return 1;
+        }
+        mmal_player_set_eos_callback(player, bench_eos_callback, &context);
+        mmal_player_set_exit_callback(player, bench_exit_callback, &context);
+        mmal_player_start(player);
+
+        context.switches++;
+        context.switch_total += player->start_time - context.eos_time;
+        context.switch_max = vcos_max(context.switch_max, player->start_time - context.eos_time);
+    }
+    elapsed = vcos_getmicrosecs64() - start;
+    getrusage(RUSAGE_SELF, &usage_end);
+    __atomic_store_n(&context.done, 1, __ATOMIC_RELEASE);
+
+    mmal_player_stop(player);
+    mmal_player_join(player);
+
+    memset(&stats, 0, sizeof(stats));
+    mmal_player_soft_renderer_stats(player->video_renderer, &stats);
+
+    printf("backend: %s, exit reason: %d\n", player->backend->name, context.reason);
+    printf("elapsed: %llu us, frames presented: %u\n", (unsigned long long)elapsed, context.frames);
+    if(stats.resumes > 0)
+        printf("transitions keeping the renderer: %u, EOS to next frame avg %llu us, max %llu us\n", stats.resumes,
+               (unsigned long long)(stats.resume_gap_total / stats.resumes), (unsigned long long)stats.resume_gap_max);
+    if(context.recycle) {
+        struct mmal_player_pool_stats pool_stats;
+
+        mmal_player_pool_get_stats(pool, &pool_stats);
+        printf("recycled transitions: %u (%u kept their decoder), EOS to restart avg %llu us, max %llu us\n",
+               pool_stats.recycled, pool_stats.reused,
+               (unsigned long long)(context.switches > 0 ? context.switch_total / context.switches : 0),
+               (unsigned long long)context.switch_max);
+    } else if(context.switches > 0)
+        printf("rebuilt transitions: %d, EOS to next frame avg %llu us, max %llu us\n", context.switches,
+               (unsigned long long)(context.switch_total / context.switches), (unsigned long long)context.switch_max);
+    printf("longest frame gap: %llu us\n", (unsigned long long)stats.max_frame_gap);
+    if(context.memory != NULL)
+        printf("memory: %u access units looped, %ld blocks read while playing\n",
+               mmal_player_memory_units(context.memory), usage_end.ru_inblock - usage_start.ru_inblock);
+
+    {
+        struct mmal_player_metrics metrics;
+        char line[2048];
+
+        mmal_player_get_metrics(player, &metrics);
+        if(mmal_player_metrics_format_json(&metrics, player->uri, vcos_getmicrosecs64(), line, sizeof(line)) > 0)
+            printf("metrics: %s\n", line);
+    }
+
+    mmal_player_get_loop_stats(player, &loop);
+    printf("loop: %u wakeups for %u signals (%u posts), %u pumps, %u empty, %u buffers moved, %u messages\n",
+           loop.wakeups, loop.signals, loop.posts, loop.pumps, loop.empty_pumps, loop.buffers, loop.messages);
+
+    if(context.windows > 1 || executor != NULL) {
+        printf("windows: %d on %s, %ld voluntary and %ld involuntary context switches\n", context.windows,
+               executor != NULL ? "shared threads" : "a thread each",
+               usage_end.ru_nvcsw - usage_start.ru_nvcsw, usage_end.ru_nivcsw - usage_start.ru_nivcsw);
+    }
+
+    if(context.overlay != NULL) {
+        struct mmal_player_overlay_stats overlay_stats;
+        void* ret = NULL;
+
+        vcos_thread_join(&context.overlay_thread, &ret);
+        mmal_player_overlay_get_stats(context.overlay, &overlay_stats);
+        printf("overlay: %u draws shown in %u updates (%.1f a second), %u waits for a buffer, "
+               "%llu bytes copied per update instead of %u, CPU avg %llu us, max %llu us per update\n",
+               overlay_stats.draws, overlay_stats.updates, overlay_stats.updates * 1e6 / elapsed, overlay_stats.buffer_waits,
+               (unsigned long long)(overlay_stats.updates > 0 ? overlay_stats.bytes / overlay_stats.updates : 0),
+               OVERLAY_WIDTH * OVERLAY_HEIGHT * 4,
+               (unsigned long long)(overlay_stats.copy.count > 0 ? overlay_stats.copy.total / overlay_stats.copy.count : 0),
+               (unsigned long long)overlay_stats.copy.max);
+        mmal_player_overlay_destroy(context.overlay);
+    }
+
+    if(sync != NULL) {
+        struct mmal_player_sync_stats sync_stats;
+        struct mmal_player_timing error = {0, 0, 0};
+        uint32_t jumps = 0;
+
+        for(i = 1; i < context.windows; i++) {
+            struct mmal_player_metrics metrics;
+
+            mmal_player_get_metrics(companions[i], &metrics);
+            error.count += metrics.sync_error.count;
+            error.total += metrics.sync_error.total;
+            error.max = vcos_max(error.max, metrics.sync_error.max);
+            jumps += metrics.sync_jumps;
+        }
+        mmal_player_sync_get_stats(sync, &sync_stats);
+        printf("sync: %u clips started together, drift avg %llu us, max %llu us over %llu checks, %u jumps\n",
+               sync_stats.generation, (unsigned long long)(error.count > 0 ? error.total / error.count : 0),
+               (unsigned long long)error.max, (unsigned long long)error.count, jumps);
+    }
+
+    for(i = 1; i < context.windows; i++) {
+        mmal_player_stop(companions[i]);
+        mmal_player_join(companions[i]);
+        mmal_player_destroy(companions[i]);
+    }
+    mmal_player_destroy(player);
+    mmal_player_pool_destroy(pool);
+    mmal_player_memory_release(context.memory);
+    if(tap != NULL) {
+        struct mmal_player_tap_stats tap_stats;
+
+        mmal_player_tap_get_stats(tap, &tap_stats);
+        printf("tap: %u of %u frames checksummed (%u over the rate, %u with every buffer out, %u dropped) in %u batches, "
+               "%u frozen, checksum %08x, cost avg %llu us, max %llu us per frame, held avg %llu us, max %llu us\n",
+               tap_stats.tapped, tap_stats.offered, tap_stats.skipped_rate, tap_stats.skipped_busy, tap_stats.dropped,
+               tap_stats.batches, context.tap_frozen, context.tap_checksum,
+               (unsigned long long)(tap_stats.cost.count > 0 ? tap_stats.cost.total / tap_stats.cost.count : 0),
+               (unsigned long long)tap_stats.cost.max,
+               (unsigned long long)(tap_stats.hold.count > 0 ? tap_stats.hold.total / tap_stats.hold.count : 0),
+               (unsigned long long)tap_stats.hold.max);
+        printf("analysis: %s kernels, %u frames by the end of their clip, %u black (%u in a row), %u frozen (%u in a row), "
+               "%u hashes, last %016llx\n", mmal_player_analysis_kernels_name(context.analysis),
+               context.analysed.frames, context.analysed.black, context.analysed.black_run_max, context.analysed.frozen,
+               context.analysed.frozen_run_max, context.analysed.hashes, (unsigned long long)context.analysed.hash);
+        mmal_player_tap_destroy(tap);
+        mmal_player_analysis_destroy(context.analysis);
+    }
+    if(sync != NULL) {
+        for(i = 0; i < context.windows; i++)
+            mmal_player_sync_leave(members[i]);
+        mmal_player_sync_close(sync);
+    }
+    if(executor != NULL) {
+        struct mmal_player_executor_stats executor_stats;
+
+        mmal_player_executor_get_stats(executor, &executor_stats);
+        printf("executor: %d threads, %u wakeups, at most %u pipelines waiting\n",
+               executor_stats.workers, executor_stats.steps, executor_stats.queue_max);
+        mmal_player_executor_destroy(executor);
+    }
+    if(context.watchdog != NULL) {
+        struct mmal_player_watchdog_stats watchdog_stats;
+        void* ret = NULL;
+
+        vcos_thread_join(&context.fault_thread, &ret);
+        mmal_player_watchdog_get_stats(context.watchdog, &watchdog_stats);
+        printf("watchdog: %u faults injected, %u stalls and %u errors noticed, %u recovered in avg %llu us, max %llu us, "
+               "%u given up\n", context.faults, watchdog_stats.stalls, watchdog_stats.errors, watchdog_stats.recovered,
+               (unsigned long long)(watchdog_stats.recovery.count > 0 ? watchdog_stats.recovery.total / watchdog_stats.recovery.count : 0),
+               (unsigned long long)watchdog_stats.recovery.max, watchdog_stats.gave_up);
+        printf("recovery:");
+        for(i = 0; i < mmal_player_WATCHDOG_BUCKETS; i++) {
+            if(mmal_player_watchdog_bucket_ms(i) != UINT32_MAX)
+                printf(" <%u ms %u,", mmal_player_watchdog_bucket_ms(i), watchdog_stats.histogram[i]);
+            else
+                printf(" more %u\n", watchdog_stats.histogram[i]);
+        }
+        mmal_player_watchdog_destroy(context.watchdog);
+    }
+    vcos_semaphore_delete(&context.sem_done);
+
+    return context.reason == mmal_player_EOS ? 0 : 1;
+}
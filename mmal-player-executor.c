@@ -0,0 +1,198 @@
+#include "mmal-player-executor.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mmal-player-pipeline.h"
+
+#define EXECUTOR_WORKERS_MAX    16
+
+struct mmal_player_executor
+{
+    VCOS_THREAD_T threads[EXECUTOR_WORKERS_MAX];
+    int workers;
+    VCOS_SEMAPHORE_T sem_work;  // posted once per queued pipeline
+    VCOS_MUTEX_T lock;          // guards the queue and the exec_* fields of every attached pipeline
+
+    struct mmal_player_pipeline* head;  // run queue, linked through exec_next
+    struct mmal_player_pipeline* tail;
+    uint32_t queued;
+    int terminate;
+    uint32_t detach_waiters;    // detaches waiting for a worker to finish a run
+    VCOS_SEMAPHORE_T sem_idle;  // posted once per detach waiter when a run finishes
+
+    struct mmal_player_executor_stats stats;
+};
+
+// with ex->lock held
+static void push(struct mmal_player_executor* ex, struct mmal_player_pipeline* pipeline)
+{
+    pipeline->exec_next = NULL;
+    if(ex->tail != NULL)
+        ex->tail->exec_next = pipeline;
+    else
+        ex->head = pipeline;
+    ex->tail = pipeline;
+    pipeline->exec_queued = MMAL_TRUE;
+
+    if(++ex->queued > ex->stats.queue_max)
+        ex->stats.queue_max = ex->queued;
+    vcos_semaphore_post(&ex->sem_work);
+}
+
+// with ex->lock held
+static struct mmal_player_pipeline* pop(struct mmal_player_executor* ex)
+{
+    struct mmal_player_pipeline* pipeline = ex->head;
+
+    if(pipeline == NULL)
+        return NULL;
+
+    ex->head = pipeline->exec_next;
+    if(ex->head == NULL)
+        ex->tail = NULL;
+    pipeline->exec_next = NULL;
+    pipeline->exec_queued = MMAL_FALSE;
+    ex->queued--;
+
+    return pipeline;
+}
+
+static void* executor_worker(void* arg)
+{
+    struct mmal_player_executor* ex = arg;
+    struct mmal_player_pipeline* pipeline;
+
+    vcos_mutex_lock(&ex->lock);
+    while(!ex->terminate) {
+        if((pipeline = pop(ex)) == NULL) {
+            vcos_mutex_unlock(&ex->lock);
+            vcos_semaphore_wait(&ex->sem_work);
+            vcos_mutex_lock(&ex->lock);
+            continue;
+        }
+
+        pipeline->exec_running = MMAL_TRUE;
+        vcos_mutex_unlock(&ex->lock);
+
+        mmal_player_pipeline_run(pipeline);
+
+        vcos_mutex_lock(&ex->lock);
+        pipeline->exec_running = MMAL_FALSE;
+        ex->stats.steps++;
+        for(; ex->detach_waiters > 0; ex->detach_waiters--)
+            vcos_semaphore_post(&ex->sem_idle);
+        // signalled while it ran: back to the end of the queue, behind the others
+        if(pipeline->exec_rerun && !pipeline->exec_detached) {
+            pipeline->exec_rerun = MMAL_FALSE;
+            push(ex, pipeline);
+        }
+    }
+    vcos_mutex_unlock(&ex->lock);
+
+    return NULL;
+}
+
+struct mmal_player_executor* mmal_player_executor_create(int workers)
+{
+    struct mmal_player_executor* ex;
+    int i;
+
+    if(workers < 1 || workers > EXECUTOR_WORKERS_MAX)
+        return NULL;
+
+    ex = calloc(1, sizeof(struct mmal_player_executor));
+    if(ex == NULL)
+        return NULL;
+
+    vcos_semaphore_create(&ex->sem_work, "mmal_player_executor:work", 0);
+    vcos_semaphore_create(&ex->sem_idle, "mmal_player_executor:idle", 0);
+    vcos_mutex_create(&ex->lock, "mmal_player_executor:lock");
+
+    for(i = 0; i < workers; i++) {
+        if(vcos_thread_create(&ex->threads[i], "mmal_player_executor:worker", NULL, executor_worker, ex) != VCOS_SUCCESS) {
+            fprintf(stderr, "unable to start executor worker %d\n", i);
+            break;
+        }
+        ex->workers++;
+    }
+    ex->stats.workers = ex->workers;
+
+    if(ex->workers == 0) {
+        mmal_player_executor_destroy(ex);
+        return NULL;
+    }
+
+    return ex;
+}
+
+void mmal_player_executor_destroy(struct mmal_player_executor* ex)
+{
+    void* ret = NULL;
+    int i;
+
+    if(ex == NULL)
+        return;
+
+    vcos_mutex_lock(&ex->lock);
+    ex->terminate = 1;
+    vcos_mutex_unlock(&ex->lock);
+
+    for(i = 0; i < ex->workers; i++)
+        vcos_semaphore_post(&ex->sem_work);
+    for(i = 0; i < ex->workers; i++)
+        vcos_thread_join(&ex->threads[i], &ret);
+
+    vcos_semaphore_delete(&ex->sem_idle);
+    vcos_semaphore_delete(&ex->sem_work);
+    vcos_mutex_delete(&ex->lock);
+    free(ex);
+}
+
+void mmal_player_executor_get_stats(struct mmal_player_executor* ex, struct mmal_player_executor_stats* stats)
+{
+    vcos_mutex_lock(&ex->lock);
+    *stats = ex->stats;
+    vcos_mutex_unlock(&ex->lock);
+}
+
+void mmal_player_executor_schedule(struct mmal_player_executor* ex, struct mmal_player_pipeline* pipeline)
+{
+    vcos_mutex_lock(&ex->lock);
+    if(!pipeline->exec_detached) {
+        if(pipeline->exec_running)
+            pipeline->exec_rerun = MMAL_TRUE;
+        else if(!pipeline->exec_queued)
+            push(ex, pipeline);
+    }
+    vcos_mutex_unlock(&ex->lock);
+}
+
+void mmal_player_executor_detach(struct mmal_player_executor* ex, struct mmal_player_pipeline* pipeline)
+{
+    struct mmal_player_pipeline** link;
+
+    vcos_mutex_lock(&ex->lock);
+    while(pipeline->exec_running) {
+        // a worker is finishing a late wakeup for it; counted under the lock so it cannot miss us
+        ex->detach_waiters++;
+        vcos_mutex_unlock(&ex->lock);
+        vcos_semaphore_wait(&ex->sem_idle);
+        vcos_mutex_lock(&ex->lock);
+    }
+
+    if(pipeline->exec_queued) {
+        for(link = &ex->head; *link != pipeline; link = &(*link)->exec_next)
+            ;
+        *link = pipeline->exec_next;
+        if(ex->tail == pipeline) {
+            ex->tail = NULL;
+            for(link = &ex->head; *link != NULL; link = &(*link)->exec_next)
+                ex->tail = *link;
+        }
+        pipeline->exec_queued = MMAL_FALSE;
+        ex->queued--;
+    }
+    pipeline->exec_detached = MMAL_TRUE;
+    vcos_mutex_unlock(&ex->lock);
+}
@@ -0,0 +1,33 @@
+#ifndef MMAL_CHAIN_PLAYER_MMAL_PLAYER_EXECUTOR_H
+#define MMAL_CHAIN_PLAYER_MMAL_PLAYER_EXECUTOR_H
+
+#include <stdint.h>
+
+// Drives the pipelines attached to it (mmal_player_options.executor) from a fixed set of
+// worker threads instead of a thread per pipeline. A pipeline with pending work is queued
+// once and handled by one worker at a time, so threads stay flat as windows are added.
+//
+// EOS and exit callbacks run on a worker: they must not wait for another pipeline of the
+// same executor unless it already ended, a single worker would wait for itself.
+struct mmal_player_executor;
+struct mmal_player_pipeline;
+
+struct mmal_player_executor_stats
+{
+    int workers;
+    uint32_t steps;         // pipeline wakeups handled
+    uint32_t queue_max;     // most pipelines waiting for a worker at once
+};
+
+struct mmal_player_executor* mmal_player_executor_create(int workers);
+// Every pipeline attached to it must have been destroyed
+void mmal_player_executor_destroy(struct mmal_player_executor* ex);
+
+void mmal_player_executor_get_stats(struct mmal_player_executor* ex, struct mmal_player_executor_stats* stats);
+
+// Used by mmal-player-pipeline.c: queues `pipeline` for a worker, or has the worker that runs
+// it now go again; detach waits for that worker and ignores the pipeline from then on.
+void mmal_player_executor_schedule(struct mmal_player_executor* ex, struct mmal_player_pipeline* pipeline);
+void mmal_player_executor_detach(struct mmal_player_executor* ex, struct mmal_player_pipeline* pipeline);
+
+#endif //MMAL_CHAIN_PLAYER_MMAL_PLAYER_EXECUTOR_H
@@ -0,0 +1,470 @@
+#include "mmal-player-index.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "interface/vcos/vcos.h"
+
+#include "mmal-player-stream.h"
+
+#define INDEX_MAGIC             0x3149464b      // "KFI1"
+#define INDEX_VERSION           1
+#define INDEX_SUFFIX            ".kfi"
+#define INDEX_FPS               30              // Annex B carries no timestamps, as in mmal-player-memory.c
+#define INDEX_READ_TIMEOUT_MS   2000
+
+struct mmal_player_index
+{
+    char* path;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+
+    struct mmal_player_keyframe* entries;
+    uint32_t count;
+    uint32_t alloc;
+
+    uint64_t build_time;
+};
+
+// What an index file starts with, followed by the path and the entries
+struct index_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint32_t count;
+    uint32_t path_length;
+};
+
+// FILE.kfi, or a name in `cache_dir` made from the path
+static char* index_file(const char* path, const char* cache_dir)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    size_t length;
+    const char* c;
+    char* name;
+
+    if(cache_dir == NULL) {
+        length = strlen(path) + sizeof(INDEX_SUFFIX);
+        if((name = malloc(length)) != NULL)
+            snprintf(name, length, "%s" INDEX_SUFFIX, path);
+        return name;
+    }
+
+    // FNV-1a; the path in the file tells collisions apart
+    for(c = path; *c != '\0'; c++)
+        hash = (hash ^ (uint8_t)*c) * 0x100000001b3ull;
+    length = strlen(cache_dir) + 18 + sizeof(INDEX_SUFFIX);
+    if((name = malloc(length)) != NULL)
+        snprintf(name, length, "%s/%016llx" INDEX_SUFFIX, cache_dir, (unsigned long long)hash);
+    return name;
+}
+
+struct mmal_player_index* mmal_player_index_create(const char* path)
+{
+    struct mmal_player_index* index;
+    struct stat st;
+
+    if(stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+        return NULL;
+
+    index = calloc(1, sizeof(struct mmal_player_index));
+    if(index == NULL)
+        return NULL;
+    index->path = strdup(path);
+    if(index->path == NULL) {
+        free(index);
+        return NULL;
+    }
+    index->size = st.st_size;
+    index->mtime_sec = st.st_mtim.tv_sec;
+    index->mtime_nsec = st.st_mtim.tv_nsec;
+
+    return index;
+}
+
+void mmal_player_index_destroy(struct mmal_player_index* index)
+{
+    if(index == NULL)
+        return;
+    free(index->entries);
+    free(index->path);
+    free(index);
+}
+
+MMAL_STATUS_T mmal_player_index_add(struct mmal_player_index* index, int64_t pts, uint64_t offset, uint32_t type)
+{
+    struct mmal_player_keyframe* entry;
+
+    if(index->count > 0 && pts <= index->entries[index->count - 1].pts)
+        return pts == index->entries[index->count - 1].pts ? MMAL_SUCCESS : MMAL_EINVAL;
+
+    if(index->count == index->alloc) {
+        uint32_t alloc = index->alloc > 0 ? index->alloc * 2 : 64;
+        struct mmal_player_keyframe* grown = realloc(index->entries, alloc * sizeof(struct mmal_player_keyframe));
+
+        if(grown == NULL)
+            return MMAL_ENOMEM;
+        index->entries = grown;
+        index->alloc = alloc;
+    }
+
+    entry = &index->entries[index->count++];
+    entry->pts = pts;
+    entry->offset = offset;
+    entry->type = type;
+    entry->reserved = 0;
+
+    return MMAL_SUCCESS;
+}
+
+struct mmal_player_index* mmal_player_index_load(const char* path, const char* cache_dir)
+{
+    struct mmal_player_index* index;
+    struct index_header header;
+    uint64_t started = vcos_getmicrosecs64();
+    char* name;
+    char* stored = NULL;
+    FILE* file;
+    int valid = 0;
+
+    if((index = mmal_player_index_create(path)) == NULL)
+        return NULL;
+    if((name = index_file(path, cache_dir)) == NULL || (file = fopen(name, "rb")) == NULL) {
+        free(name);
+        mmal_player_index_destroy(index);
+        return NULL;
+    }
+
+    if(fread(&header, sizeof(header), 1, file) == 1 && header.magic == INDEX_MAGIC && header.version == INDEX_VERSION &&
+       header.size == index->size && header.mtime_sec == index->mtime_sec && header.mtime_nsec == index->mtime_nsec &&
+       header.path_length == strlen(path) && header.count > 0 && (stored = malloc(header.path_length)) != NULL &&
+       fread(stored, header.path_length, 1, file) == 1 && memcmp(stored, path, header.path_length) == 0 &&
+       (index->entries = malloc(header.count * sizeof(struct mmal_player_keyframe))) != NULL &&
+       fread(index->entries, sizeof(struct mmal_player_keyframe), header.count, file) == header.count) {
+        index->count = index->alloc = header.count;
+        valid = 1;
+    }
+
+    fclose(file);
+    free(stored);
+    free(name);
+    if(!valid) {
+        mmal_player_index_destroy(index);
+        return NULL;
+    }
+    index->build_time = vcos_getmicrosecs64() - started;
+    return index;
+}
+
+// Written to a temporary file first, so a pipeline opening the file meanwhile never reads half of it
+MMAL_STATUS_T mmal_player_index_save(struct mmal_player_index* index, const char* cache_dir)
+{
+    struct index_header header;
+    char* name = index_file(index->path, cache_dir);
+    char* temporary;
+    size_t length;
+    FILE* file;
+    int failed;
+
+    if(name == NULL)
+        return MMAL_ENOMEM;
+    length = strlen(name) + 16;
+    if((temporary = malloc(length)) == NULL) {
+        free(name);
+        return MMAL_ENOMEM;
+    }
+    snprintf(temporary, length, "%s.%d", name, (int)getpid());
+
+    if((file = fopen(temporary, "wb")) == NULL) {
+        fprintf(stderr, "index: unable to write %s: %s\n", temporary, strerror(errno));
+        free(temporary);
+        free(name);
+        return MMAL_EIO;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = INDEX_MAGIC;
+    header.version = INDEX_VERSION;
+    header.size = index->size;
+    header.mtime_sec = index->mtime_sec;
+    header.mtime_nsec = index->mtime_nsec;
+    header.count = index->count;
+    header.path_length = strlen(index->path);
+
+    failed = fwrite(&header, sizeof(header), 1, file) != 1 ||
+             fwrite(index->path, header.path_length, 1, file) != 1 ||
+             fwrite(index->entries, sizeof(struct mmal_player_keyframe), index->count, file) != index->count;
+    failed |= fclose(file) != 0;
+    if(failed || rename(temporary, name) != 0) {
+        fprintf(stderr, "index: unable to write %s\n", name);
+        unlink(temporary);
+        failed = 1;
+    }
+
+    free(temporary);
+    free(name);
+    return failed ? MMAL_EIO : MMAL_SUCCESS;
+}
+
+uint32_t mmal_player_index_count(struct mmal_player_index* index)
+{
+    return index->count;
+}
+
+const struct mmal_player_keyframe* mmal_player_index_entry(struct mmal_player_index* index, uint32_t i)
+{
+    return i < index->count ? &index->entries[i] : NULL;
+}
+
+const struct mmal_player_keyframe* mmal_player_index_find(struct mmal_player_index* index, int64_t pts, uint32_t flags)
+{
+    uint32_t low = 0, high = index->count;
+
+    if(index->count == 0)
+        return NULL;
+
+    // the first entry after `pts`
+    while(low < high) {
+        uint32_t middle = low + (high - low) / 2;
+
+        if(index->entries[middle].pts <= pts)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    if(flags & MMAL_PARAM_SEEK_FLAG_FORWARD) {
+        if(low > 0 && index->entries[low - 1].pts == pts)
+            return &index->entries[low - 1];
+        return &index->entries[low < index->count ? low : index->count - 1];
+    }
+    return &index->entries[low > 0 ? low - 1 : 0];
+}
+
+const struct mmal_player_keyframe* mmal_player_index_loop_point(struct mmal_player_index* index)
+{
+    uint32_t i;
+
+    for(i = 0; i < index->count; i++)
+        if(index->entries[i].type != mmal_player_KEYFRAME_INTRA)
+            return &index->entries[i];
+    return index->count > 0 ? &index->entries[0] : NULL;
+}
+
+uint64_t mmal_player_index_build_time(struct mmal_player_index* index)
+{
+    return index->build_time;
+}
+
+/* building */
+
+// Exp-Golomb, enough of it for the start of a slice header
+static uint32_t read_ue(const uint8_t* data, size_t size, uint32_t* bit)
+{
+    uint32_t zeros = 0, value = 0, i;
+
+    while(*bit < size * 8 && !(data[*bit / 8] & (0x80 >> (*bit % 8)))) {
+        if(++zeros > 31)
+            return UINT32_MAX;
+        (*bit)++;
+    }
+    (*bit)++;
+    for(i = 0; i < zeros; i++) {
+        value <<= 1;
+        if(*bit < size * 8 && (data[*bit / 8] & (0x80 >> (*bit % 8))))
+            value |= 1;
+        (*bit)++;
+    }
+    return (1u << zeros) - 1 + value;
+}
+
+// A non-IDR slice that is I or SI: first_mb_in_slice, then slice_type
+static MMAL_BOOL_T slice_is_intra(const uint8_t* data, size_t size)
+{
+    uint32_t bit = 0, type;
+
+    read_ue(data, size, &bit);
+    type = read_ue(data, size, &bit);
+    return type != UINT32_MAX && (type % 5 == 2 || type % 5 == 4);
+}
+
+// The access units are cut as in mmal-player-memory.c, each keyframe's offset is where its unit starts
+static MMAL_STATUS_T index_scan(struct mmal_player_index* index, const uint8_t* data, size_t size, uint32_t fps)
+{
+    int64_t interval = 1000000 / fps;
+    uint32_t frame = 0;
+    size_t i, start = 0;
+    MMAL_BOOL_T vcl = MMAL_FALSE;
+    int type_found = -1;
+    MMAL_STATUS_T status = MMAL_SUCCESS;
+
+    for(i = 0; i + 4 < size && status == MMAL_SUCCESS; i++) {
+        uint8_t type;
+
+        if(data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1)
+            continue;
+        type = data[i + 3] & 0x1f;
+
+        if(vcl && mmal_player_h264_starts_access_unit(type, data[i + 4])) {
+            if(type_found >= 0)
+                status = mmal_player_index_add(index, frame * interval, start, type_found);
+            frame++;
+            start = i > 0 && data[i - 1] == 0 ? i - 1 : i;
+            vcl = MMAL_FALSE;
+            type_found = -1;
+        }
+
+        if(type == 5)
+            type_found = mmal_player_KEYFRAME_IDR;
+        else if(type == 1 && !vcl && slice_is_intra(data + i + 4, size - i - 4))
+            type_found = mmal_player_KEYFRAME_INTRA;
+        if(type == 1 || type == 5)
+            vcl = MMAL_TRUE;
+        i += 2;
+    }
+    if(status == MMAL_SUCCESS && vcl && type_found >= 0)
+        status = mmal_player_index_add(index, frame * interval, start, type_found);
+
+    return status;
+}
+
+struct index_reader
+{
+    VCOS_SEMAPHORE_T ready;
+    MMAL_QUEUE_T* queue;
+};
+
+static void index_reader_callback(MMAL_PORT_T* port, MMAL_BUFFER_HEADER_T* buffer)
+{
+    struct index_reader* reader = (struct index_reader*)port->userdata;
+
+    mmal_queue_put(reader->queue, buffer);
+    vcos_semaphore_post(&reader->ready);
+}
+
+static void index_control_callback(MMAL_PORT_T* port, MMAL_BUFFER_HEADER_T* buffer)
+{
+    mmal_buffer_header_release(buffer);
+}
+
+// Runs the container reader alone over the file, as fast as it goes, noting the keyframes
+static MMAL_STATUS_T index_read(struct mmal_player_index* index, const struct mmal_player_backend* backend)
+{
+    MMAL_COMPONENT_T* component = NULL;
+    MMAL_POOL_T* pool = NULL;
+    MMAL_PORT_T* out = NULL;
+    MMAL_BUFFER_HEADER_T* buffer;
+    MMAL_BOOL_T eos = MMAL_FALSE;
+    MMAL_STATUS_T status;
+    struct index_reader reader;
+
+    vcos_semaphore_create(&reader.ready, "index:ready", 0);
+    reader.queue = mmal_queue_create();
+
+    status = backend->component_create(mmal_player_ROLE_READER, &component);
+    if(status != MMAL_SUCCESS)
+        goto error;
+    status = backend->set_uri(component, index->path);
+    if(status != MMAL_SUCCESS)
+        goto error;
+
+    out = component->output[0];
+    out->buffer_num = vcos_max(out->buffer_num_recommended, out->buffer_num_min);
+    out->buffer_size = vcos_max(out->buffer_size_recommended, out->buffer_size_min);
+    pool = mmal_pool_create(out->buffer_num, out->buffer_size);
+    if(pool == NULL || reader.queue == NULL) {
+        status = MMAL_ENOMEM;
+        goto error;
+    }
+    out->userdata = (struct MMAL_PORT_USERDATA_T*)&reader;
+
+    if((status = backend->port_enable(component->control, index_control_callback)) != MMAL_SUCCESS ||
+       (status = backend->port_enable(out, index_reader_callback)) != MMAL_SUCCESS ||
+       (status = backend->component_enable(component)) != MMAL_SUCCESS)
+        goto error;
+
+    while(!eos) {
+        while((buffer = mmal_queue_get(pool->queue)) != NULL) {
+            if((status = backend->send_buffer(out, buffer)) != MMAL_SUCCESS) {
+                mmal_buffer_header_release(buffer);
+                goto error;
+            }
+        }
+
+        if(vcos_semaphore_wait_timeout(&reader.ready, INDEX_READ_TIMEOUT_MS) != VCOS_SUCCESS) {
+            fprintf(stderr, "index: %s: the reader stalled\n", index->path);
+            status = MMAL_EIO;
+            goto error;
+        }
+        buffer = mmal_queue_get(reader.queue);
+        if((buffer->flags & MMAL_BUFFER_HEADER_FLAG_KEYFRAME) && buffer->pts != MMAL_TIME_UNKNOWN)
+            mmal_player_index_add(index, buffer->pts, mmal_player_INDEX_NO_OFFSET, mmal_player_KEYFRAME_FLAGGED);
+        eos = (buffer->flags & MMAL_BUFFER_HEADER_FLAG_EOS) != 0;
+        mmal_buffer_header_release(buffer);
+    }
+
+error:
+    if(component != NULL) {
+        backend->component_disable(component);
+        if(out != NULL && out->is_enabled)
+            backend->port_disable(out);
+        if(component->control->is_enabled)
+            backend->port_disable(component->control);
+        // buffers the callback queued after the last wait
+        while((buffer = mmal_queue_get(reader.queue)) != NULL)
+            mmal_buffer_header_release(buffer);
+        backend->component_destroy(component);
+    }
+    if(pool != NULL)
+        mmal_pool_destroy(pool);
+    if(reader.queue != NULL)
+        mmal_queue_destroy(reader.queue);
+    vcos_semaphore_delete(&reader.ready);
+    return status;
+}
+
+struct mmal_player_index* mmal_player_index_build(const char* path, const struct mmal_player_backend* backend, uint32_t fps)
+{
+    struct mmal_player_index* index;
+    uint64_t started = vcos_getmicrosecs64();
+    MMAL_STATUS_T status;
+    uint8_t* data;
+    int fd;
+
+    if((index = mmal_player_index_create(path)) == NULL) {
+        fprintf(stderr, "index: %s is not a file\n", path);
+        return NULL;
+    }
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    data = fd >= 0 && index->size >= 4 ? mmap(NULL, index->size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    if(fd >= 0)
+        close(fd);
+
+    if(data != MAP_FAILED && data[0] == 0 && data[1] == 0 && (data[2] == 1 || (data[2] == 0 && data[3] == 1))) {
+        madvise(data, index->size, MADV_SEQUENTIAL);
+        status = index_scan(index, data, index->size, fps > 0 ? fps : INDEX_FPS);
+    } else {
+        status = backend != NULL ? index_read(index, backend) : MMAL_ENOSYS;
+    }
+    if(data != MAP_FAILED)
+        munmap(data, index->size);
+
+    if(status != MMAL_SUCCESS || index->count == 0) {
+        fprintf(stderr, "index: no keyframes found in %s\n", path);
+        mmal_player_index_destroy(index);
+        return NULL;
+    }
+    index->build_time = vcos_getmicrosecs64() - started;
+    return index;
+}
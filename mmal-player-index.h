@@ -0,0 +1,63 @@
+#ifndef MMAL_CHAIN_PLAYER_MMAL_PLAYER_INDEX_H
+#define MMAL_CHAIN_PLAYER_MMAL_PLAYER_INDEX_H
+
+#include <stdint.h>
+
+#include "interface/mmal/mmal.h"
+
+#include "mmal-player-backend.h"
+
+// Where the keyframes of a file are, so a seek can ask the container reader for an exact
+// keyframe time and a loop can restart at a clean one. An index is built once per file, by the
+// pipeline from the first playback or offline by mmal-player-indexer, and kept in a small file:
+// FILE.kfi next to it, or a cache directory. It is keyed by the file's path, size and mtime,
+// a changed file simply has none.
+struct mmal_player_index;
+
+enum mmal_player_keyframe_type {
+    mmal_player_KEYFRAME_IDR = 0,       // closed GOP, decoding can start here
+    mmal_player_KEYFRAME_INTRA,         // I slices without IDR: open GOP, frames after it may refer back
+    mmal_player_KEYFRAME_FLAGGED,       // flagged by the container reader, taken as clean
+};
+
+#define mmal_player_INDEX_NO_OFFSET     UINT64_MAX
+
+struct mmal_player_keyframe
+{
+    int64_t pts;
+    uint64_t offset;        // of the access unit in the file, mmal_player_INDEX_NO_OFFSET when the reader hid it
+    uint32_t type;          // enum mmal_player_keyframe_type
+    uint32_t reserved;
+};
+
+// 0 or NULL takes the default
+struct mmal_player_index_options
+{
+    MMAL_BOOL_T enabled;
+    const char* cache_dir;  // NULL: the sidecar next to the file; kept, not copied
+};
+
+// An empty index for `path`, NULL when it is not a file
+struct mmal_player_index* mmal_player_index_create(const char* path);
+// The stored index of `path`, NULL when there is none or the file changed since
+struct mmal_player_index* mmal_player_index_load(const char* path, const char* cache_dir);
+// Reads the whole file: Annex B H.264 is scanned for IDR and I slices, with PTS at `fps` (0: 30)
+// and byte offsets; anything else goes through `backend`'s container reader
+struct mmal_player_index* mmal_player_index_build(const char* path, const struct mmal_player_backend* backend, uint32_t fps);
+MMAL_STATUS_T mmal_player_index_save(struct mmal_player_index* index, const char* cache_dir);
+void mmal_player_index_destroy(struct mmal_player_index* index);
+
+// Keyframes come in PTS order; a repeat of the last one (a frame over several buffers) is dropped
+MMAL_STATUS_T mmal_player_index_add(struct mmal_player_index* index, int64_t pts, uint64_t offset, uint32_t type);
+
+uint32_t mmal_player_index_count(struct mmal_player_index* index);
+const struct mmal_player_keyframe* mmal_player_index_entry(struct mmal_player_index* index, uint32_t i);
+// The keyframe at or before `pts`, at or after it with MMAL_PARAM_SEEK_FLAG_FORWARD, or the
+// nearest the other way; NULL for an empty index
+const struct mmal_player_keyframe* mmal_player_index_find(struct mmal_player_index* index, int64_t pts, uint32_t flags);
+// Where a loop restarts: the first clean keyframe
+const struct mmal_player_keyframe* mmal_player_index_loop_point(struct mmal_player_index* index);
+// us spent building, or loading, the index
+uint64_t mmal_player_index_build_time(struct mmal_player_index* index);
+
+#endif //MMAL_CHAIN_PLAYER_MMAL_PLAYER_INDEX_H
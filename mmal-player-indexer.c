@@ -0,0 +1,86 @@
+#include "interface/vcos/vcos.h"
+#include "interface/mmal/mmal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "mmal-player-index.h"
+
+// Builds the keyframe indexes of files ahead of time, so even their first playback seeks and
+// loops with one.
+
+static const struct option long_options[] =
+{
+    {"cache-dir", required_argument, NULL, 'd'},
+    {"backend",   required_argument, NULL, 'b'},
+    {"fps",       required_argument, NULL, 'f'},
+    {NULL, 0,                        NULL, 0}
+};
+
+int usage(int ac, char** av)
+{
+    printf("Usage: %s [-d DIR] [-b mmal|soft] [-f FPS] FILE...\n", *av);
+    printf("\t-d DIR\t\tStore the indexes in DIR instead of next to each FILE, as FILE.kfi\n");
+    printf("\t-b mmal|soft\tBackend reading the files that are not an H.264 byte stream\n");
+    printf("\t-f FPS\t\tFrame rate of H.264 byte streams, 30 if not given\n");
+
+    return -1;
+}
+
+int main(int ac, char** av)
+{
+    const struct mmal_player_backend* backend = &mmal_player_backend_mmal;
+    const char* cache_dir = NULL;
+    uint32_t fps = 0;
+    int failed = 0;
+
+    int opt = -1;
+    while((opt = getopt_long(ac, av, "d:b:f:", long_options, NULL)) != -1) {
+        switch(opt) {
+            case 'd':
+                cache_dir = optarg;
+                break;
+            case 'b':
+                if(strcmp(optarg, "mmal") == 0)
+                    backend = &mmal_player_backend_mmal;
+                else if(strcmp(optarg, "soft") == 0)
+                    backend = &mmal_player_backend_soft;
+                else
+                    return usage(ac, av);
+                break;
+            case 'f':
+                fps = strtoul(optarg, NULL, 0);
+                break;
+            case '?':
+            default:
+                return usage(ac, av);
+        }
+    }
+    if(optind >= ac)
+        return usage(ac, av);
+
+    vcos_init();
+
+    for(; optind < ac; optind++) {
+        struct mmal_player_index* index;
+        uint32_t types[mmal_player_KEYFRAME_FLAGGED + 1] = {0}, i;
+
+        index = mmal_player_index_build(av[optind], backend, fps);
+        if(index == NULL || mmal_player_index_save(index, cache_dir) != MMAL_SUCCESS) {
+            fprintf(stderr, "%s: unable to index\n", av[optind]);
+            mmal_player_index_destroy(index);
+            failed++;
+            continue;
+        }
+
+        for(i = 0; i < mmal_player_index_count(index); i++)
+            types[mmal_player_index_entry(index, i)->type]++;
+        printf("%s: %u keyframes (%u IDR, %u intra, %u flagged) in %llu us\n", av[optind],
+               mmal_player_index_count(index), types[mmal_player_KEYFRAME_IDR], types[mmal_player_KEYFRAME_INTRA],
+               types[mmal_player_KEYFRAME_FLAGGED], (unsigned long long)mmal_player_index_build_time(index));
+        mmal_player_index_destroy(index);
+    }
+
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,297 @@
+#include "mmal-player-memory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "interface/vcos/vcos.h"
+
+#include "mmal-player-stream.h"
+
+#define MEMORY_FPS          30
+#define MEMORY_WIDTH        1920
+#define MEMORY_HEIGHT       1080
+
+struct memory_unit
+{
+    uint32_t offset;
+    uint32_t length;
+    uint32_t flags;
+};
+
+struct mmal_player_memory
+{
+    int refs;                   // atomic
+    char* name;
+    const uint8_t* data;
+    size_t size;
+    MMAL_BOOL_T mapped;         // munmap() data, otherwise call release
+    void (*release)(void*);
+    void* userdata;
+
+    struct mmal_player_memory_options options;
+    int64_t frame_interval;
+
+    struct memory_unit* units;
+    uint32_t count;
+    uint32_t max_unit;
+};
+
+// Cuts the byte stream at every access unit boundary; whatever precedes the first one (parameter
+// sets, SEI) goes with it, as a container reader hands it over with the first frame
+static int memory_index(struct mmal_player_memory* m)
+{
+    uint32_t alloc = 0, start = 0;
+    uint32_t flags = 0;
+    MMAL_BOOL_T vcl = MMAL_FALSE;
+    size_t i;
+
+    for(i = 0; i <= m->size; i++) {
+        MMAL_BOOL_T boundary = i == m->size;
+        uint8_t type = 0;
+
+        if(!boundary) {
+            if(i + 4 >= m->size || m->data[i] != 0 || m->data[i + 1] != 0 || m->data[i + 2] != 1)
+                continue;
+            type = m->data[i + 3] & 0x1f;
+            boundary = vcl && mmal_player_h264_starts_access_unit(type, m->data[i + 4]);
+        }
+
+        if(boundary) {
+            // a four byte start code belongs to the next access unit
+            uint32_t end = i < m->size && i > start && m->data[i - 1] == 0 ? i - 1 : i;
+
+            if(!vcl && m->count > 0) {
+                // trailing NAL units without a slice (end of stream) go with the last frame
+                m->units[m->count - 1].length += end - start;
+                m->max_unit = vcos_max(m->max_unit, m->units[m->count - 1].length);
+                break;
+            }
+            if(m->count == alloc) {
+                struct memory_unit* grown;
+
+                alloc = alloc > 0 ? alloc * 2 : 256;
+                grown = realloc(m->units, alloc * sizeof(struct memory_unit));
+                if(grown == NULL)
+                    return -1;
+                m->units = grown;
+            }
+            m->units[m->count].offset = start;
+            m->units[m->count].length = end - start;
+            m->units[m->count].flags = flags | MMAL_BUFFER_HEADER_FLAG_FRAME_END;
+            m->max_unit = vcos_max(m->max_unit, end - start);
+            m->count++;
+
+            start = end;
+            vcl = MMAL_FALSE;
+            flags = 0;
+            if(i == m->size)
+                break;
+        }
+
+        if(type == 1 || type == 5)
+            vcl = MMAL_TRUE;
+        if(type == 5)
+            flags |= MMAL_BUFFER_HEADER_FLAG_KEYFRAME;
+        i += 2;
+    }
+
+    return m->count > 0 ? 0 : -1;
+}
+
+static struct mmal_player_memory* memory_create(const char* name, const struct mmal_player_memory_options* options)
+{
+    struct mmal_player_memory* m = calloc(1, sizeof(struct mmal_player_memory));
+
+    if(m == NULL)
+        return NULL;
+    m->name = malloc(strlen(name) + 8);
+    if(m->name == NULL) {
+        free(m);
+        return NULL;
+    }
+    sprintf(m->name, "memory:%s", name);
+    m->refs = 1;
+
+    if(options != NULL)
+        m->options = *options;
+    if(m->options.fps == 0)
+        m->options.fps = MEMORY_FPS;
+    if(m->options.width == 0 || m->options.height == 0) {
+        m->options.width = MEMORY_WIDTH;
+        m->options.height = MEMORY_HEIGHT;
+    }
+    m->frame_interval = 1000000 / m->options.fps;
+
+    return m;
+}
+
+static void memory_destroy(struct mmal_player_memory* m)
+{
+    if(m->mapped)
+        munmap((void*)m->data, m->size);
+    else if(m->release != NULL)
+        m->release(m->userdata);
+    free(m->units);
+    free(m->name);
+    free(m);
+}
+
+struct mmal_player_memory* mmal_player_memory_map(const char* path, const struct mmal_player_memory_options* options)
+{
+    struct mmal_player_memory* m;
+    struct stat st;
+    void* data;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0 || (uint64_t)st.st_size > UINT32_MAX) {
+        fprintf(stderr, "memory: unable to open %s: %s\n", path, fd < 0 ? strerror(errno) : "not a clip");
+        if(fd >= 0)
+            close(fd);
+        return NULL;
+    }
+
+    // read in once here; pinned when the limits allow, so loops never page it back in
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        fprintf(stderr, "memory: unable to map %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    mlock(data, st.st_size);
+
+    m = memory_create(path, options);
+    if(m == NULL) {
+        munmap(data, st.st_size);
+        return NULL;
+    }
+    m->data = data;
+    m->size = st.st_size;
+    m->mapped = MMAL_TRUE;
+
+    if(memory_index(m) != 0) {
+        fprintf(stderr, "memory: no H.264 access units in %s\n", path);
+        memory_destroy(m);
+        return NULL;
+    }
+    return m;
+}
+
+struct mmal_player_memory* mmal_player_memory_wrap(const void* data, size_t size, const struct mmal_player_memory_options* options,
+                                                   void (*release)(void*), void* userdata)
+{
+    struct mmal_player_memory* m;
+    char name[32];
+
+    if(data == NULL || size == 0 || size > UINT32_MAX)
+        return NULL;
+
+    snprintf(name, sizeof(name), "%p", data);
+    m = memory_create(name, options);
+    if(m == NULL)
+        return NULL;
+    m->data = data;
+    m->size = size;
+
+    if(memory_index(m) != 0) {
+        fprintf(stderr, "memory: no H.264 access units at %p\n", data);
+        // the caller still owns `data` when it was not taken
+        free(m->units);
+        free(m->name);
+        free(m);
+        return NULL;
+    }
+    m->release = release;
+    m->userdata = userdata;
+    return m;
+}
+
+struct mmal_player_memory* mmal_player_memory_retain(struct mmal_player_memory* m)
+{
+    __atomic_add_fetch(&m->refs, 1, __ATOMIC_RELAXED);
+    return m;
+}
+
+void mmal_player_memory_release(struct mmal_player_memory* m)
+{
+    if(m != NULL && __atomic_sub_fetch(&m->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        memory_destroy(m);
+}
+
+const char* mmal_player_memory_name(struct mmal_player_memory* m)
+{
+    return m->name;
+}
+
+void mmal_player_memory_format(struct mmal_player_memory* m, MMAL_ES_FORMAT_T* format)
+{
+    format->type = MMAL_ES_TYPE_VIDEO;
+    format->encoding = MMAL_ENCODING_H264;
+    format->encoding_variant = 0;
+    format->bitrate = 0;
+    format->flags = MMAL_ES_FORMAT_FLAG_FRAMED;
+    format->extradata_size = 0;
+
+    format->es->video.width = VCOS_ALIGN_UP(m->options.width, 32);
+    format->es->video.height = VCOS_ALIGN_UP(m->options.height, 16);
+    format->es->video.crop.x = format->es->video.crop.y = 0;
+    format->es->video.crop.width = m->options.width;
+    format->es->video.crop.height = m->options.height;
+    format->es->video.frame_rate.num = m->options.fps;
+    format->es->video.frame_rate.den = 1;
+}
+
+int64_t mmal_player_memory_frame_interval(struct mmal_player_memory* m)
+{
+    return m->frame_interval;
+}
+
+uint32_t mmal_player_memory_units(struct mmal_player_memory* m)
+{
+    return m->count;
+}
+
+uint32_t mmal_player_memory_max_unit(struct mmal_player_memory* m)
+{
+    return m->max_unit;
+}
+
+void mmal_player_memory_unit(struct mmal_player_memory* m, uint32_t index, MMAL_BUFFER_HEADER_T* buffer)
+{
+    const struct memory_unit* unit = &m->units[index];
+
+    // only ever read: the decoder input neither writes nor frees a payload it was sent
+    buffer->data = (uint8_t*)m->data + unit->offset;
+    buffer->alloc_size = unit->length;
+    buffer->offset = 0;
+    buffer->length = unit->length;
+    buffer->flags = unit->flags;
+    buffer->pts = buffer->dts = index * m->frame_interval;
+}
+
+uint32_t mmal_player_memory_seek(struct mmal_player_memory* m, int64_t pts, uint32_t flags)
+{
+    int64_t target = pts > 0 ? (pts + m->frame_interval - 1) / m->frame_interval : 0;
+    uint32_t index = (uint32_t)vcos_min(target, (int64_t)m->count - 1);
+    uint32_t i;
+
+    if(flags & MMAL_PARAM_SEEK_FLAG_FORWARD) {
+        for(i = index; i < m->count; i++)
+            if(m->units[i].flags & MMAL_BUFFER_HEADER_FLAG_KEYFRAME)
+                return i;
+    }
+    // a PTS between two frames belongs to the earlier one
+    if(!(flags & MMAL_PARAM_SEEK_FLAG_FORWARD) && index > 0 && index * m->frame_interval > pts)
+        index--;
+    for(i = index + 1; i-- > 0; )
+        if(m->units[i].flags & MMAL_BUFFER_HEADER_FLAG_KEYFRAME)
+            return i;
+    // no keyframe flagged that early: the first unit starts the stream anyway
+    return 0;
+}
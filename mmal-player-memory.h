@@ -0,0 +1,46 @@
+#ifndef MMAL_CHAIN_PLAYER_MMAL_PLAYER_MEMORY_H
+#define MMAL_CHAIN_PLAYER_MMAL_PLAYER_MEMORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "interface/mmal/mmal.h"
+
+// A clip held in memory as an H.264 Annex B byte stream, for short clips played over and over.
+// It is split into access units once, when loaded; a pipeline playing it sends the decoder
+// buffer headers that point straight into that memory, so a loop reads and copies nothing.
+// Clips are reference counted and can be played by several pipelines at once.
+struct mmal_player_memory;
+
+// 0 takes the default
+struct mmal_player_memory_options
+{
+    uint32_t fps;           // frame rate, the byte stream carries no timestamps
+    uint32_t width;         // expected picture size, the decoder follows the stream's own
+    uint32_t height;
+};
+
+// Maps the file and reads it in
+struct mmal_player_memory* mmal_player_memory_map(const char* path, const struct mmal_player_memory_options* options);
+// Plays the caller's `data`, which has to stay valid until `release` is called with `userdata`
+struct mmal_player_memory* mmal_player_memory_wrap(const void* data, size_t size, const struct mmal_player_memory_options* options,
+                                                   void (*release)(void*), void* userdata);
+
+struct mmal_player_memory* mmal_player_memory_retain(struct mmal_player_memory* memory);
+void mmal_player_memory_release(struct mmal_player_memory* memory);
+
+// "memory:" and the file name, stands in for the URI in metrics and logs
+const char* mmal_player_memory_name(struct mmal_player_memory* memory);
+// The format the decoder input has to be committed with
+void mmal_player_memory_format(struct mmal_player_memory* memory, MMAL_ES_FORMAT_T* format);
+int64_t mmal_player_memory_frame_interval(struct mmal_player_memory* memory);
+
+uint32_t mmal_player_memory_units(struct mmal_player_memory* memory);
+uint32_t mmal_player_memory_max_unit(struct mmal_player_memory* memory);
+// Points `buffer` at access unit `index`, with its PTS and flags
+void mmal_player_memory_unit(struct mmal_player_memory* memory, uint32_t index, MMAL_BUFFER_HEADER_T* buffer);
+// The keyframe unit at or before `pts`, at or after it with MMAL_PARAM_SEEK_FLAG_FORWARD; like a
+// container reader's seek, it falls back to the nearest keyframe in the other direction
+uint32_t mmal_player_memory_seek(struct mmal_player_memory* memory, int64_t pts, uint32_t flags);
+
+#endif //MMAL_CHAIN_PLAYER_MMAL_PLAYER_MEMORY_H
@@ -0,0 +1,147 @@
+#include "mmal-player-metrics.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char* stage_names[mmal_player_STAGE_MAX] = {
+    "reader_to_decoder",
+    "decoder_to_scheduler",
+    "scheduler_to_renderer",
+};
+
+static const char* switch_names[mmal_player_SWITCH_MAX] = {
+    "rewind",
+    "reader",
+    "decoder",
+    "rebuild",
+};
+
+static void timing_copy(struct mmal_player_timing* dst, const struct mmal_player_timing* src)
+{
+    dst->count = __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+    dst->total = __atomic_load_n(&src->total, __ATOMIC_RELAXED);
+    dst->max = __atomic_load_n(&src->max, __ATOMIC_RELAXED);
+}
+
+void mmal_player_metrics_copy(struct mmal_player_metrics* dst, const struct mmal_player_metrics* src)
+{
+    int i;
+
+    for(i = 0; i < mmal_player_STAGE_MAX; i++) {
+        dst->stage[i].in_flight = __atomic_load_n(&src->stage[i].in_flight, __ATOMIC_RELAXED);
+        dst->stage[i].buffers = __atomic_load_n(&src->stage[i].buffers, __ATOMIC_RELAXED);
+        timing_copy(&dst->stage[i].queue_wait, &src->stage[i].queue_wait);
+        timing_copy(&dst->stage[i].pump, &src->stage[i].pump);
+        dst->signal_time[i] = __atomic_load_n(&src->signal_time[i], __ATOMIC_RELAXED);
+    }
+
+    dst->last_pts_in = __atomic_load_n(&src->last_pts_in, __ATOMIC_RELAXED);
+    dst->media_time = __atomic_load_n(&src->media_time, __ATOMIC_RELAXED);
+    dst->decoder_lead = __atomic_load_n(&src->decoder_lead, __ATOMIC_RELAXED);
+    timing_copy(&dst->lateness, &src->lateness);
+    dst->late_frames = __atomic_load_n(&src->late_frames, __ATOMIC_RELAXED);
+    dst->dropped_frames = __atomic_load_n(&src->dropped_frames, __ATOMIC_RELAXED);
+    dst->reader_buffer_num = __atomic_load_n(&src->reader_buffer_num, __ATOMIC_RELAXED);
+    dst->reader_buffer_size = __atomic_load_n(&src->reader_buffer_size, __ATOMIC_RELAXED);
+    dst->reader_underruns = __atomic_load_n(&src->reader_underruns, __ATOMIC_RELAXED);
+    dst->reader_pool_resizes = __atomic_load_n(&src->reader_pool_resizes, __ATOMIC_RELAXED);
+    for(i = 0; i < mmal_player_SWITCH_MAX; i++)
+        timing_copy(&dst->switches[i], &src->switches[i]);
+    timing_copy(&dst->switch_latency, &src->switch_latency);
+    timing_copy(&dst->seeks, &src->seeks);
+    dst->startup.reader = __atomic_load_n(&src->startup.reader, __ATOMIC_RELAXED);
+    dst->startup.decoder = __atomic_load_n(&src->startup.decoder, __ATOMIC_RELAXED);
+    dst->startup.presentation = __atomic_load_n(&src->startup.presentation, __ATOMIC_RELAXED);
+    dst->startup.connections = __atomic_load_n(&src->startup.connections, __ATOMIC_RELAXED);
+    dst->startup.build = __atomic_load_n(&src->startup.build, __ATOMIC_RELAXED);
+    dst->startup.first_input = __atomic_load_n(&src->startup.first_input, __ATOMIC_RELAXED);
+    dst->startup.first_frame = __atomic_load_n(&src->startup.first_frame, __ATOMIC_RELAXED);
+    dst->sync_drift = __atomic_load_n(&src->sync_drift, __ATOMIC_RELAXED);
+    timing_copy(&dst->sync_error, &src->sync_error);
+    dst->sync_jumps = __atomic_load_n(&src->sync_jumps, __ATOMIC_RELAXED);
+    dst->stream_depth = __atomic_load_n(&src->stream_depth, __ATOMIC_RELAXED);
+    dst->stream_depth_us = __atomic_load_n(&src->stream_depth_us, __ATOMIC_RELAXED);
+    dst->stream_depth_max = __atomic_load_n(&src->stream_depth_max, __ATOMIC_RELAXED);
+    dst->stream_late = __atomic_load_n(&src->stream_late, __ATOMIC_RELAXED);
+    dst->stream_overflow = __atomic_load_n(&src->stream_overflow, __ATOMIC_RELAXED);
+    dst->stream_lost = __atomic_load_n(&src->stream_lost, __ATOMIC_RELAXED);
+    dst->stream_rebases = __atomic_load_n(&src->stream_rebases, __ATOMIC_RELAXED);
+    timing_copy(&dst->stream_hold, &src->stream_hold);
+    dst->stalls = __atomic_load_n(&src->stalls, __ATOMIC_RELAXED);
+    dst->component_errors = __atomic_load_n(&src->component_errors, __ATOMIC_RELAXED);
+    dst->rebuilds = __atomic_load_n(&src->rebuilds, __ATOMIC_RELAXED);
+    timing_copy(&dst->recovery, &src->recovery);
+}
+
+static int format_timing(char* buffer, size_t size, const char* name, const struct mmal_player_timing* timing)
+{
+    return snprintf(buffer, size, "\"%s\":{\"count\":%llu,\"avg_us\":%llu,\"max_us\":%llu}", name,
+                    (unsigned long long)timing->count,
+                    (unsigned long long)(timing->count > 0 ? timing->total / timing->count : 0),
+                    (unsigned long long)timing->max);
+}
+
+#define APPEND(expr) { int n = (expr); if(n < 0) return n; len += n; if(len >= size) return len; }
+
+int mmal_player_metrics_format_json(const struct mmal_player_metrics* metrics, const char* uri, uint64_t timestamp, char* buffer, size_t size)
+{
+    size_t len = 0;
+    int i;
+
+    APPEND(snprintf(buffer, size, "{\"ts_us\":%llu,\"uri\":\"", (unsigned long long)timestamp));
+    // URIs are paths; only quotes, backslashes and control characters need care
+    for(; uri != NULL && *uri != '\0' && len + 2 < size; uri++) {
+        if(*uri == '"' || *uri == '\\')
+            buffer[len++] = '\\';
+        buffer[len++] = (unsigned char)*uri < 0x20 ? '?' : *uri;
+    }
+    buffer[len] = '\0';
+
+    APPEND(snprintf(buffer + len, size - len, "\",\"stages\":{"));
+    for(i = 0; i < mmal_player_STAGE_MAX; i++) {
+        const struct mmal_player_stage_metrics* stage = &metrics->stage[i];
+
+        APPEND(snprintf(buffer + len, size - len, "%s\"%s\":{\"in_flight\":%d,\"buffers\":%llu,",
+                        i > 0 ? "," : "", stage_names[i], stage->in_flight, (unsigned long long)stage->buffers));
+        APPEND(format_timing(buffer + len, size - len, "queue_wait", &stage->queue_wait));
+        APPEND(snprintf(buffer + len, size - len, ","));
+        APPEND(format_timing(buffer + len, size - len, "pump", &stage->pump));
+        APPEND(snprintf(buffer + len, size - len, "}"));
+    }
+
+    APPEND(snprintf(buffer + len, size - len, "},\"last_pts_in\":%lld,\"media_time\":%lld,\"decoder_lead_us\":%lld,",
+                    (long long)metrics->last_pts_in, (long long)metrics->media_time, (long long)metrics->decoder_lead));
+    APPEND(format_timing(buffer + len, size - len, "lateness", &metrics->lateness));
+    APPEND(snprintf(buffer + len, size - len, ",\"late_frames\":%u,\"dropped_frames\":%u,",
+                    metrics->late_frames, metrics->dropped_frames));
+    APPEND(snprintf(buffer + len, size - len, "\"reader_pool\":{\"num\":%u,\"size\":%u,\"underruns\":%u,\"resizes\":%u},\"switches\":{",
+                    metrics->reader_buffer_num, metrics->reader_buffer_size, metrics->reader_underruns, metrics->reader_pool_resizes));
+    for(i = 0; i < mmal_player_SWITCH_MAX; i++) {
+        APPEND(snprintf(buffer + len, size - len, "%s", i > 0 ? "," : ""));
+        APPEND(format_timing(buffer + len, size - len, switch_names[i], &metrics->switches[i]));
+    }
+    APPEND(snprintf(buffer + len, size - len, "},"));
+    APPEND(format_timing(buffer + len, size - len, "switch_latency", &metrics->switch_latency));
+    APPEND(snprintf(buffer + len, size - len, ","));
+    APPEND(format_timing(buffer + len, size - len, "seek", &metrics->seeks));
+    APPEND(snprintf(buffer + len, size - len, ",\"startup\":{\"reader_us\":%llu,\"decoder_us\":%llu,\"presentation_us\":%llu,"
+                    "\"connections_us\":%llu,\"build_us\":%llu,\"first_input_us\":%llu,\"first_frame_us\":%llu}",
+                    (unsigned long long)metrics->startup.reader, (unsigned long long)metrics->startup.decoder,
+                    (unsigned long long)metrics->startup.presentation, (unsigned long long)metrics->startup.connections,
+                    (unsigned long long)metrics->startup.build, (unsigned long long)metrics->startup.first_input,
+                    (unsigned long long)metrics->startup.first_frame));
+    APPEND(snprintf(buffer + len, size - len, ",\"sync\":{\"drift_us\":%lld,\"jumps\":%u,",
+                    (long long)metrics->sync_drift, metrics->sync_jumps));
+    APPEND(format_timing(buffer + len, size - len, "error", &metrics->sync_error));
+    APPEND(snprintf(buffer + len, size - len, "},\"stream\":{\"depth\":%u,\"depth_us\":%lld,\"depth_max\":%u,"
+                    "\"late\":%u,\"overflow\":%u,\"lost\":%u,\"rebases\":%u,",
+                    metrics->stream_depth, (long long)metrics->stream_depth_us, metrics->stream_depth_max,
+                    metrics->stream_late, metrics->stream_overflow, metrics->stream_lost, metrics->stream_rebases));
+    APPEND(format_timing(buffer + len, size - len, "hold", &metrics->stream_hold));
+    APPEND(snprintf(buffer + len, size - len, "},\"recovery\":{\"stalls\":%u,\"errors\":%u,\"rebuilds\":%u,",
+                    metrics->stalls, metrics->component_errors, metrics->rebuilds));
+    APPEND(format_timing(buffer + len, size - len, "time", &metrics->recovery));
+    APPEND(snprintf(buffer + len, size - len, "}}"));
+
+    return (int)len;
+}
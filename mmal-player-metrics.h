@@ -0,0 +1,110 @@
+#ifndef MMAL_CHAIN_PLAYER_MMAL_PLAYER_METRICS_H
+#define MMAL_CHAIN_PLAYER_MMAL_PLAYER_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Connections of a pipeline, in stream order
+enum mmal_player_stage {
+    mmal_player_STAGE_READER_TO_DECODER = 0,
+    mmal_player_STAGE_DECODER_TO_SCHEDULER,
+    mmal_player_STAGE_SCHEDULER_TO_RENDERER,
+    mmal_player_STAGE_MAX
+};
+
+// What a clip switch kept of the pipeline, from cheapest to most expensive
+enum mmal_player_switch {
+    mmal_player_SWITCH_REWIND = 0,      // same file, the reader seeked back
+    mmal_player_SWITCH_READER,          // same stream format, only the reader replaced
+    mmal_player_SWITCH_DECODER,         // new decoder, the decoded picture kept scheduler and renderer
+    mmal_player_SWITCH_REBUILD,         // everything rebuilt
+    mmal_player_SWITCH_MAX
+};
+
+// microseconds
+struct mmal_player_timing
+{
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+};
+
+struct mmal_player_stage_metrics
+{
+    int32_t in_flight;                      // pool buffers out with the components, -1 when tunnelled
+    uint64_t buffers;                       // buffers handed downstream
+    struct mmal_player_timing queue_wait;   // connection callback until conn_pump picked the buffers up
+    struct mmal_player_timing pump;         // conn_pump duration
+};
+
+// Cold start of a pipeline, microseconds; 0 until reached, and all 0 for a recycled pipeline
+struct mmal_player_startup
+{
+    uint64_t reader;            // container opened, or stream or memory attached
+    uint64_t decoder;
+    uint64_t presentation;      // scheduler and renderer
+    uint64_t connections;
+    uint64_t build;             // all of the above, less than their sum when built in parallel
+    uint64_t first_input;       // mmal_player_start() until the decoder had its first buffer
+    uint64_t first_frame;       // ... until the renderer presented the first frame
+};
+
+// Written by the pipeline thread only; every field is updated with relaxed atomics so other
+// threads can read a snapshot without locking, and recording stays cheap enough to leave on.
+struct mmal_player_metrics
+{
+    struct mmal_player_stage_metrics stage[mmal_player_STAGE_MAX];
+
+    int64_t last_pts_in;        // newest PTS handed to the decoder
+    int64_t media_time;         // scheduler clock, sampled with the snapshot
+    int64_t decoder_lead;       // last_pts_in - media_time: how far decoding runs ahead of presentation
+    struct mmal_player_timing lateness;    // frames handed to a non-tunnelled renderer behind the clock
+    uint32_t late_frames;       // ... by more than one frame interval
+    uint32_t dropped_frames;    // skipped or discarded as reported by the renderer
+
+    uint32_t reader_buffer_num;     // reader -> decoder pool, as last sized
+    uint32_t reader_buffer_size;
+    uint32_t reader_underruns;      // samples that found the decoder less than a frame ahead of the clock
+    uint32_t reader_pool_resizes;
+
+    struct mmal_player_timing switches[mmal_player_SWITCH_MAX];    // time spent switching clips
+    struct mmal_player_timing switch_latency;  // EOS of the clip before until this one's first frame
+    struct mmal_player_timing seeks;    // seek command until its first frame reached a non-tunnelled renderer
+    struct mmal_player_startup startup;
+
+    int64_t sync_drift;                 // synced followers: clock minus the master's at the last check, us
+    struct mmal_player_timing sync_error;   // ... its magnitude over all checks
+    uint32_t sync_jumps;                // ... checks more than a frame off, fixed by setting the clock
+
+    uint32_t stream_depth;              // stream inputs: jitter buffer entries waiting, sampled
+    int64_t stream_depth_us;            // ... and the PTS span they cover
+    uint32_t stream_depth_max;
+    uint32_t stream_late;               // dropped for arriving after their successors went on
+    uint32_t stream_overflow;           // dropped for a full jitter buffer
+    uint32_t stream_lost;               // RTP packets never received
+    uint32_t stream_rebases;            // the source fell behind and the delay was reset
+    struct mmal_player_timing stream_hold;  // arrival until handed to the decoder
+
+    uint32_t stalls;                    // with a watchdog: nothing presented for longer than it allows
+    uint32_t component_errors;          // ... error events from components, and buffers they refused
+    uint32_t rebuilds;                  // ... components rebuilt to get going again
+    struct mmal_player_timing recovery; // ... fault until the next frame presented
+
+    uint64_t signal_time[mmal_player_STAGE_MAX];   // last connection callback, vcos_getmicrosecs64()
+};
+
+static inline void mmal_player_timing_add(struct mmal_player_timing* timing, uint64_t us)
+{
+    __atomic_store_n(&timing->count, timing->count + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&timing->total, timing->total + us, __ATOMIC_RELAXED);
+    if(us > timing->max)
+        __atomic_store_n(&timing->max, us, __ATOMIC_RELAXED);
+}
+
+// Copies `src` field by field with atomic loads
+void mmal_player_metrics_copy(struct mmal_player_metrics* dst, const struct mmal_player_metrics* src);
+
+// One JSON object on a single line, without the trailing newline; returns snprintf()'s result
+int mmal_player_metrics_format_json(const struct mmal_player_metrics* metrics, const char* uri, uint64_t timestamp, char* buffer, size_t size);
+
+#endif //MMAL_CHAIN_PLAYER_MMAL_PLAYER_METRICS_H
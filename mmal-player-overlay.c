@@ -0,0 +1,368 @@
+#include "mmal-player-overlay.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "interface/vcos/vcos.h"
+#include "interface/mmal/util/mmal_util_params.h"
+
+#define OVERLAY_BUFFERS_MAX     3
+#define OVERLAY_DEFAULT_BUFFERS 2
+#define OVERLAY_DEFAULT_FPS     10
+#define OVERLAY_DEFAULT_LAYER   1000
+#define OVERLAY_IDLE_WAIT_MS    1000
+#define OVERLAY_PIXEL_SIZE      4
+
+// [x0, x1) x [y0, y1), empty when x0 >= x1
+struct overlay_area
+{
+    uint32_t x0, y0, x1, y1;
+};
+
+struct mmal_player_overlay
+{
+    const struct mmal_player_backend* backend;
+    MMAL_COMPONENT_T* renderer;
+    MMAL_POOL_T* pool;
+    uint32_t buffers;
+
+    uint32_t width, height;
+    uint32_t stride, slice;     // of canvas and buffers alike, in the renderer's alignment
+    uint8_t* canvas;
+
+    VCOS_MUTEX_T lock;          // canvas, stale, dirty and stats
+    struct overlay_area stale[OVERLAY_BUFFERS_MAX];     // drawn since the buffer was last filled
+    MMAL_BOOL_T dirty;          // drawn and not on screen yet
+    struct mmal_player_overlay_stats stats;
+
+    uint64_t min_interval;      // us between updates
+    uint64_t next_update;
+    mmal_player_overlay_tick tick;
+    uint64_t tick_interval;
+    uint64_t next_tick;
+    void* user;
+
+    VCOS_SEMAPHORE_T wake;      // a draw, a returned buffer, or stop
+    VCOS_THREAD_T thread;
+    MMAL_BOOL_T thread_started;
+    MMAL_BOOL_T stop;
+};
+
+static void area_add(struct overlay_area* area, const struct overlay_area* add)
+{
+    if(add->x0 >= add->x1 || add->y0 >= add->y1)
+        return;
+    if(area->x0 >= area->x1 || area->y0 >= area->y1) {
+        *area = *add;
+        return;
+    }
+    area->x0 = vcos_min(area->x0, add->x0);
+    area->y0 = vcos_min(area->y0, add->y0);
+    area->x1 = vcos_max(area->x1, add->x1);
+    area->y1 = vcos_max(area->y1, add->y1);
+}
+
+static void input_callback(MMAL_PORT_T* port, MMAL_BUFFER_HEADER_T* buffer)
+{
+    struct mmal_player_overlay* overlay = (struct mmal_player_overlay*)port->userdata;
+
+    mmal_buffer_header_release(buffer);
+    vcos_semaphore_post(&overlay->wake);
+}
+
+// Brings the next free buffer up to date with the canvas and sends it; FALSE while there is none
+static MMAL_BOOL_T overlay_update(struct mmal_player_overlay* overlay, uint64_t now)
+{
+    MMAL_BUFFER_HEADER_T* buffer;
+    struct overlay_area* stale;
+    uint64_t started;
+    uint32_t i, y, row;
+
+    vcos_mutex_lock(&overlay->lock);
+    if(!overlay->dirty || now < overlay->next_update) {
+        vcos_mutex_unlock(&overlay->lock);
+        return MMAL_TRUE;
+    }
+    buffer = mmal_queue_get(overlay->pool->queue);
+    if(buffer == NULL) {
+        overlay->stats.buffer_waits++;
+        vcos_mutex_unlock(&overlay->lock);
+        return MMAL_FALSE;
+    }
+    started = vcos_getmicrosecs64();
+    for(i = 0; i < overlay->buffers && overlay->pool->header[i] != buffer; i++)
+        ;
+
+    // what the other buffers missed stays marked for them
+    stale = &overlay->stale[i];
+    row = (stale->x1 - stale->x0) * OVERLAY_PIXEL_SIZE;
+    for(y = stale->y0; y < stale->y1; y++) {
+        size_t offset = (size_t)y * overlay->stride + stale->x0 * OVERLAY_PIXEL_SIZE;
+        memcpy(buffer->data + offset, overlay->canvas + offset, row);
+    }
+    overlay->stats.bytes += (uint64_t)row * (stale->y1 - stale->y0);
+    memset(stale, 0, sizeof(*stale));
+    overlay->dirty = MMAL_FALSE;
+    overlay->next_update = now + overlay->min_interval;
+    mmal_player_timing_add(&overlay->stats.copy, vcos_getmicrosecs64() - started);
+    overlay->stats.updates++;
+    vcos_mutex_unlock(&overlay->lock);
+
+    buffer->length = overlay->stride * overlay->slice;
+    buffer->pts = buffer->dts = MMAL_TIME_UNKNOWN;
+    if(overlay->backend->send_buffer(overlay->renderer->input[0], buffer) != MMAL_SUCCESS) {
+        struct overlay_area all = {0, 0, overlay->width, overlay->height};
+
+        fprintf(stderr, "overlay: unable to send a buffer to the renderer\n");
+        vcos_mutex_lock(&overlay->lock);
+        area_add(&overlay->stale[i], &all);
+        vcos_mutex_unlock(&overlay->lock);
+        mmal_buffer_header_release(buffer);
+    }
+
+    return MMAL_TRUE;
+}
+
+static void* overlay_thread(void* user)
+{
+    struct mmal_player_overlay* overlay = user;
+
+    while(!__atomic_load_n(&overlay->stop, __ATOMIC_ACQUIRE)) {
+        uint64_t now = vcos_getmicrosecs64();
+        uint64_t wait_us = (uint64_t)OVERLAY_IDLE_WAIT_MS * 1000;
+        MMAL_BOOL_T dirty;
+
+        if(overlay->tick != NULL && now >= overlay->next_tick) {
+            overlay->tick(overlay, overlay->user);
+            overlay->next_tick = now + overlay->tick_interval;
+        }
+        if(overlay->tick != NULL)
+            wait_us = vcos_min(wait_us, overlay->next_tick - now);
+
+        // without a free buffer, the renderer handing one back wakes us up
+        if(overlay_update(overlay, now)) {
+            vcos_mutex_lock(&overlay->lock);
+            dirty = overlay->dirty;
+            vcos_mutex_unlock(&overlay->lock);
+            if(dirty && overlay->next_update > now)
+                wait_us = vcos_min(wait_us, overlay->next_update - now);
+        }
+
+        vcos_semaphore_wait_timeout(&overlay->wake, (uint32_t)((wait_us + 999) / 1000));
+    }
+
+    return NULL;
+}
+
+void mmal_player_overlay_options_init(struct mmal_player_overlay_options* options)
+{
+    memset(options, 0, sizeof(struct mmal_player_overlay_options));
+    options->layer = OVERLAY_DEFAULT_LAYER;
+    options->buffers = OVERLAY_DEFAULT_BUFFERS;
+    options->max_fps = OVERLAY_DEFAULT_FPS;
+}
+
+static MMAL_STATUS_T setup_renderer(struct mmal_player_overlay* overlay, const struct mmal_player_overlay_options* options)
+{
+    MMAL_PORT_T* input = overlay->renderer->input[0];
+    MMAL_PARAMETER_BOOLEAN_T zero_copy = {{MMAL_PARAMETER_ZERO_COPY, sizeof(zero_copy)}, MMAL_TRUE};
+    MMAL_DISPLAYREGION_T display_region;
+    MMAL_STATUS_T status;
+
+    input->format->encoding = MMAL_ENCODING_RGBA;
+    input->format->es->video.width = overlay->stride / OVERLAY_PIXEL_SIZE;
+    input->format->es->video.height = overlay->slice;
+    input->format->es->video.crop.x = 0;
+    input->format->es->video.crop.y = 0;
+    input->format->es->video.crop.width = overlay->width;
+    input->format->es->video.crop.height = overlay->height;
+    status = overlay->backend->format_commit(input);
+    if(status != MMAL_SUCCESS)
+        return status;
+
+    // the renderer reads the buffers where they were drawn, on VideoCore
+    status = overlay->backend->parameter_set(input, &zero_copy.hdr);
+    if(status != MMAL_SUCCESS)
+        return status;
+
+    memset(&display_region, 0, sizeof(MMAL_DISPLAYREGION_T));
+    display_region.hdr.id = MMAL_PARAMETER_DISPLAYREGION;
+    display_region.hdr.size = sizeof(MMAL_DISPLAYREGION_T);
+    display_region.set = MMAL_DISPLAY_SET_NUM | MMAL_DISPLAY_SET_LAYER | MMAL_DISPLAY_SET_FULLSCREEN |
+                         MMAL_DISPLAY_SET_ALPHA | MMAL_DISPLAY_SET_MODE;
+    display_region.display_num = options->display_num;
+    display_region.layer = options->layer;
+    if(options->dest_rect.width > 0 && options->dest_rect.height > 0) {
+        display_region.fullscreen = MMAL_FALSE;
+        display_region.set |= MMAL_DISPLAY_SET_DEST_RECT;
+        display_region.dest_rect = options->dest_rect;
+    } else {
+        display_region.fullscreen = MMAL_TRUE;
+    }
+    // opaque as a layer, the pixels' own alpha blends them with the video
+    display_region.alpha = 255;
+    display_region.mode = MMAL_DISPLAY_MODE_FILL;
+
+    return overlay->backend->parameter_set(input, &display_region.hdr);
+}
+
+struct mmal_player_overlay* mmal_player_overlay_create(const struct mmal_player_overlay_options* options)
+{
+    struct mmal_player_overlay* overlay;
+    MMAL_PORT_T* input;
+    uint32_t i, size;
+    MMAL_STATUS_T status;
+
+    overlay = calloc(1, sizeof(struct mmal_player_overlay));
+    if(overlay == NULL)
+        return NULL;
+
+    overlay->backend = options->backend != NULL ? options->backend : &mmal_player_backend_mmal;
+    overlay->width = options->width > 0 ? options->width : options->dest_rect.width;
+    overlay->height = options->height > 0 ? options->height : options->dest_rect.height;
+    overlay->buffers = options->buffers > 0 ? vcos_min(vcos_max(options->buffers, 2), OVERLAY_BUFFERS_MAX) : OVERLAY_DEFAULT_BUFFERS;
+    overlay->min_interval = 1000000 / (options->max_fps > 0 ? options->max_fps : OVERLAY_DEFAULT_FPS);
+    overlay->tick = options->tick;
+    overlay->tick_interval = (uint64_t)(options->tick_ms > 0 ? options->tick_ms : OVERLAY_IDLE_WAIT_MS) * 1000;
+    overlay->user = options->user;
+    vcos_mutex_create(&overlay->lock, "mmal_player:overlay");
+    vcos_semaphore_create(&overlay->wake, "mmal_player:overlay.wake", 0);
+
+    if(overlay->width == 0 || overlay->height == 0) {
+        fprintf(stderr, "overlay: a size is needed for a full screen overlay\n");
+        goto error;
+    }
+    overlay->stride = VCOS_ALIGN_UP(overlay->width, 32) * OVERLAY_PIXEL_SIZE;
+    overlay->slice = VCOS_ALIGN_UP(overlay->height, 16);
+    overlay->canvas = calloc(overlay->slice, overlay->stride);
+    if(overlay->canvas == NULL)
+        goto error;
+
+    status = overlay->backend->component_create(mmal_player_ROLE_RENDERER, &overlay->renderer);
+    if(status != MMAL_SUCCESS) {
+        fprintf(stderr, "overlay: unable to create renderer\n");
+        goto error;
+    }
+    status = setup_renderer(overlay, options);
+    if(status == MMAL_SUCCESS)
+        status = overlay->backend->component_enable(overlay->renderer);
+    if(status != MMAL_SUCCESS) {
+        fprintf(stderr, "overlay: unable to configure renderer\n");
+        goto error;
+    }
+
+    input = overlay->renderer->input[0];
+    size = vcos_max(overlay->stride * overlay->slice, input->buffer_size_recommended);
+    input->buffer_num = overlay->buffers;
+    input->buffer_size = size;
+    overlay->pool = overlay->backend->port_pool_create(input, overlay->buffers, size);
+    if(overlay->pool == NULL) {
+        fprintf(stderr, "overlay: unable to allocate %u buffers of %u bytes\n", overlay->buffers, size);
+        goto error;
+    }
+    // each buffer starts out transparent and behind on all of the canvas
+    for(i = 0; i < overlay->buffers; i++) {
+        memset(overlay->pool->header[i]->data, 0, size);
+        overlay->stale[i].x1 = overlay->width;
+        overlay->stale[i].y1 = overlay->height;
+    }
+    overlay->dirty = MMAL_TRUE;
+
+    input->userdata = (struct MMAL_PORT_USERDATA_T*)overlay;
+    if(overlay->backend->port_enable(input, input_callback) != MMAL_SUCCESS) {
+        fprintf(stderr, "overlay: unable to enable renderer input\n");
+        goto error;
+    }
+
+    if(vcos_thread_create(&overlay->thread, "mmal-player:overlay", NULL, overlay_thread, overlay) != VCOS_SUCCESS)
+        goto error;
+    overlay->thread_started = MMAL_TRUE;
+
+    return overlay;
+
+error:
+    mmal_player_overlay_destroy(overlay);
+    return NULL;
+}
+
+void mmal_player_overlay_destroy(struct mmal_player_overlay* overlay)
+{
+    if(overlay == NULL)
+        return;
+
+    if(overlay->thread_started) {
+        void* ret = NULL;
+
+        __atomic_store_n(&overlay->stop, MMAL_TRUE, __ATOMIC_RELEASE);
+        vcos_semaphore_post(&overlay->wake);
+        vcos_thread_join(&overlay->thread, &ret);
+    }
+    if(overlay->renderer != NULL) {
+        if(overlay->renderer->input[0]->is_enabled)
+            overlay->backend->port_disable(overlay->renderer->input[0]);
+        if(overlay->pool != NULL)
+            overlay->backend->port_pool_destroy(overlay->renderer->input[0], overlay->pool);
+        overlay->backend->component_disable(overlay->renderer);
+        overlay->backend->component_destroy(overlay->renderer);
+    }
+
+    vcos_semaphore_delete(&overlay->wake);
+    vcos_mutex_delete(&overlay->lock);
+    free(overlay->canvas);
+    free(overlay);
+}
+
+uint8_t* mmal_player_overlay_lock(struct mmal_player_overlay* overlay, uint32_t* width, uint32_t* height, uint32_t* stride)
+{
+    vcos_mutex_lock(&overlay->lock);
+    if(width != NULL)
+        *width = overlay->width;
+    if(height != NULL)
+        *height = overlay->height;
+    if(stride != NULL)
+        *stride = overlay->stride;
+
+    return overlay->canvas;
+}
+
+void mmal_player_overlay_unlock(struct mmal_player_overlay* overlay, const MMAL_RECT_T* dirty)
+{
+    struct overlay_area area = {0, 0, overlay->width, overlay->height};
+    uint32_t i;
+
+    if(dirty != NULL) {
+        area.x0 = vcos_min((uint32_t)vcos_max(dirty->x, 0), overlay->width);
+        area.y0 = vcos_min((uint32_t)vcos_max(dirty->y, 0), overlay->height);
+        area.x1 = vcos_min((uint32_t)vcos_max(dirty->x + dirty->width, 0), overlay->width);
+        area.y1 = vcos_min((uint32_t)vcos_max(dirty->y + dirty->height, 0), overlay->height);
+    }
+
+    for(i = 0; i < overlay->buffers; i++)
+        area_add(&overlay->stale[i], &area);
+    overlay->dirty |= area.x0 < area.x1 && area.y0 < area.y1;
+    overlay->stats.draws++;
+    vcos_mutex_unlock(&overlay->lock);
+
+    vcos_semaphore_post(&overlay->wake);
+}
+
+MMAL_STATUS_T mmal_player_overlay_set_alpha(struct mmal_player_overlay* overlay, uint8_t alpha)
+{
+    MMAL_DISPLAYREGION_T display_region;
+
+    memset(&display_region, 0, sizeof(MMAL_DISPLAYREGION_T));
+    display_region.hdr.id = MMAL_PARAMETER_DISPLAYREGION;
+    display_region.hdr.size = sizeof(MMAL_DISPLAYREGION_T);
+    display_region.set = MMAL_DISPLAY_SET_ALPHA;
+    display_region.alpha = alpha;
+
+    return overlay->backend->parameter_set(overlay->renderer->input[0], &display_region.hdr);
+}
+
+void mmal_player_overlay_get_stats(struct mmal_player_overlay* overlay, struct mmal_player_overlay_stats* stats)
+{
+    vcos_mutex_lock(&overlay->lock);
+    *stats = overlay->stats;
+    vcos_mutex_unlock(&overlay->lock);
+}
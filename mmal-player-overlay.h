@@ -0,0 +1,60 @@
+#ifndef MMAL_CHAIN_PLAYER_MMAL_PLAYER_OVERLAY_H
+#define MMAL_CHAIN_PLAYER_MMAL_PLAYER_OVERLAY_H
+
+#include <stdint.h>
+
+#include "interface/mmal/mmal.h"
+
+#include "mmal-player-backend.h"
+#include "mmal-player-metrics.h"
+
+// An RGBA layer above the video for clocks, tickers or QR codes: a renderer of its own, fed from
+// a canvas the application draws into. The overlay's own thread copies what was drawn into a
+// free buffer of a double or triple buffered pool, only the rectangles that changed since that
+// buffer was last on screen, and at most max_fps times a second. Drawing never waits for the
+// renderer, and none of it runs on a pipeline thread.
+struct mmal_player_overlay;
+
+typedef void (*mmal_player_overlay_tick)(struct mmal_player_overlay* overlay, void* user);
+
+// 0 or NULL takes the default
+struct mmal_player_overlay_options
+{
+    const struct mmal_player_backend* backend;  // NULL: mmal_player_backend_mmal
+    uint32_t display_num;
+    int layer;                  // above the windows' layers
+    MMAL_RECT_T dest_rect;      // on the display, and the canvas size; width or height 0: full screen
+    uint32_t width, height;     // canvas, needed for a full screen overlay; stretched to dest_rect
+    uint32_t buffers;           // 2 or 3
+    uint32_t max_fps;           // screen updates per second at most, draws in between are merged
+    // called on the overlay's thread every tick_ms, to draw what changes with time
+    mmal_player_overlay_tick tick;
+    uint32_t tick_ms;
+    void* user;
+};
+
+struct mmal_player_overlay_stats
+{
+    uint32_t draws;             // mmal_player_overlay_unlock() calls
+    uint32_t updates;           // buffers sent to the renderer
+    uint32_t buffer_waits;      // updates held back while every buffer was with the renderer
+    uint64_t bytes;             // copied from the canvas into buffers
+    struct mmal_player_timing copy;     // CPU time per update, us
+};
+
+void mmal_player_overlay_options_init(struct mmal_player_overlay_options* options);
+struct mmal_player_overlay* mmal_player_overlay_create(const struct mmal_player_overlay_options* options);
+void mmal_player_overlay_destroy(struct mmal_player_overlay* overlay);
+
+// The canvas, `stride` bytes per row of RGBA, transparent to start with; keep it short, the
+// overlay's thread copies from it under the same lock
+uint8_t* mmal_player_overlay_lock(struct mmal_player_overlay* overlay, uint32_t* width, uint32_t* height, uint32_t* stride);
+// `dirty` is what was drawn, NULL for all of it
+void mmal_player_overlay_unlock(struct mmal_player_overlay* overlay, const MMAL_RECT_T* dirty);
+
+// Opacity of the whole layer over the pixels' own, 255 as created; set right away, from any thread
+MMAL_STATUS_T mmal_player_overlay_set_alpha(struct mmal_player_overlay* overlay, uint8_t alpha);
+
+void mmal_player_overlay_get_stats(struct mmal_player_overlay* overlay, struct mmal_player_overlay_stats* stats);
+
+#endif //MMAL_CHAIN_PLAYER_MMAL_PLAYER_OVERLAY_H
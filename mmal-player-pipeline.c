@@ -1,29 +1,133 @@
 #include "mmal-player-pipeline.h"
+#include "mmal-player-executor.h"
+#include "mmal-player-sync.h"
+#include "mmal-player-tap.h"
+#include "mmal-player-watchdog.h"
 
 #include <stdio.h>
+#include <unistd.h>
 
 #include "interface/mmal/util/mmal_util.h"
 #include "interface/mmal/util/mmal_util_params.h"
-#include "interface/mmal/util/mmal_default_components.h"
 
 #define CHECK_STATUS(status, msg) if (status != MMAL_SUCCESS) { fprintf(stderr, msg"\n"); goto error; }
 
-static MMAL_STATUS_T mmal_player_init(struct mmal_player_pipeline* ctx, const char* uri, int rotation, int layer);
+static MMAL_STATUS_T mmal_player_init(struct mmal_player_pipeline* ctx, const char* uri, struct mmal_player_memory* memory,
+                                      const struct mmal_player_options* options);
 static void mmal_player_deinit(struct mmal_player_pipeline* ctx);
 
 
+static MMAL_STATUS_T player_set_boolean(struct mmal_player_pipeline* ctx, MMAL_PORT_T* port, uint32_t id, MMAL_BOOL_T value)
+{
+    MMAL_PARAMETER_BOOLEAN_T param = {{id, sizeof(param)}, value};
+
+    return ctx->backend->parameter_set(port, &param.hdr);
+}
+
+static MMAL_STATUS_T player_set_int64(struct mmal_player_pipeline* ctx, MMAL_PORT_T* port, uint32_t id, int64_t value)
+{
+    MMAL_PARAMETER_INT64_T param = {{id, sizeof(param)}, value};
+
+    return ctx->backend->parameter_set(port, &param.hdr);
+}
+
+// What woke the pipeline thread, accumulated in ctx->pending until the thread picks it up
+#define PENDING_CONTROL                 0x01
+#define PENDING_READER_TO_DECODER       0x02
+#define PENDING_DECODER_TO_SCHEDULER    0x04
+#define PENDING_SCHEDULER_TO_RENDERER   0x08
+#define PENDING_SYNC                    0x10
+#define PENDING_WATCHDOG                0x20
+#define PENDING_CONNECTIONS             (PENDING_READER_TO_DECODER | PENDING_DECODER_TO_SCHEDULER | PENDING_SCHEDULER_TO_RENDERER)
+#define PENDING_STAGE(stage)            (PENDING_READER_TO_DECODER << (stage))
+
+#define METRICS_SAMPLE_INTERVAL_US      1000000
+#define DEFAULT_FRAME_INTERVAL_US       40000
+
+#define READER_BUFFER_NUM_MIN           2
+#define READER_BUFFER_NUM_MAX           64
+#define READER_SHRINK_AFTER_CLIPS       3       // clean clips before the adaptive pool gives buffers back
+#define UNDERRUN_GRACE_US               1000000 // after the clock starts, while the decoder fills up
+
+#define SYNC_CHECK_INTERVAL_US          50000   // drift measurement of a synced pipeline
+#define SYNC_SLEW_US                    1000000 // small drift is slewed away over this long
+#define SYNC_TRIM_GAIN                  16      // ... and 1/16 of that rate kept as a trim for a clock that runs off
+#define SYNC_SLEW_MAX_PPM               20000
+#define SYNC_SLEW_MIN_US                500     // closer than this: run at the nominal rate
+#define SYNC_START_AHEAD_US             2000    // a held start this close is not left to the watcher
+
+#define STREAM_DECODE_FRAMES            2       // a stream's clock starts this far behind its first PTS, for the decoder
+
+#define TRICK_PLAY_RATE                 4       // from this many times the normal speed up only keyframes are decoded
+
+// What recover() rebuilds, bits of enum mmal_player_role
+#define ROLE_BIT(role)                  (1u << mmal_player_ROLE_##role)
+#define RECOVER_PRESENTATION            (ROLE_BIT(SCHEDULER) | ROLE_BIT(RENDERER))
+#define RECOVER_ALL                     ((1u << mmal_player_ROLE_MAX) - 1)
+
+#define COMMAND_RING_SIZE               64
+#define EVENT_RING_SIZE                 32
+
+// Messages taken by the pipeline thread: commands from the application, events from MMAL callbacks
+enum {
+    COMMAND_STOP,
+    COMMAND_SKIP,           // value: vcos_getmicrosecs64() of the request
+    COMMAND_START,          // a prerolled pipeline goes on screen; status 1: stays below its layer,
+                            // value: eos_time of the clip it follows, 0 for none
+    COMMAND_SWITCH,         // ptr: URI to play now, freed by the pipeline thread
+    COMMAND_SEEK,           // value: PTS, status: MMAL_PARAM_SEEK_FLAG_*
+    COMMAND_PAUSE,
+    COMMAND_RESUME,
+    COMMAND_RATE,           // status / value: playback speed
+    EVENT_EOS,              // value: vcos_getmicrosecs64() of the event
+    EVENT_ERROR,            // status, ptr: the component that sent it
+    EVENT_ANALYSIS,         // ptr: struct mmal_player_analysis_result, freed by the pipeline thread
+};
+
+// Only the first signal after the thread drained ctx->pending posts the semaphore (or queues
+// the pipeline on its executor), later ones are folded into the same wakeup.
+static void signal_pending(struct mmal_player_pipeline* ctx, uint32_t bits)
+{
+    __atomic_fetch_add(&ctx->loop_stats.signals, 1, __ATOMIC_RELAXED);
+
+    if(__atomic_fetch_or(&ctx->pending, bits, __ATOMIC_ACQ_REL) == 0) {
+        __atomic_fetch_add(&ctx->loop_stats.posts, 1, __ATOMIC_RELAXED);
+        if(ctx->executor != NULL)
+            mmal_player_executor_schedule(ctx->executor, ctx);
+        else
+            vcos_semaphore_post(&ctx->sem_ready);
+    }
+}
+
+// Every state change from another thread arrives this way; the pipeline thread alone writes
+// terminate, eos, pipeline_status and the rest of the state they drive
+static MMAL_BOOL_T post_message(struct mmal_player_pipeline* ctx, struct mmal_player_ring* ring,
+                                uint32_t type, int32_t status, int64_t value, void* ptr)
+{
+    struct mmal_player_message message = {type, status, value, ptr};
+
+    if(!mmal_player_ring_post(ring, &message)) {
+        fprintf(stderr, "%s: message %u dropped, the ring is full\n", ctx->uri != NULL ? ctx->uri : "pipeline", type);
+        return MMAL_FALSE;
+    }
+    signal_pending(ctx, PENDING_CONTROL);
+    return MMAL_TRUE;
+}
+
 static void control_callback(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer)
 {
     struct mmal_player_pipeline* ctx = (struct mmal_player_pipeline *) port->userdata;
+    MMAL_STATUS_T status;
 
     switch(buffer->cmd)
     {
         case MMAL_EVENT_ERROR:
-            ctx->pipeline_status = (*(MMAL_STATUS_T *) buffer->data);
-            fprintf(stderr, "%s: received error: %s\n", port->name, mmal_status_to_string(ctx->pipeline_status));
+            status = *(MMAL_STATUS_T *) buffer->data;
+            fprintf(stderr, "%s: received error: %s\n", port->name, mmal_status_to_string(status));
+            post_message(ctx, &ctx->events, EVENT_ERROR, status, 0, port->component);
             break;
         case MMAL_EVENT_EOS:
-            ctx->eos = MMAL_TRUE;
+            post_message(ctx, &ctx->events, EVENT_EOS, 0, vcos_getmicrosecs64(), NULL);
             break;
 // not happen if TUNNELLED connection is set
         case MMAL_EVENT_FORMAT_CHANGED:
@@ -35,37 +139,250 @@ static void control_callback(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer)
     }
 
     mmal_buffer_header_release(buffer);
+}
 
-    /* The processing is done in our main thread */
-    vcos_semaphore_post(&ctx->sem_ready);
+static enum mmal_player_stage connection_stage(struct mmal_player_pipeline* ctx, MMAL_CONNECTION_T* connection)
+{
+    if(connection == ctx->reader_to_decoder)
+        return mmal_player_STAGE_READER_TO_DECODER;
+    if(connection == ctx->decoder_to_scheduler)
+        return mmal_player_STAGE_DECODER_TO_SCHEDULER;
+    return mmal_player_STAGE_SCHEDULER_TO_RENDERER;
 }
 
 static void connection_callback(MMAL_CONNECTION_T *connection)
 {
     struct mmal_player_pipeline* ctx = (struct mmal_player_pipeline*) connection->user_data;
+    enum mmal_player_stage stage = connection_stage(ctx, connection);
+
+    __atomic_store_n(&ctx->metrics.signal_time[stage], vcos_getmicrosecs64(), __ATOMIC_RELAXED);
 
     /* The processing is done in our main thread */
-    vcos_semaphore_post(&ctx->sem_ready);
+    signal_pending(ctx, PENDING_STAGE(stage));
+}
+
+// Buffers coming home to the reader pool wake the pipeline, as mmal_connection's own pool would
+static MMAL_BOOL_T reader_pool_release(MMAL_POOL_T* pool, MMAL_BUFFER_HEADER_T* buffer, void* userdata)
+{
+    struct mmal_player_pipeline* ctx = userdata;
+
+    mmal_queue_put(pool->queue, buffer);
+    signal_pending(ctx, PENDING_READER_TO_DECODER);
+
+    return MMAL_FALSE;
+}
+
+// A stream stands in for the container reader: frames falling due in its jitter buffer and
+// buffers coming back from the decoder both wake the reader -> decoder pump
+static void stream_notify(void* userdata)
+{
+    signal_pending((struct mmal_player_pipeline*)userdata, PENDING_READER_TO_DECODER);
+}
+
+// Streams and memory clips feed the decoder input without a connection, its buffers go back to
+// the pool they came from
+static void direct_input_callback(MMAL_PORT_T* port, MMAL_BUFFER_HEADER_T* buffer)
+{
+    mmal_buffer_header_release(buffer);
+}
+
+// Sizes ctx->reader_pool for the current reader and decoder and sets both ports to match.
+// Must be called with every buffer back in the pool; payloads are only reallocated when the
+// count changes or the file needs larger buffers than the pool already has.
+static MMAL_STATUS_T prepare_reader_pool(struct mmal_player_pipeline* ctx)
+{
+    MMAL_PORT_T* in = ctx->video_decoder->input[0];
+    MMAL_PORT_T* out = ctx->container_reader != NULL ? ctx->container_reader->output[0] : in;
+    uint32_t num = ctx->reader_buffer_num;
+    uint32_t size = ctx->reader_buffers.size;
+    MMAL_STATUS_T status;
+
+    if(num == 0)
+        num = vcos_max(out->buffer_num_recommended, in->buffer_num_recommended);
+    if(size == 0)
+        size = vcos_max(out->buffer_size_recommended, in->buffer_size_recommended);
+    num = vcos_max(num, vcos_max(out->buffer_num_min, in->buffer_num_min));
+    size = vcos_max(size, vcos_max(out->buffer_size_min, in->buffer_size_min));
+
+    if(ctx->reader_pool == NULL) {
+        ctx->reader_pool = mmal_pool_create(num, size);
+        if(ctx->reader_pool == NULL)
+            return MMAL_ENOMEM;
+        mmal_pool_callback_set(ctx->reader_pool, reader_pool_release, ctx);
+    } else if(ctx->reader_pool->headers_num != num || ctx->reader_pool_size < size) {
+        status = mmal_pool_resize(ctx->reader_pool, num, size);
+        if(status != MMAL_SUCCESS)
+            return status;
+        __atomic_store_n(&ctx->metrics.reader_pool_resizes, ctx->metrics.reader_pool_resizes + 1, __ATOMIC_RELAXED);
+    } else {
+        size = ctx->reader_pool_size;
+    }
+
+    out->buffer_num = in->buffer_num = num;
+    out->buffer_size = in->buffer_size = size;
+
+    ctx->reader_buffer_num = num;
+    ctx->reader_pool_size = size;
+    __atomic_store_n(&ctx->metrics.reader_buffer_num, num, __ATOMIC_RELAXED);
+    __atomic_store_n(&ctx->metrics.reader_buffer_size, size, __ATOMIC_RELAXED);
+
+    return MMAL_SUCCESS;
+}
+
+// At a clip switch: double the pool after a clip that starved the decoder,
+// give a quarter back after READER_SHRINK_AFTER_CLIPS clean ones.
+static void adapt_reader_buffers(struct mmal_player_pipeline* ctx)
+{
+    uint32_t num = ctx->reader_buffer_num;
+
+    if(ctx->reader_buffers.adaptive && num > 0) {
+        if(ctx->clip_underruns > 0) {
+            num *= 2;
+            ctx->clean_clips = 0;
+        } else if(++ctx->clean_clips >= READER_SHRINK_AFTER_CLIPS) {
+            num -= num / 4;
+            ctx->clean_clips = 0;
+        }
+        ctx->reader_buffer_num = vcos_min(vcos_max(num, ctx->reader_buffers.num_min), ctx->reader_buffers.num_max);
+    }
+
+    ctx->clip_underruns = 0;
+}
+
+// Commits the stream's format to the decoder input and feeds it from the reader pool directly
+static MMAL_STATUS_T connect_stream(struct mmal_player_pipeline* ctx)
+{
+    MMAL_PORT_T* in = ctx->video_decoder->input[0];
+    MMAL_STATUS_T status;
+
+    mmal_player_stream_format(ctx->stream, in->format);
+    status = ctx->backend->format_commit(in);
+    if(status != MMAL_SUCCESS)
+        return status;
+
+    status = prepare_reader_pool(ctx);
+    if(status != MMAL_SUCCESS)
+        return status;
+
+    in->userdata = (struct MMAL_PORT_USERDATA_T*)ctx;
+    return ctx->backend->port_enable(in, direct_input_callback);
+}
+
+// Feeds the decoder input from headers without a payload of their own: each is pointed at an
+// access unit of the clip, which stays put for as long as the pipeline holds a reference
+static MMAL_STATUS_T connect_memory(struct mmal_player_pipeline* ctx)
+{
+    MMAL_PORT_T* in = ctx->video_decoder->input[0];
+    uint32_t num = ctx->reader_buffer_num;
+    MMAL_STATUS_T status;
+
+    mmal_player_memory_format(ctx->memory, in->format);
+    status = ctx->backend->format_commit(in);
+    if(status != MMAL_SUCCESS)
+        return status;
+
+    if(num == 0)
+        num = in->buffer_num_recommended;
+    num = vcos_max(num, vcos_max(in->buffer_num_min, READER_BUFFER_NUM_MIN));
+    if(ctx->memory_pool == NULL) {
+        ctx->memory_pool = mmal_pool_create(num, 0);
+        if(ctx->memory_pool == NULL)
+            return MMAL_ENOMEM;
+        mmal_pool_callback_set(ctx->memory_pool, reader_pool_release, ctx);
+    } else if(ctx->memory_pool->headers_num != num) {
+        status = mmal_pool_resize(ctx->memory_pool, num, 0);
+        if(status != MMAL_SUCCESS)
+            return status;
+    }
+
+    in->buffer_num = num;
+    in->buffer_size = vcos_max(in->buffer_size_min, mmal_player_memory_max_unit(ctx->memory));
+    __atomic_store_n(&ctx->metrics.reader_buffer_num, num, __ATOMIC_RELAXED);
+    __atomic_store_n(&ctx->metrics.reader_buffer_size, 0, __ATOMIC_RELAXED);
+
+    in->userdata = (struct MMAL_PORT_USERDATA_T*)ctx;
+    return ctx->backend->port_enable(in, direct_input_callback);
+}
+
+// Also hands the reader's format to the decoder, which derives its output format from it
+static MMAL_STATUS_T connect_reader(struct mmal_player_pipeline* ctx)
+{
+    MMAL_STATUS_T status;
+
+    if(ctx->stream != NULL)
+        return connect_stream(ctx);
+    if(ctx->memory != NULL)
+        return connect_memory(ctx);
+
+    status = ctx->backend->connection_create(&ctx->reader_to_decoder, ctx->container_reader->output[0], ctx->video_decoder->input[0],
+                                             MMAL_CONNECTION_FLAG_KEEP_BUFFER_REQUIREMENTS);
+    if(status != MMAL_SUCCESS)
+        return status;
+    ctx->reader_to_decoder->callback = connection_callback;
+    ctx->reader_to_decoder->user_data = ctx;
+
+    status = prepare_reader_pool(ctx);
+    if(status == MMAL_SUCCESS)
+        status = ctx->backend->connection_set_pool(ctx->reader_to_decoder, ctx->reader_pool);
+
+    return status;
+}
+
+// Decoded frames stay in the buffers the decoder wrote them to, shared with the ARM side, and
+// the frames a tap holds on to come on top of what decoder and scheduler ask for
+static MMAL_STATUS_T prepare_tap(struct mmal_player_pipeline* ctx)
+{
+    MMAL_PORT_T* out = ctx->decoder_to_scheduler->out;
+    MMAL_PORT_T* in = ctx->decoder_to_scheduler->in;
+    MMAL_STATUS_T status;
+
+    status = player_set_boolean(ctx, out, MMAL_PARAMETER_ZERO_COPY, MMAL_TRUE);
+    if(status == MMAL_SUCCESS)
+        status = player_set_boolean(ctx, in, MMAL_PARAMETER_ZERO_COPY, MMAL_TRUE);
+    if(status != MMAL_SUCCESS) {
+        fprintf(stderr, "Unable to set zero copy between decoder and scheduler\n");
+        return status;
+    }
+
+    out->buffer_num = vcos_max(vcos_max(out->buffer_num_recommended, in->buffer_num_recommended),
+                               vcos_max(out->buffer_num_min, in->buffer_num_min));
+    out->buffer_num = in->buffer_num = out->buffer_num + mmal_player_tap_buffers(ctx->tap);
+    out->buffer_size = in->buffer_size = vcos_max(vcos_max(out->buffer_size_recommended, in->buffer_size_recommended),
+                                                  vcos_max(out->buffer_size_min, in->buffer_size_min));
+    return MMAL_SUCCESS;
+}
+
+// Frames out with the tap are decoder buffers too, they have to be back before it goes
+static void release_tapped(struct mmal_player_pipeline* ctx)
+{
+    if(ctx->tap != NULL)
+        mmal_player_tap_release(ctx->tap, ctx);
 }
 
 MMAL_STATUS_T build_connections(struct mmal_player_pipeline* ctx)
 {
     MMAL_STATUS_T status = MMAL_SUCCESS;
 
-    if(ctx->reader_to_decoder == NULL) {
-        status = mmal_connection_create(&ctx->reader_to_decoder, ctx->container_reader->output[0], ctx->video_decoder->input[0], 0);
-        ctx->reader_to_decoder->callback = connection_callback;
-        ctx->reader_to_decoder->user_data = ctx;
+    if(ctx->container_reader == NULL ? !ctx->video_decoder->input[0]->is_enabled : ctx->reader_to_decoder == NULL) {
+        status = connect_reader(ctx);
+        if(status != MMAL_SUCCESS)
+            return status;
     }
 
     if(ctx->decoder_to_scheduler == NULL) {
-        status = mmal_connection_create(&ctx->decoder_to_scheduler, ctx->video_decoder->output[0], ctx->scheduler->input[0], MMAL_CONNECTION_FLAG_TUNNELLING);
+        // a tap needs the decoded frames to pass through the pipeline thread
+        status = ctx->backend->connection_create(&ctx->decoder_to_scheduler, ctx->video_decoder->output[0], ctx->scheduler->input[0],
+                                                 ctx->tap != NULL ? MMAL_CONNECTION_FLAG_KEEP_BUFFER_REQUIREMENTS : ctx->backend->tunnelling);
         ctx->decoder_to_scheduler->callback = connection_callback;
         ctx->decoder_to_scheduler->user_data = ctx;
+        if(status == MMAL_SUCCESS && ctx->tap != NULL)
+            status = prepare_tap(ctx);
+        if(status != MMAL_SUCCESS)
+            return status;
     }
 
     if(ctx->scheduler_to_renderer == NULL) {
-        status = mmal_connection_create(&ctx->scheduler_to_renderer, ctx->scheduler->output[0], ctx->video_renderer->input[0], MMAL_CONNECTION_FLAG_TUNNELLING);
+        status = ctx->backend->connection_create(&ctx->scheduler_to_renderer, ctx->scheduler->output[0], ctx->video_renderer->input[0], ctx->backend->tunnelling);
         ctx->scheduler_to_renderer->callback = connection_callback;
         ctx->scheduler_to_renderer->user_data = ctx;
     }
@@ -82,8 +399,17 @@ MMAL_STATUS_T setup_display_port(struct mmal_player_pipeline* ctx)
     display_region.hdr.id = MMAL_PARAMETER_DISPLAYREGION;
     display_region.hdr.size = sizeof(MMAL_DISPLAYREGION_T);
 
+    display_region.set |= MMAL_DISPLAY_SET_NUM;
+    display_region.display_num = ctx->display_num;
+
     display_region.set |= MMAL_DISPLAY_SET_FULLSCREEN;
-    display_region.fullscreen = MMAL_TRUE;
+    if(ctx->dest_rect.width > 0 && ctx->dest_rect.height > 0) {
+        display_region.fullscreen = MMAL_FALSE;
+        display_region.set |= MMAL_DISPLAY_SET_DEST_RECT;
+        display_region.dest_rect = ctx->dest_rect;
+    } else {
+        display_region.fullscreen = MMAL_TRUE;
+    }
 
     display_region.set |= MMAL_DISPLAY_SET_ALPHA;
     display_region.alpha = MMAL_DISPLAY_ALPHA_FLAGS_DISCARD_LOWER_LAYERS;
@@ -93,6 +419,8 @@ MMAL_STATUS_T setup_display_port(struct mmal_player_pipeline* ctx)
 
     display_region.set |= MMAL_DISPLAY_SET_LAYER;
     display_region.layer = ctx->layer;
+    ctx->display_layer = ctx->layer;
+    ctx->display_alpha = 255;
 
     display_region.set |= MMAL_DISPLAY_SET_TRANSFORM;
     switch(ctx->rotation % 360)
@@ -111,7 +439,40 @@ MMAL_STATUS_T setup_display_port(struct mmal_player_pipeline* ctx)
             break;
     }
 
-    return mmal_port_parameter_set(ctx->video_renderer->input[0], &display_region.hdr);
+    return ctx->backend->parameter_set(ctx->video_renderer->input[0], &display_region.hdr);
+}
+
+MMAL_STATUS_T set_display_layer(struct mmal_player_pipeline* ctx, int layer)
+{
+    MMAL_DISPLAYREGION_T display_region;
+
+    memset(&display_region, 0, sizeof(MMAL_DISPLAYREGION_T));
+
+    display_region.hdr.id = MMAL_PARAMETER_DISPLAYREGION;
+    display_region.hdr.size = sizeof(MMAL_DISPLAYREGION_T);
+
+    display_region.set = MMAL_DISPLAY_SET_LAYER;
+    display_region.layer = layer;
+    ctx->display_layer = layer;
+
+    return ctx->backend->parameter_set(ctx->video_renderer->input[0], &display_region.hdr);
+}
+
+static MMAL_STATUS_T set_display_alpha(struct mmal_player_pipeline* ctx, uint8_t alpha)
+{
+    MMAL_DISPLAYREGION_T display_region;
+
+    memset(&display_region, 0, sizeof(MMAL_DISPLAYREGION_T));
+
+    display_region.hdr.id = MMAL_PARAMETER_DISPLAYREGION;
+    display_region.hdr.size = sizeof(MMAL_DISPLAYREGION_T);
+
+    // the layers below show through while it is not opaque, opaque is as setup_display_port() left it
+    display_region.set = MMAL_DISPLAY_SET_ALPHA;
+    display_region.alpha = alpha < 255 ? alpha : MMAL_DISPLAY_ALPHA_FLAGS_DISCARD_LOWER_LAYERS;
+    ctx->display_alpha = alpha;
+
+    return ctx->backend->parameter_set(ctx->video_renderer->input[0], &display_region.hdr);
 }
 
 MMAL_STATUS_T set_callback_and_enable(struct mmal_player_pipeline* ctx, MMAL_COMPONENT_T* cmp)
@@ -120,12 +481,12 @@ MMAL_STATUS_T set_callback_and_enable(struct mmal_player_pipeline* ctx, MMAL_COM
 
     cmp->control->userdata = (struct MMAL_PORT_USERDATA_T*)ctx;
 
-    status = mmal_port_enable(cmp->control, control_callback);
+    status = ctx->backend->port_enable(cmp->control, control_callback);
     if(status != MMAL_SUCCESS) {
         fprintf(stderr, "failed to enable control port\n");
         return status;
     }
-    status = mmal_component_enable(cmp);
+    status = ctx->backend->component_enable(cmp);
     if(status != MMAL_SUCCESS) {
         fprintf(stderr, "failed to enable component\n");
         return status;
@@ -133,40 +494,133 @@ MMAL_STATUS_T set_callback_and_enable(struct mmal_player_pipeline* ctx, MMAL_COM
     return status;
 };
 
-MMAL_STATUS_T build_components(struct mmal_player_pipeline* ctx, const char *next_uri)
+static MMAL_STATUS_T set_playback_rate(struct mmal_player_pipeline* ctx)
+{
+    MMAL_PARAMETER_RATIONAL_T scale = {{MMAL_PARAMETER_CLOCK_SCALE, sizeof(scale)}, ctx->rate};
+
+    return ctx->backend->parameter_set(ctx->scheduler->clock[0], &scale.hdr);
+}
+
+// Runs the media clock from now on, or, in a sync group, once the group's start time for the
+// clip has come (see sync_step)
+static MMAL_STATUS_T start_clock(struct mmal_player_pipeline* ctx)
+{
+    // moved to when the clock really starts by a synced pipeline
+    ctx->start_time = vcos_getmicrosecs64();
+
+    if(ctx->sync != NULL) {
+        mmal_player_sync_attach(ctx->sync, ctx);
+        ctx->sync_generation = 0;
+        ctx->sync_hold = MMAL_TRUE;
+        signal_pending(ctx, PENDING_SYNC);
+        return MMAL_SUCCESS;
+    }
+
+    // a rebuilt scheduler starts out at the normal speed
+    if(ctx->rate.num != ctx->rate.den)
+        set_playback_rate(ctx);
+    // mmal_player_resume() starts it
+    if(ctx->paused)
+        return MMAL_SUCCESS;
+
+    return player_set_boolean(ctx, ctx->scheduler->clock[0], MMAL_PARAMETER_CLOCK_ACTIVE, MMAL_TRUE);
+}
+
+// Finds the stored keyframe index of the file, or starts learning it when there is none
+static void open_index(struct mmal_player_pipeline* ctx, const char* uri)
+{
+    if(!ctx->index_options.enabled)
+        return;
+    ctx->index = mmal_player_index_load(uri, ctx->index_options.cache_dir);
+    if(ctx->index == NULL)
+        ctx->index_learning = mmal_player_index_create(uri);
+}
+
+static void close_index(struct mmal_player_pipeline* ctx)
+{
+    mmal_player_index_destroy(ctx->index);
+    mmal_player_index_destroy(ctx->index_learning);
+    ctx->index = ctx->index_learning = NULL;
+}
+
+// Creates the container reader for `next_uri`, or plays `memory` when it is not NULL; the decoder
+// side is left alone
+static MMAL_STATUS_T build_reader(struct mmal_player_pipeline* ctx, const char *next_uri, struct mmal_player_memory* memory)
 {
     MMAL_STATUS_T status = MMAL_SUCCESS;
 
     ctx->after_seek = MMAL_TRUE;
+    ctx->reader_eos = MMAL_FALSE;
+
+    if(ctx->uri != NULL) {
+        free(ctx->uri);
+    }
+    ctx->uri = strdup(memory != NULL ? mmal_player_memory_name(memory) : next_uri);
+
+    if(memory != NULL) {
+        ctx->memory = mmal_player_memory_retain(memory);
+        ctx->memory_next = 0;
+        ctx->frame_interval = mmal_player_memory_frame_interval(memory);
+        return MMAL_SUCCESS;
+    }
+
+    if(mmal_player_stream_is_uri(next_uri)) {
+        ctx->stream = mmal_player_stream_open(next_uri, &ctx->stream_options, stream_notify, ctx);
+        if(ctx->stream == NULL)
+            return MMAL_EIO;
+        ctx->frame_interval = mmal_player_stream_frame_interval(ctx->stream);
+        return MMAL_SUCCESS;
+    }
 
-    status = mmal_component_create(MMAL_COMPONENT_DEFAULT_CONTAINER_READER, &ctx->container_reader);
+    status = ctx->backend->component_create(mmal_player_ROLE_READER, &ctx->container_reader);
     CHECK_STATUS(status, "Unable to create container reader component");
 
     status = set_callback_and_enable(ctx, ctx->container_reader);
     CHECK_STATUS(status, "Unable to configure container reader component");
 
-    if(ctx->uri != NULL) {
-        free(ctx->uri);
-    }
-    ctx->uri = strdup(next_uri);
-    status = mmal_util_port_set_uri(ctx->container_reader->control, next_uri);
+    status = ctx->backend->set_uri(ctx->container_reader, next_uri);
     CHECK_STATUS(status, "Unable to set URI");
+    open_index(ctx, next_uri);
+
+    {
+        MMAL_RATIONAL_T frame_rate = ctx->container_reader->output[0]->format->es->video.frame_rate;
+        if(frame_rate.num > 0 && frame_rate.den > 0)
+            ctx->frame_interval = (int64_t)1000000 * frame_rate.den / frame_rate.num;
+    }
+
+error:
+    return status;
+}
+
+static MMAL_STATUS_T build_decoder(struct mmal_player_pipeline* ctx)
+{
+    MMAL_STATUS_T status = MMAL_SUCCESS;
 
-    status = mmal_component_create(MMAL_COMPONENT_DEFAULT_VIDEO_DECODER, &ctx->video_decoder);
+    status = ctx->backend->component_create(mmal_player_ROLE_DECODER, &ctx->video_decoder);
     CHECK_STATUS(status, "Unable to create video decoder component");
 
     status = set_callback_and_enable(ctx, ctx->video_decoder);
     CHECK_STATUS(status, "Unable to configure video decoder component");
 
-    status = mmal_component_create(MMAL_COMPONENT_DEFAULT_SCHEDULER, &ctx->scheduler);
+error:
+    return status;
+}
+
+// scheduler and renderer
+static MMAL_STATUS_T build_presentation(struct mmal_player_pipeline* ctx)
+{
+    MMAL_STATUS_T status = MMAL_SUCCESS;
+
+    status = ctx->backend->component_create(mmal_player_ROLE_SCHEDULER, &ctx->scheduler);
     CHECK_STATUS(status, "Unable to create scheduler component");
+    ctx->sync_ppm = 0;
     status = set_callback_and_enable(ctx, ctx->scheduler);
     CHECK_STATUS(status, "Unable to configure scheduler component");
 
-    status = mmal_port_parameter_set_boolean(ctx->scheduler->clock[0], MMAL_PARAMETER_CLOCK_REFERENCE, MMAL_TRUE);
+    status = player_set_boolean(ctx, ctx->scheduler->clock[0], MMAL_PARAMETER_CLOCK_REFERENCE, MMAL_TRUE);
     CHECK_STATUS(status, "Unable to set clock reference");
 
-    status = mmal_component_create(MMAL_COMPONENT_DEFAULT_VIDEO_RENDERER, &ctx->video_renderer);
+    status = ctx->backend->component_create(mmal_player_ROLE_RENDERER, &ctx->video_renderer);
     CHECK_STATUS(status, "Unable to create video renderer component");
     status = set_callback_and_enable(ctx, ctx->video_renderer);
     CHECK_STATUS(status, "Unable to configure video renderer component");
@@ -174,223 +628,1440 @@ MMAL_STATUS_T build_components(struct mmal_player_pipeline* ctx, const char *nex
     status = setup_display_port(ctx);
     CHECK_STATUS(status, "Unable to configure video renderer display configuration");
 
+    vcos_mutex_lock(&ctx->presentation_lock);
+    ctx->presenting = MMAL_TRUE;
+    vcos_mutex_unlock(&ctx->presentation_lock);
+
+error:
+    return status;
+}
+
+static MMAL_STATUS_T enable_connections(struct mmal_player_pipeline* ctx)
+{
+    MMAL_STATUS_T status;
+
     status = build_connections(ctx);
     CHECK_STATUS(status, "Unable to establish connections");
 
-    status = mmal_connection_enable(ctx->reader_to_decoder);
-    CHECK_STATUS(status, "Unable to enable connection reader -> decoder");
+    if(ctx->reader_to_decoder != NULL) {
+        status = ctx->backend->connection_enable(ctx->reader_to_decoder);
+        CHECK_STATUS(status, "Unable to enable connection reader -> decoder");
+    }
 
-    status = mmal_connection_enable(ctx->decoder_to_scheduler);
+    status = ctx->backend->connection_enable(ctx->decoder_to_scheduler);
     CHECK_STATUS(status, "Unable to enable connection decoder -> scheduler");
 
-    status = mmal_connection_enable(ctx->scheduler_to_renderer);
+    status = ctx->backend->connection_enable(ctx->scheduler_to_renderer);
     CHECK_STATUS(status, "Unable to enable connection scheduler -> renderer");
 
 error:
     return status;
 }
 
-#define LOG_IF_FAILS(status, format, ...) { if(status != MMAL_SUCCESS) fprintf(stderr, ("%s:%s(%d): " format "\n"), __FILE__, __func__, __LINE__, ##__VA_ARGS__); }
+struct reader_job
+{
+    struct mmal_player_pipeline* ctx;
+    const char* uri;
+    struct mmal_player_memory* memory;
+    MMAL_STATUS_T status;
+};
 
-MMAL_STATUS_T mmal_container_seek(MMAL_COMPONENT_T* container_reader, int64_t offset, uint32_t flags)
+static void* build_reader_thread(void* user)
 {
-    MMAL_PARAMETER_SEEK_T param;
-    param.hdr.id = MMAL_PARAMETER_SEEK;
-    param.hdr.size = sizeof(MMAL_PARAMETER_SEEK_T);
-    param.flags = flags;
-    param.offset = offset;
+    struct reader_job* job = user;
+    uint64_t started = vcos_getmicrosecs64();
 
-    return mmal_port_parameter_set(container_reader->control, &param.hdr);
+    job->status = build_reader(job->ctx, job->uri, job->memory);
+    __atomic_store_n(&job->ctx->metrics.startup.reader, vcos_getmicrosecs64() - started, __ATOMIC_RELAXED);
+
+    return NULL;
 }
 
-MMAL_STATUS_T mmal_player_set_new_uri(struct mmal_player_pipeline* ctx, const char* next_uri)
+// Opening the container is what takes longest, and the reader shares nothing with the decoder,
+// scheduler and renderer until they are connected: with fast_start it is built alongside them
+MMAL_STATUS_T build_components(struct mmal_player_pipeline* ctx, const char *next_uri, struct mmal_player_memory* memory)
 {
+    struct mmal_player_startup* startup = &ctx->metrics.startup;
+    struct reader_job job = {ctx, next_uri, memory, MMAL_SUCCESS};
+    VCOS_THREAD_T reader_thread;
+    MMAL_BOOL_T parallel;
     MMAL_STATUS_T status = MMAL_SUCCESS;
+    uint64_t started = vcos_getmicrosecs64(), now;
+
+    parallel = ctx->fast_start &&
+               vcos_thread_create(&reader_thread, "mmal-player:reader", NULL, build_reader_thread, &job) == VCOS_SUCCESS;
+    if(!parallel)
+        build_reader_thread(&job);
+
+    now = vcos_getmicrosecs64();
+    status = build_decoder(ctx);
+    __atomic_store_n(&startup->decoder, vcos_getmicrosecs64() - now, __ATOMIC_RELAXED);
+    if(status == MMAL_SUCCESS) {
+        now = vcos_getmicrosecs64();
+        status = build_presentation(ctx);
+        __atomic_store_n(&startup->presentation, vcos_getmicrosecs64() - now, __ATOMIC_RELAXED);
+    }
 
-    status = mmal_port_parameter_set_boolean(ctx->scheduler->clock[0], MMAL_PARAMETER_CLOCK_REFERENCE, MMAL_FALSE);
-    mmal_port_parameter_set_boolean(ctx->scheduler->clock[0], MMAL_PARAMETER_CLOCK_ACTIVE, MMAL_FALSE);
+    if(parallel) {
+        void* ret = NULL;
 
-#ifdef SEAMLESS_LOOP                    // unstable
-    if(strcmp(ctx->uri, next_uri) == 0)
-    {
-        mmal_connection_disable(ctx->reader_to_decoder); mmal_connection_destroy(ctx->reader_to_decoder);
-        ctx->reader_to_decoder = NULL;
-        {
-            // disable components
-            mmal_component_disable(ctx->video_renderer);
-            mmal_component_disable(ctx->scheduler);
-            mmal_component_disable(ctx->video_decoder);
-            mmal_component_disable(ctx->container_reader);
-
-            mmal_container_seek(ctx->container_reader, 0, MMAL_PARAM_SEEK_FLAG_FORWARD);
-            ctx->after_seek = MMAL_TRUE;
-
-            build_connections(ctx);
-
-            mmal_component_enable(ctx->container_reader);
-            mmal_component_enable(ctx->scheduler);
-            mmal_component_enable(ctx->video_decoder);
-            mmal_component_enable(ctx->video_renderer);
-        }
-        mmal_connection_enable(ctx->reader_to_decoder);
+        vcos_thread_join(&reader_thread, &ret);
     }
-    else
-#endif
-    {
-        // change movie
-        mmal_connection_disable(ctx->scheduler_to_renderer); mmal_connection_destroy(ctx->scheduler_to_renderer);
-        ctx->scheduler_to_renderer= NULL;
+    if(status == MMAL_SUCCESS)
+        status = job.status;
 
-        mmal_connection_disable(ctx->decoder_to_scheduler); mmal_connection_destroy(ctx->decoder_to_scheduler);
-        ctx->decoder_to_scheduler= NULL;
-
-        mmal_connection_disable(ctx->reader_to_decoder); mmal_connection_destroy(ctx->reader_to_decoder);
-        ctx->reader_to_decoder= NULL;
+    if(status == MMAL_SUCCESS) {
+        now = vcos_getmicrosecs64();
+        status = enable_connections(ctx);
+        __atomic_store_n(&startup->connections, vcos_getmicrosecs64() - now, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&startup->build, vcos_getmicrosecs64() - started, __ATOMIC_RELAXED);
 
-        // disable components
-        mmal_component_disable(ctx->video_renderer); mmal_component_destroy(ctx->video_renderer);
-        ctx->video_renderer= NULL;
+    return status;
+}
 
-        mmal_component_disable(ctx->scheduler); mmal_component_destroy(ctx->scheduler);
-        ctx->scheduler= NULL;
+// The decoder input hands every buffer back to the reader pool
+static void close_stream(struct mmal_player_pipeline* ctx)
+{
+    mmal_player_stream_close(ctx->stream);
+    ctx->stream = NULL;
+    if(ctx->video_decoder != NULL && ctx->video_decoder->input[0]->is_enabled)
+        ctx->backend->port_disable(ctx->video_decoder->input[0]);
+}
 
-        mmal_component_disable(ctx->video_decoder); mmal_component_destroy(ctx->video_decoder);
-        ctx->video_decoder= NULL;
+// Takes every header back from the decoder before the clip they point into may go
+static void close_memory(struct mmal_player_pipeline* ctx)
+{
+    if(ctx->video_decoder != NULL && ctx->video_decoder->input[0]->is_enabled)
+        ctx->backend->port_disable(ctx->video_decoder->input[0]);
+    mmal_player_memory_release(ctx->memory);
+    ctx->memory = NULL;
+}
 
-        mmal_component_disable(ctx->container_reader); mmal_component_destroy(ctx->container_reader);
-        ctx->container_reader= NULL;
+// Takes every buffer of the reader back from the decoder input; build_connections() connects them again
+static void disconnect_reader(struct mmal_player_pipeline* ctx)
+{
+    if(ctx->reader_to_decoder != NULL) {
+        ctx->backend->connection_disable(ctx->reader_to_decoder);
+        ctx->backend->connection_set_pool(ctx->reader_to_decoder, NULL);
+        ctx->backend->connection_destroy(ctx->reader_to_decoder);
+        ctx->reader_to_decoder = NULL;
+    } else if(ctx->video_decoder != NULL && ctx->video_decoder->input[0]->is_enabled) {
+        ctx->backend->port_disable(ctx->video_decoder->input[0]);
+    }
+}
 
-        // recreate components
-        status = build_components(ctx, next_uri);
-        if(status != MMAL_SUCCESS) {
-            ctx->pipeline_status = status;
-            return status;
-        }
+// ... and the decoded frames from the scheduler
+static void disconnect_decoder(struct mmal_player_pipeline* ctx)
+{
+    release_tapped(ctx);
+    if(ctx->decoder_to_scheduler != NULL) {
+        ctx->backend->connection_disable(ctx->decoder_to_scheduler);
+        ctx->backend->connection_destroy(ctx->decoder_to_scheduler);
+        ctx->decoder_to_scheduler = NULL;
+    }
+}
 
-        mmal_component_enable(ctx->container_reader);
-        mmal_component_enable(ctx->scheduler);
-        mmal_component_enable(ctx->video_decoder);
-        mmal_component_enable(ctx->video_renderer);
+static void destroy_reader(struct mmal_player_pipeline* ctx)
+{
+    if(ctx->stream != NULL)
+        close_stream(ctx);
+    if(ctx->memory != NULL)
+        close_memory(ctx);
+    close_index(ctx);
+    disconnect_reader(ctx);
+    if(ctx->container_reader != NULL) {
+        ctx->backend->component_disable(ctx->container_reader);
+        ctx->backend->component_destroy(ctx->container_reader);
+        ctx->container_reader = NULL;
+    }
+}
 
-        mmal_connection_enable(ctx->reader_to_decoder);
-        mmal_connection_enable(ctx->decoder_to_scheduler);
-        mmal_connection_enable(ctx->scheduler_to_renderer);
+static void destroy_decoder(struct mmal_player_pipeline* ctx)
+{
+    disconnect_decoder(ctx);
+    if(ctx->video_decoder != NULL) {
+        ctx->backend->component_disable(ctx->video_decoder);
+        ctx->backend->component_destroy(ctx->video_decoder);
+        ctx->video_decoder = NULL;
+    }
+}
 
+static void destroy_presentation(struct mmal_player_pipeline* ctx)
+{
+    // waits for a call from another thread that is under way
+    vcos_mutex_lock(&ctx->presentation_lock);
+    ctx->presenting = MMAL_FALSE;
+    vcos_mutex_unlock(&ctx->presentation_lock);
+
+    if(ctx->scheduler_to_renderer != NULL) {
+        ctx->backend->connection_disable(ctx->scheduler_to_renderer);
+        ctx->backend->connection_destroy(ctx->scheduler_to_renderer);
+        ctx->scheduler_to_renderer = NULL;
     }
-    ctx->eos = MMAL_FALSE;
+    if(ctx->video_renderer != NULL) {
+        ctx->backend->component_disable(ctx->video_renderer);
+        ctx->backend->component_destroy(ctx->video_renderer);
+        ctx->video_renderer = NULL;
+    }
+    if(ctx->scheduler != NULL) {
+        ctx->backend->component_disable(ctx->scheduler);
+        ctx->backend->component_destroy(ctx->scheduler);
+        ctx->scheduler = NULL;
+    }
+}
 
-    status = mmal_port_parameter_set_boolean(ctx->scheduler->clock[0], MMAL_PARAMETER_CLOCK_REFERENCE, MMAL_TRUE);
-    mmal_port_parameter_set_boolean(ctx->scheduler->clock[0], MMAL_PARAMETER_CLOCK_ACTIVE, MMAL_TRUE);
-    return status;
+// A component can go on with a new stream when only what it picks up in-band changed
+// (bitrate, frame rate); anything it was configured for needs a fresh one.
+#define FORMAT_CONFIGURED   (MMAL_ES_FORMAT_COMPARE_FLAG_TYPE | MMAL_ES_FORMAT_COMPARE_FLAG_ENCODING | \
+                             MMAL_ES_FORMAT_COMPARE_FLAG_VIDEO_RESOLUTION | MMAL_ES_FORMAT_COMPARE_FLAG_VIDEO_CROPPING)
+
+static MMAL_BOOL_T port_accepts(MMAL_PORT_T* in, MMAL_PORT_T* out, uint32_t configured)
+{
+    return !(mmal_format_compare(out->format, in->format) & configured);
 }
 
-MMAL_STATUS_T conn_pump(struct mmal_player_pipeline* ctx, MMAL_CONNECTION_T* connection)
+// Streams and memory clips bring their codec config in-band, any H.264 decoder goes on with them
+static MMAL_BOOL_T decoder_accepts(struct mmal_player_pipeline* ctx)
 {
-    MMAL_BUFFER_HEADER_T *buffer;
-    MMAL_STATUS_T status = MMAL_SUCCESS;
+    if(ctx->container_reader == NULL)
+        return ctx->video_decoder->input[0]->format->encoding == MMAL_ENCODING_H264;
+    return port_accepts(ctx->video_decoder->input[0], ctx->container_reader->output[0], FORMAT_CONFIGURED | MMAL_ES_FORMAT_COMPARE_FLAG_EXTRADATA);
+}
 
-    if((connection->flags) & MMAL_CONNECTION_FLAG_TUNNELLING)
-        return MMAL_SUCCESS; /* Nothing else to do in tunnelling mode */
+// Opens `uri` on a new reader in place of the current one, then rebuilds only what the new
+// stream cannot pass through: the decoder when the elementary stream format or its codec
+// config changed, scheduler and renderer when the decoded picture did. Every connection is
+// left enabled; the clock is the caller's.
+static MMAL_STATUS_T switch_reader(struct mmal_player_pipeline* ctx, const char* uri, struct mmal_player_memory* memory)
+{
+    MMAL_STATUS_T status;
 
-    /* Send empty buffers to the output port of the connection */
-    while((buffer = mmal_queue_get(connection->pool->queue)) != NULL) {
-        status = mmal_port_send_buffer(connection->out, buffer);
-        if(status != MMAL_SUCCESS) {
-            fprintf(stderr, "failed to send buffer\n");
-            return status;
+    destroy_reader(ctx);
+    status = build_reader(ctx, uri, memory);
+    CHECK_STATUS(status, "Unable to open the next file");
+
+    ctx->last_switch = mmal_player_SWITCH_READER;
+    if(ctx->video_decoder == NULL || !decoder_accepts(ctx)) {
+        ctx->last_switch = mmal_player_SWITCH_DECODER;
+        destroy_decoder(ctx);
+        status = build_decoder(ctx);
+        CHECK_STATUS(status, "Unable to rebuild the video decoder");
+
+        status = connect_reader(ctx);
+        CHECK_STATUS(status, "Unable to connect reader -> decoder");
+
+        if(ctx->scheduler == NULL || !port_accepts(ctx->scheduler->input[0], ctx->video_decoder->output[0], FORMAT_CONFIGURED)) {
+            ctx->last_switch = mmal_player_SWITCH_REBUILD;
+            destroy_presentation(ctx);
+            status = build_presentation(ctx);
+            CHECK_STATUS(status, "Unable to rebuild scheduler and renderer");
         }
     }
 
-    /* Send any queued buffer to the next component */
-    while((buffer = mmal_queue_get(connection->queue)) != NULL) {
-        status = mmal_port_send_buffer(connection->in, buffer);
-        if(status != MMAL_SUCCESS) {
-            fprintf(stderr, "failed to send buffer\n");
-            return status;
-        }
-    }
+    status = enable_connections(ctx);
+
+error:
     return status;
 }
 
-MMAL_STATUS_T conn_pump_for_container_reader(struct mmal_player_pipeline* ctx, MMAL_CONNECTION_T* connection)
-{
-    MMAL_BUFFER_HEADER_T *buffer;
-    MMAL_STATUS_T status = MMAL_SUCCESS;
+#define LOG_IF_FAILS(status, format, ...) { if(status != MMAL_SUCCESS) fprintf(stderr, ("%s:%s(%d): " format "\n"), __FILE__, __func__, __LINE__, ##__VA_ARGS__); }
+
+MMAL_STATUS_T mmal_container_seek(struct mmal_player_pipeline* ctx, int64_t offset, uint32_t flags)
+{
+    MMAL_PARAMETER_SEEK_T param;
+    param.hdr.id = MMAL_PARAMETER_SEEK;
+    param.hdr.size = sizeof(MMAL_PARAMETER_SEEK_T);
+    param.flags = flags;
+    param.offset = offset;
+
+    return ctx->backend->parameter_set(ctx->container_reader->control, &param.hdr);
+}
+
+#ifdef SEAMLESS_LOOP
+// Loops the current file in place: only reader -> decoder is cycled while the reader seeks back
+// to the start. Decoder, scheduler and renderer stay enabled; the clock is held until the first
+// rewound buffer reaches the decoder and is then re-based on its PTS (see conn_pump_for_container_reader).
+static MMAL_STATUS_T mmal_player_rewind(struct mmal_player_pipeline* ctx)
+{
+    const struct mmal_player_keyframe* loop = ctx->index != NULL ? mmal_player_index_loop_point(ctx->index) : NULL;
+    MMAL_STATUS_T status;
+
+    player_set_boolean(ctx, ctx->scheduler->clock[0], MMAL_PARAMETER_CLOCK_ACTIVE, MMAL_FALSE);
+
+    status = ctx->backend->connection_disable(ctx->reader_to_decoder);
+    LOG_IF_FAILS(status, "Unable to disable connection reader -> decoder");
+
+    // straight to the first clean keyframe when the index knows it
+    if(loop != NULL)
+        status = mmal_container_seek(ctx, loop->pts, MMAL_PARAM_SEEK_FLAG_PRECISE);
+    else
+        status = mmal_container_seek(ctx, 0, MMAL_PARAM_SEEK_FLAG_FORWARD);
+    CHECK_STATUS(status, "Unable to rewind container reader");
+
+    ctx->after_seek = MMAL_TRUE;
+    ctx->clock_resync = MMAL_TRUE;
+    ctx->reader_eos = MMAL_FALSE;
+
+    adapt_reader_buffers(ctx);
+    status = prepare_reader_pool(ctx);
+    CHECK_STATUS(status, "Unable to resize reader buffers");
+
+    status = ctx->backend->connection_enable(ctx->reader_to_decoder);
+    CHECK_STATUS(status, "Unable to enable connection reader -> decoder");
+
+    ctx->eos = MMAL_FALSE;
+
+error:
+    if(status != MMAL_SUCCESS)
+        ctx->pipeline_status = status;
+    return status;
+}
+#endif
+
+// Drops the decoded frames a non-tunnelled connection holds for its input port
+static void connection_drain(MMAL_CONNECTION_T* connection)
+{
+    MMAL_BUFFER_HEADER_T* buffer;
+
+    if(connection->flags & MMAL_CONNECTION_FLAG_TUNNELLING)
+        return;
+    while((buffer = mmal_queue_get(connection->queue)) != NULL)
+        mmal_buffer_header_release(buffer);
+}
+
+// Drops every decoded frame on its way to the renderer
+static void flush_decoded(struct mmal_player_pipeline* ctx)
+{
+    ctx->backend->port_flush(ctx->video_decoder->output[0]);
+    connection_drain(ctx->decoder_to_scheduler);
+    ctx->backend->port_flush(ctx->scheduler->input[0]);
+    ctx->backend->port_flush(ctx->scheduler->output[0]);
+    connection_drain(ctx->scheduler_to_renderer);
+    memset(ctx->stage_pts, 0, sizeof(ctx->stage_pts));
+}
+
+// Jumps to the keyframe nearest `pts` in place. Unlike a rewind at the end of the clip, frames
+// decoded from the old position are still on their way, so decoder output, scheduler and the
+// connections in between are flushed too; the clock restarts at the first buffer after the seek.
+static MMAL_STATUS_T seek_pipeline(struct mmal_player_pipeline* ctx, int64_t pts, uint32_t flags)
+{
+    const struct mmal_player_keyframe* keyframe;
+    MMAL_STATUS_T status;
+
+    if(ctx->stream != NULL) {
+        fprintf(stderr, "%s: a live stream cannot seek\n", ctx->uri);
+        return MMAL_ENOSYS;
+    }
+
+    player_set_boolean(ctx, ctx->scheduler->clock[0], MMAL_PARAMETER_CLOCK_ACTIVE, MMAL_FALSE);
+
+    if(ctx->memory != NULL) {
+        ctx->memory_next = mmal_player_memory_seek(ctx->memory, pts, flags);
+        ctx->backend->port_flush(ctx->video_decoder->input[0]);
+    } else {
+        status = ctx->backend->connection_disable(ctx->reader_to_decoder);
+        LOG_IF_FAILS(status, "Unable to disable connection reader -> decoder");
+
+        // an exact keyframe time spares the reader its search; a failed seek leaves it where it was
+        keyframe = ctx->index != NULL ? mmal_player_index_find(ctx->index, pts, flags) : NULL;
+        if(keyframe != NULL)
+            status = mmal_container_seek(ctx, keyframe->pts, MMAL_PARAM_SEEK_FLAG_PRECISE);
+        else
+            status = mmal_container_seek(ctx, pts, flags);
+        LOG_IF_FAILS(status, "Unable to seek container reader to %lld", (long long)pts);
+
+        // what is learnt from here on would have a gap
+        mmal_player_index_destroy(ctx->index_learning);
+        ctx->index_learning = NULL;
+    }
+
+    flush_decoded(ctx);
+
+    ctx->after_seek = MMAL_TRUE;
+    ctx->clock_resync = MMAL_TRUE;
+    ctx->reader_eos = MMAL_FALSE;
+    ctx->need_keyframe = MMAL_FALSE;
+    ctx->eos = MMAL_FALSE;
+    ctx->seek_time = vcos_getmicrosecs64();
+
+    if(ctx->memory == NULL) {
+        status = ctx->backend->connection_enable(ctx->reader_to_decoder);
+        if(status != MMAL_SUCCESS) {
+            fprintf(stderr, "Unable to enable connection reader -> decoder\n");
+            ctx->pipeline_status = status;
+            return status;
+        }
+    }
+
+    // flushed output ports need empty buffers again
+    signal_pending(ctx, PENDING_CONNECTIONS);
+    return MMAL_SUCCESS;
+}
+
+static void set_rate(struct mmal_player_pipeline* ctx, MMAL_RATIONAL_T rate)
+{
+    MMAL_BOOL_T fast = rate.num >= TRICK_PLAY_RATE * rate.den;
+
+    if(ctx->stream != NULL) {
+        fprintf(stderr, "%s: a live stream plays at its own rate\n", ctx->uri);
+        return;
+    }
+
+    // the frames after the last keyframe sent refer to ones that were never decoded
+    if(ctx->keyframes_only && !fast)
+        ctx->need_keyframe = MMAL_TRUE;
+    ctx->keyframes_only = fast;
+    ctx->rate = rate;
+    set_playback_rate(ctx);
+}
+
+// Trick play: keyframes only at high speed, and after it up to the next keyframe
+static MMAL_BOOL_T trick_skip(struct mmal_player_pipeline* ctx, uint32_t flags)
+{
+    if(flags & (MMAL_BUFFER_HEADER_FLAG_KEYFRAME | MMAL_BUFFER_HEADER_FLAG_EOS)) {
+        ctx->need_keyframe = MMAL_FALSE;
+        return MMAL_FALSE;
+    }
+    return ctx->keyframes_only || ctx->need_keyframe;
+}
+
+static void account_switch(struct mmal_player_pipeline* ctx, uint64_t started)
+{
+    mmal_player_timing_add(&ctx->metrics.switches[ctx->last_switch], vcos_getmicrosecs64() - started);
+}
+
+// Pipeline thread, from the EOS callback: the watchdog lets the held frame be, a skip brings the EOS back
+void mmal_player_hold_eos(struct mmal_player_pipeline* ctx)
+{
+    ctx->eos_held = MMAL_TRUE;
+}
+
+// Switches to `next_uri` on the pipeline thread, keeping every component the new file can
+// go through (see switch_reader()).
+MMAL_STATUS_T mmal_player_set_new_uri(struct mmal_player_pipeline* ctx, const char* next_uri)
+{
+    MMAL_STATUS_T status = MMAL_SUCCESS;
+    uint64_t started = vcos_getmicrosecs64();
+
+#ifdef SEAMLESS_LOOP
+    // a stream is opened again instead
+    if(ctx->stream == NULL && ctx->memory == NULL && ctx->uri != NULL && strcmp(ctx->uri, next_uri) == 0) {
+        status = mmal_player_rewind(ctx);
+        ctx->last_switch = mmal_player_SWITCH_REWIND;
+        account_switch(ctx, started);
+        return status;
+    }
+#endif
+
+    player_set_boolean(ctx, ctx->scheduler->clock[0], MMAL_PARAMETER_CLOCK_ACTIVE, MMAL_FALSE);
+
+    // the reader pool carries over
+    adapt_reader_buffers(ctx);
+    status = switch_reader(ctx, next_uri, NULL);
+    if(status != MMAL_SUCCESS) {
+        ctx->pipeline_status = status;
+        return status;
+    }
+    ctx->eos = MMAL_FALSE;
+
+    if(ctx->last_switch == mmal_player_SWITCH_REBUILD) {
+        status = start_clock(ctx);
+    } else {
+        // the scheduler still holds the last clip's time, re-base it on the first buffer
+        ctx->clock_resync = MMAL_TRUE;
+    }
+
+    account_switch(ctx, started);
+    return status;
+}
+
+// Plays `memory` next, like mmal_player_set_new_uri(). The clip playing again only starts over
+// from its first access unit; nothing is read, no component is touched.
+MMAL_STATUS_T mmal_player_set_new_memory(struct mmal_player_pipeline* ctx, struct mmal_player_memory* memory)
+{
+    MMAL_STATUS_T status = MMAL_SUCCESS;
+    uint64_t started = vcos_getmicrosecs64();
+
+    player_set_boolean(ctx, ctx->scheduler->clock[0], MMAL_PARAMETER_CLOCK_ACTIVE, MMAL_FALSE);
+
+    if(memory == ctx->memory) {
+        ctx->memory_next = 0;
+        ctx->after_seek = MMAL_TRUE;
+        ctx->clock_resync = MMAL_TRUE;
+        ctx->reader_eos = MMAL_FALSE;
+        ctx->eos = MMAL_FALSE;
+        ctx->last_switch = mmal_player_SWITCH_REWIND;
+        account_switch(ctx, started);
+        return MMAL_SUCCESS;
+    }
+
+    adapt_reader_buffers(ctx);
+    status = switch_reader(ctx, NULL, memory);
+    if(status != MMAL_SUCCESS) {
+        ctx->pipeline_status = status;
+        return status;
+    }
+    ctx->eos = MMAL_FALSE;
+
+    if(ctx->last_switch == mmal_player_SWITCH_REBUILD)
+        status = start_clock(ctx);
+    else
+        ctx->clock_resync = MMAL_TRUE;
+
+    account_switch(ctx, started);
+    return status;
+}
+
+static void account_pump(struct mmal_player_pipeline* ctx, enum mmal_player_stage index, uint64_t started, uint32_t moved, uint32_t delivered)
+{
+    struct mmal_player_stage_metrics* stage = &ctx->metrics.stage[index];
+    uint64_t signalled = __atomic_load_n(&ctx->metrics.signal_time[index], __ATOMIC_RELAXED);
+
+    ctx->loop_stats.pumps++;
+    ctx->loop_stats.buffers += moved;
+    if(moved == 0)
+        ctx->loop_stats.empty_pumps++;
+
+    if(delivered > 0) {
+        __atomic_store_n(&stage->buffers, stage->buffers + delivered, __ATOMIC_RELAXED);
+        if(signalled != 0 && signalled <= started)
+            mmal_player_timing_add(&stage->queue_wait, started - signalled);
+    }
+    mmal_player_timing_add(&stage->pump, vcos_getmicrosecs64() - started);
+}
+
+// frames reaching a non-tunnelled renderer after their presentation time, and the first after a seek
+static void account_lateness(struct mmal_player_pipeline* ctx, MMAL_BUFFER_HEADER_T* buffer)
+{
+    MMAL_PARAMETER_INT64_T clock = {{MMAL_PARAMETER_CLOCK_TIME, sizeof(clock)}, 0};
+
+    if(buffer->pts == MMAL_TIME_UNKNOWN || buffer->length == 0)
+        return;
+    if(ctx->seek_time != 0) {
+        mmal_player_timing_add(&ctx->metrics.seeks, vcos_getmicrosecs64() - ctx->seek_time);
+        ctx->seek_time = 0;
+    }
+    if(ctx->backend->parameter_get(ctx->scheduler->clock[0], &clock.hdr) != MMAL_SUCCESS || clock.value <= buffer->pts)
+        return;
+
+    mmal_player_timing_add(&ctx->metrics.lateness, clock.value - buffer->pts);
+    if(clock.value - buffer->pts > ctx->frame_interval)
+        __atomic_store_n(&ctx->metrics.late_frames, ctx->metrics.late_frames + 1, __ATOMIC_RELAXED);
+}
+
+MMAL_STATUS_T conn_pump(struct mmal_player_pipeline* ctx, MMAL_CONNECTION_T* connection)
+{
+    MMAL_BUFFER_HEADER_T *buffer;
+    MMAL_STATUS_T status = MMAL_SUCCESS;
+    uint32_t moved = 0, delivered = 0;
+    uint64_t started = vcos_getmicrosecs64();
+
+    if((connection->flags) & MMAL_CONNECTION_FLAG_TUNNELLING)
+        return MMAL_SUCCESS; /* Nothing else to do in tunnelling mode */
+
+    /* Send empty buffers to the output port of the connection */
+    while((buffer = mmal_queue_get(connection->pool->queue)) != NULL) {
+        status = ctx->backend->send_buffer(connection->out, buffer);
+        if(status != MMAL_SUCCESS) {
+            fprintf(stderr, "failed to send buffer\n");
+            return status;
+        }
+        moved++;
+    }
+
+    /* Send any queued buffer to the next component */
+    while((buffer = mmal_queue_get(connection->queue)) != NULL) {
+        if(connection == ctx->scheduler_to_renderer)
+            account_lateness(ctx, buffer);
+        else if(connection == ctx->decoder_to_scheduler && ctx->tap != NULL)
+            mmal_player_tap_offer(ctx->tap, ctx, connection->out, buffer);
+        if(buffer->pts != MMAL_TIME_UNKNOWN)
+            ctx->stage_pts[connection_stage(ctx, connection)] = buffer->pts;
+
+        status = ctx->backend->send_buffer(connection->in, buffer);
+        if(status != MMAL_SUCCESS) {
+            fprintf(stderr, "failed to send buffer\n");
+            return status;
+        }
+        moved++;
+        delivered++;
+    }
+
+    account_pump(ctx, connection_stage(ctx, connection), started, moved, delivered);
+    return status;
+}
+
+// Notes the keyframes of a file played from start to end; at its end the index is stored for
+// the next time and used from the next loop on
+static void learn_keyframe(struct mmal_player_pipeline* ctx, MMAL_BUFFER_HEADER_T* buffer)
+{
+    if((buffer->flags & MMAL_BUFFER_HEADER_FLAG_KEYFRAME) && buffer->pts != MMAL_TIME_UNKNOWN)
+        mmal_player_index_add(ctx->index_learning, buffer->pts, mmal_player_INDEX_NO_OFFSET, mmal_player_KEYFRAME_FLAGGED);
+    if(!(buffer->flags & MMAL_BUFFER_HEADER_FLAG_EOS))
+        return;
+
+    if(mmal_player_index_count(ctx->index_learning) > 0) {
+        mmal_player_index_save(ctx->index_learning, ctx->index_options.cache_dir);
+        ctx->index = ctx->index_learning;
+    } else {
+        mmal_player_index_destroy(ctx->index_learning);
+    }
+    ctx->index_learning = NULL;
+}
+
+MMAL_STATUS_T conn_pump_for_container_reader(struct mmal_player_pipeline* ctx, MMAL_CONNECTION_T* connection)
+{
+    MMAL_BUFFER_HEADER_T *buffer;
+    MMAL_STATUS_T status = MMAL_SUCCESS;
+    uint32_t moved = 0, delivered = 0;
+    uint64_t started = vcos_getmicrosecs64();
 
     if((connection->flags) & MMAL_CONNECTION_FLAG_TUNNELLING)
         return MMAL_SUCCESS; /* Nothing else to do in tunnelling mode */
 
-    /* Send empty buffers to the output port of the connection */
-    while((buffer = mmal_queue_get(connection->pool->queue)) != NULL) {
-        status = mmal_port_send_buffer(connection->out, buffer);
-        if(status != MMAL_SUCCESS) {
-            fprintf(stderr, "failed to send buffer\n");
-            return status;
+    /* Send empty buffers to the output port of the connection */
+    while((buffer = mmal_queue_get(connection->pool->queue)) != NULL) {
+        status = ctx->backend->send_buffer(connection->out, buffer);
+        if(status != MMAL_SUCCESS) {
+            fprintf(stderr, "failed to send buffer\n");
+            return status;
+        }
+        moved++;
+    }
+
+    /* Send any queued buffer to the next component */
+    while((buffer = mmal_queue_get(connection->queue)) != NULL) {
+        // straight back to the reader pool, which wakes us for the next
+        if(trick_skip(ctx, buffer->flags)) {
+            mmal_buffer_header_release(buffer);
+            moved++;
+            continue;
+        }
+
+        if(ctx->after_seek) {
+//            fprintf(stderr, "set first-after-seek flag\n");
+            buffer->flags |= MMAL_BUFFER_HEADER_FLAG_DISCONTINUITY;
+            buffer->flags |= MMAL_BUFFER_HEADER_FLAG_CONFIG;
+            ctx->after_seek = MMAL_FALSE;
+
+            // a recovery resumes the clip, positions still count from its start
+            if(!ctx->keep_clip_pts)
+                __atomic_store_n(&ctx->clip_pts, buffer->pts != MMAL_TIME_UNKNOWN ? buffer->pts : 0, __ATOMIC_RELAXED);
+            ctx->keep_clip_pts = MMAL_FALSE;
+            if(ctx->clock_resync) {
+                // start the media clock where the rewound stream begins, not where the last loop ended;
+                // a prerolling pipeline only gets its clock set, mmal_player_start() runs it
+                if(buffer->pts != MMAL_TIME_UNKNOWN)
+                    player_set_int64(ctx, ctx->scheduler->clock[0], MMAL_PARAMETER_CLOCK_TIME, buffer->pts);
+                if(!ctx->prerolled)
+                    start_clock(ctx);
+                ctx->clock_resync = MMAL_FALSE;
+            }
+        }
+
+        if(buffer->pts != MMAL_TIME_UNKNOWN)
+            __atomic_store_n(&ctx->metrics.last_pts_in, buffer->pts, __ATOMIC_RELAXED);
+        if(buffer->flags & MMAL_BUFFER_HEADER_FLAG_EOS)
+            ctx->reader_eos = MMAL_TRUE;
+        if(ctx->index_learning != NULL)
+            learn_keyframe(ctx, buffer);
+
+        status = ctx->backend->send_buffer(connection->in, buffer);
+        if(status != MMAL_SUCCESS) {
+            fprintf(stderr, "failed to send buffer\n");
+            return status;
+        }
+        moved++;
+        delivered++;
+    }
+
+    account_pump(ctx, connection_stage(ctx, connection), started, moved, delivered);
+    return status;
+}
+
+// Hands the decoder whatever the stream's jitter buffer has due, as far as the reader pool lasts
+static MMAL_STATUS_T stream_pump(struct mmal_player_pipeline* ctx)
+{
+    MMAL_BUFFER_HEADER_T *buffer;
+    MMAL_STATUS_T status = MMAL_SUCCESS;
+    uint32_t delivered = 0;
+    uint64_t started = vcos_getmicrosecs64();
+
+    while((buffer = mmal_queue_get(ctx->reader_pool->queue)) != NULL) {
+        if(!mmal_player_stream_read(ctx->stream, buffer)) {
+            mmal_queue_put_back(ctx->reader_pool->queue, buffer);
+            break;
+        }
+
+        if(ctx->after_seek) {
+            buffer->flags |= MMAL_BUFFER_HEADER_FLAG_DISCONTINUITY;
+            ctx->after_seek = MMAL_FALSE;
+
+            // live PTS start anywhere: the clock always starts from the first one, a little behind it
+            __atomic_store_n(&ctx->clip_pts, buffer->pts != MMAL_TIME_UNKNOWN ? buffer->pts : 0, __ATOMIC_RELAXED);
+            player_set_int64(ctx, ctx->scheduler->clock[0], MMAL_PARAMETER_CLOCK_TIME,
+                             ctx->clip_pts - STREAM_DECODE_FRAMES * ctx->frame_interval);
+            if(ctx->clock_resync) {
+                if(!ctx->prerolled)
+                    start_clock(ctx);
+                ctx->clock_resync = MMAL_FALSE;
+            }
+        }
+
+        if(buffer->pts != MMAL_TIME_UNKNOWN)
+            __atomic_store_n(&ctx->metrics.last_pts_in, buffer->pts, __ATOMIC_RELAXED);
+        if(buffer->flags & MMAL_BUFFER_HEADER_FLAG_EOS)
+            ctx->reader_eos = MMAL_TRUE;
+
+        status = ctx->backend->send_buffer(ctx->video_decoder->input[0], buffer);
+        if(status != MMAL_SUCCESS) {
+            fprintf(stderr, "failed to send buffer\n");
+            mmal_buffer_header_release(buffer);
+            return status;
+        }
+        delivered++;
+    }
+
+    account_pump(ctx, mmal_player_STAGE_READER_TO_DECODER, started, delivered, delivered);
+    return status;
+}
+
+// Points free headers at the clip's next access units, then sends an empty EOS after the last
+static MMAL_STATUS_T memory_pump(struct mmal_player_pipeline* ctx)
+{
+    MMAL_BUFFER_HEADER_T *buffer;
+    MMAL_STATUS_T status = MMAL_SUCCESS;
+    uint32_t delivered = 0;
+    uint32_t units = mmal_player_memory_units(ctx->memory);
+    uint64_t started = vcos_getmicrosecs64();
+
+    while(!ctx->reader_eos && (buffer = mmal_queue_get(ctx->memory_pool->queue)) != NULL) {
+        if(ctx->memory_next < units) {
+            do
+                mmal_player_memory_unit(ctx->memory, ctx->memory_next++, buffer);
+            while(trick_skip(ctx, buffer->flags) && ctx->memory_next < units);
+        } else {
+            buffer->data = NULL;
+            buffer->alloc_size = buffer->length = buffer->offset = 0;
+            buffer->flags = MMAL_BUFFER_HEADER_FLAG_EOS;
+            buffer->pts = buffer->dts = MMAL_TIME_UNKNOWN;
+            ctx->reader_eos = MMAL_TRUE;
+        }
+
+        // the same first-buffer handling as conn_pump_for_container_reader()
+        if(ctx->after_seek) {
+            buffer->flags |= MMAL_BUFFER_HEADER_FLAG_DISCONTINUITY;
+            buffer->flags |= MMAL_BUFFER_HEADER_FLAG_CONFIG;
+            ctx->after_seek = MMAL_FALSE;
+
+            if(!ctx->keep_clip_pts)
+                __atomic_store_n(&ctx->clip_pts, buffer->pts != MMAL_TIME_UNKNOWN ? buffer->pts : 0, __ATOMIC_RELAXED);
+            ctx->keep_clip_pts = MMAL_FALSE;
+            if(ctx->clock_resync) {
+                if(buffer->pts != MMAL_TIME_UNKNOWN)
+                    player_set_int64(ctx, ctx->scheduler->clock[0], MMAL_PARAMETER_CLOCK_TIME, buffer->pts);
+                if(!ctx->prerolled)
+                    start_clock(ctx);
+                ctx->clock_resync = MMAL_FALSE;
+            }
+        }
+
+        if(buffer->pts != MMAL_TIME_UNKNOWN)
+            __atomic_store_n(&ctx->metrics.last_pts_in, buffer->pts, __ATOMIC_RELAXED);
+
+        status = ctx->backend->send_buffer(ctx->video_decoder->input[0], buffer);
+        if(status != MMAL_SUCCESS) {
+            fprintf(stderr, "failed to send buffer\n");
+            mmal_buffer_header_release(buffer);
+            return status;
+        }
+        delivered++;
+    }
+
+    account_pump(ctx, mmal_player_STAGE_READER_TO_DECODER, started, delivered, delivered);
+    return status;
+}
+
+static void timing_store(struct mmal_player_timing* dst, const struct mmal_player_timing* src)
+{
+    __atomic_store_n(&dst->count, src->count, __ATOMIC_RELAXED);
+    __atomic_store_n(&dst->total, src->total, __ATOMIC_RELAXED);
+    __atomic_store_n(&dst->max, src->max, __ATOMIC_RELAXED);
+}
+
+static void sample_stream(struct mmal_player_pipeline* ctx)
+{
+    struct mmal_player_stream_stats stats;
+
+    mmal_player_stream_get_stats(ctx->stream, &stats);
+    __atomic_store_n(&ctx->metrics.stream_depth, stats.depth, __ATOMIC_RELAXED);
+    __atomic_store_n(&ctx->metrics.stream_depth_us, stats.depth_us, __ATOMIC_RELAXED);
+    __atomic_store_n(&ctx->metrics.stream_depth_max, stats.depth_max, __ATOMIC_RELAXED);
+    __atomic_store_n(&ctx->metrics.stream_late, stats.late, __ATOMIC_RELAXED);
+    __atomic_store_n(&ctx->metrics.stream_overflow, stats.overflow, __ATOMIC_RELAXED);
+    __atomic_store_n(&ctx->metrics.stream_lost, stats.lost, __ATOMIC_RELAXED);
+    __atomic_store_n(&ctx->metrics.stream_rebases, stats.rebases, __ATOMIC_RELAXED);
+    timing_store(&ctx->metrics.stream_hold, &stats.hold);
+}
+
+// Samples what needs a port query (pool occupancy, media clock, renderer statistics).
+// Runs on the pipeline thread, at most every METRICS_SAMPLE_INTERVAL_US or dump interval.
+static void sample_metrics(struct mmal_player_pipeline* ctx)
+{
+    MMAL_CONNECTION_T* connections[mmal_player_STAGE_MAX] = {
+        ctx->reader_to_decoder, ctx->decoder_to_scheduler, ctx->scheduler_to_renderer
+    };
+    MMAL_PARAMETER_INT64_T clock = {{MMAL_PARAMETER_CLOCK_TIME, sizeof(clock)}, 0};
+    MMAL_PARAMETER_STATISTICS_T statistics;
+    int i;
+
+    for(i = 0; i < mmal_player_STAGE_MAX; i++) {
+        int32_t in_flight = -1;
+        MMAL_CONNECTION_T* connection = connections[i];
+
+        if(connection != NULL && !(connection->flags & MMAL_CONNECTION_FLAG_TUNNELLING) && connection->pool != NULL)
+            in_flight = (int32_t)connection->pool->headers_num - (int32_t)mmal_queue_length(connection->pool->queue);
+        else if(i == mmal_player_STAGE_READER_TO_DECODER && ctx->stream != NULL)
+            in_flight = (int32_t)ctx->reader_pool->headers_num - (int32_t)mmal_queue_length(ctx->reader_pool->queue);
+        else if(i == mmal_player_STAGE_READER_TO_DECODER && ctx->memory != NULL)
+            in_flight = (int32_t)ctx->memory_pool->headers_num - (int32_t)mmal_queue_length(ctx->memory_pool->queue);
+        __atomic_store_n(&ctx->metrics.stage[i].in_flight, in_flight, __ATOMIC_RELAXED);
+    }
+    if(ctx->stream != NULL)
+        sample_stream(ctx);
+
+    if(ctx->backend->parameter_get(ctx->scheduler->clock[0], &clock.hdr) == MMAL_SUCCESS) {
+        int64_t lead = ctx->metrics.last_pts_in - clock.value;
+
+        __atomic_store_n(&ctx->metrics.media_time, clock.value, __ATOMIC_RELAXED);
+        __atomic_store_n(&ctx->metrics.decoder_lead, lead, __ATOMIC_RELAXED);
+
+        // the decoder has less than a frame to work on while the clock runs: the reader fell behind
+        if(lead < ctx->frame_interval && !ctx->reader_eos && !ctx->prerolled && !ctx->paused && !ctx->clock_resync &&
+           ctx->start_time != 0 && vcos_getmicrosecs64() > ctx->start_time + UNDERRUN_GRACE_US) {
+            ctx->clip_underruns++;
+            __atomic_store_n(&ctx->metrics.reader_underruns, ctx->metrics.reader_underruns + 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    memset(&statistics, 0, sizeof(statistics));
+    statistics.hdr.id = MMAL_PARAMETER_STATISTICS;
+    statistics.hdr.size = sizeof(statistics);
+    if(ctx->backend->parameter_get(ctx->video_renderer->input[0], &statistics.hdr) == MMAL_SUCCESS)
+        __atomic_store_n(&ctx->metrics.dropped_frames, statistics.frames_skipped + statistics.frames_discarded, __ATOMIC_RELAXED);
+}
+
+static void dump_metrics(struct mmal_player_pipeline* ctx, uint64_t now)
+{
+    struct mmal_player_metrics snapshot;
+    char line[2048];
+    int len;
+
+    mmal_player_metrics_copy(&snapshot, &ctx->metrics);
+    len = mmal_player_metrics_format_json(&snapshot, ctx->uri, now, line, sizeof(line) - 1);
+    if(len < 0 || (size_t)len >= sizeof(line) - 1)
+        return;
+
+    line[len++] = '\n';
+    if(write(ctx->metrics_fd, line, len) != len)
+        fprintf(stderr, "failed to write metrics\n");
+}
+
+static void update_metrics(struct mmal_player_pipeline* ctx)
+{
+    uint64_t now = vcos_getmicrosecs64();
+
+    if(now < ctx->metrics_next)
+        return;
+
+    sample_metrics(ctx);
+    if(ctx->metrics_fd >= 0)
+        dump_metrics(ctx, now);
+
+    ctx->metrics_next = now + (ctx->metrics_fd >= 0 ? ctx->metrics_interval : METRICS_SAMPLE_INTERVAL_US);
+}
+
+static void set_clock_rate(struct mmal_player_pipeline* ctx, int32_t ppm)
+{
+    MMAL_PARAMETER_RATIONAL_T scale = {{MMAL_PARAMETER_CLOCK_SCALE, sizeof(scale)}, {1000000 + ppm, 1000000}};
+
+    if(ppm == ctx->sync_ppm)
+        return;
+    if(ctx->backend->parameter_set(ctx->scheduler->clock[0], &scale.hdr) == MMAL_SUCCESS)
+        ctx->sync_ppm = ppm;
+}
+
+// Synced pipelines only. Starts a held clock at the group's start time for the clip, then keeps
+// it on the master's timeline: the master publishes where its clock is, the others measure
+// their drift against that and slew it away, or jump when they are more than a frame off.
+static void sync_step(struct mmal_player_pipeline* ctx)
+{
+    MMAL_PARAMETER_INT64_T clock = {{MMAL_PARAMETER_CLOCK_TIME, sizeof(clock)}, 0};
+    uint64_t now = vcos_getmicrosecs64();
+    int64_t position, drift;
+
+    if(ctx->sync_hold) {
+        // positions count from the first PTS of the clip, known once it went through
+        if(ctx->after_seek || ctx->prerolled)
+            return;
+        if(ctx->sync_generation == 0 &&
+           (ctx->sync_generation = mmal_player_sync_begin(ctx->sync, now, ctx->frame_interval)) == 0)
+            return;     // the master has not started its next clip yet, the watcher wakes us when it does
+        if(!mmal_player_sync_position(ctx->sync, ctx->sync_generation, now, &position)) {
+            // the master is a clip further already: join the one it plays now; or it could not be
+            // read, and the clip is held for the master's next one
+            ctx->sync_generation = 0;
+            signal_pending(ctx, PENDING_SYNC);
+            return;
+        }
+        if(position < -SYNC_START_AHEAD_US)
+            return;     // the watcher wakes us at the start time
+        // a little early the clock starts behind the first PTS and reaches it at the start time,
+        // rather than this thread sleeping while others wait for it
+
+        player_set_int64(ctx, ctx->scheduler->clock[0], MMAL_PARAMETER_CLOCK_TIME, ctx->clip_pts + position);
+        set_clock_rate(ctx, ctx->sync_trim);
+        player_set_boolean(ctx, ctx->scheduler->clock[0], MMAL_PARAMETER_CLOCK_ACTIVE, MMAL_TRUE);
+        ctx->start_time = now;
+        ctx->sync_next = now + SYNC_CHECK_INTERVAL_US;
+        ctx->sync_hold = MMAL_FALSE;
+        return;
+    }
+
+    if(ctx->sync_generation == 0 || now < ctx->sync_next)
+        return;
+    ctx->sync_next = now + SYNC_CHECK_INTERVAL_US;
+
+    if(ctx->backend->parameter_get(ctx->scheduler->clock[0], &clock.hdr) != MMAL_SUCCESS)
+        return;
+    if(mmal_player_sync_publish(ctx->sync, ctx->sync_generation, now, clock.value - ctx->clip_pts))
+        return;
+    if(!mmal_player_sync_position(ctx->sync, ctx->sync_generation, now, &position))
+        return;     // the master is on its next clip, this one ends soon
+
+    drift = clock.value - ctx->clip_pts - position;
+    __atomic_store_n(&ctx->metrics.sync_drift, drift, __ATOMIC_RELAXED);
+    mmal_player_timing_add(&ctx->metrics.sync_error, (uint64_t)(drift < 0 ? -drift : drift));
+
+    if(drift > ctx->frame_interval || drift < -ctx->frame_interval) {
+        player_set_int64(ctx, ctx->scheduler->clock[0], MMAL_PARAMETER_CLOCK_TIME, ctx->clip_pts + position);
+        set_clock_rate(ctx, ctx->sync_trim);
+        __atomic_store_n(&ctx->metrics.sync_jumps, ctx->metrics.sync_jumps + 1, __ATOMIC_RELAXED);
+    } else {
+        int64_t ppm = -drift * 1000000 / SYNC_SLEW_US;
+
+        // what is left over once the drift is gone is the rate error of this clock
+        ctx->sync_trim = (int32_t)vcos_max(vcos_min(ctx->sync_trim + ppm / SYNC_TRIM_GAIN, SYNC_SLEW_MAX_PPM), -SYNC_SLEW_MAX_PPM);
+        if(drift <= SYNC_SLEW_MIN_US && drift >= -SYNC_SLEW_MIN_US)
+            ppm = 0;
+        set_clock_rate(ctx, (int32_t)vcos_max(vcos_min(ctx->sync_trim + ppm, SYNC_SLEW_MAX_PPM), -SYNC_SLEW_MAX_PPM));
+    }
+}
+
+/* recovery, with a watchdog only (see mmal-player-watchdog.h) */
+
+static const char* role_names[mmal_player_ROLE_MAX] = {"reader", "decoder", "scheduler", "renderer"};
+
+// Frames handed to the renderer, or presented by a tunnelled one as it counts them; frames
+// already with the renderer when the scheduler was flushed do not count
+static uint64_t frames_out(struct mmal_player_pipeline* ctx)
+{
+    MMAL_PARAMETER_STATISTICS_T statistics;
+
+    if(!(ctx->scheduler_to_renderer->flags & MMAL_CONNECTION_FLAG_TUNNELLING))
+        return ctx->metrics.stage[mmal_player_STAGE_SCHEDULER_TO_RENDERER].buffers;
+
+    memset(&statistics, 0, sizeof(statistics));
+    statistics.hdr.id = MMAL_PARAMETER_STATISTICS;
+    statistics.hdr.size = sizeof(statistics);
+    if(ctx->backend->parameter_get(ctx->video_renderer->input[0], &statistics.hdr) != MMAL_SUCCESS)
+        return 0;
+    return statistics.frame_count;
+}
+
+static void watch_reset(struct mmal_player_pipeline* ctx, uint64_t frames, uint64_t now)
+{
+    ctx->watch_frames = frames;
+    ctx->watch_time = now;
+}
+
+// Where frames stopped: decoded ones that never reached the renderer are stuck in the scheduler
+// or the renderer, input the decoder never gave out in the decoder, and without either the
+// reader ran dry. Tunnelled connections show no PTS, which points at the decoder.
+static uint32_t stalled_roles(struct mmal_player_pipeline* ctx)
+{
+    int64_t decoded = ctx->stage_pts[mmal_player_STAGE_DECODER_TO_SCHEDULER];
+
+    if(ctx->stage_pts[mmal_player_STAGE_SCHEDULER_TO_RENDERER] < decoded)
+        return RECOVER_PRESENTATION;
+    if(ctx->metrics.last_pts_in > decoded || ctx->container_reader == NULL)
+        return ROLE_BIT(DECODER);
+    return ROLE_BIT(READER);
+}
+
+// Marks `roles` for recover() on the next step
+static void note_fault(struct mmal_player_pipeline* ctx, enum mmal_player_watchdog_event event, uint32_t roles, MMAL_STATUS_T status)
+{
+    if(roles == 0)
+        return;     // from a component that was replaced already
+
+    ctx->recover |= roles;
+    ctx->recover_status = status;
+    if(ctx->recovery_started == 0)
+        ctx->recovery_started = vcos_getmicrosecs64();
+    if(event == mmal_player_WATCHDOG_STALL)
+        __atomic_store_n(&ctx->metrics.stalls, ctx->metrics.stalls + 1, __ATOMIC_RELAXED);
+    else
+        __atomic_store_n(&ctx->metrics.component_errors, ctx->metrics.component_errors + 1, __ATOMIC_RELAXED);
+    mmal_player_watchdog_record(ctx->watchdog, event, 0);
+    signal_pending(ctx, PENDING_WATCHDOG);
+}
+
+static uint32_t component_roles(struct mmal_player_pipeline* ctx, MMAL_COMPONENT_T* component)
+{
+    if(component == NULL)
+        return 0;
+    if(component == ctx->container_reader)
+        return ROLE_BIT(READER);
+    if(component == ctx->video_decoder)
+        return ROLE_BIT(DECODER);
+    if(component == ctx->scheduler)
+        return ROLE_BIT(SCHEDULER);
+    if(component == ctx->video_renderer)
+        return ROLE_BIT(RENDERER);
+    return 0;
+}
+
+// A component refused a buffer: without a watchdog the session ends, otherwise both ends of
+// the connection are rebuilt. FALSE to end the session.
+static MMAL_BOOL_T pump_failed(struct mmal_player_pipeline* ctx, uint32_t roles, MMAL_STATUS_T status)
+{
+    if(ctx->watchdog == NULL)
+        return MMAL_FALSE;
+
+    note_fault(ctx, mmal_player_WATCHDOG_ERROR, roles, status);
+    return MMAL_TRUE;
+}
+
+// On every watchdog tick. Nothing is due while the clock is held, nor from a live source that
+// has nothing to give; otherwise a frame is, every frame interval at the playback speed.
+static void watch_step(struct mmal_player_pipeline* ctx)
+{
+    struct mmal_player_watchdog_options options;
+    struct mmal_player_stream_stats stream;
+    uint64_t now = vcos_getmicrosecs64(), frames = frames_out(ctx), deadline;
+    MMAL_BOOL_T idle;
+
+    idle = ctx->start_time == 0 || ctx->prerolled || ctx->paused || ctx->sync_hold || ctx->eos_held || ctx->watch_time == 0;
+    if(!idle && ctx->stream != NULL) {
+        mmal_player_stream_get_stats(ctx->stream, &stream);
+        idle = stream.depth == 0;
+    }
+    if(idle || frames != ctx->watch_frames) {
+        watch_reset(ctx, frames, now);
+        return;
+    }
+
+    mmal_player_watchdog_get_options(ctx->watchdog, &options);
+    deadline = (uint64_t)ctx->frame_interval * options.stall_frames;
+    if(ctx->rate.num < ctx->rate.den)
+        deadline = deadline * ctx->rate.den / ctx->rate.num;
+    deadline = vcos_max(deadline, (uint64_t)options.min_stall_ms * 1000);
+    if(now - ctx->watch_time < deadline)
+        return;
+
+    fprintf(stderr, "%s: nothing presented for %llu ms\n", ctx->uri, (unsigned long long)(now - ctx->watch_time) / 1000);
+    note_fault(ctx, mmal_player_WATCHDOG_STALL, stalled_roles(ctx), MMAL_ENOTREADY);
+    watch_reset(ctx, frames, now);
+}
+
+// Where presentation got to: the last frame handed to the renderer. Behind a tunnel that is the
+// clock, or where it was last sampled, which ran on through the stall and is held back to the
+// last frame decoded.
+static int64_t presented_pts(struct mmal_player_pipeline* ctx)
+{
+    MMAL_PARAMETER_INT64_T clock = {{MMAL_PARAMETER_CLOCK_TIME, sizeof(clock)}, 0};
+    int64_t pts = ctx->stage_pts[mmal_player_STAGE_SCHEDULER_TO_RENDERER];
+
+    if(pts == 0) {
+        pts = ctx->metrics.media_time;
+        if(ctx->backend->parameter_get(ctx->scheduler->clock[0], &clock.hdr) == MMAL_SUCCESS)
+            pts = clock.value;
+        if(ctx->stage_pts[mmal_player_STAGE_DECODER_TO_SCHEDULER] != 0)
+            pts = vcos_min(pts, ctx->stage_pts[mmal_player_STAGE_DECODER_TO_SCHEDULER]);
+    }
+    return vcos_max(pts, ctx->clip_pts);
+}
+
+// Replaces the components in `roles` and the connections to them, like switch_reader() but for
+// the same clip; the ones kept are connected to the new ones
+static MMAL_STATUS_T rebuild(struct mmal_player_pipeline* ctx, uint32_t roles)
+{
+    struct mmal_player_memory* memory = NULL;
+    char* uri = NULL;
+    int layer = ctx->layer;
+    uint8_t alpha = 255;
+    MMAL_STATUS_T status = MMAL_SUCCESS;
+
+    if(roles & ROLE_BIT(READER)) {
+        // destroy_reader() lets go of both
+        if(ctx->memory != NULL)
+            memory = mmal_player_memory_retain(ctx->memory);
+        uri = strdup(ctx->uri);
+        destroy_reader(ctx);
+    } else if(roles & ROLE_BIT(DECODER)) {
+        disconnect_reader(ctx);
+    }
+    if(roles & ROLE_BIT(DECODER))
+        destroy_decoder(ctx);
+    if(roles & RECOVER_PRESENTATION) {
+        disconnect_decoder(ctx);
+        destroy_presentation(ctx);
+        // other threads leave them be from here on
+        layer = ctx->display_layer;
+        alpha = ctx->display_alpha;
+    }
+
+    if(roles & ROLE_BIT(READER)) {
+        status = build_reader(ctx, uri, memory);
+        CHECK_STATUS(status, "Unable to reopen the reader");
+    }
+    if(roles & ROLE_BIT(DECODER)) {
+        status = build_decoder(ctx);
+        CHECK_STATUS(status, "Unable to rebuild the video decoder");
+    }
+    if(roles & RECOVER_PRESENTATION) {
+        status = build_presentation(ctx);
+        CHECK_STATUS(status, "Unable to rebuild scheduler and renderer");
+        // where it was: below its layer while prerolled or until raised, faded by a transition
+        set_display_layer(ctx, layer);
+        if(alpha < 255)
+            set_display_alpha(ctx, alpha);
+    }
+
+    status = enable_connections(ctx);
+
+error:
+    free(uri);
+    mmal_player_memory_release(memory);
+    return status;
+}
+
+// Picks the clip up at `pts` after a rebuild, on the same clip's timeline when `started`
+static MMAL_STATUS_T resume(struct mmal_player_pipeline* ctx, int64_t pts, MMAL_BOOL_T started)
+{
+    MMAL_BOOL_T synced = ctx->sync != NULL && ctx->sync_generation != 0;
+    int64_t position;
+    MMAL_STATUS_T status;
+
+    if(ctx->stream != NULL) {
+        // live: it goes on with what arrives next
+        player_set_boolean(ctx, ctx->scheduler->clock[0], MMAL_PARAMETER_CLOCK_ACTIVE, MMAL_FALSE);
+        flush_decoded(ctx);
+        ctx->after_seek = MMAL_TRUE;
+        ctx->clock_resync = MMAL_TRUE;
+        signal_pending(ctx, PENDING_CONNECTIONS);
+        return MMAL_SUCCESS;
+    }
+
+    // a synced one where the group got to meanwhile, rather than pull the others back
+    if(synced && started && mmal_player_sync_position(ctx->sync, ctx->sync_generation, vcos_getmicrosecs64(), &position))
+        pts = ctx->clip_pts + position;
+
+    status = seek_pipeline(ctx, pts, 0);
+    if(status != MMAL_SUCCESS)
+        return status;
+    // not a seek of the application's, and the clip still starts where it did
+    ctx->seek_time = 0;
+    ctx->keep_clip_pts = started;
+    // a synced clock goes back onto the group's timeline instead, see sync_step()
+    if(synced) {
+        ctx->clock_resync = MMAL_FALSE;
+        ctx->sync_hold = MMAL_TRUE;
+    }
+    return MMAL_SUCCESS;
+}
+
+// Rebuilds what note_fault() marked, everything when the last rebuild did not get a frame out;
+// FALSE once it gave up and the session ends with the fault's status
+static MMAL_BOOL_T recover(struct mmal_player_pipeline* ctx)
+{
+    struct mmal_player_watchdog_options options;
+    uint32_t roles = ctx->recover;
+    MMAL_STATUS_T status;
+    char names[64] = "";
+    int i;
+
+    ctx->recover = 0;
+    mmal_player_watchdog_get_options(ctx->watchdog, &options);
+    if(ctx->recover_attempts >= options.max_attempts) {
+        fprintf(stderr, "%s: giving up after %u rebuilds\n", ctx->uri, ctx->recover_attempts);
+        goto give_up;
+    }
+    if(ctx->recover_attempts > 0) {
+        roles = RECOVER_ALL;
+    } else {
+        // before the clip's first buffer went through, it starts over
+        ctx->recovery_clip_started = !ctx->after_seek;
+        ctx->recovery_pts = ctx->recovery_clip_started ? presented_pts(ctx) : 0;
+    }
+    ctx->recover_attempts++;
+
+    for(i = 0; i < mmal_player_ROLE_MAX; i++) {
+        if(roles & (1u << i))
+            snprintf(names + strlen(names), sizeof(names) - strlen(names), "%s%s", names[0] != '\0' ? ", " : "", role_names[i]);
+    }
+    fprintf(stderr, "%s: rebuilding %s, attempt %u\n", ctx->uri, names, ctx->recover_attempts);
+
+    status = rebuild(ctx, roles);
+    if(status == MMAL_SUCCESS)
+        status = resume(ctx, ctx->recovery_pts, ctx->recovery_clip_started);
+    if(status != MMAL_SUCCESS) {
+        ctx->recover_status = status;
+        goto give_up;
+    }
+
+    __atomic_store_n(&ctx->metrics.rebuilds, ctx->metrics.rebuilds + 1, __ATOMIC_RELAXED);
+    ctx->recovery_frames = frames_out(ctx);
+    watch_reset(ctx, ctx->recovery_frames, vcos_getmicrosecs64());
+    return MMAL_TRUE;
+
+give_up:
+    mmal_player_watchdog_record(ctx->watchdog, mmal_player_WATCHDOG_GAVE_UP, 0);
+    ctx->pipeline_status = ctx->recover_status;
+    return MMAL_FALSE;
+}
+
+// The first frame out after a rebuild ends the recovery
+static void account_recovery(struct mmal_player_pipeline* ctx)
+{
+    uint64_t took;
+
+    if(frames_out(ctx) == ctx->recovery_frames)
+        return;
+
+    took = vcos_getmicrosecs64() - ctx->recovery_started;
+    mmal_player_timing_add(&ctx->metrics.recovery, took);
+    mmal_player_watchdog_record(ctx->watchdog, mmal_player_WATCHDOG_RECOVERED, took);
+    fprintf(stderr, "%s: presenting again after %llu ms\n", ctx->uri, (unsigned long long)took / 1000);
+
+    ctx->recover_attempts = 0;
+    ctx->recovery_started = 0;
+    ctx->recover_status = MMAL_SUCCESS;
+}
+
+// Applies what other threads posted, events first; in the order they were posted
+static void take_messages(struct mmal_player_pipeline* ctx)
+{
+    struct mmal_player_message message;
+
+    while(mmal_player_ring_take(&ctx->events, &message) || mmal_player_ring_take(&ctx->commands, &message)) {
+        ctx->loop_stats.messages++;
+
+        switch(message.type) {
+            case EVENT_ERROR:
+                if(ctx->watchdog != NULL)
+                    note_fault(ctx, mmal_player_WATCHDOG_ERROR, component_roles(ctx, message.ptr), message.status);
+                else
+                    ctx->pipeline_status = message.status;
+                break;
+            case EVENT_ANALYSIS:
+                mmal_player_analysis_summary_add(&ctx->analysis, message.ptr);
+                if(ctx->analysis_callback)
+                    ctx->analysis_callback(ctx, message.ptr, ctx->userdata);
+                free(message.ptr);
+                break;
+            case EVENT_EOS:
+            case COMMAND_SKIP:
+                ctx->eos_time = message.value;
+                ctx->eos = MMAL_TRUE;
+                ctx->eos_held = MMAL_FALSE;
+                // how long the clip plays, for whoever starts the next one ahead of its end
+                ctx->clip_duration = 0;
+                if(message.type == EVENT_EOS && mmal_player_get_position(ctx, &ctx->clip_duration) != MMAL_SUCCESS)
+                    ctx->clip_duration = 0;
+                break;
+            case COMMAND_STOP:
+                ctx->terminate = MMAL_TRUE;
+                break;
+            case COMMAND_START:
+                if(ctx->prerolled) {
+                    if(message.status == 0)
+                        set_display_layer(ctx, ctx->layer);
+                    ctx->prerolled = MMAL_FALSE;
+                    start_clock(ctx);
+                    ctx->switch_eos = (uint64_t)message.value;
+                    ctx->switch_frames = frames_out(ctx);
+                }
+                break;
+            case COMMAND_SWITCH:
+                if(!ctx->terminate && mmal_player_set_new_uri(ctx, message.ptr) == MMAL_SUCCESS)
+                    signal_pending(ctx, PENDING_CONNECTIONS);
+                free(message.ptr);
+                break;
+            case COMMAND_SEEK:
+                if(!ctx->terminate)
+                    seek_pipeline(ctx, message.value, (uint32_t)message.status);
+                break;
+            case COMMAND_PAUSE:
+                if(!ctx->paused) {
+                    ctx->paused = MMAL_TRUE;
+                    player_set_boolean(ctx, ctx->scheduler->clock[0], MMAL_PARAMETER_CLOCK_ACTIVE, MMAL_FALSE);
+                }
+                break;
+            case COMMAND_RESUME:
+                if(ctx->paused) {
+                    ctx->paused = MMAL_FALSE;
+                    // otherwise the first buffer after a seek or switch starts it
+                    if(!ctx->prerolled && !ctx->clock_resync)
+                        start_clock(ctx);
+                }
+                break;
+            case COMMAND_RATE:
+                set_rate(ctx, (MMAL_RATIONAL_T){message.status, (int32_t)message.value});
+                break;
         }
     }
+}
 
-    /* Send any queued buffer to the next component */
-    while((buffer = mmal_queue_get(connection->queue)) != NULL) {
-        if(ctx->after_seek) {
-//            fprintf(stderr, "set first-after-seek flag\n");
-            buffer->flags |= MMAL_BUFFER_HEADER_FLAG_DISCONTINUITY;
-            buffer->flags |= MMAL_BUFFER_HEADER_FLAG_CONFIG;
-            ctx->after_seek = MMAL_FALSE;
-        }
+// Drops what a finished session left unread
+static void drop_messages(struct mmal_player_pipeline* ctx)
+{
+    struct mmal_player_message message;
 
-        status = mmal_port_send_buffer(connection->in, buffer);
-        if(status != MMAL_SUCCESS) {
-            fprintf(stderr, "failed to send buffer\n");
-            return status;
-        }
+    while(mmal_player_ring_take(&ctx->events, &message) || mmal_player_ring_take(&ctx->commands, &message)) {
+        if(message.type == COMMAND_SWITCH || message.type == EVENT_ANALYSIS)
+            free(message.ptr);
     }
-    return status;
 }
 
-void* mmal_player_pipeline_main_thread(void* user)
+// Startup latencies of the first start: first input and, from the renderer statistics, first frame
+static void account_startup(struct mmal_player_pipeline* ctx)
 {
-    struct mmal_player_pipeline* ctx = user;
-    MMAL_STATUS_T status = MMAL_SUCCESS;
+    MMAL_PARAMETER_STATISTICS_T statistics;
+    uint64_t now = vcos_getmicrosecs64();
 
-    ctx->exit_reason = mmal_player_UNDEFINED;
+    if(ctx->metrics.startup.first_input == 0 && ctx->metrics.stage[mmal_player_STAGE_READER_TO_DECODER].buffers > 0)
+        __atomic_store_n(&ctx->metrics.startup.first_input, now - ctx->startup_time, __ATOMIC_RELAXED);
 
-    while(1)
-    {
-//        fprintf(stderr, "waiting for semaphore to signal...");
-        vcos_semaphore_wait(&ctx->sem_ready);
-//        fprintf(stderr, "woken up by semaphore\n");
+    memset(&statistics, 0, sizeof(statistics));
+    statistics.hdr.id = MMAL_PARAMETER_STATISTICS;
+    statistics.hdr.size = sizeof(statistics);
+    if(ctx->backend->parameter_get(ctx->video_renderer->input[0], &statistics.hdr) != MMAL_SUCCESS || statistics.frame_count == 0)
+        return;
 
-        if(ctx->terminate)
-            break;
+    __atomic_store_n(&ctx->metrics.startup.first_frame, now - ctx->startup_time, __ATOMIC_RELAXED);
+    ctx->startup_time = 0;
+}
 
-        /* Check for errors */
-        status = ctx->pipeline_status;
-        if(status != MMAL_SUCCESS) {
-            break;
-        }
+// Until the first frame after a switch: a frame presented since the clip went on
+static void account_switch_latency(struct mmal_player_pipeline* ctx)
+{
+    uint64_t now = vcos_getmicrosecs64();
 
-        if(ctx->eos == MMAL_TRUE) {
-            if(ctx->eos_callback && ctx->eos_callback(ctx, ctx->userdata))
-                continue;
-            break;
+    if(frames_out(ctx) == ctx->switch_frames)
+        return;
+
+    mmal_player_timing_add(&ctx->metrics.switch_latency, now - ctx->switch_eos);
+    fprintf(stderr, "%s: switch latency %llu us\n", ctx->uri, (unsigned long long)(now - ctx->switch_eos));
+    ctx->switch_eos = 0;
+}
+
+// One wakeup worth of work; FALSE once the session is over
+static MMAL_BOOL_T pipeline_step(struct mmal_player_pipeline* ctx, uint32_t pending)
+{
+    MMAL_STATUS_T status;
+
+    if(pending & PENDING_CONTROL)
+        take_messages(ctx);
+
+    if(ctx->terminate)
+        return MMAL_FALSE;
+
+    if(ctx->watchdog != NULL) {
+        if((pending & PENDING_WATCHDOG) && ctx->recover == 0)
+            watch_step(ctx);
+        if(ctx->recover != 0 && ctx->pipeline_status == MMAL_SUCCESS && !recover(ctx))
+            return MMAL_FALSE;
+    }
+
+    /* Check for errors */
+    if(ctx->pipeline_status != MMAL_SUCCESS)
+        return MMAL_FALSE;
+
+    if(ctx->eos == MMAL_TRUE && !ctx->eos_held) {
+        if(ctx->eos_callback && ctx->eos_callback(ctx, ctx->userdata)) {
+            if(ctx->eos_held)
+                return MMAL_TRUE;
+            memset(&ctx->analysis, 0, sizeof(ctx->analysis));
+            // a clip that ended was presented, whatever the last rebuild got out
+            ctx->recover_attempts = 0;
+            ctx->recovery_started = 0;
+            // connections may have been rebuilt, prime all of them
+            signal_pending(ctx, PENDING_CONNECTIONS);
+            // played on here rather than handed over
+            if(!ctx->eos && ctx->eos_time != 0) {
+                ctx->switch_eos = ctx->eos_time;
+                ctx->switch_frames = frames_out(ctx);
+            }
+            return MMAL_TRUE;
         }
+        return MMAL_FALSE;
+    }
 
-        if((status = conn_pump_for_container_reader(ctx, ctx->reader_to_decoder)) != MMAL_SUCCESS) {
+    /* Tunnelled connections never signal, so only the ones with work get pumped */
+    if(pending & PENDING_READER_TO_DECODER) {
+        if(ctx->stream != NULL)
+            status = stream_pump(ctx);
+        else if(ctx->memory != NULL)
+            status = memory_pump(ctx);
+        else
+            status = conn_pump_for_container_reader(ctx, ctx->reader_to_decoder);
+        if(status != MMAL_SUCCESS) {
             fprintf(stderr, "Unable to pump pipes in reader -> decoder: %d\n", status);
-            break;
+            return pump_failed(ctx, ROLE_BIT(READER) | ROLE_BIT(DECODER), status);
         }
+    }
+    if(pending & PENDING_DECODER_TO_SCHEDULER) {
         if((status = conn_pump(ctx, ctx->decoder_to_scheduler)) != MMAL_SUCCESS) {
             fprintf(stderr, "Unable to pump pipes in decoder -> shceduler: %d\n", status);
-            break;
+            return pump_failed(ctx, ROLE_BIT(DECODER) | ROLE_BIT(SCHEDULER), status);
         }
+    }
+    if(pending & PENDING_SCHEDULER_TO_RENDERER) {
         if((status = conn_pump(ctx, ctx->scheduler_to_renderer)) != MMAL_SUCCESS) {
             fprintf(stderr, "Unable to pump pipes in scheduler -> renderer: %d\n", status);
-            break;
+            return pump_failed(ctx, RECOVER_PRESENTATION, status);
         }
     }
 
-error:
+    if(ctx->sync != NULL)
+        sync_step(ctx);
+
+    if(ctx->startup_time != 0)
+        account_startup(ctx);
+    if(ctx->switch_eos != 0)
+        account_switch_latency(ctx);
+    if(ctx->recover_attempts > 0)
+        account_recovery(ctx);
+    update_metrics(ctx);
+
+    return MMAL_TRUE;
+}
+
+void mmal_player_pipeline_poke(struct mmal_player_pipeline* ctx)
+{
+    signal_pending(ctx, PENDING_SYNC);
+}
+
+void mmal_player_pipeline_watch(struct mmal_player_pipeline* ctx)
+{
+    signal_pending(ctx, PENDING_WATCHDOG);
+}
 
+static void pipeline_exit(struct mmal_player_pipeline* ctx)
+{
     if(ctx->terminate)
         ctx->exit_reason = mmal_player_TERMINATED;
     else if(ctx->eos)
@@ -400,22 +2071,130 @@ error:
 
     if(ctx->exit_callback)
         ctx->exit_callback(ctx, ctx->userdata);
+}
+
+void* mmal_player_pipeline_main_thread(void* user)
+{
+    struct mmal_player_pipeline* ctx = user;
+    uint32_t pending;
+
+    ctx->exit_reason = mmal_player_UNDEFINED;
+
+    do {
+        vcos_semaphore_wait(&ctx->sem_ready);
+
+        pending = __atomic_exchange_n(&ctx->pending, 0, __ATOMIC_ACQ_REL);
+        ctx->loop_stats.wakeups++;
+    } while(pipeline_step(ctx, pending));
+
+    pipeline_exit(ctx);
+
+    return NULL;
+}
+
+// Called by the executor worker that dequeued the pipeline, never by two at once
+void mmal_player_pipeline_run(struct mmal_player_pipeline* ctx)
+{
+    uint32_t pending;
+
+    // late callbacks of a finished session: leave the bits for the next one
+    if(!ctx->in_session)
+        return;
+
+    pending = __atomic_exchange_n(&ctx->pending, 0, __ATOMIC_ACQ_REL);
+    ctx->loop_stats.wakeups++;
+
+    if(!pipeline_step(ctx, pending)) {
+        ctx->in_session = MMAL_FALSE;
+        pipeline_exit(ctx);
+        vcos_semaphore_post(&ctx->sem_done);
+    }
+}
+
+// Outlives its sessions, so a recycled pipeline does not pay for a thread per clip
+static void* mmal_player_pipeline_thread(void* user)
+{
+    struct mmal_player_pipeline* ctx = user;
+
+    while(1)
+    {
+        vcos_semaphore_wait(&ctx->sem_run);
+        if(ctx->shutdown)
+            break;
+
+        mmal_player_pipeline_main_thread(ctx);
+        vcos_semaphore_post(&ctx->sem_done);
+    }
 
     return NULL;
 }
 
-MMAL_STATUS_T mmal_player_init(struct mmal_player_pipeline* ctx, const char* uri, int rotation, int layer)
+static MMAL_STATUS_T start_session(struct mmal_player_pipeline* ctx)
+{
+    if(ctx->executor != NULL) {
+        // the pending bits may have been left by signals nobody picked up, queue it either way
+        ctx->session_active = MMAL_TRUE;
+        ctx->in_session = MMAL_TRUE;
+        mmal_player_executor_schedule(ctx->executor, ctx);
+        return MMAL_SUCCESS;
+    }
+
+    if(!ctx->thread_started) {
+        if(vcos_thread_create(&ctx->main_loop_thread, "mmal-player:player thread", NULL, mmal_player_pipeline_thread, ctx) != VCOS_SUCCESS)
+            return MMAL_ENOSPC;
+        ctx->thread_started = MMAL_TRUE;
+    }
+
+    ctx->session_active = MMAL_TRUE;
+    vcos_semaphore_post(&ctx->sem_run);
+
+    return MMAL_SUCCESS;
+}
+
+MMAL_STATUS_T mmal_player_init(struct mmal_player_pipeline* ctx, const char* uri, struct mmal_player_memory* memory,
+                               const struct mmal_player_options* options)
 {
     MMAL_STATUS_T status;
 
     memset(ctx, 0, sizeof(struct mmal_player_pipeline));
 
-    ctx->layer = layer;
-    ctx->rotation = rotation;
-
+    ctx->layer = options->layer;
+    ctx->rotation = options->rotation;
+    ctx->display_num = options->display_num;
+    ctx->dest_rect = options->dest_rect;
+    ctx->backend = options->backend != NULL ? options->backend : &mmal_player_backend_mmal;
+    ctx->executor = options->executor;
+    ctx->sync = options->sync;
+    ctx->tap = options->tap;
+    ctx->watchdog = options->watchdog;
+    ctx->stream_options = options->stream;
+    ctx->index_options = options->keyframe_index;
+    ctx->fast_start = options->fast_start;
+
+    ctx->reader_buffers = options->reader_buffers;
+    if(ctx->reader_buffers.num_max == 0)
+        ctx->reader_buffers.num_max = READER_BUFFER_NUM_MAX;
+    ctx->reader_buffer_num = ctx->reader_buffers.num;
+
+    ctx->metrics_fd = -1;
+    ctx->frame_interval = DEFAULT_FRAME_INTERVAL_US;
+    ctx->rate.num = ctx->rate.den = 1;
+
+    // the first wakeup primes every connection with empty buffers
+    ctx->pending = PENDING_CONNECTIONS;
     vcos_semaphore_create(&ctx->sem_ready, "mmal_player:ready", 1);
+    vcos_semaphore_create(&ctx->sem_run, "mmal_player:run", 0);
+    vcos_semaphore_create(&ctx->sem_done, "mmal_player:done", 0);
+    vcos_mutex_create(&ctx->presentation_lock, "mmal_player:presentation");
 
-    return build_components(ctx, uri);
+    if(mmal_player_ring_init(&ctx->commands, COMMAND_RING_SIZE) != MMAL_SUCCESS ||
+       mmal_player_ring_init(&ctx->events, EVENT_RING_SIZE) != MMAL_SUCCESS)
+        return MMAL_ENOMEM;
+
+    status = build_components(ctx, uri, memory);
+    if(status == MMAL_SUCCESS && ctx->watchdog != NULL)
+        mmal_player_watchdog_attach(ctx->watchdog, ctx);
+    return status;
 }
 
 MMAL_STATUS_T mmal_player_set_eos_callback(struct mmal_player_pipeline* ctx, pipeline_eos_callback cb, void* user)
@@ -440,95 +2219,483 @@ MMAL_STATUS_T mmal_player_set_exit_callback(struct mmal_player_pipeline* ctx, pi
     return MMAL_SUCCESS;
 }
 
+MMAL_STATUS_T mmal_player_set_analysis_callback(struct mmal_player_pipeline* ctx, pipeline_analysis_callback cb, void* user)
+{
+    if(ctx == NULL)
+        return EINVAL;
+
+    ctx->analysis_callback = cb;
+    ctx->userdata = user;
+
+    return MMAL_SUCCESS;
+}
+
+// The tap waits for its callbacks before the pipeline goes, so `ctx` is still there
+MMAL_STATUS_T mmal_player_post_analysis(struct mmal_player_pipeline* ctx, const struct mmal_player_analysis_result* result)
+{
+    struct mmal_player_analysis_result* copy = malloc(sizeof(*copy));
+
+    if(copy == NULL)
+        return MMAL_ENOMEM;
+    *copy = *result;
+    if(!post_message(ctx, &ctx->events, EVENT_ANALYSIS, 0, 0, copy)) {
+        free(copy);
+        return MMAL_ENOSPC;
+    }
+    return MMAL_SUCCESS;
+}
+
+// Runs the pipeline with the scheduler clock stopped and the renderer just below its own layer,
+// so the reader and decoder fill up and the first frames wait in the scheduler.
+// A following mmal_player_start() only raises the layer and starts the clock.
+MMAL_STATUS_T mmal_player_preroll(struct mmal_player_pipeline* ctx)
+{
+    MMAL_STATUS_T status;
+
+    if(ctx->prerolled)
+        return MMAL_SUCCESS;
+
+    player_set_boolean(ctx, ctx->scheduler->clock[0], MMAL_PARAMETER_CLOCK_ACTIVE, MMAL_FALSE);
+    set_display_layer(ctx, ctx->layer - 1);
+
+    ctx->exit_reason = mmal_player_UNDEFINED;
+    ctx->prerolled = MMAL_TRUE;
+
+    status = start_session(ctx);
+    if(status != MMAL_SUCCESS) {
+        ctx->prerolled = MMAL_FALSE;
+        return status;
+    }
+
+    return MMAL_SUCCESS;
+}
+
+// A prerolled pipeline's session is running already, its thread is told to go on screen
 MMAL_STATUS_T mmal_player_start(struct mmal_player_pipeline* ctx)
 {
-    VCOS_STATUS_T status;
-    mmal_port_parameter_set_boolean(ctx->scheduler->clock[0], MMAL_PARAMETER_CLOCK_ACTIVE, MMAL_TRUE);
+    return mmal_player_start_after(ctx, 0);
+}
+
+MMAL_STATUS_T mmal_player_start_after(struct mmal_player_pipeline* ctx, uint64_t eos_time)
+{
+    if(ctx->session_active && ctx->prerolled)
+        return post_message(ctx, &ctx->commands, COMMAND_START, 0, (int64_t)eos_time, NULL) ? MMAL_SUCCESS : MMAL_ENOSPC;
+
+    start_clock(ctx);
+    if(ctx->metrics.startup.build != 0 && ctx->metrics.startup.first_frame == 0)
+        ctx->startup_time = ctx->start_time;
+    // the session thread is not running yet
+    ctx->switch_eos = eos_time;
+    ctx->switch_frames = eos_time != 0 && ctx->scheduler_to_renderer != NULL ? frames_out(ctx) : 0;
 
     ctx->exit_reason = mmal_player_UNDEFINED;
 
-    status = vcos_thread_create(&ctx->main_loop_thread, "mmal-player:player thread", NULL, mmal_player_pipeline_main_thread, ctx);
+    return start_session(ctx);
+}
+
+MMAL_STATUS_T mmal_player_start_below(struct mmal_player_pipeline* ctx)
+{
+    if(!ctx->session_active || !ctx->prerolled)
+        return MMAL_EINVAL;
+    return post_message(ctx, &ctx->commands, COMMAND_START, 1, 0, NULL) ? MMAL_SUCCESS : MMAL_ENOSPC;
+}
+
+MMAL_STATUS_T mmal_player_raise(struct mmal_player_pipeline* ctx)
+{
+    MMAL_STATUS_T status = MMAL_EAGAIN;
+
+    vcos_mutex_lock(&ctx->presentation_lock);
+    if(ctx->presenting)
+        status = set_display_layer(ctx, ctx->layer);
+    vcos_mutex_unlock(&ctx->presentation_lock);
+    return status;
+}
+
+MMAL_STATUS_T mmal_player_set_alpha(struct mmal_player_pipeline* ctx, uint8_t alpha)
+{
+    MMAL_STATUS_T status = MMAL_EAGAIN;
+
+    vcos_mutex_lock(&ctx->presentation_lock);
+    if(ctx->presenting)
+        status = set_display_alpha(ctx, alpha);
+    vcos_mutex_unlock(&ctx->presentation_lock);
+    return status;
+}
 
-    return status == VCOS_SUCCESS ? MMAL_SUCCESS : status;
+MMAL_STATUS_T mmal_player_get_position(struct mmal_player_pipeline* ctx, int64_t* position)
+{
+    MMAL_PARAMETER_INT64_T clock = {{MMAL_PARAMETER_CLOCK_TIME, sizeof(clock)}, 0};
+    MMAL_STATUS_T status = MMAL_EAGAIN;
+
+    vcos_mutex_lock(&ctx->presentation_lock);
+    if(ctx->presenting)
+        status = ctx->backend->parameter_get(ctx->scheduler->clock[0], &clock.hdr);
+    vcos_mutex_unlock(&ctx->presentation_lock);
+    if(status == MMAL_SUCCESS)
+        *position = clock.value - __atomic_load_n(&ctx->clip_pts, __ATOMIC_RELAXED);
+    return status;
 }
 
 void mmal_player_stop(struct mmal_player_pipeline* ctx)
 {
-    ctx->terminate = MMAL_TRUE;
-    vcos_semaphore_post(&ctx->sem_ready);
+    post_message(ctx, &ctx->commands, COMMAND_STOP, 0, 0, NULL);
+}
+
+// Ends the current clip early; the pipeline thread handles it like an EOS from the renderer,
+// so the EOS callback decides what plays next.
+void mmal_player_skip(struct mmal_player_pipeline* ctx)
+{
+    post_message(ctx, &ctx->commands, COMMAND_SKIP, 0, vcos_getmicrosecs64(), NULL);
+}
+
+// Cuts the current clip short for `uri`, with what mmal_player_set_new_uri() keeps
+MMAL_STATUS_T mmal_player_switch_uri(struct mmal_player_pipeline* ctx, const char* uri)
+{
+    char* copy = strdup(uri);
+
+    if(copy == NULL)
+        return MMAL_ENOMEM;
+    if(!post_message(ctx, &ctx->commands, COMMAND_SWITCH, 0, 0, copy)) {
+        free(copy);
+        return MMAL_ENOSPC;
+    }
+    return MMAL_SUCCESS;
+}
+
+MMAL_STATUS_T mmal_player_seek(struct mmal_player_pipeline* ctx, int64_t pts, uint32_t flags)
+{
+    if(ctx->sync != NULL)
+        return MMAL_EINVAL;
+    return post_message(ctx, &ctx->commands, COMMAND_SEEK, (int32_t)flags, pts, NULL) ? MMAL_SUCCESS : MMAL_ENOSPC;
+}
+
+MMAL_STATUS_T mmal_player_pause(struct mmal_player_pipeline* ctx)
+{
+    if(ctx->sync != NULL)
+        return MMAL_EINVAL;
+    return post_message(ctx, &ctx->commands, COMMAND_PAUSE, 0, 0, NULL) ? MMAL_SUCCESS : MMAL_ENOSPC;
+}
+
+MMAL_STATUS_T mmal_player_resume(struct mmal_player_pipeline* ctx)
+{
+    if(ctx->sync != NULL)
+        return MMAL_EINVAL;
+    return post_message(ctx, &ctx->commands, COMMAND_RESUME, 0, 0, NULL) ? MMAL_SUCCESS : MMAL_ENOSPC;
+}
+
+// `rate` scales the media clock: {2, 1} plays twice as fast, {1, 2} at half speed. Backwards and
+// standing still (mmal_player_pause()) are no rates.
+MMAL_STATUS_T mmal_player_set_rate(struct mmal_player_pipeline* ctx, MMAL_RATIONAL_T rate)
+{
+    if(ctx->sync != NULL || rate.num <= 0 || rate.den <= 0)
+        return MMAL_EINVAL;
+    return post_message(ctx, &ctx->commands, COMMAND_RATE, rate.num, rate.den, NULL) ? MMAL_SUCCESS : MMAL_ENOSPC;
+}
+
+void mmal_player_get_metrics(struct mmal_player_pipeline* ctx, struct mmal_player_metrics* metrics)
+{
+    mmal_player_metrics_copy(metrics, &ctx->metrics);
+}
+
+// Appends one JSON line per interval to `fd` from the pipeline thread; fd < 0 stops the dump
+MMAL_STATUS_T mmal_player_set_metrics_output(struct mmal_player_pipeline* ctx, int fd, uint32_t interval_ms)
+{
+    if(ctx == NULL || (fd >= 0 && interval_ms == 0))
+        return MMAL_EINVAL;
+
+    ctx->metrics_interval = (uint64_t)interval_ms * 1000;
+    ctx->metrics_next = 0;
+    ctx->metrics_fd = fd;
+
+    return MMAL_SUCCESS;
+}
+
+void mmal_player_get_loop_stats(struct mmal_player_pipeline* ctx, struct mmal_player_loop_stats* stats)
+{
+    stats->wakeups = ctx->loop_stats.wakeups;
+    stats->signals = __atomic_load_n(&ctx->loop_stats.signals, __ATOMIC_RELAXED);
+    stats->posts = __atomic_load_n(&ctx->loop_stats.posts, __ATOMIC_RELAXED);
+    stats->pumps = ctx->loop_stats.pumps;
+    stats->empty_pumps = ctx->loop_stats.empty_pumps;
+    stats->buffers = ctx->loop_stats.buffers;
+    stats->messages = ctx->loop_stats.messages;
 }
 
+// Waits for the session to end; the thread itself stays for the next start or preroll
 void mmal_player_join(struct mmal_player_pipeline* ctx)
 {
-    void* ret = NULL;
-    vcos_thread_join(&ctx->main_loop_thread, &ret);
+    if(!ctx->session_active)
+        return;
+
+    vcos_semaphore_wait(&ctx->sem_done);
+    ctx->session_active = MMAL_FALSE;
+}
+
+// Idles a joined pipeline until mmal_player_reset(): the clock is held, every connection is
+// disabled, which takes the picture off the screen, and the reader is closed. Decoder,
+// scheduler, renderer, the reader pool and the pipeline thread are kept.
+MMAL_STATUS_T mmal_player_park(struct mmal_player_pipeline* ctx)
+{
+    if(ctx->session_active || ctx->video_decoder == NULL || ctx->scheduler == NULL)
+        return MMAL_EINVAL;
+
+    player_set_boolean(ctx, ctx->scheduler->clock[0], MMAL_PARAMETER_CLOCK_ACTIVE, MMAL_FALSE);
+
+    release_tapped(ctx);
+    if(ctx->scheduler_to_renderer != NULL)
+        ctx->backend->connection_disable(ctx->scheduler_to_renderer);
+    if(ctx->decoder_to_scheduler != NULL)
+        ctx->backend->connection_disable(ctx->decoder_to_scheduler);
+    destroy_reader(ctx);
+    if(ctx->sync != NULL)
+        mmal_player_sync_detach(ctx->sync, ctx);
+    if(ctx->watchdog != NULL)
+        mmal_player_watchdog_detach(ctx->watchdog, ctx);
+
+    ctx->eos_callback = NULL;
+    ctx->exit_callback = NULL;
+    ctx->analysis_callback = NULL;
+    ctx->userdata = NULL;
+    ctx->metrics_fd = -1;
+
+    return MMAL_SUCCESS;
+}
+
+// Readies a parked pipeline for `uri` as if it had just been created with `options`, except that
+// the struct, its semaphores, thread and reader pool stay, and so do decoder, scheduler and
+// renderer when the new file has the same codec, resolution and codec config.
+MMAL_STATUS_T mmal_player_reset(struct mmal_player_pipeline* ctx, const char* uri, const struct mmal_player_options* options)
+{
+    MMAL_STATUS_T status;
+    uint64_t started = vcos_getmicrosecs64();
+
+    if(ctx->session_active || ctx->container_reader != NULL || ctx->stream != NULL || ctx->memory != NULL)
+        return MMAL_EINVAL;
+    if(options->backend != NULL && options->backend != ctx->backend)
+        return MMAL_EINVAL;
+    if(options->executor != ctx->executor || options->tap != ctx->tap)
+        return MMAL_EINVAL;
+
+    // stale wakeups and messages from the last session
+    while(vcos_semaphore_trywait(&ctx->sem_ready) == VCOS_SUCCESS)
+        ;
+    drop_messages(ctx);
+
+    ctx->terminate = MMAL_FALSE;
+    ctx->eos = MMAL_FALSE;
+    ctx->eos_held = MMAL_FALSE;
+    ctx->pipeline_status = MMAL_SUCCESS;
+    ctx->prerolled = MMAL_FALSE;
+    ctx->eos_time = 0;
+    ctx->start_time = 0;
+    ctx->startup_time = 0;
+    ctx->switch_eos = 0;
+    ctx->exit_reason = mmal_player_UNDEFINED;
+    ctx->frame_interval = DEFAULT_FRAME_INTERVAL_US;
+    ctx->metrics_next = 0;
+    memset(&ctx->metrics, 0, sizeof(ctx->metrics));
+    memset(&ctx->loop_stats, 0, sizeof(ctx->loop_stats));
+    memset(&ctx->analysis, 0, sizeof(ctx->analysis));
+
+    ctx->layer = options->layer;
+    ctx->rotation = options->rotation;
+    ctx->display_num = options->display_num;
+    ctx->dest_rect = options->dest_rect;
+    ctx->sync = options->sync;
+    ctx->sync_hold = MMAL_FALSE;
+    ctx->sync_generation = 0;
+    ctx->stream_options = options->stream;
+    ctx->index_options = options->keyframe_index;
+    ctx->fast_start = options->fast_start;
+    ctx->reader_buffers = options->reader_buffers;
+    if(ctx->reader_buffers.num_max == 0)
+        ctx->reader_buffers.num_max = READER_BUFFER_NUM_MAX;
+    ctx->reader_buffer_num = ctx->reader_buffers.num;
+    ctx->clip_underruns = 0;
+    ctx->clean_clips = 0;
+
+    // a kept scheduler would carry the last session's speed over
+    if(ctx->rate.num != ctx->rate.den) {
+        ctx->rate.num = ctx->rate.den = 1;
+        set_playback_rate(ctx);
+    }
+    ctx->paused = MMAL_FALSE;
+    ctx->keyframes_only = MMAL_FALSE;
+    ctx->need_keyframe = MMAL_FALSE;
+    ctx->seek_time = 0;
+    ctx->watchdog = options->watchdog;
+    ctx->recover = 0;
+    ctx->recover_status = MMAL_SUCCESS;
+    ctx->recover_attempts = 0;
+    ctx->recovery_started = 0;
+    ctx->watch_time = 0;
+    ctx->keep_clip_pts = MMAL_FALSE;
+
+    status = switch_reader(ctx, uri, NULL);
+    CHECK_STATUS(status, "Unable to switch to the next file");
+
+    // a kept scheduler still holds the last clip's time, re-base it on the first buffer
+    ctx->clock_resync = ctx->last_switch != mmal_player_SWITCH_REBUILD;
+    if(ctx->last_switch != mmal_player_SWITCH_REBUILD) {
+        status = setup_display_port(ctx);
+        CHECK_STATUS(status, "Unable to configure video renderer display configuration");
+    }
+    account_switch(ctx, started);
+
+    // the first wakeup primes every connection with empty buffers
+    __atomic_store_n(&ctx->pending, PENDING_CONNECTIONS, __ATOMIC_RELEASE);
+    if(ctx->executor == NULL)
+        vcos_semaphore_post(&ctx->sem_ready);
+    if(ctx->watchdog != NULL)
+        mmal_player_watchdog_attach(ctx->watchdog, ctx);
+
+error:
+    return status;
 }
 
 void mmal_player_deinit(struct mmal_player_pipeline* ctx)
 {
+    if(ctx->session_active) {
+        mmal_player_stop(ctx);
+        mmal_player_join(ctx);
+    }
+    if(ctx->thread_started) {
+        void* ret = NULL;
+
+        ctx->shutdown = MMAL_TRUE;
+        vcos_semaphore_post(&ctx->sem_run);
+        vcos_thread_join(&ctx->main_loop_thread, &ret);
+        ctx->thread_started = MMAL_FALSE;
+    }
+    if(ctx->watchdog != NULL)
+        mmal_player_watchdog_detach(ctx->watchdog, ctx);
+    if(ctx->executor != NULL)
+        mmal_player_executor_detach(ctx->executor, ctx);
+    if(ctx->sync != NULL)
+        mmal_player_sync_detach(ctx->sync, ctx);
+    if(ctx->stream != NULL)
+        close_stream(ctx);
+    if(ctx->memory != NULL)
+        close_memory(ctx);
+    close_index(ctx);
+    release_tapped(ctx);
+
     if(ctx->reader_to_decoder != NULL)
-        mmal_connection_disable(ctx->reader_to_decoder);
+        ctx->backend->connection_disable(ctx->reader_to_decoder);
     if(ctx->decoder_to_scheduler != NULL)
-        mmal_connection_disable(ctx->decoder_to_scheduler);
+        ctx->backend->connection_disable(ctx->decoder_to_scheduler);
     if(ctx->scheduler_to_renderer != NULL)
-        mmal_connection_disable(ctx->scheduler_to_renderer);
+        ctx->backend->connection_disable(ctx->scheduler_to_renderer);
 
     if(ctx->video_renderer != NULL)
-        mmal_component_disable(ctx->video_renderer);
+        ctx->backend->component_disable(ctx->video_renderer);
     if(ctx->scheduler != NULL)
-        mmal_component_disable(ctx->scheduler);
+        ctx->backend->component_disable(ctx->scheduler);
     if(ctx->video_decoder != NULL)
-        mmal_component_disable(ctx->video_decoder);
+        ctx->backend->component_disable(ctx->video_decoder);
     if(ctx->container_reader != NULL)
-        mmal_component_disable(ctx->container_reader);
+        ctx->backend->component_disable(ctx->container_reader);
 
 
     if(ctx->scheduler_to_renderer != NULL)
-        mmal_connection_destroy(ctx->scheduler_to_renderer);
+        ctx->backend->connection_destroy(ctx->scheduler_to_renderer);
     ctx->scheduler_to_renderer= NULL;
 
     if(ctx->decoder_to_scheduler != NULL)
-        mmal_connection_destroy(ctx->decoder_to_scheduler);
+        ctx->backend->connection_destroy(ctx->decoder_to_scheduler);
     ctx->decoder_to_scheduler= NULL;
 
-    if(ctx->reader_to_decoder != NULL)
-        mmal_connection_destroy(ctx->reader_to_decoder);
+    if(ctx->reader_to_decoder != NULL) {
+        ctx->backend->connection_set_pool(ctx->reader_to_decoder, NULL);
+        ctx->backend->connection_destroy(ctx->reader_to_decoder);
+    }
     ctx->reader_to_decoder= NULL;
 
     // disable components
     if(ctx->video_renderer != NULL)
-        mmal_component_destroy(ctx->video_renderer);
+        ctx->backend->component_destroy(ctx->video_renderer);
     ctx->video_renderer= NULL;
 
     if(ctx->scheduler != NULL)
-        mmal_component_destroy(ctx->scheduler);
+        ctx->backend->component_destroy(ctx->scheduler);
     ctx->scheduler= NULL;
 
     if(ctx->video_decoder != NULL)
-        mmal_component_destroy(ctx->video_decoder);
+        ctx->backend->component_destroy(ctx->video_decoder);
     ctx->video_decoder= NULL;
 
     if(ctx->container_reader != NULL)
-        mmal_component_destroy(ctx->container_reader);
+        ctx->backend->component_destroy(ctx->container_reader);
     ctx->container_reader= NULL;
 
+    if(ctx->reader_pool != NULL) {
+        mmal_pool_destroy(ctx->reader_pool);
+        ctx->reader_pool = NULL;
+    }
+    if(ctx->memory_pool != NULL) {
+        mmal_pool_destroy(ctx->memory_pool);
+        ctx->memory_pool = NULL;
+    }
+
     if(ctx->uri != NULL) {
         free(ctx->uri);
         ctx->uri = NULL;
     }
+
+    if(ctx->commands.slots != NULL && ctx->events.slots != NULL)
+        drop_messages(ctx);
+    mmal_player_ring_deinit(&ctx->commands);
+    mmal_player_ring_deinit(&ctx->events);
+
+    vcos_semaphore_delete(&ctx->sem_ready);
+    vcos_semaphore_delete(&ctx->sem_run);
+    vcos_semaphore_delete(&ctx->sem_done);
+    vcos_mutex_delete(&ctx->presentation_lock);
 }
 
-struct mmal_player_pipeline* mmal_player_create(const char* uri, int rotation, int layer)
+void mmal_player_options_init(struct mmal_player_options* options)
+{
+    memset(options, 0, sizeof(struct mmal_player_options));
+
+    options->layer = 128;
+    options->backend = &mmal_player_backend_mmal;
+    options->reader_buffers.num_min = READER_BUFFER_NUM_MIN;
+    options->reader_buffers.num_max = READER_BUFFER_NUM_MAX;
+}
+
+struct mmal_player_pipeline* mmal_player_create_with_options(const char* uri, const struct mmal_player_options* options)
+{
+    struct mmal_player_pipeline* p = calloc(1, sizeof(struct mmal_player_pipeline));
+    if(p == NULL)
+        return NULL;
+
+    mmal_player_init(p, uri, NULL, options);
+
+    return p;
+}
+
+struct mmal_player_pipeline* mmal_player_create_with_memory(struct mmal_player_memory* memory, const struct mmal_player_options* options)
 {
     struct mmal_player_pipeline* p = calloc(1, sizeof(struct mmal_player_pipeline));
     if(p == NULL)
         return NULL;
 
-    mmal_player_init(p, uri, rotation, layer);
+    mmal_player_init(p, NULL, memory, options);
 
     return p;
 }
 
+struct mmal_player_pipeline* mmal_player_create(const char* uri, int rotation, int layer)
+{
+    struct mmal_player_options options;
+
+    mmal_player_options_init(&options);
+    options.rotation = rotation;
+    options.layer = layer;
+
+    return mmal_player_create_with_options(uri, &options);
+}
+
 void mmal_player_destroy(struct mmal_player_pipeline* ctx)
 {
     if(ctx == NULL)
@@ -6,11 +6,25 @@
 #include "interface/mmal/mmal.h"
 #include "interface/mmal/util/mmal_connection.h"
 
+#include "mmal-player-analysis.h"
+#include "mmal-player-backend.h"
+#include "mmal-player-index.h"
+#include "mmal-player-memory.h"
+#include "mmal-player-metrics.h"
+#include "mmal-player-ring.h"
+#include "mmal-player-stream.h"
+
 struct mmal_player_pipeline;
+struct mmal_player_executor;
+struct mmal_player_sync_member;
+struct mmal_player_tap;
+struct mmal_player_watchdog;
 
 // MMAL_TRUE: continue, MMAL_FALSE: shutdown pipeline
 typedef MMAL_BOOL_T (*pipeline_eos_callback)(struct mmal_player_pipeline*, void*);
 typedef void (*pipeline_exit_callback)(struct mmal_player_pipeline*, void*);
+// On the pipeline thread, for each result handed to mmal_player_post_analysis()
+typedef void (*pipeline_analysis_callback)(struct mmal_player_pipeline*, const struct mmal_player_analysis_result*, void*);
 
 enum mmal_player_exit_reason {
     mmal_player_UNDEFINED = 0,
@@ -19,49 +33,227 @@ enum mmal_player_exit_reason {
     mmal_player_ERROR
 };
 
+// Pipeline thread activity; signals and posts are counted on the callback threads
+struct mmal_player_loop_stats
+{
+    uint32_t wakeups;       // times the pipeline thread woke up
+    uint32_t signals;       // control events and connection callbacks
+    uint32_t posts;         // signals that actually had to post the semaphore
+    uint32_t pumps;         // conn_pump calls
+    uint32_t empty_pumps;   // conn_pump calls that moved no buffer
+    uint32_t buffers;       // buffers moved by conn_pump
+    uint32_t messages;      // commands and events taken off the rings
+};
+
+// Sizing of the reader -> decoder pool; 0 takes the ports' recommendation
+struct mmal_player_buffer_options
+{
+    uint32_t num;
+    uint32_t size;
+    MMAL_BOOL_T adaptive;   // grow after a clip that starved the decoder, shrink after clean ones
+    uint32_t num_min;       // bounds for adaptive
+    uint32_t num_max;
+};
+
+struct mmal_player_options
+{
+    int rotation;
+    int layer;
+    uint32_t display_num;           // 0: the main LCD/HDMI output
+    MMAL_RECT_T dest_rect;          // on that display, width or height 0: full screen
+    struct mmal_player_executor* executor;      // NULL: a thread of its own, see mmal-player-executor.h
+    struct mmal_player_sync_member* sync;       // NULL: the clock runs free, see mmal-player-sync.h
+    const struct mmal_player_backend* backend;  // NULL: mmal_player_backend_mmal
+    struct mmal_player_buffer_options reader_buffers;
+    struct mmal_player_stream_options stream;   // for stream URIs, see mmal-player-stream.h
+    struct mmal_player_index_options keyframe_index;    // for files, see mmal-player-index.h
+    MMAL_BOOL_T fast_start;         // open the reader on a thread of its own while the rest is built
+    struct mmal_player_tap* tap;    // NULL: decoded frames stay with the GPU, see mmal-player-tap.h
+    struct mmal_player_watchdog* watchdog;  // NULL: a stall goes on, a fault ends the session; see mmal-player-watchdog.h
+};
+
 struct mmal_player_pipeline
 {
-    MMAL_COMPONENT_T* container_reader;
+    const struct mmal_player_backend* backend;
+
+    MMAL_COMPONENT_T* container_reader;    // NULL while a stream or a memory clip feeds the decoder
+    struct mmal_player_stream* stream;
+    struct mmal_player_stream_options stream_options;
+    struct mmal_player_memory* memory;     // referenced while playing
+    uint32_t memory_next;                  // access unit to send next
+    MMAL_POOL_T* memory_pool;              // headers without payload, pointed into memory
+    struct mmal_player_index_options index_options;
+    struct mmal_player_index* index;       // keyframes of the file being read, NULL while unknown
+    struct mmal_player_index* index_learning;  // ... being noted down from its first plain playback
     MMAL_COMPONENT_T* video_decoder;
     MMAL_COMPONENT_T* scheduler;
     MMAL_COMPONENT_T* video_renderer;
+    VCOS_MUTEX_T presentation_lock; // scheduler and video_renderer for other threads, against a rebuild
+    MMAL_BOOL_T presenting;         // ... which may use them; FALSE while they are rebuilt
+    int display_layer;              // as last set on the renderer, put back after a rebuild
+    uint8_t display_alpha;
 
     MMAL_CONNECTION_T* reader_to_decoder;
     MMAL_CONNECTION_T* decoder_to_scheduler;
     MMAL_CONNECTION_T* scheduler_to_renderer;
 
+    MMAL_POOL_T* reader_pool;   // owned here and lent to reader_to_decoder, survives clip switches
+    struct mmal_player_buffer_options reader_buffers;
+    uint32_t reader_buffer_num; // current target, moved by the adaptive mode
+    uint32_t reader_pool_size;  // payload size of the buffers in reader_pool
+    uint32_t clip_underruns;    // since the last clip switch
+    int clean_clips;            // consecutive clips without an underrun
+
     VCOS_SEMAPHORE_T sem_ready;
-    MMAL_STATUS_T pipeline_status;
+    uint32_t pending;       // PENDING_* bits set by callbacks, atomic
+    struct mmal_player_ring commands;   // from the application: stop, skip, start, switch, trick play
+    struct mmal_player_ring events;     // from MMAL callbacks: EOS, errors
+    struct mmal_player_loop_stats loop_stats;
+
+    struct mmal_player_metrics metrics;
+    int64_t frame_interval;     // us, from the container's frame rate
+    int metrics_fd;             // JSON lines go here when >= 0
+    uint64_t metrics_interval;  // us
+    uint64_t metrics_next;      // vcos_getmicrosecs64() of the next sample
+    MMAL_STATUS_T pipeline_status;  // written by the pipeline thread only, as are eos, terminate and after_seek
     MMAL_BOOL_T eos;
 
-    VCOS_THREAD_T main_loop_thread;
+    struct mmal_player_executor* executor;  // runs the sessions instead of main_loop_thread when set
+    struct mmal_player_pipeline* exec_next; // exec_* belong to the executor, under its lock
+    MMAL_BOOL_T exec_queued, exec_running, exec_rerun, exec_detached;
+    MMAL_BOOL_T in_session;                 // executor only: wakeups are handled, not left pending
+
+    VCOS_THREAD_T main_loop_thread;    // runs one session per start or preroll, parked in between
+    VCOS_SEMAPHORE_T sem_run;           // posted to start a session, or to exit with `shutdown`
+    VCOS_SEMAPHORE_T sem_done;          // posted when a session ended
+    MMAL_BOOL_T thread_started;
+    MMAL_BOOL_T session_active;         // started and not yet joined
+    MMAL_BOOL_T shutdown;
+    enum mmal_player_switch last_switch;    // what the last clip switch or mmal_player_reset() kept
 
     MMAL_BOOL_T after_seek;
+    MMAL_BOOL_T clock_resync;   // restart the clock at the PTS of the first buffer after a rewind
+    MMAL_BOOL_T reader_eos;     // the reader handed over its last buffer
+    int64_t clip_pts;           // PTS of the first buffer of the clip
+    int64_t clip_duration;      // media time from clip_pts to the renderer's EOS, 0 when skipped or not there yet
+
+    MMAL_BOOL_T paused;         // clock held by mmal_player_pause(), start_clock() leaves it stopped
+    MMAL_RATIONAL_T rate;       // playback speed, see mmal_player_set_rate()
+    MMAL_BOOL_T keyframes_only; // trick play: too fast to decode every frame
+    MMAL_BOOL_T need_keyframe;  // ... and back at a normal speed, frames are dropped up to the next keyframe
+    uint64_t seek_time;         // vcos_getmicrosecs64() of the seek waiting for its first frame, 0 for none
+
+    struct mmal_player_sync_member* sync;
+    struct mmal_player_tap* tap;
+    MMAL_BOOL_T sync_hold;      // clock held until the group's start time for the clip
+    uint32_t sync_generation;   // group clip being started or played, 0 while none
+    int32_t sync_ppm;           // clock rate correction in effect
+    int32_t sync_trim;          // ... part of it that makes up for this clock running off
+    uint64_t sync_next;         // vcos_getmicrosecs64() of the next drift check
 
     int rotation;
     int layer;
+    uint32_t display_num;
+    MMAL_RECT_T dest_rect;
 
     char* uri;
 
     MMAL_BOOL_T terminate;
 
+    MMAL_BOOL_T prerolled;  // decoding ahead below `layer` with the clock stopped
+    uint64_t eos_time;      // vcos_getmicrosecs64() when EOS arrived
+    MMAL_BOOL_T eos_held;   // the EOS callback kept the last frame up, until a skip
+    uint64_t start_time;    // vcos_getmicrosecs64() when the clock was started
+    uint64_t startup_time;  // ... of the first start, until its first frame was presented
+    uint64_t switch_eos;    // eos_time of the clip this one follows, until its first frame; 0 when not timed
+    uint64_t switch_frames; // ... frames presented when it went on
+    MMAL_BOOL_T fast_start;
+
     int exit_reason;
     pipeline_eos_callback eos_callback;
     pipeline_exit_callback exit_callback;
-    void* userdata;     // shared with eos_callback and exit_callback
+    pipeline_analysis_callback analysis_callback;
+    void* userdata;     // shared with eos_callback, exit_callback and analysis_callback
+    struct mmal_player_analysis_summary analysis;   // of the clip, up to its EOS callback
+
+    struct mmal_player_watchdog* watchdog;
+    uint32_t recover;               // bits of enum mmal_player_role to rebuild on the next step
+    MMAL_STATUS_T recover_status;   // ... what ends the session once it gives up
+    uint32_t recover_attempts;      // rebuilds since the last frame presented
+    uint64_t recovery_started;      // vcos_getmicrosecs64() of the first of those faults, 0 while none
+    uint64_t recovery_frames;       // frames_out() right after the last rebuild
+    int64_t recovery_pts;           // where each rebuild since the first fault resumes
+    MMAL_BOOL_T recovery_clip_started;  // ... on the clip's timeline, otherwise it starts over
+    uint64_t watch_frames;          // frames_out() when it last moved
+    uint64_t watch_time;            // ... vcos_getmicrosecs64() then
+    int64_t stage_pts[mmal_player_STAGE_MAX];   // PTS each connection handed on last, to tell where frames stop
+    MMAL_BOOL_T keep_clip_pts;      // the first buffer after a recovery goes on with the clip
 };
 
+void mmal_player_options_init(struct mmal_player_options* options);
+struct mmal_player_pipeline* mmal_player_create_with_options(const char* uri, const struct mmal_player_options* options);
 struct mmal_player_pipeline* mmal_player_create(const char* uri, int rotation, int layer);
+// Plays a clip loaded with mmal-player-memory.h instead of a file
+struct mmal_player_pipeline* mmal_player_create_with_memory(struct mmal_player_memory* memory, const struct mmal_player_options* options);
 void mmal_player_destroy(struct mmal_player_pipeline* ctx);
 
 MMAL_STATUS_T mmal_player_set_eos_callback(struct mmal_player_pipeline* ctx, pipeline_eos_callback cb, void* user);
 MMAL_STATUS_T mmal_player_set_exit_callback(struct mmal_player_pipeline* ctx, pipeline_exit_callback cb, void* user);
+MMAL_STATUS_T mmal_player_set_analysis_callback(struct mmal_player_pipeline* ctx, pipeline_analysis_callback cb, void* user);
+// From a tap callback (see mmal-player-analysis.h), for result->pipeline: the result is counted
+// into ctx->analysis and handed to the analysis callback on the pipeline thread
+MMAL_STATUS_T mmal_player_post_analysis(struct mmal_player_pipeline* ctx, const struct mmal_player_analysis_result* result);
 
+// From the EOS callback, which then returns TRUE: the last frame stays up and the callback is
+// not called again until mmal_player_skip()
+void mmal_player_hold_eos(struct mmal_player_pipeline* ctx);
 MMAL_STATUS_T mmal_player_set_new_uri(struct mmal_player_pipeline* ctx, const char* next_uri);
+MMAL_STATUS_T mmal_player_set_new_memory(struct mmal_player_pipeline* ctx, struct mmal_player_memory* memory);
 
+MMAL_STATUS_T mmal_player_preroll(struct mmal_player_pipeline* ctx);
 MMAL_STATUS_T mmal_player_start(struct mmal_player_pipeline* ctx);
+// Starts in place of a clip that reached EOS at `eos_time`, vcos_getmicrosecs64(); from then
+// until this clip's first frame is presented is its switch latency, logged and in the metrics.
+// Clips a pipeline loops or switches to itself from its EOS callback are timed the same way.
+MMAL_STATUS_T mmal_player_start_after(struct mmal_player_pipeline* ctx, uint64_t eos_time);
+// Transitions: a prerolled pipeline starts playing where it prerolled, one layer below its own,
+// and mmal_player_raise() puts it up later. Alpha and layer are set on the renderer right away,
+// from any thread, so a ramp does not wait for the pipeline thread; 255 is the opaque default
+// that hides the layers below, reset for the next clip. MMAL_EAGAIN while the watchdog rebuilds
+// the renderer, which then comes back with what was set last.
+MMAL_STATUS_T mmal_player_start_below(struct mmal_player_pipeline* ctx);
+MMAL_STATUS_T mmal_player_raise(struct mmal_player_pipeline* ctx);
+MMAL_STATUS_T mmal_player_set_alpha(struct mmal_player_pipeline* ctx, uint8_t alpha);
+// Media time since the start of the clip, us; from any thread, MMAL_EAGAIN while the scheduler is rebuilt
+MMAL_STATUS_T mmal_player_get_position(struct mmal_player_pipeline* ctx, int64_t* position);
+// From any thread, these only post a command the pipeline thread carries out in order
 void mmal_player_stop(struct mmal_player_pipeline* ctx);
+void mmal_player_skip(struct mmal_player_pipeline* ctx);
+MMAL_STATUS_T mmal_player_switch_uri(struct mmal_player_pipeline* ctx, const char* uri);
+// Trick play, posted the same way. Seeks land on a keyframe, MMAL_PARAM_SEEK_FLAG_FORWARD picks the
+// one after `pts`; a paused pipeline shows where it landed once resumed. From 4x up only keyframes
+// are decoded. A pipeline in a sync group runs on the group's clock and takes none of these.
+MMAL_STATUS_T mmal_player_seek(struct mmal_player_pipeline* ctx, int64_t pts, uint32_t flags);
+MMAL_STATUS_T mmal_player_pause(struct mmal_player_pipeline* ctx);
+MMAL_STATUS_T mmal_player_resume(struct mmal_player_pipeline* ctx);
+MMAL_STATUS_T mmal_player_set_rate(struct mmal_player_pipeline* ctx, MMAL_RATIONAL_T rate);
 void mmal_player_join(struct mmal_player_pipeline* ctx);
 
+// Recycling a joined pipeline for another file instead of destroying it, see mmal-player-pool.h
+MMAL_STATUS_T mmal_player_park(struct mmal_player_pipeline* ctx);
+MMAL_STATUS_T mmal_player_reset(struct mmal_player_pipeline* ctx, const char* uri, const struct mmal_player_options* options);
+
+void mmal_player_get_metrics(struct mmal_player_pipeline* ctx, struct mmal_player_metrics* metrics);
+MMAL_STATUS_T mmal_player_set_metrics_output(struct mmal_player_pipeline* ctx, int fd, uint32_t interval_ms);
+
+void mmal_player_get_loop_stats(struct mmal_player_pipeline* ctx, struct mmal_player_loop_stats* stats);
+
+// Handles one wakeup of an executor-driven pipeline, called by the executor only
+void mmal_player_pipeline_run(struct mmal_player_pipeline* ctx);
+// Has a synced pipeline check its clock against the group, called by mmal-player-sync.c only
+void mmal_player_pipeline_poke(struct mmal_player_pipeline* ctx);
+// Has the pipeline check it still presents frames, called by mmal-player-watchdog.c only
+void mmal_player_pipeline_watch(struct mmal_player_pipeline* ctx);
+
 
 #endif //MMAL_CHAIN_PLAYER_MMAL_PLAYER_PIPELINE_H
@@ -0,0 +1,141 @@
+#include "mmal-player-pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct mmal_player_pool
+{
+    VCOS_MUTEX_T lock;      // guards everything below
+
+    struct mmal_player_pipeline** idle;     // parked, most recent last
+    int count;
+    int capacity;
+
+    struct mmal_player_pool_stats stats;
+};
+
+struct mmal_player_pool* mmal_player_pool_create(int capacity)
+{
+    struct mmal_player_pool* pool;
+
+    pool = calloc(1, sizeof(struct mmal_player_pool));
+    if(pool == NULL)
+        return NULL;
+
+    if(capacity > 0) {
+        pool->idle = calloc(capacity, sizeof(struct mmal_player_pipeline*));
+        if(pool->idle == NULL) {
+            free(pool);
+            return NULL;
+        }
+    }
+
+    pool->capacity = capacity;
+    vcos_mutex_create(&pool->lock, "mmal_player_pool:lock");
+
+    return pool;
+}
+
+void mmal_player_pool_destroy(struct mmal_player_pool* pool)
+{
+    int i;
+
+    if(pool == NULL)
+        return;
+
+    for(i = 0; i < pool->count; i++)
+        mmal_player_destroy(pool->idle[i]);
+
+    vcos_mutex_delete(&pool->lock);
+    free(pool->idle);
+    free(pool);
+}
+
+// the pipeline that last played `uri` most likely decodes it with the components it has,
+// otherwise the most recently parked one
+static struct mmal_player_pipeline* take_idle(struct mmal_player_pool* pool, const char* uri)
+{
+    struct mmal_player_pipeline* pipeline;
+    int i = pool->count - 1;
+
+    if(pool->count == 0)
+        return NULL;
+
+    while(i > 0 && (pool->idle[i]->uri == NULL || strcmp(pool->idle[i]->uri, uri) != 0))
+        i--;
+    if(pool->idle[i]->uri == NULL || strcmp(pool->idle[i]->uri, uri) != 0)
+        i = pool->count - 1;
+
+    pipeline = pool->idle[i];
+    memmove(&pool->idle[i], &pool->idle[i + 1], sizeof(struct mmal_player_pipeline*) * (pool->count - i - 1));
+    pool->count--;
+
+    return pipeline;
+}
+
+struct mmal_player_pipeline* mmal_player_pool_get(struct mmal_player_pool* pool, const char* uri, const struct mmal_player_options* options)
+{
+    struct mmal_player_pipeline* pipeline;
+
+    vcos_mutex_lock(&pool->lock);
+    pipeline = take_idle(pool, uri);
+    vcos_mutex_unlock(&pool->lock);
+
+    if(pipeline != NULL) {
+        if(mmal_player_reset(pipeline, uri, options) == MMAL_SUCCESS) {
+            vcos_mutex_lock(&pool->lock);
+            pool->stats.recycled++;
+            if(pipeline->last_switch == mmal_player_SWITCH_READER)
+                pool->stats.reused++;
+            vcos_mutex_unlock(&pool->lock);
+            return pipeline;
+        }
+
+        fprintf(stderr, "unable to recycle pipeline for %s, creating a new one\n", uri);
+        mmal_player_destroy(pipeline);
+        vcos_mutex_lock(&pool->lock);
+        pool->stats.destroyed++;
+        vcos_mutex_unlock(&pool->lock);
+    }
+
+    pipeline = mmal_player_create_with_options(uri, options);
+    if(pipeline != NULL) {
+        vcos_mutex_lock(&pool->lock);
+        pool->stats.created++;
+        vcos_mutex_unlock(&pool->lock);
+    }
+
+    return pipeline;
+}
+
+void mmal_player_pool_put(struct mmal_player_pool* pool, struct mmal_player_pipeline* pipeline)
+{
+    if(pipeline == NULL)
+        return;
+
+    // a pipeline that failed to build or errored out is not worth keeping
+    if(pool->capacity > 0 && pipeline->exit_reason != mmal_player_ERROR && mmal_player_park(pipeline) == MMAL_SUCCESS) {
+        vcos_mutex_lock(&pool->lock);
+        if(pool->count < pool->capacity) {
+            pool->idle[pool->count++] = pipeline;
+            pipeline = NULL;
+        }
+        vcos_mutex_unlock(&pool->lock);
+    }
+
+    if(pipeline != NULL) {
+        mmal_player_destroy(pipeline);
+        vcos_mutex_lock(&pool->lock);
+        pool->stats.destroyed++;
+        vcos_mutex_unlock(&pool->lock);
+    }
+}
+
+void mmal_player_pool_get_stats(struct mmal_player_pool* pool, struct mmal_player_pool_stats* stats)
+{
+    vcos_mutex_lock(&pool->lock);
+    *stats = pool->stats;
+    stats->idle = pool->count;
+    vcos_mutex_unlock(&pool->lock);
+}
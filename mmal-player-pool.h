@@ -0,0 +1,33 @@
+#ifndef MMAL_CHAIN_PLAYER_MMAL_PLAYER_POOL_H
+#define MMAL_CHAIN_PLAYER_MMAL_PLAYER_POOL_H
+
+#include <stdint.h>
+
+#include "mmal-player-pipeline.h"
+
+// Keeps finished pipelines around instead of destroying them, so the next clip gets a pipeline
+// whose struct, semaphores, thread and reader pool already exist, and whose decoder, scheduler
+// and renderer are kept as well when the file has the same codec and resolution.
+struct mmal_player_pool;
+
+struct mmal_player_pool_stats
+{
+    uint32_t created;       // pipelines built from scratch
+    uint32_t recycled;      // ... handed out again after mmal_player_reset()
+    uint32_t reused;        // ... of which kept decoder, scheduler and renderer
+    uint32_t destroyed;     // dropped because the pool was full or the reset failed
+    uint32_t idle;          // parked right now
+};
+
+// Parks up to `capacity` pipelines; 0 makes the pool a plain create/destroy wrapper
+struct mmal_player_pool* mmal_player_pool_create(int capacity);
+void mmal_player_pool_destroy(struct mmal_player_pool* pool);
+
+// A parked pipeline reset for `uri` and `options`, or a new one
+struct mmal_player_pipeline* mmal_player_pool_get(struct mmal_player_pool* pool, const char* uri, const struct mmal_player_options* options);
+// Takes back a pipeline that is not running: stopped and joined, or never started
+void mmal_player_pool_put(struct mmal_player_pool* pool, struct mmal_player_pipeline* pipeline);
+
+void mmal_player_pool_get_stats(struct mmal_player_pool* pool, struct mmal_player_pool_stats* stats);
+
+#endif //MMAL_CHAIN_PLAYER_MMAL_PLAYER_POOL_H
@@ -0,0 +1,378 @@
+#include "mmal-player-prefetch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "interface/vcos/vcos.h"
+
+#include "mmal-player-stream.h"
+
+#define PREFETCH_SLOTS      2           // the file playing and the next one
+#define PREFETCH_CHUNK      (1 << 20)   // read per lock round trip
+
+struct prefetch_slot
+{
+    char* path;             // NULL: free
+    int fd;
+    uint8_t* map;           // only for mincore(), reads go through fd
+    size_t length;          // prefetch window, at most pf->window
+    size_t done;            // bytes read so far
+    uint64_t installed;     // vcos_getmicrosecs64(), oldest is evicted first
+    uint64_t completed;     // ... when done reached length, 0 while prefetching
+    uint64_t opened;        // ... at mmal_player_prefetch_opened(), 0 if not yet
+};
+
+struct prefetch_request
+{
+    char* path;             // NULL: free
+    uint64_t opened;        // the reader got there before the prefetch thread did
+};
+
+struct mmal_player_prefetcher
+{
+    VCOS_THREAD_T thread;
+    VCOS_SEMAPHORE_T sem_work;
+    VCOS_MUTEX_T lock;      // guards everything below; slots are only mapped and unmapped by the thread
+
+    struct prefetch_request pending[PREFETCH_SLOTS];   // not mapped yet, oldest first
+    struct prefetch_request installing;                 // taken off pending, being mapped
+    struct prefetch_slot slots[PREFETCH_SLOTS];
+    size_t window;
+    long page_size;
+    int terminate;
+
+    uint8_t* scratch;       // PREFETCH_CHUNK, reads land here and are thrown away
+    struct mmal_player_prefetch_stats stats;
+};
+
+static struct prefetch_slot* find_slot(struct mmal_player_prefetcher* pf, const char* path)
+{
+    int i;
+
+    for(i = 0; i < PREFETCH_SLOTS; i++) {
+        if(pf->slots[i].path != NULL && strcmp(pf->slots[i].path, path) == 0)
+            return &pf->slots[i];
+    }
+    return NULL;
+}
+
+// a request that has no slot yet, including the one being mapped
+static struct prefetch_request* find_pending(struct mmal_player_prefetcher* pf, const char* path)
+{
+    int i;
+
+    if(pf->installing.path != NULL && strcmp(pf->installing.path, path) == 0)
+        return &pf->installing;
+    for(i = 0; i < PREFETCH_SLOTS; i++) {
+        if(pf->pending[i].path != NULL && strcmp(pf->pending[i].path, path) == 0)
+            return &pf->pending[i];
+    }
+    return NULL;
+}
+
+static void pop_pending(struct mmal_player_prefetcher* pf)
+{
+    memmove(&pf->pending[0], &pf->pending[1], sizeof(struct prefetch_request) * (PREFETCH_SLOTS - 1));
+    memset(&pf->pending[PREFETCH_SLOTS - 1], 0, sizeof(struct prefetch_request));
+}
+
+static void release_slot(struct prefetch_slot* slot)
+{
+    if(slot->map != NULL)
+        munmap(slot->map, slot->length);
+    if(slot->fd >= 0)
+        close(slot->fd);
+    free(slot->path);
+
+    memset(slot, 0, sizeof(struct prefetch_slot));
+    slot->fd = -1;
+}
+
+// Opens and maps pf->installing outside the lock, then takes over a free or the oldest slot
+static void install_slot(struct mmal_player_prefetcher* pf)
+{
+    struct prefetch_slot slot, old;
+    struct stat st;
+    char* path = pf->installing.path;
+    int i, victim = 0;
+
+    memset(&slot, 0, sizeof(struct prefetch_slot));
+    slot.path = path;
+    slot.fd = open(path, O_RDONLY);
+    if(slot.fd < 0 || fstat(slot.fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        // not a local file (a URL, a device): nothing to warm up
+        if(slot.fd >= 0)
+            close(slot.fd);
+        vcos_mutex_lock(&pf->lock);
+        memset(&pf->installing, 0, sizeof(struct prefetch_request));
+        vcos_mutex_unlock(&pf->lock);
+        free(path);
+        return;
+    }
+
+    slot.length = vcos_min((size_t)st.st_size, pf->window);
+    if(slot.length > 0) {
+        slot.map = mmap(NULL, slot.length, PROT_READ, MAP_SHARED, slot.fd, 0);
+        if(slot.map == MAP_FAILED)
+            slot.map = NULL;
+        posix_fadvise(slot.fd, 0, slot.length, POSIX_FADV_SEQUENTIAL);
+    }
+    slot.installed = vcos_getmicrosecs64();
+    if(slot.length == 0)
+        slot.completed = slot.installed;
+
+    vcos_mutex_lock(&pf->lock);
+    slot.opened = pf->installing.opened;
+    memset(&pf->installing, 0, sizeof(struct prefetch_request));
+    for(i = 0; i < PREFETCH_SLOTS; i++) {
+        if(pf->slots[i].path == NULL) {
+            victim = i;
+            break;
+        }
+        if(pf->slots[i].installed < pf->slots[victim].installed)
+            victim = i;
+    }
+    old = pf->slots[victim];
+    pf->slots[victim] = slot;
+    vcos_mutex_unlock(&pf->lock);
+
+    if(old.path != NULL)
+        release_slot(&old);
+}
+
+// oldest slot that still has something to read
+static struct prefetch_slot* next_slot(struct mmal_player_prefetcher* pf)
+{
+    struct prefetch_slot* next = NULL;
+    int i;
+
+    for(i = 0; i < PREFETCH_SLOTS; i++) {
+        struct prefetch_slot* slot = &pf->slots[i];
+
+        if(slot->path != NULL && slot->done < slot->length && (next == NULL || slot->installed < next->installed))
+            next = slot;
+    }
+    return next;
+}
+
+static void* prefetch_thread(void* arg)
+{
+    struct mmal_player_prefetcher* pf = arg;
+
+    vcos_mutex_lock(&pf->lock);
+    while(!pf->terminate) {
+        struct prefetch_slot* slot;
+        size_t offset, length;
+        ssize_t n;
+
+        if(pf->pending[0].path != NULL) {
+            pf->installing = pf->pending[0];
+            pop_pending(pf);
+
+            vcos_mutex_unlock(&pf->lock);
+            install_slot(pf);
+            vcos_mutex_lock(&pf->lock);
+            continue;
+        }
+
+        slot = next_slot(pf);
+        if(slot == NULL) {
+            vcos_mutex_unlock(&pf->lock);
+            vcos_semaphore_wait(&pf->sem_work);
+            vcos_mutex_lock(&pf->lock);
+            continue;
+        }
+
+        offset = slot->done;
+        length = vcos_min(slot->length - offset, (size_t)PREFETCH_CHUNK);
+        vcos_mutex_unlock(&pf->lock);
+
+        // the slot can only go away on this thread
+        n = pread(slot->fd, pf->scratch, length, offset);
+
+        vcos_mutex_lock(&pf->lock);
+        if(n <= 0) {
+            // truncated or unreadable: stop here, the reader will find out for itself
+            slot->length = slot->done;
+        } else {
+            slot->done += n;
+            pf->stats.bytes += n;
+        }
+
+        if(slot->done == slot->length) {
+            slot->completed = vcos_getmicrosecs64();
+            if(slot->opened != 0)
+                mmal_player_timing_add(&pf->stats.lag, slot->completed - slot->opened);
+        }
+    }
+    vcos_mutex_unlock(&pf->lock);
+
+    return NULL;
+}
+
+// bytes of the window already in the page cache
+static size_t resident_bytes(struct mmal_player_prefetcher* pf, struct prefetch_slot* slot)
+{
+    size_t pages = (slot->length + pf->page_size - 1) / pf->page_size;
+    size_t i, resident = 0;
+    unsigned char* vec;
+
+    if(slot->map == NULL)
+        return slot->done;
+
+    vec = malloc(pages);
+    if(vec == NULL || mincore(slot->map, slot->length, vec) != 0) {
+        free(vec);
+        return slot->done;
+    }
+
+    for(i = 0; i < pages; i++) {
+        if(vec[i] & 1)
+            resident++;
+    }
+    free(vec);
+
+    return vcos_min(resident * pf->page_size, slot->length);
+}
+
+struct mmal_player_prefetcher* mmal_player_prefetcher_create(size_t budget)
+{
+    struct mmal_player_prefetcher* pf;
+    int i;
+
+    pf = calloc(1, sizeof(struct mmal_player_prefetcher));
+    if(pf == NULL)
+        return NULL;
+
+    pf->scratch = malloc(PREFETCH_CHUNK);
+    if(pf->scratch == NULL) {
+        free(pf);
+        return NULL;
+    }
+
+    pf->window = budget / PREFETCH_SLOTS;
+    pf->page_size = sysconf(_SC_PAGESIZE);
+    for(i = 0; i < PREFETCH_SLOTS; i++)
+        pf->slots[i].fd = -1;
+
+    vcos_semaphore_create(&pf->sem_work, "prefetch:work", 0);
+    vcos_mutex_create(&pf->lock, "prefetch:lock");
+
+    if(vcos_thread_create(&pf->thread, "prefetch:thread", NULL, prefetch_thread, pf) != VCOS_SUCCESS) {
+        fprintf(stderr, "unable to start prefetch thread\n");
+        vcos_semaphore_delete(&pf->sem_work);
+        vcos_mutex_delete(&pf->lock);
+        free(pf->scratch);
+        free(pf);
+        return NULL;
+    }
+
+    return pf;
+}
+
+void mmal_player_prefetcher_destroy(struct mmal_player_prefetcher* pf)
+{
+    void* ret = NULL;
+    int i;
+
+    if(pf == NULL)
+        return;
+
+    vcos_mutex_lock(&pf->lock);
+    pf->terminate = 1;
+    vcos_mutex_unlock(&pf->lock);
+    vcos_semaphore_post(&pf->sem_work);
+    vcos_thread_join(&pf->thread, &ret);
+
+    for(i = 0; i < PREFETCH_SLOTS; i++) {
+        free(pf->pending[i].path);
+        if(pf->slots[i].path != NULL)
+            release_slot(&pf->slots[i]);
+    }
+
+    vcos_semaphore_delete(&pf->sem_work);
+    vcos_mutex_delete(&pf->lock);
+    free(pf->scratch);
+    free(pf);
+}
+
+void mmal_player_prefetch(struct mmal_player_prefetcher* pf, const char* path)
+{
+    char* copy;
+    int i;
+
+    // live streams have nothing to read ahead
+    if(pf == NULL || path == NULL || mmal_player_stream_is_uri(path))
+        return;
+
+    vcos_mutex_lock(&pf->lock);
+    if(find_slot(pf, path) != NULL || find_pending(pf, path) != NULL) {
+        vcos_mutex_unlock(&pf->lock);
+        return;
+    }
+
+    copy = strdup(path);
+    if(copy == NULL) {
+        vcos_mutex_unlock(&pf->lock);
+        return;
+    }
+
+    // a full queue drops its oldest request, it would be evicted right away anyway
+    if(pf->pending[PREFETCH_SLOTS - 1].path != NULL) {
+        free(pf->pending[0].path);
+        pop_pending(pf);
+    }
+    for(i = 0; pf->pending[i].path != NULL; i++)
+        ;
+    pf->pending[i].path = copy;
+    pf->stats.requests++;
+    vcos_mutex_unlock(&pf->lock);
+
+    vcos_semaphore_post(&pf->sem_work);
+}
+
+void mmal_player_prefetch_opened(struct mmal_player_prefetcher* pf, const char* path)
+{
+    struct prefetch_slot* slot;
+    struct prefetch_request* request;
+    uint64_t now = vcos_getmicrosecs64();
+
+    if(pf == NULL || path == NULL || mmal_player_stream_is_uri(path))
+        return;
+
+    vcos_mutex_lock(&pf->lock);
+    slot = find_slot(pf, path);
+    if(slot == NULL) {
+        // the lag is accounted once the thread caught up, if it was asked at all
+        request = find_pending(pf, path);
+        if(request != NULL)
+            request->opened = now;
+        pf->stats.misses++;
+        vcos_mutex_unlock(&pf->lock);
+        return;
+    }
+
+    pf->stats.opened_bytes += slot->length;
+    pf->stats.resident_bytes += resident_bytes(pf, slot);
+
+    slot->opened = now;
+    if(slot->completed != 0) {
+        pf->stats.hits++;
+        mmal_player_timing_add(&pf->stats.slack, now - slot->completed);
+    } else {
+        pf->stats.misses++;
+    }
+    vcos_mutex_unlock(&pf->lock);
+}
+
+void mmal_player_prefetcher_get_stats(struct mmal_player_prefetcher* pf, struct mmal_player_prefetch_stats* stats)
+{
+    vcos_mutex_lock(&pf->lock);
+    *stats = pf->stats;
+    vcos_mutex_unlock(&pf->lock);
+}
@@ -0,0 +1,36 @@
+#ifndef MMAL_CHAIN_PLAYER_MMAL_PLAYER_PREFETCH_H
+#define MMAL_CHAIN_PLAYER_MMAL_PLAYER_PREFETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mmal-player-metrics.h"
+
+// Reads files into the page cache on a background thread before the container reader asks for
+// them, so slow SD cards and USB sticks stall this thread instead of the reader. Each file is
+// mapped and touched up to its share of the budget; the current and the next file are kept.
+struct mmal_player_prefetcher;
+
+struct mmal_player_prefetch_stats
+{
+    uint32_t requests;              // files queued with mmal_player_prefetch()
+    uint32_t hits;                  // prefetch window complete when the reader opened the file
+    uint32_t misses;                // still prefetching, or never queued
+    uint64_t bytes;                 // read ahead by the prefetch thread
+    uint64_t opened_bytes;          // prefetch windows of the files opened
+    uint64_t resident_bytes;        // ... of which already in the page cache at open
+    struct mmal_player_timing lag;  // misses: open until the window was read, us
+    struct mmal_player_timing slack;// hits: window read until open, us
+};
+
+struct mmal_player_prefetcher* mmal_player_prefetcher_create(size_t budget);
+void mmal_player_prefetcher_destroy(struct mmal_player_prefetcher* pf);
+
+// Queues `path`, evicting the least recently queued file; cheap enough for an EOS callback
+void mmal_player_prefetch(struct mmal_player_prefetcher* pf, const char* path);
+// Accounts a hit or a miss, call right before `path` is handed to the container reader
+void mmal_player_prefetch_opened(struct mmal_player_prefetcher* pf, const char* path);
+
+void mmal_player_prefetcher_get_stats(struct mmal_player_prefetcher* pf, struct mmal_player_prefetch_stats* stats);
+
+#endif //MMAL_CHAIN_PLAYER_MMAL_PLAYER_PREFETCH_H
@@ -0,0 +1,73 @@
+#include "mmal-player-ring.h"
+
+#include <stdlib.h>
+
+MMAL_STATUS_T mmal_player_ring_init(struct mmal_player_ring* ring, uint32_t capacity)
+{
+    uint32_t size = 2, i;
+
+    while(size < capacity)
+        size <<= 1;
+
+    ring->slots = calloc(size, sizeof(struct mmal_player_ring_slot));
+    if(ring->slots == NULL)
+        return MMAL_ENOMEM;
+    // slot i is free for the post at position i
+    for(i = 0; i < size; i++)
+        ring->slots[i].seq = i;
+    ring->mask = size - 1;
+    ring->head = ring->tail = 0;
+    ring->full = 0;
+
+    return MMAL_SUCCESS;
+}
+
+void mmal_player_ring_deinit(struct mmal_player_ring* ring)
+{
+    free(ring->slots);
+    ring->slots = NULL;
+}
+
+MMAL_BOOL_T mmal_player_ring_post(struct mmal_player_ring* ring, const struct mmal_player_message* message)
+{
+    struct mmal_player_ring_slot* slot;
+    uint32_t pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+    while(1) {
+        int32_t diff;
+
+        slot = &ring->slots[pos & ring->mask];
+        diff = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+        if(diff == 0) {
+            // free: claim it, a failed exchange reloads pos
+            if(__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, MMAL_TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if(diff < 0) {
+            // still holds the message posted one lap ago
+            __atomic_fetch_add(&ring->full, 1, __ATOMIC_RELAXED);
+            return MMAL_FALSE;
+        } else {
+            pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->message = *message;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+    return MMAL_TRUE;
+}
+
+MMAL_BOOL_T mmal_player_ring_take(struct mmal_player_ring* ring, struct mmal_player_message* message)
+{
+    struct mmal_player_ring_slot* slot = &ring->slots[ring->tail & ring->mask];
+
+    if(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != ring->tail + 1)
+        return MMAL_FALSE;
+
+    *message = slot->message;
+    // free again for the post one lap ahead
+    __atomic_store_n(&slot->seq, ring->tail + ring->mask + 1, __ATOMIC_RELEASE);
+    ring->tail++;
+
+    return MMAL_TRUE;
+}
@@ -0,0 +1,44 @@
+#ifndef MMAL_CHAIN_PLAYER_MMAL_PLAYER_RING_H
+#define MMAL_CHAIN_PLAYER_MMAL_PLAYER_RING_H
+
+#include <stdint.h>
+
+#include "interface/mmal/mmal.h"
+
+// Bounded lock-free message ring into a pipeline thread. Any thread may post, only the pipeline
+// thread takes. Each slot carries a sequence number: a poster claims a slot by moving `head`,
+// fills it and then publishes it through the sequence, so posting never blocks, messages from
+// one thread arrive in the order they were posted, and the taker never sees a half written one.
+struct mmal_player_message
+{
+    uint32_t type;          // up to the pipeline
+    int32_t status;
+    int64_t value;
+    void* ptr;              // owned by the message once posted
+};
+
+struct mmal_player_ring_slot
+{
+    uint32_t seq;
+    struct mmal_player_message message;
+};
+
+struct mmal_player_ring
+{
+    struct mmal_player_ring_slot* slots;
+    uint32_t mask;
+    uint32_t head;          // next slot to claim, atomic
+    uint32_t tail;          // next slot to take, the taker's own
+    uint32_t full;          // posts refused, atomic
+};
+
+// `capacity` is rounded up to a power of two
+MMAL_STATUS_T mmal_player_ring_init(struct mmal_player_ring* ring, uint32_t capacity);
+void mmal_player_ring_deinit(struct mmal_player_ring* ring);
+
+// FALSE when the ring is full; the message was not posted then
+MMAL_BOOL_T mmal_player_ring_post(struct mmal_player_ring* ring, const struct mmal_player_message* message);
+// FALSE when there is nothing (complete) to take
+MMAL_BOOL_T mmal_player_ring_take(struct mmal_player_ring* ring, struct mmal_player_message* message);
+
+#endif //MMAL_CHAIN_PLAYER_MMAL_PLAYER_RING_H
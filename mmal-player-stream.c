@@ -0,0 +1,810 @@
+#define _GNU_SOURCE    // ppoll(), pipe2()
+
+#include "mmal-player-stream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "interface/vcos/vcos.h"
+
+#define STREAM_LATENCY_MS       100
+#define STREAM_FPS              30
+#define STREAM_CAPACITY         512
+#define STREAM_WIDTH            1920
+#define STREAM_HEIGHT           1080
+
+#define STREAM_RECEIVE_SIZE     65536           // a datagram, or one read of a byte stream
+#define STREAM_SOCKET_BUFFER    (4 << 20)       // bursts the kernel holds while the thread is busy
+#define STREAM_AU_MAX           (4 << 20)       // cut a byte stream here even without an access unit boundary
+
+#define RTP_VERSION             2
+#define RTP_HEADER_SIZE         12
+
+enum stream_source {
+    STREAM_RTP = 0,
+    STREAM_UDP,
+    STREAM_UNIX,
+    STREAM_PIPE,
+};
+
+struct stream_entry
+{
+    uint8_t* data;          // Annex B, the allocation stays with the slot
+    uint32_t length;
+    uint32_t alloc;
+    uint32_t offset;        // already handed to the decoder
+    uint32_t seq;           // extended RTP sequence number, access unit count for byte streams
+    uint32_t flags;         // MMAL_BUFFER_HEADER_FLAG_*
+    int64_t pts;
+    uint64_t arrival;       // vcos_getmicrosecs64()
+    uint64_t due;           // ... when it goes to the decoder
+};
+
+struct mmal_player_stream
+{
+    enum stream_source source;
+    MMAL_BOOL_T datagram;   // drops when full, a stream source is just not read
+    int fd;
+    int wake[2];            // wakes the receive thread out of poll()
+
+    VCOS_THREAD_T thread;
+    VCOS_MUTEX_T lock;      // guards everything below but the receive thread's own state
+    int terminate;
+    MMAL_BOOL_T waiting;    // the receive thread stopped reading until there is room
+    void (*notify)(void*);
+    void* userdata;
+
+    struct mmal_player_stream_options options;
+    int64_t frame_interval;
+    int64_t latency;
+
+    // ring of options.capacity slots, oldest first
+    struct stream_entry* entries;
+    uint32_t head;
+    uint32_t count;
+    uint32_t due_notified;  // leading entries the pipeline was told about
+
+    // due = base_time + latency + pts - base_pts
+    MMAL_BOOL_T based;
+    uint64_t base_time;
+    int64_t base_pts;
+    int64_t pts_offset;     // added to every PTS since the last rebase
+
+    MMAL_BOOL_T rtp_started;
+    uint32_t rtp_seq;       // highest extended sequence number received
+    int64_t rtp_ts;         // ... and its extended timestamp
+    MMAL_BOOL_T released;
+    uint32_t released_seq;  // last entry handed out or dropped
+
+    // byte streams, receive thread only
+    uint8_t* au;            // access unit being assembled
+    size_t au_length;
+    size_t au_alloc;
+    size_t au_scan;         // start codes before this were looked at
+    MMAL_BOOL_T au_vcl;     // it has a slice already
+    uint32_t au_flags;
+    uint32_t au_count;
+    int64_t next_pts;
+    MMAL_BOOL_T eof;
+
+    uint8_t* receive;       // STREAM_RECEIVE_SIZE
+    struct mmal_player_stream_stats stats;
+};
+
+MMAL_BOOL_T mmal_player_stream_is_uri(const char* uri)
+{
+    return uri != NULL && (strncmp(uri, "rtp://", 6) == 0 || strncmp(uri, "udp://", 6) == 0 ||
+                           strncmp(uri, "unix:", 5) == 0 || strncmp(uri, "pipe:", 5) == 0);
+}
+
+static inline struct stream_entry* entry(struct mmal_player_stream* s, uint32_t i)
+{
+    return &s->entries[(s->head + i) % s->options.capacity];
+}
+
+static int entry_put(struct stream_entry* e, const uint8_t* data, size_t length)
+{
+    if(e->length + length > e->alloc) {
+        uint32_t alloc = vcos_max(e->alloc * 2, e->length + (uint32_t)length);
+        uint8_t* grown = realloc(e->data, alloc);
+
+        if(grown == NULL)
+            return -1;
+        e->data = grown;
+        e->alloc = alloc;
+    }
+    memcpy(e->data + e->length, data, length);
+    e->length += length;
+    return 0;
+}
+
+static int entry_put_start_code(struct stream_entry* e)
+{
+    static const uint8_t start_code[4] = {0, 0, 0, 1};
+
+    return entry_put(e, start_code, sizeof(start_code));
+}
+
+// The oldest entry leaves the buffer; `now` 0 drops it
+static void entry_pop(struct mmal_player_stream* s, uint64_t now)
+{
+    struct stream_entry* e = entry(s, 0);
+
+    if(now != 0) {
+        mmal_player_timing_add(&s->stats.hold, now - e->arrival);
+        if(s->source == STREAM_RTP && s->released && (int32_t)(e->seq - s->released_seq) > 1)
+            s->stats.lost += e->seq - s->released_seq - 1;
+    } else {
+        s->stats.overflow++;
+    }
+    s->released = MMAL_TRUE;
+    s->released_seq = e->seq;
+
+    s->head = (s->head + 1) % s->options.capacity;
+    s->count--;
+    if(s->due_notified > 0)
+        s->due_notified--;
+}
+
+// The free slot after the newest entry, made by dropping the oldest when the buffer is full
+static struct stream_entry* entry_next(struct mmal_player_stream* s)
+{
+    struct stream_entry* e;
+
+    if(s->count == s->options.capacity)
+        entry_pop(s, 0);
+
+    e = entry(s, s->count);
+    e->length = e->offset = 0;
+    e->flags = 0;
+    return e;
+}
+
+// Moves the slot entry_next() filled to `position` among the entries
+static void entry_commit(struct mmal_player_stream* s, uint32_t position)
+{
+    struct stream_entry slot = *entry(s, s->count);
+    uint32_t i;
+
+    for(i = s->count; i > position; i--)
+        *entry(s, i) = *entry(s, i - 1);
+    *entry(s, position) = slot;
+
+    s->count++;
+    s->stats.depth_max = vcos_max(s->stats.depth_max, s->count);
+}
+
+// Puts an entry that arrived at `now` on the playout timeline. A frame that starts past its due
+// time means the source fell more than the latency behind: everything from it on is delayed by
+// a full latency again, as a gap in the PTS the scheduler simply waits out.
+static void entry_schedule(struct mmal_player_stream* s, struct stream_entry* e, uint64_t now, MMAL_BOOL_T frame_start)
+{
+    int64_t due;
+
+    if(!s->based) {
+        s->base_time = now;
+        s->base_pts = e->pts;
+        s->based = MMAL_TRUE;
+    }
+
+    due = (int64_t)s->base_time + s->latency + e->pts - s->base_pts;
+    if(frame_start && due < (int64_t)now) {
+        int64_t shift = (int64_t)now + s->latency - due;
+
+        s->pts_offset += shift;
+        e->pts += shift;
+        due += shift;
+        s->stats.rebases++;
+    }
+
+    e->arrival = now;
+    e->due = due > (int64_t)now ? (uint64_t)due : now;
+}
+
+/* RTP */
+
+static uint32_t read_be32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// RFC 6184 payload to Annex B; single NAL units, STAP-A and FU-A, the interleaved modes are not used live
+static int rtp_depacketize(struct stream_entry* e, const uint8_t* payload, size_t length)
+{
+    uint8_t type = payload[0] & 0x1f;
+    size_t i;
+
+    if(type >= 1 && type <= 23) {
+        if(type == 5)
+            e->flags |= MMAL_BUFFER_HEADER_FLAG_KEYFRAME;
+        return entry_put_start_code(e) || entry_put(e, payload, length);
+    }
+
+    if(type == 24) {
+        for(i = 1; i + 2 < length; ) {
+            size_t size = ((size_t)payload[i] << 8) | payload[i + 1];
+
+            i += 2;
+            if(size == 0 || i + size > length)
+                break;
+            if((payload[i] & 0x1f) == 5)
+                e->flags |= MMAL_BUFFER_HEADER_FLAG_KEYFRAME;
+            if(entry_put_start_code(e) || entry_put(e, payload + i, size))
+                return -1;
+            i += size;
+        }
+        return 0;
+    }
+
+    if(type == 28 && length > 2) {
+        if((payload[1] & 0x1f) == 5)
+            e->flags |= MMAL_BUFFER_HEADER_FLAG_KEYFRAME;
+        if(payload[1] & 0x80) {
+            // the start fragment carries the NAL header split over both bytes
+            uint8_t header = (payload[0] & 0xe0) | (payload[1] & 0x1f);
+
+            if(entry_put_start_code(e) || entry_put(e, &header, 1))
+                return -1;
+        }
+        return entry_put(e, payload + 2, length - 2);
+    }
+
+    return 0;
+}
+
+static void rtp_receive(struct mmal_player_stream* s, const uint8_t* packet, size_t length, uint64_t now)
+{
+    struct stream_entry* e;
+    size_t header = RTP_HEADER_SIZE;
+    uint32_t seq, position;
+    int64_t ts;
+    MMAL_BOOL_T frame_start;
+
+    if(length <= RTP_HEADER_SIZE || (packet[0] >> 6) != RTP_VERSION)
+        return;
+    header += 4 * (packet[0] & 0x0f);
+    if(packet[0] & 0x10) {
+        if(length < header + 4)
+            return;
+        header += 4 + 4 * (((size_t)packet[header + 2] << 8) | packet[header + 3]);
+    }
+    if(packet[0] & 0x20) {
+        if(packet[length - 1] >= length)
+            return;
+        length -= packet[length - 1];
+    }
+    if(header >= length)
+        return;
+
+    // extend sequence numbers and timestamps past their wrap, relative to the newest packet
+    if(!s->rtp_started) {
+        seq = s->rtp_seq = 0x10000 + (((uint32_t)packet[2] << 8) | packet[3]);
+        ts = s->rtp_ts = read_be32(packet + 4);
+        frame_start = s->rtp_started = MMAL_TRUE;
+    } else {
+        seq = s->rtp_seq + (int16_t)((((uint32_t)packet[2] << 8) | packet[3]) - (s->rtp_seq & 0xffff));
+        ts = s->rtp_ts + (int32_t)(read_be32(packet + 4) - (uint32_t)s->rtp_ts);
+        frame_start = (int32_t)(seq - s->rtp_seq) > 0 && ts != s->rtp_ts;
+        if((int32_t)(seq - s->rtp_seq) > 0) {
+            s->rtp_seq = seq;
+            s->rtp_ts = ts;
+        }
+    }
+
+    if(s->released && (int32_t)(seq - s->released_seq) <= 0) {
+        s->stats.late++;
+        return;
+    }
+    for(position = s->count; position > 0 && (int32_t)(entry(s, position - 1)->seq - seq) > 0; position--)
+        ;
+    if(position > 0 && entry(s, position - 1)->seq == seq)
+        return;     // duplicate
+
+    if(s->count == s->options.capacity && position == 0) {
+        // older than everything a full buffer holds
+        s->stats.overflow++;
+        return;
+    }
+    if(s->count == s->options.capacity)
+        position--;
+    e = entry_next(s);
+    if(rtp_depacketize(e, packet + header, length - header) != 0 || e->length == 0)
+        return;
+
+    e->seq = seq;
+    if(packet[1] & 0x80)
+        e->flags |= MMAL_BUFFER_HEADER_FLAG_FRAME_END;
+    // 90 kHz
+    e->pts = ts * 100 / 9 + s->pts_offset;
+    entry_schedule(s, e, now, frame_start);
+    entry_commit(s, position);
+}
+
+/* byte streams */
+
+// Delimiter, SEI, parameter sets, or a slice with first_mb_in_slice 0 (ue(v) 0 is a single 1 bit)
+MMAL_BOOL_T mmal_player_h264_starts_access_unit(uint8_t type, uint8_t next)
+{
+    if(type == 6 || type == 7 || type == 8 || type == 9 || (type >= 14 && type <= 18))
+        return MMAL_TRUE;
+    return (type == 1 || type == 5) && (next & 0x80);
+}
+
+// The first `length` bytes of the assembly buffer become the next entry
+static void bytestream_emit(struct mmal_player_stream* s, size_t length, uint64_t now)
+{
+    struct stream_entry* e = entry_next(s);
+
+    if(entry_put(e, s->au, length) == 0) {
+        e->seq = s->au_count++;
+        e->flags = s->au_flags | MMAL_BUFFER_HEADER_FLAG_FRAME_END;
+        e->pts = s->next_pts;
+        entry_schedule(s, e, now, MMAL_TRUE);
+        s->next_pts = e->pts + s->frame_interval;
+        entry_commit(s, s->count);
+        if(!s->datagram)
+            s->stats.packets++;
+    }
+
+    memmove(s->au, s->au + length, s->au_length - length);
+    s->au_length -= length;
+    s->au_scan = 0;
+    s->au_vcl = MMAL_FALSE;
+    s->au_flags = 0;
+}
+
+static void bytestream_receive(struct mmal_player_stream* s, const uint8_t* data, size_t length, uint64_t now)
+{
+    size_t i;
+
+    if(s->au_length + length > s->au_alloc) {
+        size_t alloc = vcos_max(s->au_alloc * 2, s->au_length + length);
+        uint8_t* grown = realloc(s->au, alloc);
+
+        if(grown == NULL)
+            return;
+        s->au = grown;
+        s->au_alloc = alloc;
+    }
+    memcpy(s->au + s->au_length, data, length);
+    s->au_length += length;
+
+    // up to the NAL header and the byte after it, the rest waits for more data
+    for(i = s->au_scan; i + 4 < s->au_length; i++) {
+        uint8_t type;
+
+        if(s->au[i] != 0 || s->au[i + 1] != 0 || s->au[i + 2] != 1)
+            continue;
+
+        type = s->au[i + 3] & 0x1f;
+        if(s->au_vcl && mmal_player_h264_starts_access_unit(type, s->au[i + 4])) {
+            // a four byte start code belongs to the next access unit
+            size_t start = i > 0 && s->au[i - 1] == 0 ? i - 1 : i;
+
+            bytestream_emit(s, start, now);
+            i -= start;
+        }
+        if(type == 1 || type == 5)
+            s->au_vcl = MMAL_TRUE;
+        if(type == 5)
+            s->au_flags |= MMAL_BUFFER_HEADER_FLAG_KEYFRAME;
+        i += 2;
+    }
+    s->au_scan = i;
+
+    if(s->au_length > STREAM_AU_MAX)
+        bytestream_emit(s, s->au_length, now);
+}
+
+// Flushes what is left and queues the EOS
+static void bytestream_end(struct mmal_player_stream* s, uint64_t now)
+{
+    struct stream_entry* e;
+
+    if(s->au_length > 0)
+        bytestream_emit(s, s->au_length, now);
+
+    e = entry_next(s);
+    e->seq = s->au_count++;
+    e->flags = MMAL_BUFFER_HEADER_FLAG_EOS;
+    e->pts = s->next_pts;
+    e->arrival = now;
+    e->due = s->count > 0 ? vcos_max(entry(s, s->count - 1)->due, now) : now;
+    entry_commit(s, s->count);
+    s->eof = MMAL_TRUE;
+}
+
+/* receive thread */
+
+// Tells the pipeline about entries that fell due; returns how long until the next one does, -1 for none
+static int64_t stream_due(struct mmal_player_stream* s, uint64_t now, MMAL_BOOL_T* notify)
+{
+    uint32_t due;
+
+    // handed out in order, so only the leading ones count
+    for(due = 0; due < s->count && entry(s, due)->due <= now; due++)
+        ;
+    if(due > s->due_notified) {
+        s->due_notified = due;
+        *notify = MMAL_TRUE;
+    }
+    return due < s->count ? (int64_t)(entry(s, due)->due - now) : -1;
+}
+
+// A stream source faster than real time, a file piped in, is read no further ahead than the latency
+static MMAL_BOOL_T stream_has_room(struct mmal_player_stream* s, uint64_t now)
+{
+    return s->count == 0 || (s->count < s->options.capacity && entry(s, s->count - 1)->due <= now + s->latency);
+}
+
+static void stream_receive(struct mmal_player_stream* s)
+{
+    ssize_t length = read(s->fd, s->receive, STREAM_RECEIVE_SIZE);
+    uint64_t now = vcos_getmicrosecs64();
+
+    if(length < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if(length == 0 && s->datagram)
+        return;     // an empty datagram, not the end
+
+    vcos_mutex_lock(&s->lock);
+    if(length <= 0) {
+        if(length < 0)
+            fprintf(stderr, "stream: %s\n", strerror(errno));
+        // a socket error ends a datagram source without an EOS, like a sender that went away
+        if(s->datagram)
+            s->eof = MMAL_TRUE;
+        else
+            bytestream_end(s, now);
+    } else {
+        s->stats.bytes += length;
+        if(s->source == STREAM_RTP) {
+            s->stats.packets++;
+            rtp_receive(s, s->receive, length, now);
+        } else {
+            if(s->datagram)
+                s->stats.packets++;
+            bytestream_receive(s, s->receive, length, now);
+        }
+    }
+    vcos_mutex_unlock(&s->lock);
+}
+
+static void* stream_thread(void* user)
+{
+    struct mmal_player_stream* s = user;
+
+    while(1) {
+        struct pollfd fds[2] = {{s->wake[0], POLLIN, 0}, {s->fd, POLLIN, 0}};
+        struct timespec timeout;
+        MMAL_BOOL_T notify = MMAL_FALSE, reading;
+        int64_t wait;
+        char drain[16];
+
+        vcos_mutex_lock(&s->lock);
+        if(s->terminate) {
+            vcos_mutex_unlock(&s->lock);
+            break;
+        }
+        wait = stream_due(s, vcos_getmicrosecs64(), &notify);
+        reading = !s->eof && (s->datagram || stream_has_room(s, vcos_getmicrosecs64()));
+        s->waiting = !reading && !s->eof;
+        vcos_mutex_unlock(&s->lock);
+
+        if(notify)
+            s->notify(s->userdata);
+
+        timeout.tv_sec = wait / 1000000;
+        timeout.tv_nsec = (wait % 1000000) * 1000;
+        if(ppoll(fds, reading ? 2 : 1, wait >= 0 ? &timeout : NULL, NULL) < 0 && errno != EINTR) {
+            fprintf(stderr, "stream: poll: %s\n", strerror(errno));
+            break;
+        }
+
+        if(fds[0].revents & POLLIN)
+            while(read(s->wake[0], drain, sizeof(drain)) > 0)
+                ;
+        if(reading && (fds[1].revents & (POLLIN | POLLHUP | POLLERR)))
+            stream_receive(s);
+    }
+
+    return NULL;
+}
+
+/* sources */
+
+// "[ADDRESS]:PORT"; joins ADDRESS when it is a multicast group
+static int open_datagram(const char* spec)
+{
+    struct addrinfo hints, *address = NULL;
+    struct sockaddr_in bound;
+    char host[256];
+    const char* port = strrchr(spec, ':');
+    int size = STREAM_SOCKET_BUFFER;
+    int reuse = 1;
+    int fd = -1;
+
+    if(port == NULL || (size_t)(port - spec) >= sizeof(host))
+        return -1;
+    memcpy(host, spec, port - spec);
+    host[port - spec] = '\0';
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_PASSIVE;
+    if(getaddrinfo(host[0] != '\0' ? host : NULL, port + 1, &hints, &address) != 0)
+        return -1;
+
+    bound = *(struct sockaddr_in*)address->ai_addr;
+    freeaddrinfo(address);
+
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if(fd < 0)
+        return -1;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    if(IN_MULTICAST(ntohl(bound.sin_addr.s_addr))) {
+        struct ip_mreq group;
+
+        group.imr_multiaddr = bound.sin_addr;
+        group.imr_interface.s_addr = htonl(INADDR_ANY);
+        if(setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &group, sizeof(group)) != 0)
+            goto error;
+    }
+    if(bind(fd, (struct sockaddr*)&bound, sizeof(bound)) != 0)
+        goto error;
+
+    return fd;
+
+error:
+    close(fd);
+    return -1;
+}
+
+static int open_unix(const char* path)
+{
+    struct sockaddr_un address;
+    int fd;
+
+    if(strlen(path) >= sizeof(address.sun_path))
+        return -1;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+        return -1;
+    if(connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    return fd;
+}
+
+// Non-blocking, so opening a FIFO does not wait for its writer; poll() does
+static int open_pipe(const char* path)
+{
+    int fd;
+
+    if(strcmp(path, "-") == 0) {
+        fd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+        if(fd >= 0)
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        return fd;
+    }
+    return open(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+}
+
+struct mmal_player_stream* mmal_player_stream_open(const char* uri, const struct mmal_player_stream_options* options,
+                                                   void (*notify)(void*), void* userdata)
+{
+    struct mmal_player_stream* s;
+
+    if(!mmal_player_stream_is_uri(uri) || notify == NULL)
+        return NULL;
+
+    s = calloc(1, sizeof(struct mmal_player_stream));
+    if(s == NULL)
+        return NULL;
+    s->fd = s->wake[0] = s->wake[1] = -1;
+
+    if(options != NULL)
+        s->options = *options;
+    if(s->options.latency_ms == 0)
+        s->options.latency_ms = STREAM_LATENCY_MS;
+    if(s->options.fps == 0)
+        s->options.fps = STREAM_FPS;
+    if(s->options.capacity == 0)
+        s->options.capacity = STREAM_CAPACITY;
+    if(s->options.width == 0 || s->options.height == 0) {
+        s->options.width = STREAM_WIDTH;
+        s->options.height = STREAM_HEIGHT;
+    }
+    s->frame_interval = 1000000 / s->options.fps;
+    s->latency = (int64_t)s->options.latency_ms * 1000;
+    s->notify = notify;
+    s->userdata = userdata;
+
+    if(strncmp(uri, "rtp://", 6) == 0) {
+        s->source = STREAM_RTP;
+        s->datagram = MMAL_TRUE;
+        s->fd = open_datagram(uri + 6);
+    } else if(strncmp(uri, "udp://", 6) == 0) {
+        s->source = STREAM_UDP;
+        s->datagram = MMAL_TRUE;
+        s->fd = open_datagram(uri + 6);
+    } else if(strncmp(uri, "unix:", 5) == 0) {
+        s->source = STREAM_UNIX;
+        s->fd = open_unix(uri + 5);
+    } else {
+        s->source = STREAM_PIPE;
+        s->fd = open_pipe(uri + 5);
+    }
+    if(s->fd < 0) {
+        fprintf(stderr, "stream: unable to open %s: %s\n", uri, strerror(errno));
+        goto error;
+    }
+
+    s->entries = calloc(s->options.capacity, sizeof(struct stream_entry));
+    s->receive = malloc(STREAM_RECEIVE_SIZE);
+    if(s->entries == NULL || s->receive == NULL || pipe2(s->wake, O_CLOEXEC | O_NONBLOCK) != 0)
+        goto error;
+
+    vcos_mutex_create(&s->lock, "mmal_player:stream");
+    if(vcos_thread_create(&s->thread, "mmal-player:stream", NULL, stream_thread, s) != VCOS_SUCCESS) {
+        vcos_mutex_delete(&s->lock);
+        goto error;
+    }
+
+    return s;
+
+error:
+    if(s->fd >= 0)
+        close(s->fd);
+    if(s->wake[0] >= 0) {
+        close(s->wake[0]);
+        close(s->wake[1]);
+    }
+    free(s->entries);
+    free(s->receive);
+    free(s);
+    return NULL;
+}
+
+void mmal_player_stream_close(struct mmal_player_stream* s)
+{
+    void* ret = NULL;
+    uint32_t i;
+
+    if(s == NULL)
+        return;
+
+    vcos_mutex_lock(&s->lock);
+    s->terminate = 1;
+    vcos_mutex_unlock(&s->lock);
+    if(write(s->wake[1], "", 1) < 0)
+        fprintf(stderr, "stream: unable to wake the receive thread\n");
+    vcos_thread_join(&s->thread, &ret);
+
+    close(s->fd);
+    close(s->wake[0]);
+    close(s->wake[1]);
+    vcos_mutex_delete(&s->lock);
+
+    for(i = 0; i < s->options.capacity; i++)
+        free(s->entries[i].data);
+    free(s->entries);
+    free(s->au);
+    free(s->receive);
+    free(s);
+}
+
+void mmal_player_stream_format(struct mmal_player_stream* s, MMAL_ES_FORMAT_T* format)
+{
+    format->type = MMAL_ES_TYPE_VIDEO;
+    format->encoding = MMAL_ENCODING_H264;
+    format->encoding_variant = 0;
+    format->bitrate = 0;
+    // access units come whole, split over buffers only when they do not fit
+    format->flags = MMAL_ES_FORMAT_FLAG_FRAMED;
+    format->extradata_size = 0;
+
+    format->es->video.width = VCOS_ALIGN_UP(s->options.width, 32);
+    format->es->video.height = VCOS_ALIGN_UP(s->options.height, 16);
+    format->es->video.crop.x = format->es->video.crop.y = 0;
+    format->es->video.crop.width = s->options.width;
+    format->es->video.crop.height = s->options.height;
+    format->es->video.frame_rate.num = s->options.fps;
+    format->es->video.frame_rate.den = 1;
+}
+
+int64_t mmal_player_stream_frame_interval(struct mmal_player_stream* s)
+{
+    return s->frame_interval;
+}
+
+MMAL_BOOL_T mmal_player_stream_read(struct mmal_player_stream* s, MMAL_BUFFER_HEADER_T* buffer)
+{
+    uint64_t now = vcos_getmicrosecs64();
+    int64_t frame_pts = MMAL_TIME_UNKNOWN;
+    MMAL_BOOL_T wake;
+
+    buffer->offset = 0;
+    buffer->length = 0;
+    buffer->flags = 0;
+    buffer->pts = buffer->dts = MMAL_TIME_UNKNOWN;
+
+    vcos_mutex_lock(&s->lock);
+    while(s->count > 0) {
+        struct stream_entry* e = entry(s, 0);
+        uint32_t length, flags;
+
+        if(e->due > now)
+            break;
+        if(e->flags & MMAL_BUFFER_HEADER_FLAG_EOS) {
+            if(buffer->length == 0) {
+                buffer->flags |= MMAL_BUFFER_HEADER_FLAG_EOS;
+                entry_pop(s, now);
+            }
+            break;
+        }
+        // RTP packets of one frame share a buffer, frames do not
+        if(buffer->length > 0 && e->pts != frame_pts)
+            break;
+
+        length = vcos_min(e->length - e->offset, buffer->alloc_size - buffer->length);
+        if(length == 0)
+            break;
+        if(buffer->length == 0) {
+            frame_pts = e->pts;
+            if(e->offset == 0)
+                buffer->pts = e->pts;
+        }
+        memcpy(buffer->data + buffer->length, e->data + e->offset, length);
+        buffer->length += length;
+        e->offset += length;
+        buffer->flags |= e->flags & MMAL_BUFFER_HEADER_FLAG_KEYFRAME;
+        if(e->offset < e->length)
+            break;
+
+        flags = e->flags;
+        entry_pop(s, now);
+        if(flags & MMAL_BUFFER_HEADER_FLAG_FRAME_END) {
+            buffer->flags |= MMAL_BUFFER_HEADER_FLAG_FRAME_END;
+            break;
+        }
+    }
+    wake = s->waiting && stream_has_room(s, now);
+    if(wake)
+        s->waiting = MMAL_FALSE;
+    vcos_mutex_unlock(&s->lock);
+
+    if(wake && write(s->wake[1], "", 1) < 0)
+        fprintf(stderr, "stream: unable to wake the receive thread\n");
+
+    return buffer->length > 0 || (buffer->flags & MMAL_BUFFER_HEADER_FLAG_EOS);
+}
+
+void mmal_player_stream_get_stats(struct mmal_player_stream* s, struct mmal_player_stream_stats* stats)
+{
+    vcos_mutex_lock(&s->lock);
+    *stats = s->stats;
+    stats->depth = s->count;
+    stats->depth_us = s->count > 1 ? entry(s, s->count - 1)->pts - entry(s, 0)->pts : 0;
+    vcos_mutex_unlock(&s->lock);
+}
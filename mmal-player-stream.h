@@ -0,0 +1,70 @@
+#ifndef MMAL_CHAIN_PLAYER_MMAL_PLAYER_STREAM_H
+#define MMAL_CHAIN_PLAYER_MMAL_PLAYER_STREAM_H
+
+#include <stdint.h>
+
+#include "interface/mmal/mmal.h"
+
+#include "mmal-player-metrics.h"
+
+// Live H.264 elementary streams fed to the decoder without a container reader. A receive thread
+// reads the source into a bounded jitter buffer; the pipeline takes each frame out once it has
+// been held for the target latency, so network jitter turns into a fixed delay.
+//
+//   rtp://[ADDRESS]:PORT   RTP (RFC 6184: single NAL units, STAP-A, FU-A), PTS from the RTP timestamps
+//   udp://[ADDRESS]:PORT   Annex B byte stream in datagrams
+//   unix:PATH              ... from a stream socket another process listens on
+//   pipe:PATH              ... from a FIFO, "pipe:-" for stdin
+//
+// ADDRESS is the local one to bind, or a multicast group to join. Byte streams carry no
+// timestamps: they are cut into access units and given PTS at the configured frame rate, moved
+// forward whenever the source falls behind it. Datagram sources drop their oldest frames when the
+// buffer is full, stream sources are simply not read until there is room again.
+struct mmal_player_stream;
+
+// 0 takes the default
+struct mmal_player_stream_options
+{
+    uint32_t latency_ms;    // how long a frame is held before the decoder gets it
+    uint32_t fps;           // frame rate of the source
+    uint32_t capacity;      // packets (RTP) or access units (byte streams) held at most
+    uint32_t width;         // expected picture size, the decoder follows the stream's own
+    uint32_t height;
+};
+
+struct mmal_player_stream_stats
+{
+    uint32_t depth;             // waiting in the jitter buffer
+    int64_t depth_us;           // ... PTS span they cover
+    uint32_t depth_max;
+    uint64_t packets;           // datagrams or access units received
+    uint64_t bytes;
+    uint32_t late;              // dropped, arrived after what followed them went to the decoder
+    uint32_t overflow;          // dropped, the buffer was full
+    uint32_t lost;              // RTP sequence numbers never received
+    uint32_t rebases;           // the source fell more than the latency behind, the delay was reset
+    struct mmal_player_timing hold;     // arrival until handed to the decoder, us
+};
+
+MMAL_BOOL_T mmal_player_stream_is_uri(const char* uri);
+
+// `notify` is called from the receive thread whenever a frame becomes due
+struct mmal_player_stream* mmal_player_stream_open(const char* uri, const struct mmal_player_stream_options* options,
+                                                   void (*notify)(void*), void* userdata);
+void mmal_player_stream_close(struct mmal_player_stream* stream);
+
+// The format the decoder input has to be committed with
+void mmal_player_stream_format(struct mmal_player_stream* stream, MMAL_ES_FORMAT_T* format);
+int64_t mmal_player_stream_frame_interval(struct mmal_player_stream* stream);
+
+// Fills `buffer` with what is due of the next frame; FALSE when nothing is. A frame larger than
+// the buffer takes several, FRAME_END marks the last one; the end of a byte stream comes as EOS.
+MMAL_BOOL_T mmal_player_stream_read(struct mmal_player_stream* stream, MMAL_BUFFER_HEADER_T* buffer);
+
+void mmal_player_stream_get_stats(struct mmal_player_stream* stream, struct mmal_player_stream_stats* stats);
+
+// Whether a NAL unit of `type`, followed by the byte `next`, opens a new access unit once the
+// current one has a slice; splits Annex B byte streams into frames
+MMAL_BOOL_T mmal_player_h264_starts_access_unit(uint8_t type, uint8_t next);
+
+#endif //MMAL_CHAIN_PLAYER_MMAL_PLAYER_STREAM_H
@@ -0,0 +1,365 @@
+#include "mmal-player-sync.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "interface/vcos/vcos.h"
+
+#include "mmal-player-pipeline.h"
+
+#define SYNC_MAGIC              0x6d706c73u
+#define SYNC_START_MARGIN_US    10000   // from the master's clip start to the first frame, for followers to get woken
+#define SYNC_POKE_US            50000   // wakes attached pipelines at least this often for drift checks
+#define SYNC_READ_TRIES         100     // a master write takes a few stores; one that never ends died halfway
+
+// Lives in shared memory when the group is named: vcos_getmicrosecs64() runs on CLOCK_MONOTONIC,
+// which every process on the host shares. Only the master writes, under `seq`.
+struct sync_shared
+{
+    uint32_t magic;
+    uint32_t generation;        // futex word, bumped at every clip start of the master
+    uint32_t seq;               // odd while the fields below are written
+    int32_t master_pid;         // 0: no master
+    uint64_t epoch;             // vcos_getmicrosecs64() at which clip `generation` starts
+    int64_t frame_interval;     // ... and its frame duration, the grid for the next start
+    uint64_t anchor_time;       // the master's clock read anchor_position at anchor_time
+    int64_t anchor_position;
+};
+
+struct mmal_player_sync_member
+{
+    struct mmal_player_sync* sync;
+    struct mmal_player_sync_member* next;
+    MMAL_BOOL_T master;
+    uint32_t generation;                    // last group clip one of its pipelines started
+    struct mmal_player_pipeline* pipeline;  // woken by the watcher, NULL between pipelines
+};
+
+struct mmal_player_sync
+{
+    struct sync_shared* shared;
+    MMAL_BOOL_T mapped;         // shared memory, otherwise allocated for this process
+
+    VCOS_THREAD_T watcher;
+    VCOS_MUTEX_T lock;          // guards the member list and the master's writes
+    struct mmal_player_sync_member* members;
+    int terminate;
+
+    struct mmal_player_sync_stats stats;
+};
+
+static void futex_wait(uint32_t* word, uint32_t value, uint64_t timeout_us)
+{
+    struct timespec timeout = {(time_t)(timeout_us / 1000000), (long)(timeout_us % 1000000) * 1000};
+
+    syscall(SYS_futex, word, FUTEX_WAIT, value, &timeout, NULL, 0);
+}
+
+static void futex_wake(uint32_t* word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// Wakes on every clip start of the master, at the start time of a clip, and every SYNC_POKE_US
+static void* sync_watcher(void* arg)
+{
+    struct mmal_player_sync* sync = arg;
+    struct sync_shared* shared = sync->shared;
+    struct mmal_player_sync_member* member;
+    uint32_t seen = __atomic_load_n(&shared->generation, __ATOMIC_ACQUIRE);
+
+    while(!__atomic_load_n(&sync->terminate, __ATOMIC_ACQUIRE)) {
+        uint64_t now = vcos_getmicrosecs64();
+        uint64_t epoch = __atomic_load_n(&shared->epoch, __ATOMIC_RELAXED);
+        uint64_t timeout = SYNC_POKE_US;
+
+        if(epoch > now && epoch - now < timeout)
+            timeout = epoch - now;
+        futex_wait(&shared->generation, seen, timeout);
+        seen = __atomic_load_n(&shared->generation, __ATOMIC_ACQUIRE);
+
+        vcos_mutex_lock(&sync->lock);
+        for(member = sync->members; member != NULL; member = member->next) {
+            if(member->pipeline != NULL) {
+                mmal_player_pipeline_poke(member->pipeline);
+                sync->stats.pokes++;
+            }
+        }
+        vcos_mutex_unlock(&sync->lock);
+    }
+
+    return NULL;
+}
+
+struct mmal_player_sync* mmal_player_sync_open(const char* name)
+{
+    struct mmal_player_sync* sync;
+    uint32_t magic = 0;
+
+    sync = calloc(1, sizeof(struct mmal_player_sync));
+    if(sync == NULL)
+        return NULL;
+
+    if(name == NULL) {
+        sync->shared = calloc(1, sizeof(struct sync_shared));
+        if(sync->shared == NULL)
+            goto error;
+        sync->shared->magic = SYNC_MAGIC;
+    } else {
+        char path[NAME_MAX];
+        struct stat st;
+        void* map;
+        int fd;
+
+        // shm_open() wants exactly one leading slash
+        snprintf(path, sizeof(path), "/%s", name[0] == '/' ? name + 1 : name);
+        fd = shm_open(path, O_RDWR | O_CREAT, 0644);
+        if(fd < 0) {
+            perror(path);
+            goto error;
+        }
+        // a fresh segment reads as zeroes: no master, generation 0
+        if(fstat(fd, &st) != 0 || (st.st_size < (off_t)sizeof(struct sync_shared) &&
+                                   ftruncate(fd, sizeof(struct sync_shared)) != 0)) {
+            perror(path);
+            close(fd);
+            goto error;
+        }
+        map = mmap(NULL, sizeof(struct sync_shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if(map == MAP_FAILED) {
+            perror(path);
+            goto error;
+        }
+        sync->shared = map;
+        sync->mapped = MMAL_TRUE;
+
+        if(!__atomic_compare_exchange_n(&sync->shared->magic, &magic, SYNC_MAGIC, MMAL_FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) &&
+           magic != SYNC_MAGIC) {
+            fprintf(stderr, "%s is not a sync group\n", path);
+            goto error;
+        }
+    }
+
+    vcos_mutex_create(&sync->lock, "mmal_player_sync:lock");
+    if(vcos_thread_create(&sync->watcher, "mmal_player_sync:watcher", NULL, sync_watcher, sync) != VCOS_SUCCESS) {
+        vcos_mutex_delete(&sync->lock);
+        goto error;
+    }
+
+    return sync;
+
+error:
+    if(sync->mapped)
+        munmap(sync->shared, sizeof(struct sync_shared));
+    else
+        free(sync->shared);
+    free(sync);
+    return NULL;
+}
+
+void mmal_player_sync_close(struct mmal_player_sync* sync)
+{
+    void* ret = NULL;
+
+    if(sync == NULL)
+        return;
+
+    __atomic_store_n(&sync->terminate, 1, __ATOMIC_RELEASE);
+    // spurious for the watchers of other processes, they go back to sleep
+    futex_wake(&sync->shared->generation);
+    vcos_thread_join(&sync->watcher, &ret);
+    vcos_mutex_delete(&sync->lock);
+
+    if(sync->mapped)
+        munmap(sync->shared, sizeof(struct sync_shared));
+    else
+        free(sync->shared);
+    free(sync);
+}
+
+// with sync->lock held, master only
+static void write_begin(struct sync_shared* shared)
+{
+    __atomic_store_n(&shared->seq, shared->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void write_end(struct sync_shared* shared)
+{
+    __atomic_store_n(&shared->seq, shared->seq + 1, __ATOMIC_RELEASE);
+}
+
+struct mmal_player_sync_member* mmal_player_sync_join(struct mmal_player_sync* sync, MMAL_BOOL_T master)
+{
+    struct mmal_player_sync_member* member;
+    int32_t pid = getpid(), holder = 0;
+
+    if(master && !__atomic_compare_exchange_n(&sync->shared->master_pid, &holder, pid, MMAL_FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        // left behind by a master that died without leaving
+        if(holder == pid || kill(holder, 0) == 0 ||
+           !__atomic_compare_exchange_n(&sync->shared->master_pid, &holder, pid, MMAL_FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            fprintf(stderr, "the sync group already has a master, process %d\n", holder);
+            return NULL;
+        }
+    }
+
+    member = calloc(1, sizeof(struct mmal_player_sync_member));
+    if(member == NULL) {
+        if(master)
+            __atomic_store_n(&sync->shared->master_pid, 0, __ATOMIC_RELEASE);
+        return NULL;
+    }
+    member->sync = sync;
+    member->master = master;
+
+    vcos_mutex_lock(&sync->lock);
+    // a master that died between write_begin() and write_end() left `seq` odd
+    if(master && (sync->shared->seq & 1))
+        write_end(sync->shared);
+    member->next = sync->members;
+    sync->members = member;
+    sync->stats.members++;
+    vcos_mutex_unlock(&sync->lock);
+
+    return member;
+}
+
+void mmal_player_sync_leave(struct mmal_player_sync_member* member)
+{
+    struct mmal_player_sync* sync;
+    struct mmal_player_sync_member** link;
+
+    if(member == NULL)
+        return;
+
+    sync = member->sync;
+    vcos_mutex_lock(&sync->lock);
+    for(link = &sync->members; *link != NULL; link = &(*link)->next) {
+        if(*link == member) {
+            *link = member->next;
+            break;
+        }
+    }
+    sync->stats.members--;
+    vcos_mutex_unlock(&sync->lock);
+
+    if(member->master)
+        __atomic_store_n(&sync->shared->master_pid, 0, __ATOMIC_RELEASE);
+    free(member);
+}
+
+void mmal_player_sync_get_stats(struct mmal_player_sync* sync, struct mmal_player_sync_stats* stats)
+{
+    vcos_mutex_lock(&sync->lock);
+    *stats = sync->stats;
+    vcos_mutex_unlock(&sync->lock);
+    stats->generation = __atomic_load_n(&sync->shared->generation, __ATOMIC_ACQUIRE);
+}
+
+void mmal_player_sync_attach(struct mmal_player_sync_member* member, struct mmal_player_pipeline* pipeline)
+{
+    vcos_mutex_lock(&member->sync->lock);
+    member->pipeline = pipeline;
+    vcos_mutex_unlock(&member->sync->lock);
+}
+
+void mmal_player_sync_detach(struct mmal_player_sync_member* member, struct mmal_player_pipeline* pipeline)
+{
+    vcos_mutex_lock(&member->sync->lock);
+    if(member->pipeline == pipeline)
+        member->pipeline = NULL;
+    vcos_mutex_unlock(&member->sync->lock);
+}
+
+uint32_t mmal_player_sync_begin(struct mmal_player_sync_member* member, uint64_t now, int64_t frame_interval)
+{
+    struct sync_shared* shared = member->sync->shared;
+    uint32_t generation;
+
+    vcos_mutex_lock(&member->sync->lock);
+    if(member->master) {
+        uint64_t epoch = now + SYNC_START_MARGIN_US;
+        int64_t interval = shared->frame_interval;
+
+        // on the frame grid of the clip before, where the outputs present now
+        if(shared->generation > 0 && interval > 0 && shared->epoch < epoch)
+            epoch += (interval - (int64_t)((epoch - shared->epoch) % interval)) % interval;
+
+        generation = shared->generation + 1;
+        write_begin(shared);
+        __atomic_store_n(&shared->epoch, epoch, __ATOMIC_RELAXED);
+        __atomic_store_n(&shared->frame_interval, frame_interval, __ATOMIC_RELAXED);
+        __atomic_store_n(&shared->anchor_time, epoch, __ATOMIC_RELAXED);
+        __atomic_store_n(&shared->anchor_position, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&shared->generation, generation, __ATOMIC_RELAXED);
+        write_end(shared);
+
+        member->generation = generation;
+        futex_wake(&shared->generation);
+    } else {
+        generation = __atomic_load_n(&shared->generation, __ATOMIC_ACQUIRE);
+        if(generation != member->generation)
+            member->generation = generation;
+        else
+            generation = 0;
+    }
+    vcos_mutex_unlock(&member->sync->lock);
+
+    return generation;
+}
+
+MMAL_BOOL_T mmal_player_sync_position(struct mmal_player_sync_member* member, uint32_t generation, uint64_t now, int64_t* position)
+{
+    struct sync_shared* shared = member->sync->shared;
+    uint32_t seq, current, tries = 0;
+    uint64_t anchor_time;
+    int64_t anchor_position;
+
+    do {
+        // no position then: the clip is held, or runs free until the next check
+        if(tries++ == SYNC_READ_TRIES)
+            return MMAL_FALSE;
+        if((seq = __atomic_load_n(&shared->seq, __ATOMIC_ACQUIRE)) & 1)
+            continue;
+        current = __atomic_load_n(&shared->generation, __ATOMIC_RELAXED);
+        anchor_time = __atomic_load_n(&shared->anchor_time, __ATOMIC_RELAXED);
+        anchor_position = __atomic_load_n(&shared->anchor_position, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while((seq & 1) || __atomic_load_n(&shared->seq, __ATOMIC_RELAXED) != seq);
+
+    if(current != generation)
+        return MMAL_FALSE;
+
+    *position = anchor_position + ((int64_t)now - (int64_t)anchor_time);
+    return MMAL_TRUE;
+}
+
+MMAL_BOOL_T mmal_player_sync_publish(struct mmal_player_sync_member* member, uint32_t generation, uint64_t now, int64_t position)
+{
+    struct sync_shared* shared = member->sync->shared;
+
+    if(!member->master)
+        return MMAL_FALSE;
+
+    vcos_mutex_lock(&member->sync->lock);
+    if(shared->generation == generation) {
+        write_begin(shared);
+        __atomic_store_n(&shared->anchor_time, now, __ATOMIC_RELAXED);
+        __atomic_store_n(&shared->anchor_position, position, __ATOMIC_RELAXED);
+        write_end(shared);
+    }
+    vcos_mutex_unlock(&member->sync->lock);
+
+    return MMAL_TRUE;
+}
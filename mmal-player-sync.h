@@ -0,0 +1,53 @@
+#ifndef MMAL_CHAIN_PLAYER_MMAL_PLAYER_SYNC_H
+#define MMAL_CHAIN_PLAYER_MMAL_PLAYER_SYNC_H
+
+#include <stdint.h>
+
+#include "interface/mmal/mmal.h"
+
+// Keeps pipelines on one media timeline, within a process or across processes on one host.
+// The master member publishes when each of its clips starts and where its clock is; every
+// other member holds its scheduler clock until the same start time, then follows the master
+// by slewing its clock rate, or by jumping when it is more than a frame off. Clip and loop
+// starts are placed on the frame grid of the clip before, so all outputs switch together.
+struct mmal_player_sync;
+// One window's place in the group; successive pipelines of the window share it
+struct mmal_player_sync_member;
+struct mmal_player_pipeline;
+
+struct mmal_player_sync_stats
+{
+    uint32_t generation;    // clips the master has started
+    uint32_t members;       // joined in this process
+    uint32_t pokes;         // held or playing pipelines woken by the watcher
+};
+
+// `name` NULL: a group for this process only, otherwise shared memory that every process
+// opening the same name joins
+struct mmal_player_sync* mmal_player_sync_open(const char* name);
+// Every member must have left
+void mmal_player_sync_close(struct mmal_player_sync* sync);
+
+// At most one master per group, across processes
+struct mmal_player_sync_member* mmal_player_sync_join(struct mmal_player_sync* sync, MMAL_BOOL_T master);
+// No pipeline using `member` may be left
+void mmal_player_sync_leave(struct mmal_player_sync_member* member);
+
+void mmal_player_sync_get_stats(struct mmal_player_sync* sync, struct mmal_player_sync_stats* stats);
+
+// Used by mmal-player-pipeline.c.
+// attach makes `pipeline` the one the watcher wakes for `member`; detach forgets it if it still is.
+void mmal_player_sync_attach(struct mmal_player_sync_member* member, struct mmal_player_pipeline* pipeline);
+void mmal_player_sync_detach(struct mmal_player_sync_member* member, struct mmal_player_pipeline* pipeline);
+// The group clip a held pipeline starts with, 0 to keep holding: the master opens a new one
+// starting on the frame grid after `now`, others take the master's clip once it is newer than
+// the last they started
+uint32_t mmal_player_sync_begin(struct mmal_player_sync_member* member, uint64_t now, int64_t frame_interval);
+// Where the master's clock is in clip `generation` at `now`, relative to the clip's first PTS;
+// negative before the clip starts. FALSE once the master moved on to another clip, or while a
+// write of the master does not end, as when it died halfway.
+MMAL_BOOL_T mmal_player_sync_position(struct mmal_player_sync_member* member, uint32_t generation, uint64_t now, int64_t* position);
+// Master only, FALSE for the others: its clock read `position` at `now`
+MMAL_BOOL_T mmal_player_sync_publish(struct mmal_player_sync_member* member, uint32_t generation, uint64_t now, int64_t position);
+
+#endif //MMAL_CHAIN_PLAYER_MMAL_PLAYER_SYNC_H
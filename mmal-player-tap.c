@@ -0,0 +1,350 @@
+#include "mmal-player-tap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "interface/vcos/vcos.h"
+
+#define TAP_HELD_MAX            16
+#define TAP_WORKERS_MAX         8
+#define TAP_PIPELINES_MAX       32      // rate limited apart, the least recently tapped gives way
+#define TAP_DEFAULT_HELD        2
+#define TAP_DEFAULT_WORKERS     1
+#define TAP_DEFAULT_BATCH_MS    100
+#define TAP_IDLE_WAIT_MS        1000
+
+enum {
+    SLOT_FREE = 0,
+    SLOT_QUEUED,            // taken, waiting for a worker
+    SLOT_WORKING,           // with a callback, until its buffer is released
+};
+
+struct tap_slot
+{
+    int state;
+    MMAL_BUFFER_HEADER_T* buffer;   // referenced while not free
+    struct mmal_player_tap_frame frame;
+    uint64_t taken;                 // vcos_getmicrosecs64()
+};
+
+struct tap_rate
+{
+    struct mmal_player_pipeline* pipeline;
+    uint64_t next_take;         // vcos_getmicrosecs64()
+};
+
+struct mmal_player_tap
+{
+    struct mmal_player_tap_options options;
+    uint64_t min_interval;      // us between frames taken from a pipeline
+    uint64_t batch_wait;        // us
+
+    VCOS_MUTEX_T lock;          // slots, counters and stats
+    struct tap_slot slots[TAP_HELD_MAX];
+    uint32_t held;
+    uint32_t queued;
+    uint32_t sequence;
+    struct mmal_player_tap_stats stats;
+    struct tap_rate rates[TAP_PIPELINES_MAX];
+    uint32_t release_waiters;   // releases waiting for a worker to free a slot
+
+    VCOS_SEMAPHORE_T wake;      // a frame taken, or stop
+    VCOS_SEMAPHORE_T freed;     // posted once per release waiter when a worker frees slots
+    VCOS_THREAD_T threads[TAP_WORKERS_MAX];
+    uint32_t workers;
+    MMAL_BOOL_T stop;
+};
+
+// with tap->lock held: the oldest queued slot, NULL for none
+static struct tap_slot* oldest_queued(struct mmal_player_tap* tap)
+{
+    struct tap_slot* oldest = NULL;
+    uint32_t i;
+
+    for(i = 0; i < tap->options.max_held; i++) {
+        struct tap_slot* slot = &tap->slots[i];
+
+        if(slot->state == SLOT_QUEUED && (oldest == NULL || (int32_t)(slot->frame.sequence - oldest->frame.sequence) < 0))
+            oldest = slot;
+    }
+    return oldest;
+}
+
+// with tap->lock held: a worker is still looking at one of the frames of `pipeline`
+static MMAL_BOOL_T working_for(struct mmal_player_tap* tap, struct mmal_player_pipeline* pipeline)
+{
+    uint32_t i;
+
+    for(i = 0; i < tap->options.max_held; i++) {
+        if(tap->slots[i].state == SLOT_WORKING && tap->slots[i].frame.pipeline == pipeline)
+            return MMAL_TRUE;
+    }
+    return MMAL_FALSE;
+}
+
+// with tap->lock held: where `pipeline` stands with max_fps
+static struct tap_rate* rate_of(struct mmal_player_tap* tap, struct mmal_player_pipeline* pipeline)
+{
+    struct tap_rate* rate = &tap->rates[0];
+    uint32_t i;
+
+    for(i = 0; i < TAP_PIPELINES_MAX; i++) {
+        if(tap->rates[i].pipeline == pipeline)
+            return &tap->rates[i];
+        if(tap->rates[i].next_take < rate->next_take)
+            rate = &tap->rates[i];
+    }
+    rate->pipeline = pipeline;
+    rate->next_take = 0;
+    return rate;
+}
+
+// with tap->lock held: a full batch, or what is there once the oldest frame waited long enough;
+// otherwise 0 and how long to wait for that
+static uint32_t take_batch(struct mmal_player_tap* tap, uint64_t now, struct tap_slot** batch, uint64_t* wait_us)
+{
+    struct tap_slot* slot = oldest_queued(tap);
+    uint32_t count = 0;
+
+    if(slot == NULL)
+        return 0;
+    if(tap->queued < tap->options.batch && now < slot->taken + tap->batch_wait && !tap->stop) {
+        *wait_us = vcos_min(*wait_us, slot->taken + tap->batch_wait - now);
+        return 0;
+    }
+
+    while(count < tap->options.batch && (slot = oldest_queued(tap)) != NULL) {
+        slot->state = SLOT_WORKING;
+        tap->queued--;
+        batch[count++] = slot;
+    }
+    return count;
+}
+
+static void* tap_worker(void* user)
+{
+    struct mmal_player_tap* tap = user;
+    struct tap_slot* batch[TAP_HELD_MAX];
+    struct mmal_player_tap_frame frames[TAP_HELD_MAX];
+    uint64_t started, cost, now;
+    uint32_t count, i;
+
+    vcos_mutex_lock(&tap->lock);
+    while(!tap->stop || tap->queued > 0) {
+        uint64_t wait_us = (uint64_t)TAP_IDLE_WAIT_MS * 1000;
+
+        now = vcos_getmicrosecs64();
+        count = take_batch(tap, now, batch, &wait_us);
+        if(count == 0) {
+            vcos_mutex_unlock(&tap->lock);
+            vcos_semaphore_wait_timeout(&tap->wake, (uint32_t)((wait_us + 999) / 1000));
+            vcos_mutex_lock(&tap->lock);
+            continue;
+        }
+        for(i = 0; i < count; i++)
+            frames[i] = batch[i]->frame;
+        vcos_mutex_unlock(&tap->lock);
+
+        started = vcos_getmicrosecs64();
+        tap->options.callback(frames, count, tap->options.user);
+        now = vcos_getmicrosecs64();
+        cost = (now - started) / count;
+
+        // back to the decoder before the slot is free, so a release waits for this too
+        for(i = 0; i < count; i++)
+            mmal_buffer_header_release(batch[i]->buffer);
+
+        vcos_mutex_lock(&tap->lock);
+        for(i = 0; i < count; i++) {
+            mmal_player_timing_add(&tap->stats.cost, cost);
+            mmal_player_timing_add(&tap->stats.hold, now - batch[i]->taken);
+            batch[i]->buffer = NULL;
+            batch[i]->state = SLOT_FREE;
+            tap->held--;
+        }
+        tap->stats.batches++;
+        for(; tap->release_waiters > 0; tap->release_waiters--)
+            vcos_semaphore_post(&tap->freed);
+    }
+    vcos_mutex_unlock(&tap->lock);
+
+    return NULL;
+}
+
+void mmal_player_tap_options_init(struct mmal_player_tap_options* options)
+{
+    memset(options, 0, sizeof(struct mmal_player_tap_options));
+}
+
+struct mmal_player_tap* mmal_player_tap_create(const struct mmal_player_tap_options* options)
+{
+    struct mmal_player_tap* tap;
+    uint32_t i;
+
+    if(options->callback == NULL) {
+        fprintf(stderr, "tap: a callback is needed\n");
+        return NULL;
+    }
+
+    tap = calloc(1, sizeof(struct mmal_player_tap));
+    if(tap == NULL)
+        return NULL;
+
+    tap->options = *options;
+    if(tap->options.max_held == 0)
+        tap->options.max_held = TAP_DEFAULT_HELD;
+    tap->options.max_held = vcos_min(tap->options.max_held, TAP_HELD_MAX);
+    if(tap->options.workers == 0)
+        tap->options.workers = TAP_DEFAULT_WORKERS;
+    tap->options.workers = vcos_min(tap->options.workers, TAP_WORKERS_MAX);
+    tap->options.batch = vcos_min(vcos_max(tap->options.batch, 1), tap->options.max_held);
+    tap->batch_wait = (uint64_t)(tap->options.batch_ms > 0 ? tap->options.batch_ms : TAP_DEFAULT_BATCH_MS) * 1000;
+    tap->min_interval = tap->options.max_fps > 0 ? 1000000 / tap->options.max_fps : 0;
+
+    vcos_mutex_create(&tap->lock, "mmal_player:tap.lock");
+    vcos_semaphore_create(&tap->wake, "mmal_player:tap.wake", 0);
+    vcos_semaphore_create(&tap->freed, "mmal_player:tap.freed", 0);
+
+    for(i = 0; i < tap->options.workers; i++) {
+        if(vcos_thread_create(&tap->threads[i], "mmal-player:tap", NULL, tap_worker, tap) != VCOS_SUCCESS) {
+            fprintf(stderr, "tap: unable to start worker %u\n", i);
+            break;
+        }
+        tap->workers++;
+    }
+    if(tap->workers == 0) {
+        mmal_player_tap_destroy(tap);
+        return NULL;
+    }
+
+    return tap;
+}
+
+void mmal_player_tap_destroy(struct mmal_player_tap* tap)
+{
+    void* ret = NULL;
+    uint32_t i;
+
+    if(tap == NULL)
+        return;
+
+    vcos_mutex_lock(&tap->lock);
+    tap->stop = MMAL_TRUE;
+    vcos_mutex_unlock(&tap->lock);
+
+    for(i = 0; i < tap->workers; i++)
+        vcos_semaphore_post(&tap->wake);
+    for(i = 0; i < tap->workers; i++)
+        vcos_thread_join(&tap->threads[i], &ret);
+
+    vcos_semaphore_delete(&tap->freed);
+    vcos_semaphore_delete(&tap->wake);
+    vcos_mutex_delete(&tap->lock);
+    free(tap);
+}
+
+void mmal_player_tap_get_stats(struct mmal_player_tap* tap, struct mmal_player_tap_stats* stats)
+{
+    vcos_mutex_lock(&tap->lock);
+    *stats = tap->stats;
+    vcos_mutex_unlock(&tap->lock);
+}
+
+uint32_t mmal_player_tap_buffers(struct mmal_player_tap* tap)
+{
+    return tap->options.max_held;
+}
+
+// On the pipeline thread, between decoder and scheduler: never waits for a worker
+void mmal_player_tap_offer(struct mmal_player_tap* tap, struct mmal_player_pipeline* pipeline,
+                           MMAL_PORT_T* port, MMAL_BUFFER_HEADER_T* buffer)
+{
+    struct tap_slot* slot = NULL;
+    struct tap_rate* rate;
+    uint64_t now;
+    uint32_t i;
+
+    if(buffer->cmd != 0 || buffer->length == 0)
+        return;
+
+    now = vcos_getmicrosecs64();
+    vcos_mutex_lock(&tap->lock);
+    tap->stats.offered++;
+    rate = rate_of(tap, pipeline);
+    if(now < rate->next_take) {
+        tap->stats.skipped_rate++;
+        vcos_mutex_unlock(&tap->lock);
+        return;
+    }
+    for(i = 0; i < tap->options.max_held && slot == NULL; i++)
+        if(tap->slots[i].state == SLOT_FREE)
+            slot = &tap->slots[i];
+    if(slot == NULL) {
+        tap->stats.skipped_busy++;
+        vcos_mutex_unlock(&tap->lock);
+        return;
+    }
+
+    // a frame late by more than an interval does not earn the next one early
+    rate->next_take = rate->next_take + 2 * tap->min_interval > now ? rate->next_take + tap->min_interval : now + tap->min_interval;
+
+    mmal_buffer_header_acquire(buffer);
+    slot->buffer = buffer;
+    slot->taken = now;
+    slot->frame.pipeline = pipeline;
+    slot->frame.data = buffer->data + buffer->offset;
+    slot->frame.length = buffer->length;
+    slot->frame.encoding = port->format->encoding;
+    slot->frame.width = port->format->es->video.width;
+    slot->frame.height = port->format->es->video.height;
+    slot->frame.crop = port->format->es->video.crop;
+    slot->frame.pts = buffer->pts;
+    slot->frame.flags = buffer->flags;
+    slot->frame.sequence = tap->sequence++;
+    slot->state = SLOT_QUEUED;
+
+    tap->queued++;
+    tap->held++;
+    tap->stats.tapped++;
+    tap->stats.held_max = vcos_max(tap->stats.held_max, tap->held);
+    vcos_mutex_unlock(&tap->lock);
+
+    vcos_semaphore_post(&tap->wake);
+}
+
+void mmal_player_tap_release(struct mmal_player_tap* tap, struct mmal_player_pipeline* pipeline)
+{
+    MMAL_BUFFER_HEADER_T* dropped[TAP_HELD_MAX];
+    uint32_t count = 0, i;
+
+    vcos_mutex_lock(&tap->lock);
+    for(i = 0; i < tap->options.max_held; i++) {
+        struct tap_slot* slot = &tap->slots[i];
+
+        if(slot->state != SLOT_QUEUED || slot->frame.pipeline != pipeline)
+            continue;
+        dropped[count++] = slot->buffer;
+        slot->buffer = NULL;
+        slot->state = SLOT_FREE;
+        tap->queued--;
+        tap->held--;
+        tap->stats.dropped++;
+    }
+    for(i = 0; i < TAP_PIPELINES_MAX; i++) {
+        if(tap->rates[i].pipeline == pipeline)
+            memset(&tap->rates[i], 0, sizeof(tap->rates[i]));
+    }
+
+    while(working_for(tap, pipeline)) {
+        // counted under the lock, so the worker freeing the slot cannot miss it
+        tap->release_waiters++;
+        vcos_mutex_unlock(&tap->lock);
+        vcos_semaphore_wait(&tap->freed);
+        vcos_mutex_lock(&tap->lock);
+    }
+    vcos_mutex_unlock(&tap->lock);
+
+    for(i = 0; i < count; i++)
+        mmal_buffer_header_release(dropped[i]);
+}
@@ -0,0 +1,77 @@
+#ifndef MMAL_CHAIN_PLAYER_MMAL_PLAYER_TAP_H
+#define MMAL_CHAIN_PLAYER_MMAL_PLAYER_TAP_H
+
+#include <stdint.h>
+
+#include "interface/mmal/mmal.h"
+
+#include "mmal-player-metrics.h"
+
+// Decoded frames for the application: thumbnails, black or frozen picture checks, proof-of-play
+// checksums. A pipeline with a tap (mmal_player_options.tap) connects decoder and scheduler
+// without tunnelling, over zero copy buffers, and offers the tap each frame on its way to the
+// scheduler. Up to max_fps a second of each pipeline are taken by reference, not copied, and
+// handed to `callback` in batches on the tap's worker threads; the buffer goes back to the
+// decoder once both the scheduler and the callback are done with it. The decoder gets max_held
+// more buffers for that, and a frame that finds them all out is let through untapped, so
+// presentation never waits.
+struct mmal_player_tap;
+struct mmal_player_pipeline;
+
+struct mmal_player_tap_frame
+{
+    struct mmal_player_pipeline* pipeline;  // tells windows apart, not to be called into
+    const uint8_t* data;        // the planes, read only and valid until the callback returns
+    uint32_t length;
+    uint32_t encoding;          // MMAL_ENCODING_I420 from video_decode
+    uint32_t width, height;     // of the planes, aligned; the Y stride is `width`
+    MMAL_RECT_T crop;           // the picture within them
+    int64_t pts;
+    uint32_t flags;             // MMAL_BUFFER_HEADER_FLAG_*
+    uint32_t sequence;          // counts the frames taken, over all pipelines
+};
+
+// On a worker thread, `count` frames in the order they were decoded
+typedef void (*mmal_player_tap_callback)(const struct mmal_player_tap_frame* frames, uint32_t count, void* user);
+
+// 0 or NULL takes the default
+struct mmal_player_tap_options
+{
+    uint32_t max_fps;           // frames taken per second and pipeline at most; default every frame
+    uint32_t batch;             // frames per callback, default 1
+    uint32_t batch_ms;          // ... or fewer, once the oldest has waited this long
+    uint32_t max_held;          // frames out with the tap at once, per tap
+    uint32_t workers;           // threads running callbacks
+    mmal_player_tap_callback callback;
+    void* user;
+};
+
+struct mmal_player_tap_stats
+{
+    uint32_t offered;           // decoded frames that came by
+    uint32_t tapped;            // ... taken
+    uint32_t skipped_rate;      // ... let through above max_fps
+    uint32_t skipped_busy;      // ... let through with max_held frames out
+    uint32_t dropped;           // taken, but handed back untouched as their pipeline was torn down
+    uint32_t batches;           // callbacks
+    uint32_t held_max;          // most frames out at once
+    struct mmal_player_timing cost;     // callback time per frame, us
+    struct mmal_player_timing hold;     // taken until handed back, us
+};
+
+void mmal_player_tap_options_init(struct mmal_player_tap_options* options);
+struct mmal_player_tap* mmal_player_tap_create(const struct mmal_player_tap_options* options);
+// Every pipeline using it must have been destroyed
+void mmal_player_tap_destroy(struct mmal_player_tap* tap);
+
+void mmal_player_tap_get_stats(struct mmal_player_tap* tap, struct mmal_player_tap_stats* stats);
+
+// Used by mmal-player-pipeline.c: the buffers the decoder needs on top of its own; takes a
+// reference to `buffer` when it is tapped; hands back every frame of `pipeline`, waiting for
+// callbacks under way, before its decoder output is disabled.
+uint32_t mmal_player_tap_buffers(struct mmal_player_tap* tap);
+void mmal_player_tap_offer(struct mmal_player_tap* tap, struct mmal_player_pipeline* pipeline,
+                           MMAL_PORT_T* port, MMAL_BUFFER_HEADER_T* buffer);
+void mmal_player_tap_release(struct mmal_player_tap* tap, struct mmal_player_pipeline* pipeline);
+
+#endif //MMAL_CHAIN_PLAYER_MMAL_PLAYER_TAP_H
@@ -0,0 +1,442 @@
+#include "mmal-player-transition.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "interface/vcos/vcos.h"
+
+#include "mmal-player-overlay.h"
+
+#define TRANSITION_DEFAULT_MS       1000
+#define TRANSITION_IDLE_WAIT_MS     1000
+#define TRANSITION_POLL_MS          100     // while armed, with the outgoing clip's end further off
+#define TRANSITION_STEP_MIN_MS      10      // one opacity step per frame, within these
+#define TRANSITION_STEP_MAX_MS      50
+#define TRANSITION_GRACE_STEPS      3       // the incoming clip starts on what preroll decoded, its first frames prove nothing
+#define COLOUR_WIDTH                32      // DIP's colour layer, stretched over the window
+#define COLOUR_HEIGHT               16
+#define COLOUR_FPS                  60
+
+enum {
+    STATE_IDLE = 0,
+    STATE_ARMED,
+    STATE_RUNNING,
+};
+
+struct mmal_player_transition
+{
+    struct mmal_player_transition_options options;
+    int64_t duration;           // us
+    mmal_player_transition_begin begin;
+    mmal_player_transition_end end;
+    void* user;
+
+    VCOS_MUTEX_T lock;          // everything below
+    int state;
+    struct mmal_player_pipeline* from;
+    struct mmal_player_pipeline* to;
+    int64_t end_pts;            // of `from`'s clip, 0 when unknown
+    MMAL_BOOL_T from_ended;
+    MMAL_BOOL_T to_ended;       // ... and `to`'s, while the transition into it ran
+    MMAL_BOOL_T enabled;        // FALSE once a clip fell behind: hard cuts from then on
+    MMAL_BOOL_T stop;
+    struct mmal_player_transition_stats stats;
+
+    VCOS_SEMAPHORE_T wake;      // armed, EOS or stop
+    VCOS_THREAD_T thread;
+    MMAL_BOOL_T thread_started;
+};
+
+// Media time a pipeline played since the ramp began, wall time when its clock cannot be read
+struct ramp_clock
+{
+    struct mmal_player_pipeline* pipeline;
+    int64_t base;
+    uint64_t wall_base;
+};
+
+// What a ramp fades: a pipeline's renderer or the colour layer
+struct ramp_layer
+{
+    struct mmal_player_pipeline* pipeline;
+    struct mmal_player_overlay* overlay;
+};
+
+// Both clips decoding: what they had late or dropped as it began, and the least decoder lead since
+struct overlap
+{
+    struct mmal_player_pipeline* from;
+    struct mmal_player_pipeline* to;
+    uint32_t steps;
+    uint32_t late_base;
+    uint32_t late;
+    int64_t lead_min;           // -1 until measured
+};
+
+static void clock_start(struct ramp_clock* clock, struct mmal_player_pipeline* pipeline)
+{
+    clock->pipeline = pipeline;
+    clock->wall_base = vcos_getmicrosecs64();
+    if(pipeline == NULL || mmal_player_get_position(pipeline, &clock->base) != MMAL_SUCCESS)
+        clock->pipeline = NULL;
+}
+
+static int64_t clock_elapsed(const struct ramp_clock* clock)
+{
+    int64_t position;
+
+    if(clock->pipeline != NULL && mmal_player_get_position(clock->pipeline, &position) == MMAL_SUCCESS)
+        return position - clock->base;
+    return (int64_t)(vcos_getmicrosecs64() - clock->wall_base);
+}
+
+static void layer_set_alpha(const struct ramp_layer* layer, uint8_t alpha)
+{
+    if(layer->pipeline != NULL)
+        mmal_player_set_alpha(layer->pipeline, alpha);
+    if(layer->overlay != NULL)
+        mmal_player_overlay_set_alpha(layer->overlay, alpha);
+}
+
+static uint32_t step_ms(struct mmal_player_pipeline* pipeline)
+{
+    uint32_t ms = pipeline != NULL ? (uint32_t)(pipeline->frame_interval / 1000) : TRANSITION_STEP_MAX_MS;
+
+    return vcos_min(vcos_max(ms, TRANSITION_STEP_MIN_MS), TRANSITION_STEP_MAX_MS);
+}
+
+static uint32_t late_count(struct mmal_player_pipeline* pipeline)
+{
+    struct mmal_player_metrics metrics;
+
+    mmal_player_get_metrics(pipeline, &metrics);
+    return metrics.late_frames + metrics.dropped_frames;
+}
+
+static void overlap_begin(struct overlap* overlap, struct mmal_player_pipeline* from, struct mmal_player_pipeline* to)
+{
+    overlap->from = from;
+    overlap->to = to;
+    overlap->steps = 0;
+    overlap->late_base = overlap->late = late_count(from) + late_count(to);
+    overlap->lead_min = -1;
+}
+
+// FALSE when either clip fell behind: a frame late or dropped, or the incoming decoder less
+// than a frame ahead of its clock
+static MMAL_BOOL_T overlap_check(struct overlap* overlap)
+{
+    struct mmal_player_metrics metrics;
+    int64_t position, lead;
+
+    overlap->late = late_count(overlap->from) + late_count(overlap->to);
+    if(++overlap->steps <= TRANSITION_GRACE_STEPS) {
+        overlap->late_base = overlap->late;
+        return MMAL_TRUE;
+    }
+    if(overlap->late > overlap->late_base)
+        return MMAL_FALSE;
+
+    mmal_player_get_metrics(overlap->to, &metrics);
+    if(mmal_player_get_position(overlap->to, &position) != MMAL_SUCCESS)
+        return MMAL_TRUE;
+    lead = metrics.last_pts_in - position - __atomic_load_n(&overlap->to->clip_pts, __ATOMIC_RELAXED);
+    if(overlap->lead_min < 0 || lead < overlap->lead_min)
+        overlap->lead_min = vcos_max(lead, 0);
+    return lead >= overlap->to->frame_interval;
+}
+
+// Steps the layer's opacity from `a0` to `a1` over `span` us of `clock`; FALSE when the overlap
+// could not be sustained. A clock that does not run, or destroy, does not hold it up.
+static MMAL_BOOL_T ramp(struct mmal_player_transition* transition, const struct ramp_clock* clock, int64_t span,
+                        int a0, int a1, const struct ramp_layer* layer, struct overlap* overlap, uint32_t step)
+{
+    uint64_t started = vcos_getmicrosecs64();
+    int alpha, shown = -1;
+    int64_t elapsed;
+
+    while(1) {
+        elapsed = clock_elapsed(clock);
+        if((int64_t)(vcos_getmicrosecs64() - started) > 2 * span || __atomic_load_n(&transition->stop, __ATOMIC_ACQUIRE))
+            elapsed = span;
+        elapsed = vcos_min(vcos_max(elapsed, 0), span);
+
+        alpha = a0 + (int)((a1 - a0) * elapsed / span);
+        if(alpha != shown) {
+            layer_set_alpha(layer, (uint8_t)alpha);
+            shown = alpha;
+        }
+        if(elapsed >= span)
+            return MMAL_TRUE;
+        if(overlap != NULL && !overlap_check(overlap))
+            return MMAL_FALSE;
+        vcos_sleep(step);
+    }
+}
+
+// A small opaque frame of the dip's colour, stretched over the window one layer up, transparent for now
+static struct mmal_player_overlay* colour_layer(struct mmal_player_transition* transition)
+{
+    struct mmal_player_overlay_options options;
+    struct mmal_player_overlay* overlay;
+    const uint8_t rgba[4] = {(transition->options.colour >> 16) & 0xff, (transition->options.colour >> 8) & 0xff,
+                             transition->options.colour & 0xff, 255};
+    uint32_t width, height, stride, x, y;
+    uint8_t* canvas;
+
+    mmal_player_overlay_options_init(&options);
+    options.backend = transition->options.backend;
+    options.display_num = transition->options.display_num;
+    options.layer = transition->options.layer + 1;
+    options.dest_rect = transition->options.dest_rect;
+    options.width = COLOUR_WIDTH;
+    options.height = COLOUR_HEIGHT;
+    options.max_fps = COLOUR_FPS;
+    overlay = mmal_player_overlay_create(&options);
+    if(overlay == NULL)
+        return NULL;
+
+    mmal_player_overlay_set_alpha(overlay, 0);
+    canvas = mmal_player_overlay_lock(overlay, &width, &height, &stride);
+    for(y = 0; y < height; y++)
+        for(x = 0; x < width; x++)
+            memcpy(canvas + y * stride + x * 4, rgba, 4);
+    mmal_player_overlay_unlock(overlay, NULL);
+
+    return overlay;
+}
+
+static void run(struct mmal_player_transition* transition, struct mmal_player_pipeline* from,
+                struct mmal_player_pipeline* to, MMAL_BOOL_T overlapped)
+{
+    struct ramp_clock clock;
+    struct ramp_layer out = {from, NULL}, colour = {NULL, NULL};
+    struct overlap overlap = {NULL, NULL, 0, 0, 0, -1};
+    MMAL_BOOL_T sustained = MMAL_TRUE;
+
+    if(!transition->begin(from, to, transition->user))
+        return;
+
+    if(overlapped)
+        overlap_begin(&overlap, from, to);
+
+    if(transition->options.kind == mmal_player_TRANSITION_CROSSFADE) {
+        // `to` plays below, `from` fades out over it
+        mmal_player_start_below(to);
+        clock_start(&clock, to);
+        sustained = ramp(transition, &clock, transition->duration, 255, 0, &out,
+                         overlapped ? &overlap : NULL, step_ms(to));
+        mmal_player_set_alpha(from, 0);
+        mmal_player_raise(to);
+    } else {
+        // half way the colour hides both: `from` goes off screen and `to` on
+        colour.overlay = colour_layer(transition);
+        clock_start(&clock, overlapped ? from : NULL);
+        if(colour.overlay != NULL)
+            sustained = ramp(transition, &clock, transition->duration / 2, 0, 255, &colour,
+                             overlapped ? &overlap : NULL, step_ms(from));
+        mmal_player_set_alpha(from, 0);
+        mmal_player_start(to);
+        clock_start(&clock, to);
+        if(colour.overlay != NULL && sustained)
+            ramp(transition, &clock, transition->duration / 2, 255, 0, &colour, NULL, step_ms(to));
+        mmal_player_overlay_destroy(colour.overlay);
+    }
+
+    transition->end(from, transition->user);
+
+    vcos_mutex_lock(&transition->lock);
+    transition->stats.transitions++;
+    if(overlapped) {
+        transition->stats.overlapped++;
+        transition->stats.late_frames += overlap.late - overlap.late_base;
+        if(overlap.lead_min >= 0) {
+            mmal_player_timing_add(&transition->stats.headroom, (uint64_t)overlap.lead_min);
+            if(transition->stats.headroom_min < 0 || overlap.lead_min < transition->stats.headroom_min)
+                transition->stats.headroom_min = overlap.lead_min;
+        }
+    }
+    if(!sustained) {
+        transition->stats.cut_short++;
+        transition->enabled = MMAL_FALSE;
+    }
+    vcos_mutex_unlock(&transition->lock);
+
+    if(!sustained)
+        fprintf(stderr, "transition: %s fell behind while both clips played, hard cuts from now on\n",
+                overlap.late > overlap.late_base ? "a frame" : "the decoder");
+}
+
+static void* transition_thread(void* user)
+{
+    struct mmal_player_transition* transition = user;
+    int64_t lead = transition->options.kind == mmal_player_TRANSITION_DIP ? transition->duration / 2 : transition->duration;
+
+    vcos_mutex_lock(&transition->lock);
+    while(!transition->stop) {
+        uint32_t wait_ms = TRANSITION_IDLE_WAIT_MS;
+        MMAL_BOOL_T go = MMAL_FALSE, overlapped = MMAL_FALSE;
+        struct mmal_player_pipeline *from, *to;
+        int64_t position;
+
+        if(transition->state == STATE_ARMED) {
+            if(transition->from_ended) {
+                go = MMAL_TRUE;
+            } else if(transition->end_pts > 0 && mmal_player_get_position(transition->from, &position) == MMAL_SUCCESS) {
+                // starting `lead` ahead of the end has the ramp finish as `from`'s last frame goes
+                if(transition->end_pts - position <= lead)
+                    go = overlapped = MMAL_TRUE;
+                else
+                    wait_ms = (uint32_t)vcos_min((transition->end_pts - position - lead) / 1000 + 1, TRANSITION_POLL_MS);
+            }
+        }
+        if(!go) {
+            vcos_mutex_unlock(&transition->lock);
+            vcos_semaphore_wait_timeout(&transition->wake, wait_ms);
+            vcos_mutex_lock(&transition->lock);
+            continue;
+        }
+
+        transition->state = STATE_RUNNING;
+        from = transition->from;
+        to = transition->to;
+        vcos_mutex_unlock(&transition->lock);
+
+        run(transition, from, to, overlapped);
+
+        vcos_mutex_lock(&transition->lock);
+        // a clip shorter than the transition into it ends now
+        if(transition->to_ended)
+            mmal_player_skip(to);
+        transition->state = STATE_IDLE;
+        transition->from = transition->to = NULL;
+    }
+    vcos_mutex_unlock(&transition->lock);
+
+    return NULL;
+}
+
+void mmal_player_transition_options_init(struct mmal_player_transition_options* options)
+{
+    memset(options, 0, sizeof(struct mmal_player_transition_options));
+    options->duration_ms = TRANSITION_DEFAULT_MS;
+}
+
+struct mmal_player_transition* mmal_player_transition_create(const struct mmal_player_transition_options* options,
+                                                             mmal_player_transition_begin begin, mmal_player_transition_end end, void* user)
+{
+    struct mmal_player_transition* transition;
+
+    transition = calloc(1, sizeof(struct mmal_player_transition));
+    if(transition == NULL)
+        return NULL;
+
+    transition->options = *options;
+    transition->duration = (int64_t)(options->duration_ms > 0 ? options->duration_ms : TRANSITION_DEFAULT_MS) * 1000;
+    transition->begin = begin;
+    transition->end = end;
+    transition->user = user;
+    transition->enabled = MMAL_TRUE;
+    transition->stats.headroom_min = -1;
+    vcos_mutex_create(&transition->lock, "mmal_player:transition");
+    vcos_semaphore_create(&transition->wake, "mmal_player:transition.wake", 0);
+
+    if(vcos_thread_create(&transition->thread, "mmal-player:transition", NULL, transition_thread, transition) != VCOS_SUCCESS) {
+        mmal_player_transition_destroy(transition);
+        return NULL;
+    }
+    transition->thread_started = MMAL_TRUE;
+
+    return transition;
+}
+
+void mmal_player_transition_destroy(struct mmal_player_transition* transition)
+{
+    if(transition == NULL)
+        return;
+
+    if(transition->thread_started) {
+        void* ret = NULL;
+
+        vcos_mutex_lock(&transition->lock);
+        __atomic_store_n(&transition->stop, MMAL_TRUE, __ATOMIC_RELEASE);
+        vcos_mutex_unlock(&transition->lock);
+        vcos_semaphore_post(&transition->wake);
+        vcos_thread_join(&transition->thread, &ret);
+    }
+
+    vcos_semaphore_delete(&transition->wake);
+    vcos_mutex_delete(&transition->lock);
+    free(transition);
+}
+
+MMAL_STATUS_T mmal_player_transition_arm(struct mmal_player_transition* transition,
+                                         struct mmal_player_pipeline* from, struct mmal_player_pipeline* to, int64_t end)
+{
+    MMAL_STATUS_T status = MMAL_SUCCESS;
+
+    vcos_mutex_lock(&transition->lock);
+    if(!transition->enabled || transition->options.kind == mmal_player_TRANSITION_CUT) {
+        status = MMAL_ENOSYS;
+    } else if(transition->state != STATE_IDLE) {
+        status = MMAL_EAGAIN;
+    } else {
+        transition->state = STATE_ARMED;
+        transition->from = from;
+        transition->to = to;
+        transition->end_pts = end;
+        transition->from_ended = MMAL_FALSE;
+        transition->to_ended = MMAL_FALSE;
+    }
+    vcos_mutex_unlock(&transition->lock);
+
+    if(status == MMAL_SUCCESS)
+        vcos_semaphore_post(&transition->wake);
+    return status;
+}
+
+MMAL_BOOL_T mmal_player_transition_eos(struct mmal_player_transition* transition, struct mmal_player_pipeline* from)
+{
+    MMAL_BOOL_T armed;
+
+    vcos_mutex_lock(&transition->lock);
+    armed = transition->state == STATE_ARMED && transition->from == from;
+    if(armed)
+        transition->from_ended = MMAL_TRUE;
+    vcos_mutex_unlock(&transition->lock);
+
+    if(armed)
+        vcos_semaphore_post(&transition->wake);
+    return armed;
+}
+
+void mmal_player_transition_cancel(struct mmal_player_transition* transition)
+{
+    vcos_mutex_lock(&transition->lock);
+    if(transition->state == STATE_ARMED) {
+        transition->state = STATE_IDLE;
+        transition->from = transition->to = NULL;
+    }
+    vcos_mutex_unlock(&transition->lock);
+}
+
+MMAL_BOOL_T mmal_player_transition_ended(struct mmal_player_transition* transition, struct mmal_player_pipeline* to)
+{
+    MMAL_BOOL_T running;
+
+    vcos_mutex_lock(&transition->lock);
+    running = transition->state == STATE_RUNNING && transition->to == to;
+    if(running)
+        transition->to_ended = MMAL_TRUE;
+    vcos_mutex_unlock(&transition->lock);
+
+    return running;
+}
+
+void mmal_player_transition_get_stats(struct mmal_player_transition* transition, struct mmal_player_transition_stats* stats)
+{
+    vcos_mutex_lock(&transition->lock);
+    *stats = transition->stats;
+    vcos_mutex_unlock(&transition->lock);
+}
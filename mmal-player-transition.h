@@ -0,0 +1,76 @@
+#ifndef MMAL_CHAIN_PLAYER_MMAL_PLAYER_TRANSITION_H
+#define MMAL_CHAIN_PLAYER_MMAL_PLAYER_TRANSITION_H
+
+#include <stdint.h>
+
+#include "interface/mmal/mmal.h"
+
+#include "mmal-player-metrics.h"
+#include "mmal-player-pipeline.h"
+
+// Cross fades and dips to a colour between consecutive clips of one window. The incoming clip is
+// prerolled one layer below the outgoing one and, when the outgoing clip's length is known,
+// started that far ahead of its end; otherwise at its EOS, over its last frame. A crossfade fades
+// the outgoing layer out over the incoming one, a dip fades a colour layer above both in and out
+// again. Opacity is stepped once per frame on the transition's own thread, timed by the media
+// clock of the clip that plays. Both clips decoding at once load the decoder about twice: when
+// either falls behind during the overlap, the transition is cut short and later ones are refused,
+// so the window goes back to hard cuts.
+struct mmal_player_transition;
+
+enum mmal_player_transition_kind {
+    mmal_player_TRANSITION_CUT = 0,
+    mmal_player_TRANSITION_CROSSFADE,
+    mmal_player_TRANSITION_DIP,
+};
+
+// 0 or NULL takes the default
+struct mmal_player_transition_options
+{
+    int kind;                   // enum mmal_player_transition_kind
+    uint32_t duration_ms;
+    uint32_t colour;            // DIP: 0xRRGGBB
+    // where the window is, DIP puts its colour layer there, one layer above
+    const struct mmal_player_backend* backend;  // NULL: mmal_player_backend_mmal
+    uint32_t display_num;
+    int layer;
+    MMAL_RECT_T dest_rect;      // width or height 0: full screen
+};
+
+struct mmal_player_transition_stats
+{
+    uint32_t transitions;       // run to their end
+    uint32_t overlapped;        // ... of them started ahead of the outgoing clip's end
+    uint32_t cut_short;         // a clip fell behind during the overlap
+    uint32_t late_frames;       // late or dropped by either clip during overlaps
+    struct mmal_player_timing headroom;     // per overlap, the least the incoming decoder ran ahead of its clock, us
+    int64_t headroom_min;       // ... the least of them, -1 before the first
+};
+
+// On the transition's thread, as `to` starts: take it over as the playing clip, or return FALSE
+// to call the transition off
+typedef MMAL_BOOL_T (*mmal_player_transition_begin)(struct mmal_player_pipeline* from, struct mmal_player_pipeline* to, void* user);
+// ... once `to` is alone on screen: `from` may still be playing, invisibly, and is the caller's again
+typedef void (*mmal_player_transition_end)(struct mmal_player_pipeline* from, void* user);
+
+void mmal_player_transition_options_init(struct mmal_player_transition_options* options);
+struct mmal_player_transition* mmal_player_transition_create(const struct mmal_player_transition_options* options,
+                                                             mmal_player_transition_begin begin, mmal_player_transition_end end, void* user);
+// Ends a transition under way first
+void mmal_player_transition_destroy(struct mmal_player_transition* transition);
+
+// `from` plays, `to` is prerolled; `end` is the media time `from`'s clip ends at, 0 when unknown.
+// MMAL_ENOSYS for hard cuts, MMAL_EAGAIN while a transition is under way.
+MMAL_STATUS_T mmal_player_transition_arm(struct mmal_player_transition* transition,
+                                         struct mmal_player_pipeline* from, struct mmal_player_pipeline* to, int64_t end);
+// `from` reached its end: an armed transition begins now; FALSE when none is armed from it
+MMAL_BOOL_T mmal_player_transition_eos(struct mmal_player_transition* transition, struct mmal_player_pipeline* from);
+// Disarms one that has not begun yet; one under way runs on
+void mmal_player_transition_cancel(struct mmal_player_transition* transition);
+// For `to`'s EOS callback: TRUE while a transition into it is under way, which then skips `to`
+// once done so the callback comes again; the callback holds the last frame until then
+MMAL_BOOL_T mmal_player_transition_ended(struct mmal_player_transition* transition, struct mmal_player_pipeline* to);
+
+void mmal_player_transition_get_stats(struct mmal_player_transition* transition, struct mmal_player_transition_stats* stats);
+
+#endif //MMAL_CHAIN_PLAYER_MMAL_PLAYER_TRANSITION_H
@@ -0,0 +1,190 @@
+#include "mmal-player-watchdog.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "interface/vcos/vcos.h"
+
+#include "mmal-player-pipeline.h"
+
+#define WATCHDOG_DEFAULT_TICK_MS        100
+#define WATCHDOG_DEFAULT_STALL_FRAMES   25
+#define WATCHDOG_DEFAULT_MIN_STALL_MS   500
+#define WATCHDOG_DEFAULT_MAX_ATTEMPTS   3
+
+static const uint32_t bucket_ms[mmal_player_WATCHDOG_BUCKETS - 1] = {10, 20, 50, 100, 200, 500, 1000, 2000};
+
+struct mmal_player_watchdog
+{
+    struct mmal_player_watchdog_options options;
+
+    VCOS_THREAD_T thread;
+    VCOS_SEMAPHORE_T wake;      // posted to have the thread exit
+    VCOS_MUTEX_T lock;          // guards pipelines and stats
+    struct mmal_player_pipeline** pipelines;
+    uint32_t pipelines_num;
+    uint32_t pipelines_size;
+    int terminate;
+
+    struct mmal_player_watchdog_stats stats;
+};
+
+// The checks run on each pipeline's own thread, this one only wakes them
+static void* watchdog_thread(void* arg)
+{
+    struct mmal_player_watchdog* watchdog = arg;
+    uint32_t i;
+
+    while(!__atomic_load_n(&watchdog->terminate, __ATOMIC_ACQUIRE)) {
+        vcos_semaphore_wait_timeout(&watchdog->wake, watchdog->options.tick_ms);
+
+        vcos_mutex_lock(&watchdog->lock);
+        for(i = 0; i < watchdog->pipelines_num; i++)
+            mmal_player_pipeline_watch(watchdog->pipelines[i]);
+        vcos_mutex_unlock(&watchdog->lock);
+    }
+
+    return NULL;
+}
+
+void mmal_player_watchdog_options_init(struct mmal_player_watchdog_options* options)
+{
+    memset(options, 0, sizeof(struct mmal_player_watchdog_options));
+}
+
+struct mmal_player_watchdog* mmal_player_watchdog_create(const struct mmal_player_watchdog_options* options)
+{
+    struct mmal_player_watchdog* watchdog;
+
+    watchdog = calloc(1, sizeof(struct mmal_player_watchdog));
+    if(watchdog == NULL)
+        return NULL;
+
+    watchdog->options = *options;
+    if(watchdog->options.tick_ms == 0)
+        watchdog->options.tick_ms = WATCHDOG_DEFAULT_TICK_MS;
+    if(watchdog->options.stall_frames == 0)
+        watchdog->options.stall_frames = WATCHDOG_DEFAULT_STALL_FRAMES;
+    if(watchdog->options.min_stall_ms == 0)
+        watchdog->options.min_stall_ms = WATCHDOG_DEFAULT_MIN_STALL_MS;
+    if(watchdog->options.max_attempts == 0)
+        watchdog->options.max_attempts = WATCHDOG_DEFAULT_MAX_ATTEMPTS;
+
+    vcos_mutex_create(&watchdog->lock, "mmal_player_watchdog:lock");
+    vcos_semaphore_create(&watchdog->wake, "mmal_player_watchdog:wake", 0);
+    if(vcos_thread_create(&watchdog->thread, "mmal_player_watchdog", NULL, watchdog_thread, watchdog) != VCOS_SUCCESS) {
+        vcos_semaphore_delete(&watchdog->wake);
+        vcos_mutex_delete(&watchdog->lock);
+        free(watchdog);
+        return NULL;
+    }
+
+    return watchdog;
+}
+
+void mmal_player_watchdog_destroy(struct mmal_player_watchdog* watchdog)
+{
+    void* ret = NULL;
+
+    if(watchdog == NULL)
+        return;
+
+    __atomic_store_n(&watchdog->terminate, 1, __ATOMIC_RELEASE);
+    vcos_semaphore_post(&watchdog->wake);
+    vcos_thread_join(&watchdog->thread, &ret);
+
+    if(watchdog->pipelines_num > 0)
+        fprintf(stderr, "watchdog: %u pipelines still attached\n", watchdog->pipelines_num);
+    free(watchdog->pipelines);
+    vcos_semaphore_delete(&watchdog->wake);
+    vcos_mutex_delete(&watchdog->lock);
+    free(watchdog);
+}
+
+void mmal_player_watchdog_get_options(struct mmal_player_watchdog* watchdog, struct mmal_player_watchdog_options* options)
+{
+    *options = watchdog->options;
+}
+
+void mmal_player_watchdog_get_stats(struct mmal_player_watchdog* watchdog, struct mmal_player_watchdog_stats* stats)
+{
+    vcos_mutex_lock(&watchdog->lock);
+    *stats = watchdog->stats;
+    stats->pipelines = watchdog->pipelines_num;
+    vcos_mutex_unlock(&watchdog->lock);
+}
+
+uint32_t mmal_player_watchdog_bucket_ms(int index)
+{
+    if(index < 0 || index >= mmal_player_WATCHDOG_BUCKETS - 1)
+        return UINT32_MAX;
+    return bucket_ms[index];
+}
+
+void mmal_player_watchdog_attach(struct mmal_player_watchdog* watchdog, struct mmal_player_pipeline* pipeline)
+{
+    uint32_t i;
+
+    vcos_mutex_lock(&watchdog->lock);
+    for(i = 0; i < watchdog->pipelines_num; i++) {
+        if(watchdog->pipelines[i] == pipeline)
+            goto done;
+    }
+    if(watchdog->pipelines_num == watchdog->pipelines_size) {
+        uint32_t size = watchdog->pipelines_size > 0 ? watchdog->pipelines_size * 2 : 8;
+        struct mmal_player_pipeline** pipelines = realloc(watchdog->pipelines, size * sizeof(*pipelines));
+
+        if(pipelines == NULL) {
+            fprintf(stderr, "watchdog: out of memory, %s goes unwatched\n", pipeline->uri);
+            goto done;
+        }
+        watchdog->pipelines = pipelines;
+        watchdog->pipelines_size = size;
+    }
+    watchdog->pipelines[watchdog->pipelines_num++] = pipeline;
+
+done:
+    vcos_mutex_unlock(&watchdog->lock);
+}
+
+void mmal_player_watchdog_detach(struct mmal_player_watchdog* watchdog, struct mmal_player_pipeline* pipeline)
+{
+    uint32_t i;
+
+    vcos_mutex_lock(&watchdog->lock);
+    for(i = 0; i < watchdog->pipelines_num; i++) {
+        if(watchdog->pipelines[i] == pipeline) {
+            watchdog->pipelines[i] = watchdog->pipelines[--watchdog->pipelines_num];
+            break;
+        }
+    }
+    vcos_mutex_unlock(&watchdog->lock);
+}
+
+void mmal_player_watchdog_record(struct mmal_player_watchdog* watchdog, enum mmal_player_watchdog_event event, uint64_t us)
+{
+    struct mmal_player_watchdog_stats* stats = &watchdog->stats;
+    int i;
+
+    vcos_mutex_lock(&watchdog->lock);
+    switch(event) {
+        case mmal_player_WATCHDOG_STALL:
+            stats->stalls++;
+            break;
+        case mmal_player_WATCHDOG_ERROR:
+            stats->errors++;
+            break;
+        case mmal_player_WATCHDOG_RECOVERED:
+            stats->recovered++;
+            mmal_player_timing_add(&stats->recovery, us);
+            for(i = 0; i < mmal_player_WATCHDOG_BUCKETS - 1 && us >= (uint64_t)bucket_ms[i] * 1000; i++)
+                ;
+            stats->histogram[i]++;
+            break;
+        case mmal_player_WATCHDOG_GAVE_UP:
+            stats->gave_up++;
+            break;
+    }
+    vcos_mutex_unlock(&watchdog->lock);
+}
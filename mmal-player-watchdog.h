@@ -0,0 +1,65 @@
+#ifndef MMAL_CHAIN_PLAYER_MMAL_PLAYER_WATCHDOG_H
+#define MMAL_CHAIN_PLAYER_MMAL_PLAYER_WATCHDOG_H
+
+#include <stdint.h>
+
+#include "interface/mmal/mmal.h"
+
+#include "mmal-player-metrics.h"
+
+// Keeps pipelines on screen through component faults. A thread wakes every attached pipeline
+// each tick; a playing pipeline that presented nothing for stall_frames frame intervals has
+// stalled. A stall, an error event from a component, or a buffer a component refused has the
+// pipeline thread rebuild only the component at fault and resume the clip at the frame it was
+// showing, or where its sync group got to meanwhile. The next fault before a frame was
+// presented again rebuilds all of them, and after max_attempts in a row the session ends with
+// an error as it would without a watchdog.
+struct mmal_player_watchdog;
+struct mmal_player_pipeline;
+
+// 0 takes the default
+struct mmal_player_watchdog_options
+{
+    uint32_t tick_ms;           // how often pipelines are checked, default 100
+    uint32_t stall_frames;      // frame intervals without a frame presented, default 25
+    uint32_t min_stall_ms;      // ... but never less than this, default 500
+    uint32_t max_attempts;      // rebuilds without a frame in between before giving up, default 3
+};
+
+// Recovery time histogram: below 10, 20, 50, 100, 200, 500, 1000, 2000 ms, and the rest
+#define mmal_player_WATCHDOG_BUCKETS    9
+
+struct mmal_player_watchdog_stats
+{
+    uint32_t pipelines;         // attached now
+    uint32_t stalls;
+    uint32_t errors;            // error events and refused buffers
+    uint32_t recovered;         // faults followed by a frame presented again
+    uint32_t gave_up;           // sessions ended after max_attempts
+    struct mmal_player_timing recovery;     // fault noticed until that frame
+    uint32_t histogram[mmal_player_WATCHDOG_BUCKETS];
+};
+
+void mmal_player_watchdog_options_init(struct mmal_player_watchdog_options* options);
+struct mmal_player_watchdog* mmal_player_watchdog_create(const struct mmal_player_watchdog_options* options);
+// Every pipeline must have been detached, i.e. destroyed
+void mmal_player_watchdog_destroy(struct mmal_player_watchdog* watchdog);
+
+void mmal_player_watchdog_get_options(struct mmal_player_watchdog* watchdog, struct mmal_player_watchdog_options* options);
+void mmal_player_watchdog_get_stats(struct mmal_player_watchdog* watchdog, struct mmal_player_watchdog_stats* stats);
+// Upper bound of histogram bucket `index`, UINT32_MAX for the last
+uint32_t mmal_player_watchdog_bucket_ms(int index);
+
+// Used by mmal-player-pipeline.c.
+enum mmal_player_watchdog_event {
+    mmal_player_WATCHDOG_STALL = 0,
+    mmal_player_WATCHDOG_ERROR,
+    mmal_player_WATCHDOG_RECOVERED,     // with the time it took
+    mmal_player_WATCHDOG_GAVE_UP,
+};
+
+void mmal_player_watchdog_attach(struct mmal_player_watchdog* watchdog, struct mmal_player_pipeline* pipeline);
+void mmal_player_watchdog_detach(struct mmal_player_watchdog* watchdog, struct mmal_player_pipeline* pipeline);
+void mmal_player_watchdog_record(struct mmal_player_watchdog* watchdog, enum mmal_player_watchdog_event event, uint64_t us);
+
+#endif //MMAL_CHAIN_PLAYER_MMAL_PLAYER_WATCHDOG_H
@@ -0,0 +1,882 @@
+#include "playlist.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PLAYLIST_INITIAL_CAPACITY 16
+#define PLAYLIST_WEIGHT_MAX     100
+#define PLAYLIST_FILE_MAX       (4 << 20)
+#define PLAYLIST_URI_MAX        4096
+#define PLAYLIST_JSON_DEPTH     16
+
+int playlist_init(struct playlist* playlist)
+{
+    if(playlist == NULL)
+        return -1;
+
+    memset(playlist, 0, sizeof(struct playlist));
+    playlist->seed = (uint32_t)time(NULL) ^ (uint32_t)(uintptr_t)playlist;
+    return 0;
+}
+
+void playlist_deinit(struct playlist* playlist)
+{
+    playlist_clear(playlist);
+    free(playlist->entries);
+    free(playlist->durations);
+    free(playlist->rules);
+    free(playlist->order);
+    memset(playlist, 0, sizeof(struct playlist));
+}
+
+/* play order */
+
+struct slot
+{
+    double key;
+    int entry;
+};
+
+static int compare_slots(const void* a, const void* b)
+{
+    const struct slot* x = a;
+    const struct slot* y = b;
+
+    if(x->key != y->key)
+        return x->key < y->key ? -1 : 1;
+    return x->entry - y->entry;
+}
+
+static uint32_t weight_of(const struct playlist_rules* rules)
+{
+    return rules->weight == 0 ? 1 : rules->weight > PLAYLIST_WEIGHT_MAX ? PLAYLIST_WEIGHT_MAX : rules->weight;
+}
+
+// One pass: each entry in as many slots as its weight, evenly spaced, then shuffled if asked for
+static int build_order(struct playlist* playlist)
+{
+    struct slot* slots;
+    int* order;
+    int total = 0, n = 0, i;
+    uint32_t k, weight;
+
+    playlist->timed = 0;
+    for(i = 0; i < playlist->count; i++) {
+        total += weight_of(&playlist->rules[i]);
+        if(playlist->rules[i].from != playlist->rules[i].until)
+            playlist->timed = 1;
+    }
+    if(total == 0) {
+        playlist->order_count = 0;
+        return 0;
+    }
+
+    slots = malloc(sizeof(struct slot) * total);
+    order = slots != NULL ? realloc(playlist->order, sizeof(int) * total) : NULL;
+    if(order == NULL) {
+        free(slots);
+        return -1;
+    }
+    playlist->order = order;
+
+    for(i = 0; i < playlist->count; i++) {
+        weight = weight_of(&playlist->rules[i]);
+        for(k = 0; k < weight; k++) {
+            slots[n].key = (k + 0.5) / weight;
+            slots[n++].entry = i;
+        }
+    }
+    qsort(slots, n, sizeof(struct slot), compare_slots);
+    for(i = 0; i < n; i++)
+        order[i] = slots[i].entry;
+    free(slots);
+
+    if(playlist->shuffle) {
+        for(i = n - 1; i > 0; i--) {
+            int j = rand_r(&playlist->seed) % (i + 1), entry = order[i];
+
+            order[i] = order[j];
+            order[j] = entry;
+        }
+    }
+    playlist->order_count = n;
+    return 0;
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+    while(b != 0) {
+        uint32_t t = a % b;
+
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// The entry in `slot` of pass `pass`. Shuffled passes after the first walk the shuffled order
+// in a stride coprime to its length from an offset, both picked by the pass: a fresh order
+// every pass that costs nothing to lay out, and the same for every cursor looking ahead.
+static int order_at(const struct playlist* playlist, uint32_t pass, int slot)
+{
+    uint32_t n = (uint32_t)playlist->order_count, hash, stride;
+
+    if(!playlist->shuffle || pass == 0 || n < 3)
+        return playlist->order[slot];
+
+    hash = (pass ^ playlist->seed) * 2654435761u;
+    hash ^= hash >> 15;
+    // stride 1 would only rotate the first pass
+    stride = n > 3 ? 2 + hash % (n - 2) : 2;
+    while(gcd(stride, n) != 1)
+        stride = stride % (n - 1) + 1;
+    return playlist->order[((uint64_t)stride * slot + (hash >> 8)) % n];
+}
+
+int playlist_configure(struct playlist* playlist, int loops, int repeat, int shuffle)
+{
+    playlist->loops = loops;
+    playlist->repeat = repeat;
+    playlist->shuffle = shuffle;
+    return build_order(playlist);
+}
+
+/* entries */
+
+static int insert_entry(struct playlist* playlist, int index, const char* uri, const struct playlist_rules* rules)
+{
+    char* copy;
+    int64_t duration;
+    int same;
+
+    if(index < 0 || index > playlist->count || uri == NULL)
+        return -1;
+
+    if(playlist->count == playlist->capacity) {
+        int capacity = playlist->capacity > 0 ? playlist->capacity * 2 : PLAYLIST_INITIAL_CAPACITY;
+        char** entries = realloc(playlist->entries, sizeof(char*) * capacity);
+        int64_t* durations;
+        struct playlist_rules* more_rules;
+
+        if(entries == NULL)
+            return -1;
+        playlist->entries = entries;
+        durations = realloc(playlist->durations, sizeof(int64_t) * capacity);
+        if(durations == NULL)
+            return -1;
+        playlist->durations = durations;
+        more_rules = realloc(playlist->rules, sizeof(struct playlist_rules) * capacity);
+        if(more_rules == NULL)
+            return -1;
+        playlist->rules = more_rules;
+        playlist->capacity = capacity;
+    }
+
+    copy = strdup(uri);
+    if(copy == NULL)
+        return -1;
+
+    // known already if the URI is listed elsewhere
+    same = playlist_find(playlist, uri);
+    duration = same >= 0 ? playlist->durations[same] : 0;
+
+    memmove(&playlist->entries[index + 1], &playlist->entries[index], sizeof(char*) * (playlist->count - index));
+    memmove(&playlist->durations[index + 1], &playlist->durations[index], sizeof(int64_t) * (playlist->count - index));
+    memmove(&playlist->rules[index + 1], &playlist->rules[index], sizeof(struct playlist_rules) * (playlist->count - index));
+    playlist->entries[index] = copy;
+    playlist->durations[index] = duration;
+    if(rules != NULL)
+        playlist->rules[index] = *rules;
+    else
+        memset(&playlist->rules[index], 0, sizeof(struct playlist_rules));
+    playlist->count++;
+
+    return index;
+}
+
+int playlist_insert(struct playlist* playlist, int index, const char* uri)
+{
+    index = insert_entry(playlist, index, uri, NULL);
+    if(index >= 0 && build_order(playlist) != 0)
+        return -1;
+    return index;
+}
+
+int playlist_append(struct playlist* playlist, const char* uri)
+{
+    return playlist_insert(playlist, playlist->count, uri);
+}
+
+void playlist_clear(struct playlist* playlist)
+{
+    int i;
+
+    for(i = 0; i < playlist->count; i++)
+        free(playlist->entries[i]);
+    playlist->count = 0;
+    playlist->order_count = 0;
+    playlist->timed = 0;
+}
+
+const char* playlist_get(const struct playlist* playlist, int index)
+{
+    if(index < 0 || index >= playlist->count)
+        return NULL;
+    return playlist->entries[index];
+}
+
+int playlist_find(const struct playlist* playlist, const char* uri)
+{
+    int i;
+
+    for(i = 0; i < playlist->count; i++)
+        if(strcmp(playlist->entries[i], uri) == 0)
+            return i;
+    return -1;
+}
+
+int64_t playlist_get_duration(const struct playlist* playlist, int index)
+{
+    if(index < 0 || index >= playlist->count)
+        return 0;
+    return playlist->durations[index];
+}
+
+void playlist_set_duration(struct playlist* playlist, int index, int64_t duration)
+{
+    int i;
+
+    if(index < 0 || index >= playlist->count)
+        return;
+    for(i = 0; i < playlist->count; i++)
+        if(i == index || strcmp(playlist->entries[i], playlist->entries[index]) == 0)
+            playlist->durations[i] = duration;
+}
+
+int64_t playlist_get_play_time(const struct playlist* playlist, int index)
+{
+    if(index < 0 || index >= playlist->count)
+        return 0;
+    return playlist->rules[index].play_time;
+}
+
+/* cursor */
+
+void playlist_cursor_init(struct playlist_cursor* cursor)
+{
+    memset(cursor, 0, sizeof(struct playlist_cursor));
+    cursor->entry = -1;
+    cursor->slot = -1;
+    cursor->cue = -1;
+}
+
+// `*day` is filled in on first use, a clock read per lookup at most
+static int window_open(const struct playlist_rules* rules, int* day)
+{
+    if(rules->from == rules->until)
+        return 1;
+
+    if(*day < 0) {
+        time_t now = time(NULL);
+        struct tm tm;
+
+        localtime_r(&now, &tm);
+        *day = tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec;
+    }
+    if(rules->from < rules->until)
+        return *day >= rules->from && *day < rules->until;
+    return *day >= rules->from || *day < rules->until;
+}
+
+static void enter(const struct playlist* playlist, struct playlist_cursor* cursor, int entry)
+{
+    const struct playlist_rules* rules = &playlist->rules[entry];
+    int loops = rules->loops != 0 ? rules->loops : playlist->loops;
+
+    cursor->entry = entry;
+    cursor->iter = rules->play_time > 0 || loops == 0 ? 1 : loops;
+    cursor->until = 0;
+}
+
+const char* playlist_next(const struct playlist* playlist, struct playlist_cursor* cursor, int64_t now)
+{
+    struct playlist_cursor at = *cursor;
+    int day = -1, entry, i;
+
+    if(at.entry >= 0 && at.entry < playlist->count) {
+        // the same again while its play time runs, or while it has plays left without one
+        if(at.until != 0) {
+            if(now < at.until)
+                return playlist->entries[at.entry];
+        } else if(at.iter == -1 || --at.iter > 0) {
+            *cursor = at;
+            return playlist->entries[at.entry];
+        }
+    }
+
+    // the order carries on after a cued entry
+    if(at.cue >= 0 && at.cue < playlist->count) {
+        enter(playlist, &at, at.cue);
+        // one cued where the order goes anyway takes its slot rather than playing twice
+        if(at.slot + 1 < playlist->order_count && order_at(playlist, at.pass, at.slot + 1) == at.cue)
+            at.slot++;
+        at.cue = -1;
+        *cursor = at;
+        return playlist->entries[at.entry];
+    }
+    at.cue = -1;
+
+    for(i = 0; i < playlist->order_count; i++) {
+        if(++at.slot >= playlist->order_count) {
+            if(!playlist->repeat)
+                return NULL;
+            at.slot = 0;
+            at.pass++;
+        }
+        entry = order_at(playlist, at.pass, at.slot);
+        if(!playlist->timed || window_open(&playlist->rules[entry], &day)) {
+            enter(playlist, &at, entry);
+            *cursor = at;
+            return playlist->entries[entry];
+        }
+    }
+    return NULL;
+}
+
+void playlist_start(const struct playlist* playlist, struct playlist_cursor* cursor, int64_t now)
+{
+    int64_t play_time = playlist_get_play_time(playlist, cursor->entry);
+
+    if(cursor->until == 0 && play_time > 0)
+        cursor->until = now + play_time;
+}
+
+void playlist_cursor_update(const struct playlist* playlist, struct playlist_cursor* cursor)
+{
+    int slot;
+
+    if(cursor->cue >= playlist->count)
+        cursor->cue = -1;
+    if(cursor->entry < 0 || cursor->entry >= playlist->count) {
+        cursor->entry = -1;
+        cursor->slot = -1;
+        return;
+    }
+    if(cursor->slot >= 0 && cursor->slot < playlist->order_count && order_at(playlist, cursor->pass, cursor->slot) == cursor->entry)
+        return;
+
+    for(slot = 0; slot < playlist->order_count; slot++) {
+        if(order_at(playlist, cursor->pass, slot) == cursor->entry) {
+            cursor->slot = slot;
+            return;
+        }
+    }
+    cursor->slot = -1;
+}
+
+int playlist_waits(const struct playlist* playlist)
+{
+    return playlist->repeat && playlist->timed;
+}
+
+/* loading */
+
+struct loader
+{
+    struct playlist* playlist;
+    const char* path;
+    char dir[PLAYLIST_URI_MAX];
+    struct playlist_rules rules;    // of the next entry
+    char uri[PLAYLIST_URI_MAX];
+};
+
+// A path relative to the playlist file's directory; URIs and absolute paths as they are
+static int add_entry(struct loader* loader, const char* uri)
+{
+    char resolved[PLAYLIST_URI_MAX];
+    size_t scheme = strcspn(uri, ":/");
+    int n;
+
+    if(uri[0] == '/' || uri[scheme] == ':' || loader->dir[0] == '\0')
+        n = snprintf(resolved, sizeof(resolved), "%s", uri);
+    else
+        n = snprintf(resolved, sizeof(resolved), "%s/%s", loader->dir, uri);
+    if(n < 0 || (size_t)n >= sizeof(resolved))
+        return -1;
+
+    n = insert_entry(loader->playlist, loader->playlist->count, resolved, &loader->rules);
+    memset(&loader->rules, 0, sizeof(struct playlist_rules));
+    return n < 0 ? -1 : 0;
+}
+
+// "HH:MM[:SS]-HH:MM[:SS]"
+static int parse_window(const char* text, struct playlist_rules* rules)
+{
+    unsigned int h[2], m[2], s[2] = {0, 0};
+    const char* dash = strchr(text, '-');
+
+    if(dash == NULL ||
+       sscanf(text, "%u:%u:%u", &h[0], &m[0], &s[0]) < 2 || sscanf(dash + 1, "%u:%u:%u", &h[1], &m[1], &s[1]) < 2 ||
+       h[0] > 24 || h[1] > 24 || m[0] > 59 || m[1] > 59 || s[0] > 59 || s[1] > 59)
+        return -1;
+
+    rules->from = (int32_t)((h[0] * 3600 + m[0] * 60 + s[0]) % 86400);
+    rules->until = (int32_t)((h[1] * 3600 + m[1] * 60 + s[1]) % 86400);
+    return 0;
+}
+
+static int parse_flag(const char* text)
+{
+    return strcmp(text, "1") == 0 || strcmp(text, "true") == 0 || strcmp(text, "yes") == 0;
+}
+
+static int set_loops(int* loops, double value)
+{
+    if(value < -1 || value != (int)value)
+        return -1;
+    *loops = (int)value;
+    return 0;
+}
+
+static int set_weight(struct playlist_rules* rules, double value)
+{
+    if(value < 0 || value > PLAYLIST_WEIGHT_MAX || value != (uint32_t)value)
+        return -1;
+    rules->weight = (uint32_t)value;
+    return 0;
+}
+
+/* M3U: attributes as IPTV lists carry them, key="value" between the tag and its comma */
+
+// The next key="value" of a tag; NULL when there is none or it is malformed
+static char* m3u_attribute(char* p, char** key, char** value)
+{
+    while(*p == ' ' || *p == '\t')
+        p++;
+    if(*p == '\0' || *p == ',')
+        return NULL;
+
+    *key = p;
+    p = strchr(p, '=');
+    if(p == NULL || p[1] != '"')
+        return NULL;
+    *p = '\0';
+    *value = p + 2;
+    p = strchr(*value, '"');
+    if(p == NULL)
+        return NULL;
+    *p = '\0';
+    return p + 1;
+}
+
+static int m3u_tag(struct loader* loader, char* p, int entry)
+{
+    struct playlist* playlist = loader->playlist;
+    char* key;
+    char* value;
+
+    while((p = m3u_attribute(p, &key, &value)) != NULL) {
+        char* end;
+        double number = strtod(value, &end);
+        int status = 0;
+
+        // numbers whole or not at all
+        if(*end != '\0')
+            number = -2;
+
+        if(entry && strcmp(key, "loops") == 0)
+            status = set_loops(&loader->rules.loops, number);
+        else if(entry && strcmp(key, "weight") == 0)
+            status = set_weight(&loader->rules, number);
+        else if(entry && strcmp(key, "window") == 0)
+            status = parse_window(value, &loader->rules);
+        else if(!entry && strcmp(key, "loops") == 0)
+            status = set_loops(&playlist->loops, number);
+        else if(!entry && strcmp(key, "repeat") == 0)
+            playlist->repeat = parse_flag(value);
+        else if(!entry && strcmp(key, "shuffle") == 0)
+            playlist->shuffle = parse_flag(value);
+        if(status != 0) {
+            fprintf(stderr, "bad %s=\"%s\"", key, value);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int load_m3u(struct loader* loader, char* text)
+{
+    char* line = text;
+    int number = 0;
+
+    while(line != NULL) {
+        char* end = strchr(line, '\n');
+        size_t length;
+
+        if(end != NULL)
+            *end++ = '\0';
+        number++;
+        while(isspace((unsigned char)*line))
+            line++;
+        length = strlen(line);
+        while(length > 0 && isspace((unsigned char)line[length - 1]))
+            line[--length] = '\0';
+
+        if(strncmp(line, "#EXTM3U", 7) == 0) {
+            if(m3u_tag(loader, line + 7, 0) != 0)
+                goto error;
+        } else if(strncmp(line, "#EXTINF:", 8) == 0) {
+            char* attributes;
+            double seconds = strtod(line + 8, &attributes);
+
+            loader->rules.play_time = seconds > 0 ? (int64_t)(seconds * 1000000) : 0;
+            if(m3u_tag(loader, attributes, 1) != 0)
+                goto error;
+        } else if(line[0] != '\0' && line[0] != '#') {
+            if(add_entry(loader, line) != 0) {
+                fprintf(stderr, "cannot add %s", line);
+                goto error;
+            }
+        }
+        line = end;
+    }
+    return 0;
+
+error:
+    fprintf(stderr, " in %s:%d\n", loader->path, number);
+    return -1;
+}
+
+/* JSON: just what a playlist needs, with the keys it does not know skipped */
+
+struct json
+{
+    const char* p;
+    int depth;
+};
+
+static void json_space(struct json* j)
+{
+    while(isspace((unsigned char)*j->p))
+        j->p++;
+}
+
+// Takes `c` if it is next
+static int json_take(struct json* j, char c)
+{
+    json_space(j);
+    if(*j->p != c)
+        return -1;
+    j->p++;
+    return 0;
+}
+
+// `out` NULL skips it
+static int json_string(struct json* j, char* out, size_t size)
+{
+    size_t n = 0;
+
+    if(json_take(j, '"') != 0)
+        return -1;
+    while(*j->p != '"') {
+        unsigned int c = (unsigned char)*j->p++;
+
+        if(c == '\0')
+            return -1;
+        if(c == '\\') {
+            c = (unsigned char)*j->p++;
+            switch(c) {
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                case 'u':
+                    if(sscanf(j->p, "%4x", &c) != 1)
+                        return -1;
+                    j->p += 4;
+                    break;
+                case '"': case '\\': case '/':
+                    break;
+                default:
+                    return -1;
+            }
+        }
+        // \u escapes as UTF-8; surrogate pairs are not put together
+        if(out == NULL)
+            continue;
+        if(n + 4 >= size)
+            return -1;
+        if(c < 0x80) {
+            out[n++] = (char)c;
+        } else if(c < 0x800) {
+            out[n++] = (char)(0xc0 | (c >> 6));
+            out[n++] = (char)(0x80 | (c & 0x3f));
+        } else {
+            out[n++] = (char)(0xe0 | (c >> 12));
+            out[n++] = (char)(0x80 | ((c >> 6) & 0x3f));
+            out[n++] = (char)(0x80 | (c & 0x3f));
+        }
+    }
+    j->p++;
+    if(out != NULL)
+        out[n] = '\0';
+    return 0;
+}
+
+static int json_number(struct json* j, double* value)
+{
+    char* end;
+
+    json_space(j);
+    *value = strtod(j->p, &end);
+    if(end == j->p)
+        return -1;
+    j->p = end;
+    return 0;
+}
+
+static int json_flag(struct json* j, int* value)
+{
+    double number;
+
+    json_space(j);
+    if(strncmp(j->p, "true", 4) == 0 || strncmp(j->p, "false", 5) == 0) {
+        *value = *j->p == 't';
+        j->p += *value ? 4 : 5;
+        return 0;
+    }
+    if(json_number(j, &number) != 0)
+        return -1;
+    *value = number != 0;
+    return 0;
+}
+
+static int json_skip(struct json* j);
+
+// Calls `member` with each key of an object, `element` with each element of an array; they
+// take the value
+static int json_object(struct json* j, int (*member)(struct json*, const char*, void*), void* user)
+{
+    char key[64];
+
+    if(json_take(j, '{') != 0 || ++j->depth > PLAYLIST_JSON_DEPTH)
+        return -1;
+    if(json_take(j, '}') == 0)
+        goto out;
+    do {
+        if(json_string(j, key, sizeof(key)) != 0 || json_take(j, ':') != 0 || member(j, key, user) != 0)
+            return -1;
+    } while(json_take(j, ',') == 0);
+    if(json_take(j, '}') != 0)
+        return -1;
+out:
+    j->depth--;
+    return 0;
+}
+
+static int json_array(struct json* j, int (*element)(struct json*, void*), void* user)
+{
+    if(json_take(j, '[') != 0 || ++j->depth > PLAYLIST_JSON_DEPTH)
+        return -1;
+    if(json_take(j, ']') == 0)
+        goto out;
+    do {
+        if(element(j, user) != 0)
+            return -1;
+    } while(json_take(j, ',') == 0);
+    if(json_take(j, ']') != 0)
+        return -1;
+out:
+    j->depth--;
+    return 0;
+}
+
+static int skip_member(struct json* j, const char* key, void* user)
+{
+    return json_skip(j);
+}
+
+static int skip_element(struct json* j, void* user)
+{
+    return json_skip(j);
+}
+
+static int json_skip(struct json* j)
+{
+    double number;
+    int flag;
+
+    json_space(j);
+    switch(*j->p) {
+        case '{':
+            return json_object(j, skip_member, NULL);
+        case '[':
+            return json_array(j, skip_element, NULL);
+        case '"':
+            return json_string(j, NULL, 0);
+        case 'n':
+            if(strncmp(j->p, "null", 4) != 0)
+                return -1;
+            j->p += 4;
+            return 0;
+        default:
+            return json_flag(j, &flag) == 0 ? 0 : json_number(j, &number);
+    }
+}
+
+static int item_member(struct json* j, const char* key, void* user)
+{
+    struct loader* loader = user;
+    char window[32];
+    double number;
+
+    if(strcmp(key, "uri") == 0)
+        return json_string(j, loader->uri, sizeof(loader->uri));
+    if(strcmp(key, "duration") == 0) {
+        if(json_number(j, &number) != 0 || number < 0)
+            return -1;
+        loader->rules.play_time = (int64_t)(number * 1000000);
+        return 0;
+    }
+    if(strcmp(key, "loops") == 0)
+        return json_number(j, &number) != 0 ? -1 : set_loops(&loader->rules.loops, number);
+    if(strcmp(key, "weight") == 0)
+        return json_number(j, &number) != 0 ? -1 : set_weight(&loader->rules, number);
+    if(strcmp(key, "window") == 0)
+        return json_string(j, window, sizeof(window)) != 0 ? -1 : parse_window(window, &loader->rules);
+    return json_skip(j);
+}
+
+static int item_element(struct json* j, void* user)
+{
+    struct loader* loader = user;
+
+    loader->uri[0] = '\0';
+    json_space(j);
+    if(*j->p == '"') {
+        if(json_string(j, loader->uri, sizeof(loader->uri)) != 0)
+            return -1;
+    } else if(json_object(j, item_member, loader) != 0) {
+        return -1;
+    }
+    return loader->uri[0] != '\0' ? add_entry(loader, loader->uri) : -1;
+}
+
+static int list_member(struct json* j, const char* key, void* user)
+{
+    struct loader* loader = user;
+    struct playlist* playlist = loader->playlist;
+    double number;
+
+    if(strcmp(key, "items") == 0)
+        return json_array(j, item_element, loader);
+    if(strcmp(key, "loops") == 0)
+        return json_number(j, &number) != 0 ? -1 : set_loops(&playlist->loops, number);
+    if(strcmp(key, "repeat") == 0)
+        return json_flag(j, &playlist->repeat);
+    if(strcmp(key, "shuffle") == 0)
+        return json_flag(j, &playlist->shuffle);
+    return json_skip(j);
+}
+
+static int load_json(struct loader* loader, const char* text)
+{
+    struct json j = {text, 0};
+    int status;
+
+    json_space(&j);
+    if(*j.p == '[')
+        status = json_array(&j, item_element, loader);
+    else
+        status = json_object(&j, list_member, loader);
+    if(status == 0 && (json_space(&j), *j.p != '\0'))
+        status = -1;
+    if(status != 0)
+        fprintf(stderr, "bad JSON in %s at offset %ld\n", loader->path, (long)(j.p - text));
+    return status;
+}
+
+static char* read_file(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    char* text = NULL;
+    size_t length = 0, size = 0;
+
+    if(file == NULL)
+        goto error;
+    do {
+        char* more;
+
+        if(size >= PLAYLIST_FILE_MAX)
+            goto error;
+        size = size > 0 ? size * 2 : 4096;
+        more = realloc(text, size + 1);
+        if(more == NULL)
+            goto error;
+        text = more;
+        length += fread(text + length, 1, size - length, file);
+    } while(length == size);
+    if(ferror(file))
+        goto error;
+
+    fclose(file);
+    text[length] = '\0';
+    return text;
+
+error:
+    perror(path);
+    if(file != NULL)
+        fclose(file);
+    free(text);
+    return NULL;
+}
+
+int playlist_load(struct playlist* playlist, const char* path)
+{
+    struct loader* loader;
+    struct playlist loaded, old;
+    const char* slash = strrchr(path, '/');
+    const char* p;
+    char* text;
+    int status = -1;
+
+    text = read_file(path);
+    loader = calloc(1, sizeof(struct loader));
+    if(text == NULL || loader == NULL)
+        goto out;
+
+    playlist_init(&loaded);
+    loaded.loops = playlist->loops;
+    loaded.repeat = playlist->repeat;
+    loaded.shuffle = playlist->shuffle;
+    loaded.seed = playlist->seed;
+    loader->playlist = &loaded;
+    loader->path = path;
+    if(slash != NULL)
+        snprintf(loader->dir, sizeof(loader->dir), "%.*s", (int)(slash - path), path);
+    if(slash == path)
+        strcpy(loader->dir, "/");
+
+    for(p = text; isspace((unsigned char)*p); p++)
+        ;
+    status = *p == '{' || *p == '[' ? load_json(loader, p) : load_m3u(loader, text);
+    if(status == 0)
+        status = build_order(&loaded);
+    if(status != 0) {
+        playlist_deinit(&loaded);
+        goto out;
+    }
+
+    old = *playlist;
+    *playlist = loaded;
+    playlist_deinit(&old);
+
+out:
+    free(loader);
+    free(text);
+    return status;
+}
@@ -0,0 +1,93 @@
+#ifndef MMAL_CHAIN_PLAYER_PLAYLIST_H
+#define MMAL_CHAIN_PLAYER_PLAYLIST_H
+
+#include <stdint.h>
+
+// How an entry plays; zeroes take the playlist's defaults
+struct playlist_rules
+{
+    int loops;              // plays in a row, -1 forever, 0: the playlist's loops
+    int64_t play_time;      // us on screen, the clip looped or cut to it; 0: the clip and its loops
+    uint32_t weight;        // times it comes up in one pass of the playlist, spread over it; 0 means 1
+    int32_t from, until;    // seconds into the local day it may start in, wrapping at midnight;
+                            // from == until: at any time
+};
+
+// An ordered list of URIs that can be edited while playing; not thread safe by itself.
+// Every edit lays out the order of a pass ahead, weights spread and shuffled if asked for,
+// so finding the next entry is a lookup; playlist_load() fills one from an M3U or JSON file.
+struct playlist
+{
+    char** entries;
+    int64_t* durations;     // us, learned from playback, 0 while unknown
+    struct playlist_rules* rules;
+    int count;
+    int capacity;
+
+    int loops;              // plays in a row of entries without their own, -1 forever, 0 once
+    int repeat;             // starts over after the last entry
+    int shuffle;            // a different order every pass
+
+    int* order;             // entry of each slot of a pass
+    int order_count;
+    int timed;              // some entry has a time of day window
+    uint32_t seed;
+};
+
+// A place in the play order. Copies look ahead without moving the original.
+struct playlist_cursor
+{
+    int entry;              // playing, -1 before the first or once it was dropped
+    int slot;               // ... where in the order of the pass
+    uint32_t pass;          // passes completed, each in an order of its own when shuffled
+    int iter;               // plays of it in a row left, this one included; -1 forever
+    int64_t until;          // while its play time runs, when that is up; 0 otherwise
+    int cue;                // entry to play next whatever the order, -1 for none
+};
+
+int playlist_init(struct playlist* playlist);
+void playlist_deinit(struct playlist* playlist);
+// Sets the defaults and lays the order out again
+int playlist_configure(struct playlist* playlist, int loops, int repeat, int shuffle);
+
+// index == count appends; returns the index or -1
+int playlist_insert(struct playlist* playlist, int index, const char* uri);
+int playlist_append(struct playlist* playlist, const char* uri);
+void playlist_clear(struct playlist* playlist);
+
+// Replaces the entries with those of an M3U or JSON file; defaults the file does not set are
+// kept. On error the playlist is left as it was and -1 returned.
+//   #EXTM3U shuffle="1" repeat="1" loops="2"
+//   #EXTINF:12.5 loops="3" weight="2" window="08:00-18:00",Title
+//   clip.mp4
+// or
+//   {"shuffle": true, "repeat": true, "loops": 2,
+//    "items": ["a.mp4", {"uri": "b.mp4", "duration": 12.5, "loops": 3, "weight": 2, "window": "08:00-18:00"}]}
+// where a bare array stands for the items. EXTINF seconds and "duration" are the play time.
+// Relative paths are taken from the file's directory.
+int playlist_load(struct playlist* playlist, const char* path);
+
+// NULL when out of range
+const char* playlist_get(const struct playlist* playlist, int index);
+// Index of the first entry for `uri`, -1 when there is none
+int playlist_find(const struct playlist* playlist, const char* uri);
+
+// How long an entry played last time, 0 when unknown or out of range; shared by the entries of one URI
+int64_t playlist_get_duration(const struct playlist* playlist, int index);
+void playlist_set_duration(struct playlist* playlist, int index, int64_t duration);
+// Its play time, 0 when it has none or is out of range
+int64_t playlist_get_play_time(const struct playlist* playlist, int index);
+
+void playlist_cursor_init(struct playlist_cursor* cursor);
+// What plays after the cursor's entry at `now` (vcos_getmicrosecs64()) and moves the cursor to
+// it: the same entry again while loops or play time are left, the cue, then the next slot whose
+// time of day window is open. NULL at the end, the cursor unmoved.
+const char* playlist_next(const struct playlist* playlist, struct playlist_cursor* cursor, int64_t now);
+// The cursor's entry went on screen at `now`: its play time starts running
+void playlist_start(const struct playlist* playlist, struct playlist_cursor* cursor, int64_t now);
+// Finds the cursor's entry in the order again after an edit
+void playlist_cursor_update(const struct playlist* playlist, struct playlist_cursor* cursor);
+// NULL from playlist_next() may turn into an entry as the day goes on
+int playlist_waits(const struct playlist* playlist);
+
+#endif //MMAL_CHAIN_PLAYER_PLAYLIST_H
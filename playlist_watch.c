@@ -0,0 +1,135 @@
+#include "playlist_watch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#define WATCH_POLL_MS           250     // how often a blocked thread looks at `terminate`
+#define WATCH_SETTLE_MS         100     // writes closer together than this are one change
+#define WATCH_EVENTS            (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+// reads what is pending; 1 if any event was about the file
+static int read_events(struct playlist_watch* context)
+{
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event* event;
+    int changed = 0;
+
+    while(1) {
+        ssize_t n = read(context->fd, buffer, sizeof(buffer));
+        char* p;
+
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return changed;
+
+        for(p = buffer; p < buffer + n; p += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event*)p;
+            if(event->len > 0 && (event->mask & WATCH_EVENTS) && strcmp(event->name, context->name) == 0)
+                changed = 1;
+        }
+    }
+}
+
+static void* playlist_watch_thread(void* user)
+{
+    struct playlist_watch* context = user;
+    struct pollfd pfd = {context->fd, POLLIN, 0};
+    int pending = 0;
+
+    while(!__atomic_load_n(&context->terminate, __ATOMIC_ACQUIRE)) {
+        int n = poll(&pfd, 1, pending ? WATCH_SETTLE_MS : WATCH_POLL_MS);
+
+        if(n < 0 && errno != EINTR)
+            break;
+        if(n > 0) {
+            pending |= read_events(context);
+            continue;
+        }
+        // quiet for a while after a change: it has been written
+        if(n == 0 && pending) {
+            pending = 0;
+            context->handler(context->user, context->path);
+        }
+    }
+
+    return NULL;
+}
+
+int playlist_watch_start(struct playlist_watch* context, const char* path, playlist_watch_handler handler, void* user)
+{
+    const char* slash;
+    char* dir;
+
+    if(context == NULL || path == NULL || handler == NULL)
+        return -1;
+
+    memset(context, 0, sizeof(struct playlist_watch));
+    context->handler = handler;
+    context->user = user;
+
+    slash = strrchr(path, '/');
+    if(slash == NULL)
+        dir = strdup(".");
+    else if(slash == path)
+        dir = strdup("/");
+    else
+        dir = strndup(path, slash - path);
+    context->path = strdup(path);
+    context->name = strdup(slash != NULL ? slash + 1 : path);
+    if(dir == NULL || context->path == NULL || context->name == NULL)
+        goto error;
+
+    context->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(context->fd < 0) {
+        perror("inotify");
+        goto error;
+    }
+    if(inotify_add_watch(context->fd, dir, WATCH_EVENTS) < 0) {
+        perror(dir);
+        close(context->fd);
+        goto error;
+    }
+    free(dir);
+
+    if(vcos_thread_create(&context->thread, "playlist_watch", NULL, playlist_watch_thread, context) != VCOS_SUCCESS) {
+        fprintf(stderr, "unable to start playlist watch thread\n");
+        close(context->fd);
+        dir = NULL;
+        goto error;
+    }
+
+    return 0;
+
+error:
+    free(dir);
+    free(context->path);
+    free(context->name);
+    context->path = NULL;
+    context->name = NULL;
+    return -1;
+}
+
+int playlist_watch_stop(struct playlist_watch* context)
+{
+    void* ret = NULL;
+
+    if(context == NULL || context->path == NULL)
+        return -1;
+
+    __atomic_store_n(&context->terminate, 1, __ATOMIC_RELEASE);
+    vcos_thread_join(&context->thread, &ret);
+
+    close(context->fd);
+    free(context->path);
+    free(context->name);
+    context->path = NULL;
+    context->name = NULL;
+
+    return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef MMAL_CHAIN_PLAYER_PLAYLIST_WATCH_H
+#define MMAL_CHAIN_PLAYER_PLAYLIST_WATCH_H
+
+#include "interface/vcos/vcos.h"
+
+// Called on the watch thread once the file was written; it is closed by then
+typedef void (*playlist_watch_handler)(void* user, const char* path);
+
+// Watches one playlist file with inotify from its own thread. The directory is watched rather
+// than the file so editors that write a temporary file and rename it over the old one are seen.
+struct playlist_watch
+{
+    int fd;
+    char* path;
+    char* name;             // ... its last component
+    int terminate;
+
+    playlist_watch_handler handler;
+    void* user;
+
+    VCOS_THREAD_T thread;
+};
+
+int playlist_watch_start(struct playlist_watch* context, const char* path, playlist_watch_handler handler, void* user);
+int playlist_watch_stop(struct playlist_watch* context);
+
+#endif //MMAL_CHAIN_PLAYER_PLAYLIST_WATCH_H